@@ -170,12 +170,14 @@ HEADERS += src/database/board.h \
   src/database/bitfind.h \
   src/database/circularbuffer.h \
   src/database/clipboarddatabase.h \
+  src/database/compactgamestore.h \
   src/database/ctg.h \
   src/database/ctgbookwriter.h \
   src/database/ctgdatabase.h \
   src/database/database.h \
   src/database/databaseconversion.h \
   src/database/databaseinfo.h \
+  src/database/databasewriter.h \
   src/database/datesearch.h \
   src/database/downloadmanager.h \
   src/database/duplicatesearch.h \
@@ -195,12 +197,16 @@ HEADERS += src/database/board.h \
   src/database/filtermodel.h \
   src/database/filteroperator.h \
   src/database/filtersearch.h \
+  src/database/gamefingerprint.h \
   src/database/gameid.h \
+  src/database/gamesignature.h \
   src/database/gameundocommand.h \
   src/database/gamex.h \
   src/database/historylist.h \
   src/database/index.h \
+  src/database/indeximage.h \
   src/database/indexitem.h \
+  src/database/indexsorter.h \
   src/database/lichessopening.h \
   src/database/lichessopeningdatabase.h \
   src/database/memorydatabase.h \
@@ -210,9 +216,11 @@ HEADERS += src/database/board.h \
   src/database/networkhelper.h \
   src/database/numbersearch.h \
   src/database/openingtree.h \
+  src/database/openingtreecache.h \
   src/database/openingtreethread.h \
   src/database/output.h \
   src/database/outputoptions.h \
+  src/database/parallelfor.h \
   src/database/partialdate.h \
   src/database/pdbtest.h \
   src/database/pgndatabase.h \
@@ -222,15 +230,21 @@ HEADERS += src/database/board.h \
   src/database/playerinfo.h \
   src/database/polyglotdatabase.h \
   src/database/polyglotwriter.h \
+  src/database/positionindex.h \
+  src/database/positionreplay.h \
   src/database/positionsearch.h \
   src/database/refcount.h \
   src/database/result.h \
   src/database/search.h \
   src/database/settings.h \
+  src/database/sortedruns.h \
   src/database/spellchecker.h \
   src/database/square.h \
+  src/database/statisticsbook.h \
+  src/database/statisticsbookwriter.h \
   src/database/streamdatabase.h \
   src/database/tablebase.h \
+  src/database/tagcolumn.h \
   src/database/tags.h \
   src/database/tagsearch.h \
   src/database/telnetclient.h \
@@ -347,11 +361,13 @@ SOURCES += \
   src/database/bitboard.cpp \
   src/database/board.cpp \
   src/database/clipboarddatabase.cpp \
+  src/database/compactgamestore.cpp \
   src/database/ctgbookwriter.cpp \
   src/database/ctgdatabase.cpp \
   src/database/database.cpp \
   src/database/databaseconversion.cpp \
   src/database/databaseinfo.cpp \
+  src/database/databasewriter.cpp \
   src/database/datesearch.cpp \
   src/database/downloadmanager.cpp \
   src/database/duplicatesearch.cpp \
@@ -369,10 +385,14 @@ SOURCES += \
   src/database/filter.cpp \
   src/database/filtermodel.cpp \
   src/database/filtersearch.cpp \
+  src/database/gamefingerprint.cpp \
+  src/database/gamesignature.cpp \
   src/database/gamex.cpp \
   src/database/historylist.cpp \
   src/database/index.cpp \
+  src/database/indeximage.cpp \
   src/database/indexitem.cpp \
+  src/database/indexsorter.cpp \
   src/database/lichessopening.cpp \
   src/database/lichessopeningdatabase.cpp \
   src/database/memorydatabase.cpp \
@@ -381,9 +401,11 @@ SOURCES += \
   src/database/networkhelper.cpp \
   src/database/numbersearch.cpp \
   src/database/openingtree.cpp \
+  src/database/openingtreecache.cpp \
   src/database/openingtreethread.cpp \
   src/database/output.cpp \
   src/database/outputoptions.cpp \
+  src/database/parallelfor.cpp \
   src/database/partialdate.cpp \
   src/database/pdbtest.cpp \
   src/database/pgndatabase.cpp \
@@ -393,14 +415,19 @@ SOURCES += \
   src/database/playerinfo.cpp \
   src/database/polyglotdatabase.cpp \
   src/database/polyglotwriter.cpp \
+  src/database/positionindex.cpp \
+  src/database/positionreplay.cpp \
   src/database/positionsearch.cpp \
   src/database/refcount.cpp \
   src/database/result.cpp \
   src/database/search.cpp \
   src/database/settings.cpp \
   src/database/spellchecker.cpp \
+  src/database/statisticsbook.cpp \
+  src/database/statisticsbookwriter.cpp \
   src/database/streamdatabase.cpp \
   src/database/tablebase.cpp \
+  src/database/tagcolumn.cpp \
   src/database/tags.cpp \
   src/database/tagsearch.cpp \
   src/database/telnetclient.cpp \
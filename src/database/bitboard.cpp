@@ -1799,8 +1799,15 @@ Move BitBoard::createCastlingQ() const
 
 Move BitBoard::parseMove(const QString& algebraic) const
 {
+    if (algebraic=="none")
+        return Move();
+
     const QByteArray& bs(algebraic.toLatin1());
-    const char *san = bs.constData();
+    return parseMove(bs.constData());
+}
+
+Move BitBoard::parseMove(const char* san) const
+{
     const char* s = san;
     char c = *(s++);
     quint64 match;
@@ -1811,9 +1818,6 @@ Move BitBoard::parseMove(const QString& algebraic) const
     Move move;
     unsigned int type;
 
-    if (algebraic=="none")
-        return move;
-
     // Castling
     if(c == 'o' || c == 'O' || c == '0')
     {
@@ -1966,7 +1970,7 @@ Move BitBoard::parseMove(const QString& algebraic) const
         PieceType promotePiece = None;
 
         // Promotion as in bxc8=Q or bxc8(Q) or bxc8(Q)
-        if(c == '=' || c == '(' || QString("QRBN").indexOf(toupper(c))>=0)
+        if(c == '=' || c == '(' || (c && strchr("QRBN", toupper(c))))
         {
             if(c == '=' || c == '(')
             {
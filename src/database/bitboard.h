@@ -85,6 +85,8 @@ public:
 
     /** parse SAN or LAN representation of move, and return proper Move() object */
     Move parseMove(const QString& algebraic) const;
+    /** parse a NUL terminated SAN or LAN move without converting it to a QString first */
+    Move parseMove(const char* san) const;
     /** Return a proper Move() object given only a from-to move specification */
     Move prepareMove(const chessx::Square& from, const chessx::Square& to) const;
 
@@ -115,6 +117,10 @@ public:
     bool canBeReachedFrom(const BitBoard& target) const;
     /** @return true if position is same, but don't consider Move # in determination */
     bool positionIsSame(const BitBoard& target) const;
+    /** @return number of pieces INCLUDING pawns of color @p c */
+    unsigned int pieceCount(Color c) const;
+    /** @return number of pawns of color @p c */
+    unsigned int pawnCount(Color c) const;
     /** @return true if neither side can win the game */
     bool insufficientMaterial() const;
     /** @return the square at which the king of @p color is located */
@@ -549,6 +555,16 @@ inline chessx::CastlingRights BitBoard::castlingRights() const
     return m_castle;
 }
 
+inline unsigned int BitBoard::pieceCount(Color c) const
+{
+    return m_pieceCount[c];
+}
+
+inline unsigned int BitBoard::pawnCount(Color c) const
+{
+    return m_pawnCount[c];
+}
+
 inline QString BitBoard::PieceNames::get(PieceType type) const
 {
     Q_ASSERT(0 <= type && type < PieceTypeCount);
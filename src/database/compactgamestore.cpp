@@ -0,0 +1,335 @@
+#include <QDataStream>
+
+#include <algorithm>
+#include <cstring>
+
+#include "compactgamestore.h"
+#include "positionindex.h"
+#include "positionreplay.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+namespace {
+
+void writeAnnotations(QDataStream& out, const QMap<MoveId, QString>& annotations, const QVector<MoveId>& ids)
+{
+    for (auto it = annotations.cbegin(); it != annotations.cend(); ++it)
+    {
+        MoveId id = (it.key() >= 0 && it.key() < ids.count()) ? ids.at(it.key()) : NO_MOVE;
+        if (id != NO_MOVE && !it.value().isEmpty())
+        {
+            out << static_cast<qint16>(id) << it.value().toUtf8();
+        }
+    }
+    out << static_cast<qint16>(NO_MOVE);
+}
+
+void readAnnotations(QDataStream& in, QMap<MoveId, QString>& annotations)
+{
+    for (;;)
+    {
+        qint16 id = NO_MOVE;
+        in >> id;
+        if (id == NO_MOVE || in.status() != QDataStream::Ok)
+        {
+            return;
+        }
+        QByteArray text;
+        in >> text;
+        annotations.insert(id, QString::fromUtf8(text));
+    }
+}
+
+void writeNags(QDataStream& out, const QMap<MoveId, NagSet>& nags, const QVector<MoveId>& ids)
+{
+    for (auto it = nags.cbegin(); it != nags.cend(); ++it)
+    {
+        MoveId id = (it.key() >= 0 && it.key() < ids.count()) ? ids.at(it.key()) : NO_MOVE;
+        if (id != NO_MOVE && !it.value().isEmpty())
+        {
+            out << static_cast<qint16>(id) << static_cast<quint8>(it.value().count());
+            for (Nag nag: it.value())
+            {
+                out << static_cast<quint16>(nag);
+            }
+        }
+    }
+    out << static_cast<qint16>(NO_MOVE);
+}
+
+void readNags(QDataStream& in, QMap<MoveId, NagSet>& nags)
+{
+    for (;;)
+    {
+        qint16 id = NO_MOVE;
+        in >> id;
+        if (id == NO_MOVE || in.status() != QDataStream::Ok)
+        {
+            return;
+        }
+        quint8 count;
+        in >> count;
+        NagSet nagSet;
+        for (quint8 i = 0; i < count; ++i)
+        {
+            quint16 nag;
+            in >> nag;
+            nagSet.append(Nag(nag));
+        }
+        nags.insert(id, nagSet);
+    }
+}
+
+} // anonymous namespace
+
+CompactGameStore::CompactGameStore() : m_garbageTokens(0), m_garbageExtra(0)
+{
+}
+
+void CompactGameStore::clear()
+{
+    m_records.clear();
+    m_tokens.clear();
+    m_extra.clear();
+    m_garbageTokens = 0;
+    m_garbageExtra = 0;
+}
+
+int CompactGameStore::count() const
+{
+    return m_records.count();
+}
+
+void CompactGameStore::append(const GameX& game)
+{
+    m_records.append(encode(game));
+}
+
+void CompactGameStore::replace(GameId gameId, const GameX& game)
+{
+    Record& record = m_records[static_cast<int>(gameId)];
+    m_garbageTokens += record.tokenCount;
+    m_garbageExtra += record.extraSize;
+    record = encode(game);
+
+    if (2 * m_garbageTokens > static_cast<quint32>(m_tokens.count()))
+    {
+        squeeze();
+    }
+}
+
+CompactGameStore::Record CompactGameStore::encode(const GameX& game)
+{
+    const GameCursor& cursor = game.cursor();
+    QVector<MoveId> ids(cursor.capacity(), NO_MOVE);
+    ids[ROOT_NODE] = ROOT_NODE;
+    MoveId nextId = ROOT_NODE + 1;
+
+    Record record;
+    record.tokens = static_cast<quint32>(m_tokens.count());
+    encodeLine(cursor, ROOT_NODE, ids, nextId);
+    record.tokenCount = static_cast<quint32>(m_tokens.count()) - record.tokens;
+
+    record.extra = static_cast<quint32>(m_extra.size());
+    record.extraSize = 0;
+
+    const BoardX& start = cursor.initialBoard();
+    quint8 flags = 0;
+    if (start.chess960())
+    {
+        flags |= HasStartPosition | IsChess960;
+    }
+    else if (start != BoardX::standardStartBoard)
+    {
+        flags |= HasStartPosition;
+    }
+
+    if (flags || !game.m_annotations.isEmpty() || !game.m_variationStartAnnotations.isEmpty() || !game.m_nags.isEmpty())
+    {
+        QByteArray extra;
+        QDataStream out(&extra, QIODevice::WriteOnly);
+        out << flags;
+        if (flags & HasStartPosition)
+        {
+            out << start.toFen();
+        }
+        writeAnnotations(out, game.m_annotations, ids);
+        writeAnnotations(out, game.m_variationStartAnnotations, ids);
+        writeNags(out, game.m_nags, ids);
+
+        m_extra.append(extra);
+        record.extraSize = static_cast<quint32>(extra.size());
+    }
+    return record;
+}
+
+void CompactGameStore::encodeLine(const GameCursor& cursor, MoveId node, QVector<MoveId>& ids, MoveId& nextId)
+{
+    // Same order as PGN: a move, the variations replacing it, the rest of the line
+    for (;;)
+    {
+        MoveId next = cursor.nextMove(node);
+        if (next != NO_MOVE)
+        {
+            m_tokens.append(PositionIndex::encodeMove(cursor.move(next)));
+            ids[next] = nextId++;
+        }
+        for (MoveId variation: cursor.variations(node))
+        {
+            m_tokens.append(next != NO_MOVE ? VariationStart : VariationAtEnd);
+            m_tokens.append(PositionIndex::encodeMove(cursor.move(variation)));
+            ids[variation] = nextId++;
+            encodeLine(cursor, variation, ids, nextId);
+            m_tokens.append(VariationEnd);
+        }
+        if (next == NO_MOVE)
+        {
+            return;
+        }
+        node = next;
+    }
+}
+
+void CompactGameStore::load(GameId gameId, GameX& game) const
+{
+    const Record& record = m_records.at(static_cast<int>(gameId));
+    QDataStream in(QByteArray::fromRawData(m_extra.constData() + record.extra, static_cast<int>(record.extraSize)));
+
+    GameX g;
+    if (record.extraSize)
+    {
+        quint8 flags;
+        in >> flags;
+        if (flags & HasStartPosition)
+        {
+            QString fen;
+            in >> fen;
+            g.dbSetStartingBoard(fen, flags & IsChess960);
+        }
+    }
+
+    const GameCursor& cursor = g.cursor();
+    QVector<MoveId> lines;
+    MoveId current = ROOT_NODE;
+    const quint16* token = m_tokens.constData() + record.tokens;
+    const quint16* end = token + record.tokenCount;
+    while (token != end)
+    {
+        quint16 t = *token++;
+        if (t == VariationStart || t == VariationAtEnd)
+        {
+            lines.append(current);
+            if (t == VariationStart)
+            {
+                g.dbMoveToId(cursor.prevMove(current));
+            }
+            current = g.dbAddVariation(PositionIndex::decodeMove(g.board(), *token++));
+        }
+        else if (t == VariationEnd)
+        {
+            current = lines.takeLast();
+            g.dbMoveToId(current);
+        }
+        else
+        {
+            current = g.dbAddMove(PositionIndex::decodeMove(g.board(), t));
+        }
+    }
+
+    if (record.extraSize)
+    {
+        readAnnotations(in, g.m_annotations);
+        readAnnotations(in, g.m_variationStartAnnotations);
+        readNags(in, g.m_nags);
+    }
+    g.dbMoveToId(ROOT_NODE);
+    game = g;
+}
+
+bool CompactGameStore::startReplay(const Record& record, PositionReplay& replay) const
+{
+    // The flags are the first byte of the extra data
+    quint8 flags = record.extraSize ? static_cast<quint8>(m_extra.at(static_cast<int>(record.extra))) : 0;
+    if (flags & HasStartPosition)
+    {
+        QDataStream in(QByteArray::fromRawData(m_extra.constData() + record.extra, static_cast<int>(record.extraSize)));
+        QString fen;
+        in >> flags >> fen;
+        BoardX board;
+        board.setChess960(flags & IsChess960);
+        board.fromFen(fen);
+        return replay.start(board);
+    }
+    return replay.start(BoardX::standardStartBoard);
+}
+
+MoveId CompactGameStore::findPosition(GameId gameId, PositionReplay& replay) const
+{
+    const Record& record = m_records.at(static_cast<int>(gameId));
+    if (!startReplay(record, replay))
+    {
+        return replay.moveId();
+    }
+
+    const quint16* token = m_tokens.constData() + record.tokens;
+    const quint16* end = token + record.tokenCount;
+    MoveId lastId = ROOT_NODE;
+    int depth = 0;
+    for (; token != end; ++token)
+    {
+        if (*token == VariationStart || *token == VariationAtEnd)
+        {
+            ++depth;
+        }
+        else if (*token == VariationEnd)
+        {
+            --depth;
+        }
+        else if (depth)
+        {
+            ++lastId; // Nodes of variations are numbered as well
+        }
+        else if (!replay.play(PositionIndex::decodeMove(replay.board(), *token), ++lastId))
+        {
+            break;
+        }
+    }
+    return replay.moveId();
+}
+
+void CompactGameStore::squeeze()
+{
+    if (m_garbageTokens || m_garbageExtra)
+    {
+        QVector<quint16> tokens(m_tokens.count() - static_cast<int>(m_garbageTokens));
+        QByteArray extra(m_extra.size() - static_cast<int>(m_garbageExtra), Qt::Uninitialized);
+        quint32 tokenPos = 0;
+        quint32 extraPos = 0;
+        for (Record& record: m_records)
+        {
+            std::copy(m_tokens.constBegin() + record.tokens, m_tokens.constBegin() + record.tokens + record.tokenCount,
+                      tokens.begin() + tokenPos);
+            record.tokens = tokenPos;
+            tokenPos += record.tokenCount;
+
+            if (record.extraSize)
+            {
+                memcpy(extra.data() + extraPos, m_extra.constData() + record.extra, record.extraSize);
+            }
+            record.extra = extraPos;
+            extraPos += record.extraSize;
+        }
+        m_tokens.swap(tokens);
+        m_extra.swap(extra);
+        m_garbageTokens = 0;
+        m_garbageExtra = 0;
+    }
+    m_records.squeeze();
+    m_tokens.squeeze();
+    m_extra.squeeze();
+}
@@ -0,0 +1,88 @@
+#ifndef COMPACTGAMESTORE_H_INCLUDED
+#define COMPACTGAMESTORE_H_INCLUDED
+
+#include <QByteArray>
+#include <QVector>
+
+#include "board.h"
+#include "gameid.h"
+#include "gamex.h"
+
+class PositionReplay;
+
+/** @ingroup Database
+   The CompactGameStore class keeps the move trees of many games in a compact
+   form. Every move takes two bytes (see PositionIndex::encodeMove()) in a
+   token array shared by all games, variations are delimited by marker tokens.
+   Comments, NAGs and non-standard start positions are serialized into a second
+   shared arena, so plain games need no space there at all.
+
+   Nodes are numbered in PGN order, which is the numbering a freshly parsed game
+   gets as well. A GameX is only built by load(), findPosition() replays the
+   encoded main line directly.
+
+   The class does no locking, the owner has to serialize access.
+*/
+
+class CompactGameStore
+{
+public:
+    CompactGameStore();
+
+    /** Remove all games */
+    void clear();
+    /** @return number of stored games */
+    int count() const;
+
+    /** Store the moves and annotations of @p game as the last game */
+    void append(const GameX& game);
+    /** Replace the moves and annotations of game @p gameId by those of @p game */
+    void replace(GameId gameId, const GameX& game);
+    /** Build game @p gameId in @p game. Only the start position related tags are set. */
+    void load(GameId gameId, GameX& game) const;
+
+    /** Feed the main line of game @p gameId to @p replay without building a GameX.
+        @return the node reaching the position of @p replay or NO_MOVE */
+    MoveId findPosition(GameId gameId, PositionReplay& replay) const;
+
+    /** Release the space left over by replaced games */
+    void squeeze();
+
+private:
+    struct Record
+    {
+        /** First token of the game in m_tokens */
+        quint32 tokens;
+        quint32 tokenCount;
+        /** First byte of the game in m_extra */
+        quint32 extra;
+        quint32 extraSize;
+    };
+
+    /** Tokens above all encoded moves */
+    static const quint16 VariationStart = 0x8001;  ///< Variation replacing the previous move
+    static const quint16 VariationAtEnd = 0x8002;  ///< Variation of a position without continuation
+    static const quint16 VariationEnd = 0x8003;
+
+    /** Flags of the extra data */
+    static const quint8 HasStartPosition = 0x01;
+    static const quint8 IsChess960 = 0x02;
+
+    /** Encode @p game at the end of the arenas */
+    Record encode(const GameX& game);
+    /** Encode the line starting after @p node, numbering the nodes into @p ids */
+    void encodeLine(const GameCursor& cursor, MoveId node, QVector<MoveId>& ids, MoveId& nextId);
+    /** Start @p replay at the start position of @p record */
+    bool startReplay(const Record& record, PositionReplay& replay) const;
+
+    QVector<Record> m_records;
+    /** Moves and variation markers of all games */
+    QVector<quint16> m_tokens;
+    /** Start positions, comments and NAGs of all games */
+    QByteArray m_extra;
+    /** Space in the arenas no longer referenced by m_records */
+    quint32 m_garbageTokens;
+    quint32 m_garbageExtra;
+};
+
+#endif // COMPACTGAMESTORE_H_INCLUDED
@@ -8,6 +8,8 @@
  *   (at your option) any later version.                                   *
  ***************************************************************************/
 
+#include <QDataStream>
+#include <QDateTime>
 #include <QFile>
 #include <QFileInfo>
 #include <QtDebug>
@@ -55,6 +57,16 @@ quint64 Database::count() const
     return 0;
 }
 
+unsigned int Database::generation() const
+{
+    return static_cast<unsigned int>(m_generation.load());
+}
+
+void Database::touch()
+{
+    m_generation.ref();
+}
+
 bool Database::isModified() const
 {
     return false;
@@ -108,14 +120,56 @@ QString Database::tagValue(GameId gameId, TagIndex tag) const
 
 void Database::findPosition(const BoardX& position, PositionSearchOptions options, const QList<GameId>& games, QList<MoveId>& output, QMap<Move, MoveData>& stats)
 {
+    bool indexed = !m_positionIndex.isEmpty();
+    bool signatures = m_index.hasSignatures();
+    const IndexX::Snapshot index = m_index.snapshot();
+    GameSignature::Target target(position);
+    PositionReplay replay(position);
     for (auto gameId: games)
     {
-        // search for position
-        GameX g;
-        loadGameMoves(gameId, g);
-        const auto& cursor = g.cursor();
-        auto moveId = cursor.findPosition(position);
-        if ((options & PositionSearch_GameEnd) && !cursor.atGameEnd(moveId))
+        MoveId moveId = NO_MOVE;
+        Move move;
+
+        // try the position index first
+        quint16 nextMove = PositionIndex::NoMove;
+        auto lookup = indexed ? m_positionIndex.lookup(position, gameId, moveId, nextMove) : PositionIndex::Unknown;
+        if (lookup == PositionIndex::Unknown && signatures && !m_index.signature(gameId).canReach(target))
+        {
+            // the material and home pawns of the main line rule the game out
+            lookup = PositionIndex::NotFound;
+        }
+        if (lookup == PositionIndex::Found)
+        {
+            if ((options & PositionSearch_GameEnd) && nextMove != PositionIndex::NoMove)
+            {
+                moveId = NO_MOVE;
+            }
+            else
+            {
+                move = PositionIndex::decodeMove(position, nextMove);
+            }
+        }
+        else if (lookup == PositionIndex::Unknown)
+        {
+            // search for position
+            moveId = replayToPosition(gameId, replay);
+            if ((options & PositionSearch_GameEnd) && !replay.atEnd())
+            {
+                moveId = NO_MOVE;
+            }
+
+            // determine played move
+            if (moveId != NO_MOVE && !replay.atEnd())
+            {
+                move = replay.nextMove();
+                if (indexed)
+                {
+                    // keep the stats keys identical to the moves decoded from the index
+                    move = PositionIndex::decodeMove(position, PositionIndex::encodeMove(move));
+                }
+            }
+        }
+        else
         {
             moveId = NO_MOVE;
         }
@@ -126,53 +180,305 @@ void Database::findPosition(const BoardX& position, PositionSearchOptions option
         // update stats
         if (moveId != NO_MOVE)
         {
-            // determine played move
-            Move move;
-            if (!cursor.atGameEnd(moveId))
-            {
-                move = cursor.move(cursor.nextMove(moveId));
-            }
+            updateMoveStats(index, position, move, gameId, stats);
+        }
+    }
+}
 
-            // update metrics
-            auto& md = stats[move];
-            if (!md.results)
+void Database::findNextPosition(const BoardX& position, const Move& move, const QList<GameId>& games, const QList<MoveId>& previous, QList<MoveId>& output, QMap<Move, MoveData>& stats)
+{
+    bool indexed = !m_positionIndex.isEmpty();
+    const IndexX::Snapshot index = m_index.snapshot();
+    QList<GameId> others;
+    QList<int> otherSlots;
+    for (int i = 0; i < games.count(); ++i)
+    {
+        GameId gameId = games.at(i);
+        MoveId moveId = NO_MOVE;
+        if (previous.at(i) != NO_MOVE)
+        {
+            GameX g;
+            loadGameMoves(gameId, g);
+            const auto& cursor = g.cursor();
+            MoveId node = cursor.nextMove(previous.at(i));
+            if (node != NO_MOVE)
             {
-                if (move.isLegal())
-                {
-                    md.san = position.moveToSan(move);
-                    md.localsan = position.moveToSan(move, true);
-                }
-                else
+                // flags of the move may differ, the squares and the promotion tell the move
+                const Move& played = cursor.move(node);
+                if (played.from() == move.from() && played.to() == move.to() && played.promotedPiece() == move.promotedPiece())
                 {
-                    // game is finished
-                    md.localsan = md.san = qApp->translate("MoveData", "[end]");
+                    moveId = node;
+                    Move next;
+                    MoveId nextNode = cursor.nextMove(node);
+                    if (nextNode != NO_MOVE)
+                    {
+                        next = cursor.move(nextNode);
+                        if (indexed)
+                        {
+                            // keep the stats keys identical to the moves decoded from the index
+                            next = PositionIndex::decodeMove(position, PositionIndex::encodeMove(next));
+                        }
+                    }
+                    updateMoveStats(index, position, next, gameId, stats);
                 }
-                md.move = move;
             }
+        }
+        if (moveId == NO_MOVE)
+        {
+            // the position may still be reached by a transposition
+            others.append(gameId);
+            otherSlots.append(output.count());
+        }
+        output.append(moveId);
+    }
 
-            auto result = m_index.tagValue(TagNameResult, gameId);
-            if(result == "1-0")
-            {
-                md.results.update(WhiteWin);
-            }
-            else if(result == "1/2-1/2")
-            {
-                md.results.update(Draw);
-            }
-            else if(result == "0-1")
-            {
-                md.results.update(BlackWin);
-            }
-            else
+    // the position index answers these without a replay when it exists
+    QList<MoveId> found;
+    findPosition(position, PositionSearch_Default, others, found, stats);
+    for (int i = 0; i < otherSlots.count(); ++i)
+    {
+        output[otherSlots.at(i)] = found.at(i);
+    }
+}
+
+MoveId Database::replayToPosition(GameId gameId, PositionReplay& replay)
+{
+    GameX g;
+    loadGameMoves(gameId, g);
+    const auto& cursor = g.cursor();
+    if (replay.start(cursor.initialBoard()))
+    {
+        for (MoveId node = cursor.nextMove(ROOT_NODE); node != NO_MOVE; node = cursor.nextMove(node))
+        {
+            if (!replay.play(cursor.move(node), node))
             {
-                md.results.update(ResultUnknown);
+                break;
             }
-            auto elo = m_index.tagValue((position.toMove() == White)? TagNameWhiteElo: TagNameBlackElo, gameId);
-            md.rating.update(elo.toInt());
-            auto date = m_index.tagValue(TagNameDate, gameId);
-            md.year.update(date.section(".", 0, 0).toInt());
         }
     }
+    return replay.moveId();
+}
+
+void Database::updateMoveStats(const IndexX::Snapshot& index, const BoardX& position, const Move& move, GameId gameId, QMap<Move, MoveData>& stats) const
+{
+    auto& md = stats[move];
+    if (!md.results)
+    {
+        if (move.isLegal())
+        {
+            md.san = position.moveToSan(move);
+            md.localsan = position.moveToSan(move, true);
+        }
+        else
+        {
+            // game is finished
+            md.localsan = md.san = qApp->translate("MoveData", "[end]");
+        }
+        md.move = move;
+    }
+
+    md.results.update(index.result(gameId));
+    md.rating.update(index.elo(gameId, position.toMove()));
+    md.year.update(index.date(gameId).year());
+}
+
+PositionIndex* Database::positionIndex()
+{
+    return &m_positionIndex;
+}
+
+const PositionIndex* Database::positionIndex() const
+{
+    return &m_positionIndex;
+}
+
+bool Database::buildPositionIndex(volatile bool* breakFlag)
+{
+    m_positionIndex.clear();
+    GameId n = static_cast<GameId>(count());
+    int percentDone = -1;
+    for (GameId gameId = 0; gameId < n; ++gameId)
+    {
+        if (breakFlag && *breakFlag)
+        {
+            m_positionIndex.clear();
+            return false;
+        }
+        GameX g;
+        loadGameMoves(gameId, g);
+        m_positionIndex.updateGame(gameId, g);
+        if (!m_index.signature(gameId).isValid())
+        {
+            m_index.setSignature(gameId, GameSignature::fromGame(g));
+        }
+        int percent = static_cast<int>(gameId * 100ull / n);
+        if (percent != percentDone)
+        {
+            percentDone = percent;
+            emit progress(percent);
+        }
+    }
+    m_positionIndex.squeeze();
+    emit progress(100);
+    return true;
+}
+
+bool Database::readPositionIndex(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+
+    short version;
+    unsigned short magic;
+    int streamVersion;
+
+    in >> version;
+    in >> magic;
+    if (magic != POSITION_INDEX_FILE_MAGIC || version != VERSION_POSITION_INDEX_CURRENT)
+    {
+        return false;
+    }
+    in >> streamVersion;
+    in.setVersion(streamVersion);
+
+    QFileInfo fi = QFileInfo(filename());
+    QString basefile;
+    QDateTime lastModified;
+    quint64 games;
+
+    in >> basefile;
+    in >> lastModified;
+    in >> games;
+
+    if (basefile != fi.completeBaseName() || lastModified != fi.lastModified() || games != count())
+    {
+        return false;
+    }
+
+    if (!m_positionIndex.read(in, &m_break) || m_positionIndex.count() != static_cast<int>(games))
+    {
+        m_positionIndex.clear();
+        return false;
+    }
+    if (!m_index.hasSignatures())
+    {
+        m_index.readSignatures(in);
+    }
+    return true;
+}
+
+bool Database::writePositionIndex(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream out(&file);
+
+    short version = VERSION_POSITION_INDEX_CURRENT;
+    unsigned short magic = POSITION_INDEX_FILE_MAGIC;
+    int streamVersion = out.version();
+
+    out << version;
+    out << magic;
+    out << streamVersion;
+
+    QFileInfo fi = QFileInfo(filename());
+    out << fi.completeBaseName();
+    out << fi.lastModified().toUTC();
+    out << static_cast<quint64>(count());
+
+    m_positionIndex.squeeze();
+    if (!m_positionIndex.write(out))
+    {
+        return false;
+    }
+    // Keep the signatures computed while building, not all databases store them
+    m_index.writeSignatures(out);
+    return out.status() == QDataStream::Ok;
+}
+
+OpeningTreeCache* Database::openingTreeCache()
+{
+    return &m_openingTreeCache;
+}
+
+bool Database::readOpeningTreeCache(const QString& path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+
+    QDataStream in(&file);
+
+    short version;
+    unsigned short magic;
+    int streamVersion;
+
+    in >> version;
+    in >> magic;
+    if (magic != OPENING_TREE_CACHE_FILE_MAGIC || version != VERSION_OPENING_TREE_CACHE_CURRENT)
+    {
+        return false;
+    }
+    in >> streamVersion;
+    in.setVersion(streamVersion);
+
+    QFileInfo fi = QFileInfo(filename());
+    QString basefile;
+    QDateTime lastModified;
+    quint64 games;
+
+    in >> basefile;
+    in >> lastModified;
+    in >> games;
+
+    if (basefile != fi.completeBaseName() || lastModified != fi.lastModified() || games != count())
+    {
+        return false;
+    }
+    return m_openingTreeCache.read(in, generation());
+}
+
+bool Database::writeOpeningTreeCache(const QString& path)
+{
+    // Trees of unsaved changes do not match the file
+    if (!m_openingTreeCache.isModified() || isModified() || m_openingTreeCache.generation() != generation())
+    {
+        return false;
+    }
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        return false;
+    }
+
+    QDataStream out(&file);
+
+    short version = VERSION_OPENING_TREE_CACHE_CURRENT;
+    unsigned short magic = OPENING_TREE_CACHE_FILE_MAGIC;
+    int streamVersion = out.version();
+
+    out << version;
+    out << magic;
+    out << streamVersion;
+
+    QFileInfo fi = QFileInfo(filename());
+    out << fi.completeBaseName();
+    out << fi.lastModified().toUTC();
+    out << static_cast<quint64>(count());
+
+    return m_openingTreeCache.write(out);
 }
 
 bool Database::replace(GameId, GameX &)
@@ -202,6 +508,7 @@ bool Database::remove(GameId)
 
 void Database::clear()
 {
+    m_positionIndex.clear();
 }
 
 void Database::setTagsToIndex(const GameX& game, GameId id)
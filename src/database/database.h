@@ -17,7 +17,11 @@
 #include "refcount.h"
 #include "move.h"
 #include "movedata.h"
+#include "openingtreecache.h"
+#include "positionindex.h"
+#include "positionreplay.h"
 
+#include <QAtomicInt>
 #include <QMutex>
 #include <QString>
 #include <QTextStream>
@@ -91,6 +95,11 @@ public:
     virtual int findPosition(GameId index, const BoardX& position) = 0;
     /** Perform batched position search */
     virtual void findPosition(const BoardX& position, PositionSearchOptions options, const QList<GameId>& games, QList<MoveId>& output, QMap<Move, MoveData>& stats);
+    /** Perform batched position search for @p position, reached by @p move from a position found in
+        each game at the node in @p previous (NO_MOVE if not found). Games continuing with @p move are
+        advanced to the following node without a replay. The others may still reach the position by a
+        transposition, they are looked up in the position index, or replayed when there is none */
+    void findNextPosition(const BoardX& position, const Move& move, const QList<GameId>& games, const QList<MoveId>& previous, QList<MoveId>& output, QMap<Move, MoveData>& stats);
     /** Saves a game at the given position, returns true if successful */
     virtual bool replace(GameId, GameX&);
     /** Adds a game to the database */
@@ -107,12 +116,29 @@ public:
     IndexX *index();
     /** @return const pointer to the index of the database */
     const IndexX *index() const;
+    /** @return the position index of the database, empty if it was not built */
+    PositionIndex* positionIndex();
+    const PositionIndex* positionIndex() const;
+    /** Index the positions of all games by replaying them, returns false if interrupted */
+    bool buildPositionIndex(volatile bool* breakFlag);
+    /** Read the position index from @p path, returns false if it is missing or outdated */
+    bool readPositionIndex(const QString& path);
+    /** Write the position index to @p path */
+    bool writePositionIndex(const QString& path);
+    /** @return the opening trees kept for the first plies */
+    OpeningTreeCache* openingTreeCache();
+    /** Read the opening trees from @p path, returns false if they are missing or outdated */
+    bool readOpeningTreeCache(const QString& path);
+    /** Write the opening trees to @p path, if new trees for the saved state of the database were added */
+    bool writeOpeningTreeCache(const QString& path);
     /** Returns the number of games in the database */
     virtual quint64 count() const;
     /** @return true if the database has been modified. */
     virtual bool isModified() const;
     /** Set / Reset the modification flag. */
     virtual void setModified(bool) { }
+    /** @return a counter which changes whenever games or tags of the database change */
+    unsigned int generation() const;
     virtual void startTransaction(bool) { }
     /** Get the Valid Flag for a given game id from the index */
     virtual bool getValidFlag(GameId gameId) const;
@@ -125,6 +151,13 @@ public:
 protected:
     /** Copies all tags from @p game to the Index */
     void setTagsToIndex(const GameX& game, GameId id);
+    /** Feed the main line of game @p gameId to @p replay, @return the node reaching its position or NO_MOVE */
+    virtual MoveId replayToPosition(GameId gameId, PositionReplay& replay);
+    /** Update the statistics of the move @p move played from @p position in game @p gameId,
+        the headers are read from @p index */
+    void updateMoveStats(const IndexX::Snapshot& index, const BoardX& position, const Move& move, GameId gameId, QMap<Move, MoveData>& stats) const;
+    /** Note a change of games or tags, see generation() */
+    void touch();
 
 signals:
     /** Signal emitted when some progress is done. */
@@ -133,8 +166,11 @@ signals:
 
 protected:
     IndexX m_index;
+    PositionIndex m_positionIndex;
+    OpeningTreeCache m_openingTreeCache;
     bool m_utf8;
     QMutex m_mutex;
+    QAtomicInt m_generation;
 };
 
 class DatabaseTransaction
@@ -7,7 +7,9 @@
  *   (at your option) any later version.                                   *
  ***************************************************************************/
 
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QUndoStack>
 
 #include "arenabook.h"
@@ -21,6 +23,7 @@
 #include "pgndatabase.h"
 #include "polyglotdatabase.h"
 #include "settings.h"
+#include "statisticsbook.h"
 #include "tags.h"
 
 #ifdef USE_SCID
@@ -79,6 +82,10 @@ DatabaseInfo::DatabaseInfo(QUndoGroup* undoGroup, const QString& fname): m_filte
     {
         m_database = new CtgDatabase;
     }
+    else if (IsStatisticsBook())
+    {
+        m_database = new StatisticsBook;
+    }
     else if(file.size()/(1024 * 1024) < AppSettings->getValue("/General/EditLimit").toInt())
     {
         m_database = new MemoryDatabase;
@@ -105,12 +112,29 @@ void DatabaseInfo::doLoadFile(QString filename)
         return;
     }
     m_database->parseFile();
+    if (!IsBook() && !IsFicsDB() && AppSettings->getValue("/General/usePositionIndex").toBool())
+    {
+        QString path = AppSettings->indexPath() + QDir::separator() + QFileInfo(filename).completeBaseName() + ".cxp";
+        if (!m_database->readPositionIndex(path) && m_database->buildPositionIndex(&m_database->m_break))
+        {
+            m_database->writePositionIndex(path);
+        }
+    }
+    if (!IsBook() && !IsFicsDB())
+    {
+        m_database->readOpeningTreeCache(openingTreeCachePath());
+    }
     delete m_filter;
     m_filter = new FilterX(m_database);
     m_bLoaded = true;
     emit LoadFinished(this);
 }
 
+QString DatabaseInfo::openingTreeCachePath() const
+{
+    return AppSettings->indexPath() + QDir::separator() + QFileInfo(m_database->filename()).completeBaseName() + ".cxt";
+}
+
 void DatabaseInfo::run()
 {
     QFileInfo fi = QFileInfo(m_filename);
@@ -133,6 +157,7 @@ void DatabaseInfo::close()
     {
         m_filter->cancel();
     }
+    bool loaded = m_bLoaded;
     m_bLoaded = false;
     m_database->m_break = true;
     if(isRunning())
@@ -143,6 +168,10 @@ void DatabaseInfo::close()
             terminate();
         }
     }
+    if (loaded && !IsBook() && !IsFicsDB())
+    {
+        m_database->writeOpeningTreeCache(openingTreeCachePath());
+    }
 
     delete m_database;
     delete m_filter;
@@ -406,6 +435,11 @@ bool DatabaseInfo::IsChessbaseBook() const
     return IsChessbaseBook(m_filename);
 }
 
+bool DatabaseInfo::IsStatisticsBook() const
+{
+    return IsStatisticsBook(m_filename);
+}
+
 bool DatabaseInfo::IsArenaBook() const
 {
     return IsArenaBook(m_filename);
@@ -428,6 +462,12 @@ bool DatabaseInfo::IsBook() const
     return (fi.suffix().toLower() == "ctg");
 }
 
+/* static */ bool DatabaseInfo::IsStatisticsBook(QString s)
+{
+    QFileInfo fi(s);
+    return (fi.suffix().toLower() == "cxb");
+}
+
 /* static */ bool DatabaseInfo::IsArenaBook(QString s)
 {
     QFileInfo fi(s);
@@ -443,7 +483,7 @@ bool DatabaseInfo::IsBook() const
 /* static */ bool DatabaseInfo::IsBook(QString s)
 {
     // Add here if more book formats come in
-    return IsPolyglotBook(s) || IsChessbaseBook(s) || IsOnlineBook(s) ;
+    return IsPolyglotBook(s) || IsChessbaseBook(s) || IsStatisticsBook(s) || IsOnlineBook(s) ;
 }
 
 /* static */ bool DatabaseInfo::IsLocalDatabase(QString s)
@@ -455,7 +495,8 @@ bool DatabaseInfo::IsBook() const
             (suffix == "si4") ||
             (suffix == "bin") ||
             (suffix == "abk") ||
-            (suffix == "ctg"));
+            (suffix == "ctg") ||
+            (suffix == "cxb"));
 }
 
 /* static */ bool DatabaseInfo::IsLocalArchive(QString s)
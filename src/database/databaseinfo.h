@@ -101,11 +101,13 @@ public:
     bool IsFicsDB() const;
     bool IsChessbaseBook() const;
     bool IsPolyglotBook() const;
+    bool IsStatisticsBook() const;
     bool IsArenaBook() const;
     bool IsBook() const;
 
     static bool IsPolyglotBook(QString name);
     static bool IsChessbaseBook(QString s);
+    static bool IsStatisticsBook(QString name);
     static bool IsArenaBook(QString name);
     static bool IsOnlineBook(QString name);
     static bool IsBook(QString name);
@@ -137,6 +139,8 @@ public:
 
 protected:
     void doLoadFile(QString filename);
+    /** @return the file keeping the opening trees of the database */
+    QString openingTreeCachePath() const;
 
 signals:
     void LoadFinished(DatabaseInfo*);
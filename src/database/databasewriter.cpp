@@ -0,0 +1,78 @@
+#include "databasewriter.h"
+#include "memorydatabase.h"
+#include "output.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+DatabaseWriter::DatabaseWriter(QObject* parent) :
+    QThread(parent),
+    m_database(nullptr),
+    m_output(nullptr),
+    m_saving(false),
+    m_cancel(0)
+{
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    delete m_output;
+}
+
+void DatabaseWriter::run()
+{
+    bool ok;
+    if (m_saving)
+    {
+        MemoryDatabase* memoryDb = qobject_cast<MemoryDatabase*>(m_database.data());
+        ok = memoryDb && memoryDb->save(*m_output, false, &m_cancel);
+    }
+    else
+    {
+        ok = m_database && m_output->save(m_filename, *m_database, &m_cancel);
+    }
+    if (ok)
+    {
+        emit writeFinished(m_filename, this);
+    }
+    else
+    {
+        emit writeError(m_filename, this);
+    }
+    deleteLater();
+}
+
+// ---------------------------------------------------------
+// Mainthread Interface
+// ---------------------------------------------------------
+
+void DatabaseWriter::writeDatabase(Database* database, const QString& filename, Output* output)
+{
+    m_cancel = 0;
+    m_filename = filename;
+    m_database = database;
+    m_output = output;
+    m_saving = false;
+    connect(m_output, SIGNAL(progress(int)), this, SIGNAL(progress(int)));
+    start();
+}
+
+void DatabaseWriter::saveDatabase(MemoryDatabase* database, Output* output)
+{
+    m_cancel = 0;
+    m_filename = database->filename();
+    m_database = database;
+    m_output = output;
+    m_saving = true;
+    // Appending games in place reports the progress through the database
+    connect(m_output, SIGNAL(progress(int)), this, SIGNAL(progress(int)));
+    connect(database, SIGNAL(progress(int)), this, SIGNAL(progress(int)));
+    start();
+}
+
+void DatabaseWriter::cancel()
+{
+    m_cancel = 1;
+}
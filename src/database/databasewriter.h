@@ -0,0 +1,55 @@
+#ifndef DATABASEWRITER_H_INCLUDED
+#define DATABASEWRITER_H_INCLUDED
+
+#include <QAtomicInt>
+#include <QPointer>
+#include <QThread>
+
+#include "database.h"
+
+class MemoryDatabase;
+class Output;
+
+/** @ingroup Database
+   The DatabaseWriter class writes all games of a database to a file in a
+   background thread. Until it is finished, the old file is left as it was,
+   so cancelling the writer never loses data. It also saves a MemoryDatabase
+   to its own file, which may write only the changed games.
+*/
+
+class DatabaseWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit DatabaseWriter(QObject* parent = nullptr);
+    ~DatabaseWriter();
+    /** Starts writing @p database to @p filename with @p output, which is owned by the writer from now on */
+    void writeDatabase(Database* database, const QString& filename, Output* output);
+    /** Starts saving @p database to its file with @p output, which is owned by the writer from now on */
+    void saveDatabase(MemoryDatabase* database, Output* output);
+    /** @return the database being written */
+    Database* database() const { return m_database; }
+    /** @return true if the database is saved to its own file */
+    bool isSaving() const { return m_saving; }
+    /** @return true if the writer was asked to stop */
+    bool isCancelled() const { return m_cancel.load(); }
+
+signals:
+    void writeFinished(QString, DatabaseWriter*);
+    void writeError(QString, DatabaseWriter*);
+    void progress(int);
+
+public slots:
+    void cancel();
+
+protected:
+    virtual void run();
+
+    QPointer<Database> m_database;
+    Output* m_output;
+    QString m_filename;
+    bool m_saving;
+    QAtomicInt m_cancel;
+};
+
+#endif // DATABASEWRITER_H_INCLUDED
@@ -20,12 +20,9 @@ DateSearch::DateSearch()
     m_minDate = m_maxDate = PartialDate();
 }
 
-DateSearch::DateSearch(const PartialDate& minDate, const PartialDate& maxDate)
+DateSearch::DateSearch(Database* database, const PartialDate& minDate, const PartialDate& maxDate) : Search(database)
 {
-    Q_ASSERT(minDate < maxDate);
-
-    m_minDate = minDate;
-    m_maxDate = maxDate;
+    setDateRange(minDate, maxDate);
 }
 
 PartialDate DateSearch::minDate() const
@@ -43,14 +40,24 @@ void DateSearch::setDateRange(const PartialDate& minDate, const PartialDate& max
     Q_ASSERT(minDate < maxDate);
     m_minDate = minDate;
     m_maxDate = maxDate;
+    initialize();
+}
+
+void DateSearch::initialize()
+{
+    if (m_database)
+    {
+        m_matches = m_database->index()->listInDateRange(m_minDate, m_maxDate);
+    }
 }
 
 int DateSearch::matches(GameId index) const
 {
-    GameX g;
-    m_database->loadGameHeaders(index, g);
-    PartialDate date(g.tag("Date"));
+    return m_matches.at(index);
+}
 
-    return (date >= m_minDate && date <= m_maxDate);
+const QBitArray* DateSearch::matchList() const
+{
+    return &m_matches;
 }
 
@@ -7,6 +7,7 @@
 
 #include "search.h"
 #include "partialdate.h"
+#include <QBitArray>
 
 /** @ingroup Search
 The DataSearch class defines a search based on a date range */
@@ -17,16 +18,18 @@ class DateSearch : public Search
 public:
     /** Standard constructor. */
     DateSearch();
-    /** Constructor for searching games in given time period. */
-    DateSearch(const PartialDate &minDate, const PartialDate &maxDate);
+    /** Constructor for searching games of @p database in given time period. */
+    DateSearch(Database* database, const PartialDate &minDate, const PartialDate &maxDate);
     /** @return beginning of the acceptable period. */
     PartialDate minDate() const;
     /** @return end of the acceptable period. */
     PartialDate maxDate() const;
     /** Sets whole period. */
     void setDateRange(const PartialDate &minDate, const PartialDate &maxDate);
+    void initialize();
     /** Return true if the game at index matches the search */
     virtual int matches(GameId index) const;
+    virtual const QBitArray* matchList() const;
 
 private:
     PartialDate m_minDate;
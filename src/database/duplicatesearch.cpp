@@ -5,12 +5,16 @@
 #include "database.h"
 #include "duplicatesearch.h"
 #include "index.h"
+#include "parallelfor.h"
 
 #if defined(_MSC_VER) && defined(_DEBUG)
 #define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
+/** Games per work item when fingerprinting */
+static const int FingerprintChunk = 256;
+
 /* DuplicateSearch class
  * **********************/
 DuplicateSearch::DuplicateSearch(Database *db, DSMode mode):Search(db),m_filter(nullptr)
@@ -24,6 +28,89 @@ DuplicateSearch::DuplicateSearch(FilterX *filter, DSMode mode):Search(filter ? f
    m_filter = filter;
 }
 
+void DuplicateSearch::fingerprintCandidates(volatile bool& breakFlag)
+{
+    IndexX* index = m_database->index();
+    const int count = index->count();
+
+    // Only games sharing their tags with another game are ever compared
+    QVector<unsigned int> hashes(count);
+    QHash<unsigned int, int> bucketSize;
+    for (GameId i = 0; (int)i < count; ++i)
+    {
+        if (!index->deleted(i))
+        {
+            hashes[i] = index->hashIndexItem(i);
+            ++bucketSize[hashes.at(i)];
+        }
+    }
+    QVector<GameId> games;
+    for (GameId i = 0; (int)i < count; ++i)
+    {
+        if (!index->deleted(i) && bucketSize.value(hashes.at(i)) > 1 && !index->fingerprint(i).isValid())
+        {
+            games.append(i);
+        }
+    }
+    if (games.isEmpty())
+    {
+        return;
+    }
+
+    const int n = games.count();
+    QVector<GameFingerprint> fingerprints(n);
+    GameFingerprint* out = fingerprints.data();
+
+    ParallelFor loop(n, FingerprintChunk, [&](int first, int last)
+    {
+        for (int k = first; k < last && !breakFlag; ++k)
+        {
+            GameX game;
+            m_database->loadGame(games.at(k), game);
+            out[k] = GameFingerprint::fromGame(game);
+        }
+    });
+    while (!loop.wait(100))
+    {
+        if (breakFlag)
+        {
+            loop.stop();
+        }
+        emit prepareUpdate(static_cast<int>(loop.done() * 100ll / n));
+    }
+
+    // Unfinished games after a break are unknown and skipped by setFingerprint
+    for (int k = 0; k < n; ++k)
+    {
+        index->setFingerprint(games.at(k), fingerprints.at(k));
+    }
+}
+
+GameFingerprint DuplicateSearch::fingerprint(GameId gameId)
+{
+    GameFingerprint result = m_database->index()->fingerprint(gameId);
+    if (!result.isValid())
+    {
+        GameX game;
+        m_database->loadGame(gameId, game);
+        result = GameFingerprint::fromGame(game);
+        m_database->index()->setFingerprint(gameId, result);
+    }
+    return result;
+}
+
+bool DuplicateSearch::isSameGame(GameId i, GameId j)
+{
+    if (!fingerprint(i).mayEqual(fingerprint(j)))
+    {
+        return false;
+    }
+    GameX gI, gJ;
+    m_database->loadGame(i, gI);
+    m_database->loadGame(j, gJ);
+    return gI.isEqual(gJ);
+}
+
 void DuplicateSearch::PrepareFilter(volatile bool &breakFlag)
 {
     const IndexX* index = m_database->index();
@@ -41,10 +128,7 @@ void DuplicateSearch::PrepareFilter(volatile bool &breakFlag)
                 GameId j = iter.value();
                 if (index->isIndexItemEqual(i,j))
                 {
-                    GameX gI, gJ;
-                    m_database->loadGame(i, gI);
-                    m_database->loadGame(j, gJ);
-                    found = gI.isEqual(gJ);
+                    found = isSameGame(i, j);
                 }
             }
         }
@@ -61,6 +145,10 @@ void DuplicateSearch::Prepare(volatile bool &breakFlag)
     {
         const IndexX* index = m_database->index();
         m_matches = QBitArray(index->count(), false);
+        if (m_mode != DS_Tags)
+        {
+            fingerprintCandidates(breakFlag);
+        }
         if (m_filter)
         {
             PrepareFilter(breakFlag);
@@ -84,10 +172,7 @@ void DuplicateSearch::Prepare(volatile bool &breakFlag)
                     {
                         if ((m_mode == DS_Both) || (m_mode == DS_Both_All))
                         {
-                            GameX gI, gJ;
-                            m_database->loadGame(i, gI);
-                            m_database->loadGame(j, gJ);
-                            found = gI.isEqual(gJ);
+                            found = isSameGame(i, j);
                             if ((m_mode == DS_Both_All) && found)
                             {
                                m_matches[j] = 1;
@@ -95,18 +180,18 @@ void DuplicateSearch::Prepare(volatile bool &breakFlag)
                         }
                         else if (m_mode == DS_Tags_BestGame)
                         {
-                            GameX gI, gJ;
-                            m_database->loadGame(i, gI);
-                            m_database->loadGame(j, gJ);
-                            if (gJ.isBetterOrEqual(gI))
+                            GameFingerprint fI = fingerprint(i);
+                            GameFingerprint fJ = fingerprint(j);
+                            if (fJ.isBetterOrEqual(fI))
                             {
                                 found = true;
                             }
-                            else if (gI.isBetterOrEqual(gJ))
+                            else if (fI.isBetterOrEqual(fJ))
                             {
+                                // Game i replaces the worse game j
                                 m_matches[j] = 1;
-                                m_hashToGames.remove(hashval, i);
-                                m_hashToGames.insert(hashval, j);
+                                m_hashToGames.remove(hashval, j);
+                                m_hashToGames.insert(hashval, i);
                                 found = true;
                                 break;
                             }
@@ -144,3 +229,8 @@ int DuplicateSearch::matches(GameId index) const
     return m_matches.at(index);
 }
 
+const QBitArray* DuplicateSearch::matchList() const
+{
+    return &m_matches;
+}
+
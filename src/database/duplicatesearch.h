@@ -6,11 +6,15 @@
 #define DUPLICATESEARCH_H
 
 #include "search.h"
+#include "gamefingerprint.h"
 #include <QBitArray>
 #include <QMultiHash>
 
 /** @ingroup Search
-The DuplicateSearch class defines a search for duplicates within a database */
+The DuplicateSearch class defines a search for duplicates within a database.
+Games with equal tags are told apart by their fingerprints, which are computed
+in parallel and kept in the index. Games are only loaded and compared when
+their fingerprints are equal. */
 class DuplicateSearch : public Search
 {
     Q_OBJECT
@@ -29,11 +33,19 @@ public:
     DuplicateSearch(FilterX* filter, DSMode mode=DS_Both_All);
     /** Return true if the game at index matches the search */
     virtual int matches(GameId index) const;
+    virtual const QBitArray* matchList() const;
 
     virtual void Prepare(volatile bool& breakFlag);
     void PrepareFilter(volatile bool& breakFlag);
 
 private:
+    /** Fingerprint all games which share their tags with another game */
+    void fingerprintCandidates(volatile bool& breakFlag);
+    /** @return the fingerprint of game @p gameId, computing it if it is unknown */
+    GameFingerprint fingerprint(GameId gameId);
+    /** @return true if the moves and annotations of games @p i and @p j are equal */
+    bool isSameGame(GameId i, GameId j);
+
     QMultiHash<quint64, GameId> m_hashToGames;
     QBitArray m_matches;
     DSMode m_mode;
@@ -109,17 +109,15 @@ void EcoInfo::update()
 
     // Clean previous statistics
     reset();
+    // Read the headers of the games without locking the index for each of them
+    const IndexX::Snapshot headers = index->snapshot();
 
-    for(int i = 0; i < (int) m_database->count(); ++i)
+    foreach(GameId i, index->gamesWithValue(TagNameECO, eco))
     {
-        if(index->valueIndexFromTag(TagNameECO, i) != eco)
-        {
-            continue;
-        }
-        QString result = index->tagValue(TagNameResult, i);
+        QString result = headers.tagValue(TagNameResult, i);
         int res = toResult(result);
-        QString whitePlayer = index->tagValue(TagNameWhite, i);
-        QString blackPlayer = index->tagValue(TagNameBlack, i);
+        QString whitePlayer = headers.tagValue(TagNameWhite, i);
+        QString blackPlayer = headers.tagValue(TagNameBlack, i);
         // The following works as QHash initializes a default-constructed value to 0
         float fres = toPoints(result);
         if(fres >= 0)
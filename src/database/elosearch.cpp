@@ -58,3 +58,8 @@ int EloSearch::matches(GameId index) const
 {
     return m_matches.at(index);
 }
+
+const QBitArray* EloSearch::matchList() const
+{
+    return &m_matches;
+}
@@ -32,6 +32,7 @@ public:
     void initialize();
     /** Return true if the game at index matches the search */
     virtual int matches(GameId index) const;
+    virtual const QBitArray* matchList() const;
 
 private:
     int m_minWhiteElo;
@@ -104,17 +104,15 @@ void EventInfo::update()
 
     // Clean previous statistics
     reset();
+    // Read the headers of the games without locking the index for each of them
+    const IndexX::Snapshot headers = index->snapshot();
 
-    for(int i = 0; i < (int) m_database->count(); ++i)
+    foreach(GameId i, index->gamesWithValue(TagNameEvent, event))
     {
-        if(index->valueIndexFromTag(TagNameEvent, i) != event)
-        {
-            continue;
-        }
-        QString result = index->tagValue(TagNameResult, i);
+        QString result = headers.tagValue(TagNameResult, i);
         int res = ResultFromString(result);
-        QString whitePlayer = index->tagValue(TagNameWhite, i);
-        QString blackPlayer = index->tagValue(TagNameBlack, i);
+        QString whitePlayer = headers.tagValue(TagNameWhite, i);
+        QString blackPlayer = headers.tagValue(TagNameBlack, i);
         // The following works as QHash initializes a default-constructed value to 0
         players[whitePlayer] += toPoints(result);
         players[blackPlayer] += (1.0 - toPoints(result));
@@ -122,7 +120,7 @@ void EventInfo::update()
         m_games[blackPlayer]++;
         m_result[res]++;
         m_count++;
-        PartialDate date(index->tagValue(TagNameDate, i));
+        PartialDate date = index->date(i);
         if(date.year() > 1000)
         {
             m_date[0] = qMin(date, m_date[0]);
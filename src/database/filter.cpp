@@ -12,8 +12,13 @@
 #include "database.h"
 #include "filter.h"
 #include "filtersearch.h"
+#include "parallelfor.h"
+#include <QtAlgorithms>
+#include <QtEndian>
 #include <QtDebug>
 
+#include <cstring>
+
 using namespace chessx;
 
 #if defined(_MSC_VER) && defined(_DEBUG)
@@ -21,11 +26,52 @@ using namespace chessx;
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
+/** Games per work item of a parallel search */
+static const int ParallelSearchChunk = 2048;
+/** Filters smaller than this are searched on a single thread */
+static const unsigned int ParallelSearchThreshold = 4 * ParallelSearchChunk;
+
+/** @return the number of 64 bit words holding @p size bits */
+static int wordCount(unsigned int size)
+{
+    return static_cast<int>((size + 63) / 64);
+}
+
+/** @return the first @p size bits of @p bits as 64 bit words, missing bits are 0 */
+static QVector<quint64> toWords(const QBitArray& bits, unsigned int size)
+{
+    QVector<quint64> words(wordCount(size), 0);
+    int n = qMin(bits.size(), static_cast<int>(size));
+    int first = 0;
+#if QT_VERSION >= 0x050B00
+    // QBitArray stores bit i in bit i % 8 of byte i / 8, copy the whole bytes at once
+    int bytes = n / 8;
+    QByteArray buffer(words.count() * 8, 0);
+    memcpy(buffer.data(), bits.bits(), static_cast<size_t>(bytes));
+    for (int i = 0; i < words.count(); ++i)
+    {
+        words[i] = qFromLittleEndian<quint64>(reinterpret_cast<const uchar*>(buffer.constData()) + i * 8);
+    }
+    first = bytes * 8;
+#endif
+    for (int i = first; i < n; ++i)
+    {
+        if (bits.testBit(i))
+        {
+            words[i / 64] |= quint64(1) << (i % 64);
+        }
+    }
+    return words;
+}
+
 FilterX::FilterX(Database* database) : QThread()
 {
     m_database = database;
-    m_count = m_database->count();
-    m_vector = new QVector<FilterX::value_type>(m_count, 1);
+    m_size = static_cast<unsigned int>(m_database->count());
+    m_count = static_cast<int>(m_size);
+    m_bits = QVector<quint64>(wordCount(m_size), ~quint64(0));
+    clearTail();
+    m_plies = nullptr;
     m_gamesSearched = 0;
     m_searchTime = 0;
     currentSearchOperator = NullOperator;
@@ -36,12 +82,12 @@ FilterX::~FilterX()
 {
     cancel();
     delete currentSearch;
-    delete m_vector;
+    delete m_plies;
 }
 
 FilterX::FilterX(FilterX const& rhs) : QThread()
 {
-    m_vector = nullptr;
+    m_plies = nullptr;
     *this = rhs;
 }
 
@@ -51,8 +97,10 @@ FilterX& FilterX::operator= (FilterX const& rhs)
     {
         m_database = rhs.m_database;
         m_count = rhs.m_count;
-        delete m_vector;
-        m_vector = new QVector<FilterX::value_type>(*rhs.m_vector);
+        m_size = rhs.m_size;
+        m_bits = rhs.m_bits;
+        delete m_plies;
+        m_plies = rhs.m_plies ? new QVector<FilterX::value_type>(*rhs.m_plies) : nullptr;
         m_gamesSearched = 0;
         m_searchTime = 0;
         currentSearch = nullptr;
@@ -84,141 +132,295 @@ void FilterX::set(GameId game, FilterX::value_type value)
     {
         return;
     }
+    quint64 bit = quint64(1) << (game % 64);
     if(value && !contains(game))
     {
         ++m_count;
+        m_bits[game / 64] |= bit;
     }
     else if(!value && contains(game))
     {
         --m_count;
+        m_bits[game / 64] &= ~bit;
     }
 
-    (*m_vector)[game] = value;
+    if (value > 1 && !m_plies)
+    {
+        detachPlies();
+    }
+    if (m_plies)
+    {
+        (*m_plies)[game] = value;
+    }
 }
 
 void FilterX::setAll(FilterX::value_type value)
 {
     cancel();
-    m_vector->fill(value);
+    m_bits.fill(value ? ~quint64(0) : 0);
+    clearTail();
     m_count = value ? size() : 0;
+    if (value > 1)
+    {
+        detachPlies();
+        m_plies->fill(value);
+    }
+    else
+    {
+        dropPlies();
+    }
 }
 
 bool FilterX::contains(GameId game) const
 {
-    if(static_cast<int>(game) < m_vector->count())
+    if(game < m_size)
     {
-        return (m_vector->at(game) != 0);
+        return (m_bits.at(game / 64) >> (game % 64)) & 1;
     }
     return false;
 }
 
 FilterX::value_type FilterX::gamePosition(GameId game) const
 {
-    return m_vector->at(static_cast<int>(game));
+    if (!contains(game))
+    {
+        return 0;
+    }
+    return m_plies ? m_plies->at(static_cast<int>(game)) : 1;
 }
 
 unsigned int FilterX::size() const
 {
-    return static_cast<unsigned int>(m_vector->size());
+    return m_size;
 }
 
-void FilterX::resize(unsigned int newsize, bool includeNew)
+quint64 FilterX::signature() const
 {
-    for(GameId i = static_cast<GameId>(newsize); i < size(); ++i)   // Decrease count by number of removed games
+    // The words beyond size() are kept clear, so equal sets give equal words
+    quint64 h = m_size;
+    for (quint64 word: m_bits)
     {
-        if(contains(i))
-        {
-            --m_count;
-        }
+        h = (h ^ word) * 0x100000001B3ull;
+        h ^= h >> 29;
     }
+    return h;
+}
+
+void FilterX::resize(unsigned int newsize, bool includeNew)
+{
     unsigned int oldsize = size();
-    m_vector->resize(newsize);
-    // Set new (uninitialized games) to 'includeNew' value.
-    for(unsigned int i = oldsize; i < newsize; ++i)
+    m_bits.resize(wordCount(newsize));
+    m_size = newsize;
+    if (includeNew)
     {
-        (*m_vector)[i] = includeNew;
+        // Set new (uninitialized games) to 'includeNew' value.
+        for (unsigned int i = oldsize; i < newsize; ++i)
+        {
+            m_bits[i / 64] |= quint64(1) << (i % 64);
+        }
     }
-    if(includeNew)
+    clearTail();
+    if (m_plies)
     {
-        m_count += newsize - oldsize;
+        m_plies->resize(static_cast<int>(newsize));
+        for (unsigned int i = oldsize; i < newsize; ++i)
+        {
+            (*m_plies)[i] = includeNew;
+        }
     }
+    recount();
 }
 
 void FilterX::invert()
 {
     cancel();
     m_count = size() - m_count;
-    for(int i = 0, sz = static_cast<int>(size()); i < sz; ++i)
+    for (auto it = m_bits.begin(); it != m_bits.end(); ++it)
     {
-        if(m_vector->at(i))
-        {
-            (*m_vector)[i] = 0;
-        }
-        else
+        *it = ~*it;
+    }
+    clearTail();
+    dropPlies();
+}
+
+void FilterX::detachPlies()
+{
+    if (!m_plies)
+    {
+        m_plies = new QVector<FilterX::value_type>(static_cast<int>(m_size), 0);
+        for (GameId game = 0; game < m_size; ++game)
         {
-            (*m_vector)[i] = 1;
+            if (contains(game))
+            {
+                (*m_plies)[game] = 1;
+            }
         }
     }
 }
 
-void FilterX::runSingleSearch(Search* s, FilterOperator op)
+void FilterX::dropPlies()
 {
-    connect(s, SIGNAL(prepareUpdate(int)), this, SIGNAL(searchProgress(int)));
-    s->Prepare(m_break);
+    delete m_plies;
+    m_plies = nullptr;
+}
+
+void FilterX::clearTail()
+{
+    if (m_size % 64)
+    {
+        m_bits.last() &= (quint64(1) << (m_size % 64)) - 1;
+    }
+}
+
+void FilterX::recount()
+{
+    int count = 0;
+    for (int i = 0; i < m_bits.count(); ++i)
+    {
+        count += qPopulationCount(m_bits.at(i));
+    }
+    m_count = count;
+}
+
+void FilterX::joinMatchList(const QBitArray& matches, FilterOperator op)
+{
+    QVector<quint64> words = toWords(matches, m_size);
+    const int n = m_bits.count();
+    quint64* bits = m_bits.data();
+    const quint64* other = words.constData();
     switch (op)
     {
     case FilterOperator::NullOperator:
-        for(int searchIndex = 0, sz = static_cast<int>(size()); searchIndex < sz; ++searchIndex)
+        m_bits = words;
+        dropPlies();
+        break;
+    case FilterOperator::And:
+        // Games which stay keep their ply
+        for (int i = 0; i < n; ++i)
         {
-            if (m_break) break;
-            set(searchIndex, s->matches(searchIndex));
-            if (searchIndex % 1024 == 0) emit searchProgress(searchIndex*100/size());
+            bits[i] &= other[i];
         }
         break;
+    case FilterOperator::Or:
+        for (int i = 0; i < n; ++i)
+        {
+            quint64 added = other[i] & ~bits[i];
+            bits[i] |= added;
+            while (m_plies && added)
+            {
+                (*m_plies)[i * 64 + qCountTrailingZeroBits(added)] = 1;
+                added &= added - 1;
+            }
+        }
+        break;
+    case FilterOperator::Remove:
+        for (int i = 0; i < n; ++i)
+        {
+            bits[i] &= ~other[i];
+        }
+        break;
+    default:
+        return;
+    }
+    recount();
+}
+
+FilterX::value_type FilterX::evaluate(const Search* s, FilterOperator op, GameId game) const
+{
+    value_type current = gamePosition(game);
+    switch (op)
+    {
+    case FilterOperator::NullOperator:
+        return s->matches(game);
     case FilterOperator::And:
-        for(int searchIndex = 0, sz = static_cast<int>(size()); searchIndex < sz; ++searchIndex)
+        if (current)
         {
-            if (m_break) break;
-            if (contains(searchIndex))
+            int n = s->matches(game);
+            if (n!=1) // Better search result or and does not apply
             {
-                int n = s->matches(searchIndex);
-                if (n!=1) // Better search result or and does not apply
-                {
-                    set(searchIndex, n);
-                }
+                return n;
             }
-            if (searchIndex % 1024 == 0) emit searchProgress(searchIndex*100/size());
         }
         break;
     case FilterOperator::Or:
-        for(int searchIndex = 0, sz = static_cast<int>(size()); searchIndex < sz; ++searchIndex)
+        if (!current)
         {
-            if (m_break) break;
-            if (!contains(searchIndex))
+            int n = s->matches(game);
+            if (n)
             {
-                int n = s->matches(searchIndex);
-                if (n)
-                {
-                    set(searchIndex, n);
-                }
+                return n;
             }
-            if (searchIndex % 1024 == 0) emit searchProgress(searchIndex*100/size());
         }
         break;
     case FilterOperator::Remove:
-        for(int searchIndex = 0, sz = static_cast<int>(size()); searchIndex < sz; ++searchIndex)
+        if (current && s->matches(game))
         {
-            if (m_break) break;
-            if (contains(searchIndex) && s->matches(searchIndex))
-            {
-                set(searchIndex, 0);
-            }
-            if (searchIndex % 1024 == 0) emit searchProgress(searchIndex*100/size());
+            return 0;
         }
         break;
     default:
         break;
     }
+    return current;
+}
+
+void FilterX::runSingleSearch(Search* s, FilterOperator op)
+{
+    connect(s, SIGNAL(prepareUpdate(int)), this, SIGNAL(searchProgress(int)));
+    s->Prepare(m_break);
+
+    if (s->matchList() && !m_break)
+    {
+        joinMatchList(*s->matchList(), op);
+        return;
+    }
+
+    if (QThread::idealThreadCount() > 1 && size() >= ParallelSearchThreshold)
+    {
+        runParallelSearch(s, op);
+        return;
+    }
+
+    for(int searchIndex = 0, sz = static_cast<int>(size()); searchIndex < sz; ++searchIndex)
+    {
+        if (m_break) break;
+        set(searchIndex, evaluate(s, op, searchIndex));
+        if (searchIndex % 1024 == 0) emit searchProgress(searchIndex*100/size());
+    }
+}
+
+void FilterX::runParallelSearch(Search* s, FilterOperator op)
+{
+    const int sz = static_cast<int>(size());
+    QVector<value_type> result(sz);
+    value_type* out = result.data();
+
+    ParallelFor loop(sz, ParallelSearchChunk, [&](int first, int last)
+    {
+        for (int searchIndex = first; searchIndex < last && !m_break; ++searchIndex)
+        {
+            out[searchIndex] = evaluate(s, op, searchIndex);
+        }
+    });
+    while (!loop.wait(100))
+    {
+        if (m_break)
+        {
+            loop.stop();
+        }
+        emit searchProgress(static_cast<int>(loop.done() * 100ll / sz));
+    }
+
+    if (m_break)
+    {
+        return;
+    }
+
+    // Merge in game order, so that the count is maintained exactly as in the serial case
+    for (int searchIndex = 0; searchIndex < sz; ++searchIndex)
+    {
+        set(searchIndex, result.at(searchIndex));
+    }
 }
 
 void FilterX::run()
@@ -16,6 +16,7 @@
 #include <QPair>
 #include <QPointer>
 #include <QThread>
+#include <QVector>
 
 #include "gameid.h"
 #include "filteroperator.h"
@@ -27,6 +28,11 @@ class Database;
    The FilterX class represents a set of games. It is always associated with
    some Database object. On creation it has the same size as database,
    but it is not automatically resized when database size changes.
+
+   Membership is kept in a bitmap of 64 bit words, so that searches which
+   deliver their results as a bit array are joined a word at a time. The ply
+   found by a position search is kept in a side array, which only exists
+   once a game has a value other than 1.
 */
 
 class FilterX : public QThread
@@ -37,6 +43,8 @@ public:
     /** Operator for joining filters */
 
     void runSingleSearch(Search* s, FilterOperator op);
+    /** Run the search on chunks of games using all cores, results equal runSingleSearch() */
+    void runParallelSearch(Search* s, FilterOperator op);
     void run();
     void cancel();
 
@@ -64,6 +72,8 @@ public:
     inline int count() const { return m_count; }
     /** @return the size of the filter. */
     unsigned int size() const;
+    /** @return a hash of the games in the filter, equal for equal sets of games */
+    quint64 signature() const;
     /** Resize the filter to the specified size, keeping current content. If the filter is increased,
     added game will be initialized to @p includeNew (by default - not in filter). */
     void resize(unsigned int newsize, bool includeNew = false);
@@ -78,9 +88,25 @@ signals:
     void searchFinished();
 
 protected:
+    /** @return the value of @p game after joining the result of @p s with operator @p op */
+    value_type evaluate(const Search* s, FilterOperator op, GameId game) const;
+    /** Join the results @p matches of a search with operator @p op, a word at a time */
+    void joinMatchList(const QBitArray& matches, FilterOperator op);
+    /** Create the ply array from the current membership */
+    void detachPlies();
+    /** Drop the ply array, all games in the filter get value 1 */
+    void dropPlies();
+    /** Clear the bits beyond size() in the last word */
+    void clearTail();
+    /** Count the games in the filter */
+    void recount();
 
     int m_count;
-    QVector<value_type>* m_vector;
+    unsigned int m_size;
+    /** Bit i % 64 of word i / 64 is set if game i is in the filter */
+    QVector<quint64> m_bits;
+    /** Values of all games, nullptr while every game in the filter has value 1 */
+    QVector<value_type>* m_plies;
     Database* m_database;
 
     /* Search statistics variables */
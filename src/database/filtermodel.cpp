@@ -15,6 +15,7 @@
 #include "settings.h"
 #include "tags.h"
 
+#include <QtConcurrent/QtConcurrent>
 #include <QtGui>
 
 #if defined(_MSC_VER) && defined(_DEBUG)
@@ -23,8 +24,10 @@
 #endif // _MSC_VER
 
 FilterModel::FilterModel(FilterX* filter, QObject* parent)
-    : QAbstractItemModel(parent), m_filter(filter), m_modelUpdateStarted(0)
+    : QAbstractItemModel(parent), m_filter(filter), m_modelUpdateStarted(0), m_ringPos(0), m_prefetchVersion(0)
 {
+    m_prefetch = new QFutureWatcher<QVector<RowData> >(this);
+    connect(m_prefetch, SIGNAL(finished()), SLOT(prefetchFinished()));
     setupColumns();
 }
 
@@ -93,6 +96,7 @@ bool FilterModel::canEditItem(const QModelIndex& index) const
 
 void FilterModel::cacheTags()
 {
+    clearRows();
     m_columnTagIndex.clear();
     foreach(QString tagName, m_columnTags)
     {
@@ -184,18 +188,11 @@ QVariant FilterModel::data(const QModelIndex &index, int role) const
                 {
                     return i + 1;
                 }
-
-                QString tag = m_filter->database()->tagValue(i, m_columnTagIndex[index.column()]);
-                if(tag == "?")
-                {
-                    tag.clear();
-                }
-                return tag;
+                return row(i).values.value(index.column());
             }
             else if(role == Qt::BackgroundRole)
             {
-                QString medal = m_filter->database()->tagValue(i, "Medal");
-                QColor bg(medal);
+                QColor bg(row(i).medal);
                 if (bg.isValid())
                 {
                     bg.setAlpha(80);
@@ -204,7 +201,7 @@ QVariant FilterModel::data(const QModelIndex &index, int role) const
             }
             else if(role == Qt::FontRole)
             {
-                if(m_filter->database()->deleted(i))
+                if(snapshot().deleted(i))
                 {
                     QFont font;
                     font.setStrikeOut(true);
@@ -213,7 +210,7 @@ QVariant FilterModel::data(const QModelIndex &index, int role) const
             }
             else if(role == Qt::ForegroundRole)
             {
-                if(!m_filter->database()->getValidFlag(i))
+                if(!snapshot().isValidFlag(i))
                 {
                     QVariant v = qApp->palette().color(QPalette::BrightText);
                     return v;
@@ -226,6 +223,128 @@ QVariant FilterModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+const IndexX::Snapshot& FilterModel::snapshot() const
+{
+    const IndexX* index = m_filter->database()->index();
+    if (!m_snapshot.isCurrent(index))
+    {
+        m_snapshot = index->snapshot();
+        clearRows();
+    }
+    return m_snapshot;
+}
+
+QVector<FilterModel::RowData> FilterModel::decodeRows(const IndexX::Snapshot& snapshot, const QVector<TagIndex>& tags,
+                                                      const QVector<GameId>& games)
+{
+    QVector<RowData> rows(games.count());
+    for (int i = 0; i < games.count(); ++i)
+    {
+        RowData& data = rows[i];
+        data.values.append(QString());
+        for (int column = 1; column < tags.count(); ++column)
+        {
+            QString tag = snapshot.tagValue(tags.at(column), games.at(i));
+            if(tag == "?")
+            {
+                tag.clear();
+            }
+            data.values.append(tag);
+        }
+        data.medal = snapshot.tagValue("Medal", games.at(i));
+    }
+    return rows;
+}
+
+FilterModel::RowData FilterModel::row(GameId gameId) const
+{
+    const IndexX::Snapshot& headers = snapshot();
+    QHash<GameId, RowData>::const_iterator it = m_rows.constFind(gameId);
+    if (it != m_rows.constEnd())
+    {
+        return *it;
+    }
+    RowData data = decodeRows(headers, m_columnTagIndex, QVector<GameId>() << gameId).first();
+    storeRow(gameId, data);
+    return data;
+}
+
+void FilterModel::storeRow(GameId gameId, const RowData& data) const
+{
+    if (!m_rows.contains(gameId))
+    {
+        if (m_ring.count() < CachedRows)
+        {
+            m_ring.append(gameId);
+        }
+        else
+        {
+            m_rows.remove(m_ring.at(m_ringPos));
+            m_ring[m_ringPos] = gameId;
+            m_ringPos = (m_ringPos + 1) % CachedRows;
+        }
+    }
+    m_rows.insert(gameId, data);
+}
+
+void FilterModel::clearRows() const
+{
+    m_rows.clear();
+    m_ring.clear();
+    m_ringPos = 0;
+}
+
+void FilterModel::prefetch(const QVector<GameId>& games)
+{
+    if (!m_filter || m_modelUpdateStarted)
+    {
+        return;
+    }
+    const IndexX::Snapshot& headers = snapshot();
+    QVector<GameId> missing;
+    foreach (GameId gameId, games)
+    {
+        if (!m_rows.contains(gameId))
+        {
+            missing.append(gameId);
+        }
+    }
+    if (missing.isEmpty())
+    {
+        return;
+    }
+    if (m_prefetch->isRunning())
+    {
+        // Only the rows asked for last are still wanted
+        m_nextPrefetch = missing;
+        return;
+    }
+    m_prefetchGames = missing;
+    m_prefetchTags = m_columnTagIndex;
+    m_prefetchVersion = headers.version();
+    m_prefetch->setFuture(QtConcurrent::run(&FilterModel::decodeRows, headers, m_prefetchTags, m_prefetchGames));
+}
+
+void FilterModel::prefetchFinished()
+{
+    QVector<RowData> rows = m_prefetch->result();
+    if (m_filter && !m_modelUpdateStarted && m_prefetchTags == m_columnTagIndex
+            && snapshot().version() == m_prefetchVersion)
+    {
+        for (int i = 0; i < rows.count(); ++i)
+        {
+            storeRow(m_prefetchGames.at(i), rows.at(i));
+        }
+    }
+    m_prefetchGames.clear();
+    if (!m_nextPrefetch.isEmpty())
+    {
+        QVector<GameId> games;
+        games.swap(m_nextPrefetch);
+        prefetch(games);
+    }
+}
+
 QVariant FilterModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
     if(role != Qt::DisplayRole)
@@ -278,20 +397,20 @@ FilterX* FilterModel::filter()
 void FilterModel::setFilter(FilterX* filter)
 {
     m_filter = filter;
+    m_snapshot = IndexX::Snapshot();
+    clearRows();
 }
 
 void FilterModel::invert()
 {
-    startUpdate();
     m_filter->invert();
-    endUpdate();
+    emit filterChanged();
 }
 
 void FilterModel::setAll(int value)
 {
-    startUpdate();
     m_filter->setAll(value);
-    endUpdate();
+    emit filterChanged();
 }
 
 void FilterModel::executeSearch(Search* search, FilterOperator searchOperator, int preSelect)
@@ -318,15 +437,27 @@ void FilterModel::executeSearch(Search* search, FilterOperator searchOperator, i
 
 void FilterModel::endSearch()
 {
-    startUpdate();
     FilterX* f = qobject_cast<FilterX*>(sender());
     if (f && f!= m_filter)
     {
+        // Only a filter of another size changes the rows
+        bool resized = (f->size() != m_filter->size());
+        if (resized)
+        {
+            startUpdate();
+        }
         *m_filter = *f;
         m_filter->lock(nullptr);
         delete f;
+        if (resized)
+        {
+            endUpdate();
+        }
+        else
+        {
+            emit filterChanged();
+        }
     }
-    endUpdate();
     emit searchFinished();
 }
 
@@ -12,11 +12,15 @@
 #define FILTERMODEL_H_INCLUDED
 
 #include <QAbstractItemModel>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QStringList>
 #include <QPointer>
+#include <QVector>
 
 #include "filteroperator.h"
 #include "gameid.h"
+#include "index.h"
 #include "indexitem.h"
 
 class FilterX;
@@ -25,6 +29,10 @@ class Search;
 /** @ingroup Database
   The FilterModel class is an interface to Database used with Qt
   Model/View architecture
+
+  The decoded rows are kept in a ring of CachedRows rows, the view asks
+  for the rows about to be shown with prefetch(). A change of the games
+  in the filter only emits filterChanged(), the model is not reset.
 */
 class FilterModel: public QAbstractItemModel
 {
@@ -82,20 +90,47 @@ public:
     void invert();
     void setAll(int value);
     void executeSearch(Search* search, FilterOperator searchOperator = FilterOperator::NullOperator, int preSelect=1);
+    /** Decode the rows of @p games on a worker thread, as they are shown next */
+    void prefetch(const QVector<GameId>& games);
 
 signals:
     void searchProgress(int);
     void searchFinished();
+    /** The games in the filter changed, the rows of the model did not */
+    void filterChanged();
 
 private slots:
     /** End a search */
     void endSearch();
+    /** Store the rows decoded by prefetch() */
+    void prefetchFinished();
 
 private:
     void addColumns(const QStringList &tags);
     void setupColumns();
     bool canEditItem(const QModelIndex& index) const;
     void cacheTags();
+    /** @return a snapshot of the game headers, taken again after a change */
+    const IndexX::Snapshot& snapshot() const;
+
+    /** The decoded tags of a game */
+    struct RowData
+    {
+        /** Values of the columns, empty for the game number */
+        QStringList values;
+        QString medal;
+    };
+    /** Number of decoded rows which are kept */
+    static const int CachedRows = 4096;
+
+    /** @return the decoded tags of @p games in the columns @p tags */
+    static QVector<RowData> decodeRows(const IndexX::Snapshot& snapshot, const QVector<TagIndex>& tags,
+                                       const QVector<GameId>& games);
+    /** @return the decoded row of @p gameId, decoded now if it is not kept */
+    RowData row(GameId gameId) const;
+    /** Keep @p data, replacing the oldest row if the ring is full */
+    void storeRow(GameId gameId, const RowData& data) const;
+    void clearRows() const;
 
     /** A pointer to filter on which the model opperates */
     QPointer<FilterX> m_filter;
@@ -105,6 +140,19 @@ private:
     QStringList m_columnTags;
     QVector<TagIndex> m_columnTagIndex;
     int m_modelUpdateStarted;
+    /** Game headers read by data() without locking the index */
+    mutable IndexX::Snapshot m_snapshot;
+    /** Decoded rows by game, the games in the order they were decoded */
+    mutable QHash<GameId, RowData> m_rows;
+    mutable QVector<GameId> m_ring;
+    mutable int m_ringPos;
+    /** Running prefetch and the games it decodes */
+    QFutureWatcher<QVector<RowData> >* m_prefetch;
+    QVector<GameId> m_prefetchGames;
+    QVector<TagIndex> m_prefetchTags;
+    int m_prefetchVersion;
+    /** Games to prefetch once the running prefetch is done */
+    QVector<GameId> m_nextPrefetch;
 };
 
 #endif	// FILTERMODEL_H_INCLUDED
@@ -0,0 +1,118 @@
+#include "gamefingerprint.h"
+#include "gamex.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+namespace {
+
+/** Add @p value to @p hash, using the finalizer of splitmix64 */
+inline void mix(quint64& hash, quint64 value)
+{
+    quint64 z = hash ^ (value + 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    hash = z ^ (z >> 31);
+}
+
+inline void mix(quint64& hash, const QString& value)
+{
+    mix(hash, (quint64(qHash(value)) << 32) | quint32(value.length()));
+}
+
+/** Add the moves from @p node on and their variations to @p hash, depth first */
+void mixLine(quint64& hash, const GameCursor& cursor, MoveId node)
+{
+    for (; node != NO_MOVE; node = cursor.nextMove(node))
+    {
+        mix(hash, (quint64(quint16(node)) << 32) | cursor.move(node).rawMove());
+        const QList<MoveId>& variations = cursor.variations(node);
+        for (int i = 0; i < variations.count(); ++i)
+        {
+            // Mark the start of each variation, so that moving a move between
+            // a variation and the line after it changes the hash
+            mix(hash, quint64(0xFFFF) << 32);
+            mixLine(hash, cursor, variations.at(i));
+        }
+    }
+    mix(hash, quint64(0xFFFE) << 32);
+}
+
+} // anonymous namespace
+
+GameFingerprint::GameFingerprint()
+    : m_hash(0)
+    , m_nodes(0)
+    , m_annotations(0)
+    , m_variationStartAnnotations(0)
+{
+}
+
+GameFingerprint GameFingerprint::fromGame(const GameX& game)
+{
+    GameFingerprint fingerprint;
+    const GameCursor& cursor = game.cursor();
+    quint64 hash = 0;
+    mixLine(hash, cursor, ROOT_NODE);
+
+    for (auto it = game.m_annotations.cbegin(); it != game.m_annotations.cend(); ++it)
+    {
+        mix(hash, quint64(quint16(it.key())));
+        mix(hash, it.value());
+    }
+    mix(hash, quint64(0xFFFD) << 32);
+    for (auto it = game.m_variationStartAnnotations.cbegin(); it != game.m_variationStartAnnotations.cend(); ++it)
+    {
+        mix(hash, quint64(quint16(it.key())));
+        mix(hash, it.value());
+    }
+    mix(hash, quint64(0xFFFC) << 32);
+    for (auto it = game.m_nags.cbegin(); it != game.m_nags.cend(); ++it)
+    {
+        mix(hash, quint64(quint16(it.key())));
+        foreach (Nag nag, it.value())
+        {
+            mix(hash, quint64(nag));
+        }
+        mix(hash, quint64(0xFFFB) << 32);
+    }
+
+    fingerprint.m_hash = hash;
+    fingerprint.m_nodes = static_cast<quint32>(cursor.capacity());
+    fingerprint.m_annotations = static_cast<quint32>(game.m_annotations.count());
+    fingerprint.m_variationStartAnnotations = static_cast<quint32>(game.m_variationStartAnnotations.count());
+    return fingerprint;
+}
+
+bool GameFingerprint::isValid() const
+{
+    return m_nodes != 0;
+}
+
+bool GameFingerprint::mayEqual(const GameFingerprint& other) const
+{
+    if (!isValid() || !other.isValid())
+    {
+        return true;
+    }
+    return m_hash == other.m_hash &&
+           m_nodes == other.m_nodes &&
+           m_annotations == other.m_annotations &&
+           m_variationStartAnnotations == other.m_variationStartAnnotations;
+}
+
+bool GameFingerprint::isBetterOrEqual(const GameFingerprint& other) const
+{
+    return m_nodes >= other.m_nodes &&
+           m_annotations >= other.m_annotations &&
+           m_variationStartAnnotations >= other.m_variationStartAnnotations;
+}
+
+quint64 GameFingerprint::hash() const
+{
+    return m_hash;
+}
@@ -0,0 +1,45 @@
+#ifndef GAMEFINGERPRINT_H_INCLUDED
+#define GAMEFINGERPRINT_H_INCLUDED
+
+#include <QtGlobal>
+
+class GameX;
+
+/** @ingroup Database
+   The GameFingerprint class summarizes the moves, variations, annotations
+   and NAGs of a game, so that a duplicate search can tell games apart
+   without loading them.
+
+   Games which are equal according to GameX::isEqual() always have the same
+   fingerprint. Games with the same fingerprint are most likely, but not
+   certainly, equal. The node and annotation counts are kept as well, they
+   are all GameX::isBetterOrEqual() looks at.
+*/
+
+class GameFingerprint
+{
+public:
+    /** Creates an unknown fingerprint */
+    GameFingerprint();
+
+    /** @return the fingerprint of @p game */
+    static GameFingerprint fromGame(const GameX& game);
+
+    /** @return true if the fingerprint is known */
+    bool isValid() const;
+    /** @return false if the games of both fingerprints are certainly different */
+    bool mayEqual(const GameFingerprint& other) const;
+    /** Same as GameX::isBetterOrEqual() for the games of both fingerprints */
+    bool isBetterOrEqual(const GameFingerprint& other) const;
+
+    quint64 hash() const;
+
+private:
+    quint64 m_hash;
+    /** Nodes of the game, 0 if the fingerprint is unknown */
+    quint32 m_nodes;
+    quint32 m_annotations;
+    quint32 m_variationStartAnnotations;
+};
+
+#endif // GAMEFINGERPRINT_H_INCLUDED
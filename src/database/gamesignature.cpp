@@ -0,0 +1,228 @@
+#include <QDataStream>
+
+#include "gamesignature.h"
+#include "gamex.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+namespace {
+
+// Layout of SCID's matsig.h: black in the low 12 bits, white in the high 12 bits
+const int MaterialShift[Pawn + 1] = { 0, 0, 10, 8, 6, 4, 0 };
+const quint32 MaterialMask[Pawn + 1] = { 0, 0, 3, 3, 3, 3, 15 };
+const int ColorShift[2] = { 12, 0 };
+
+const quint16 AllHomePawns = 0xFFFF;
+
+/** @return SCID's home pawn bit index of @p square or -1, a2 is 15 and h7 is 0 */
+inline int homePawnIndex(Square square)
+{
+    if (square >= a2 && square <= h2)
+    {
+        return 15 - (square - a2);
+    }
+    if (square >= a7 && square <= h7)
+    {
+        return 7 - (square - a7);
+    }
+    return -1;
+}
+
+} // anonymous namespace
+
+GameSignature::Target::Target(const BoardX& position) : m_homePawns(0)
+{
+    for (int c = White; c <= Black; ++c)
+    {
+        for (int type = None; type <= Pawn; ++type)
+        {
+            m_count[c][type] = 0;
+        }
+    }
+    for (int s = a1; s < NumSquares; ++s)
+    {
+        Piece piece = position.pieceAt(Square(s));
+        if (piece != Empty)
+        {
+            ++m_count[pieceColor(piece)][pieceType(piece)];
+        }
+    }
+    for (int file = 0; file < 8; ++file)
+    {
+        if (position.pieceAt(Square(a2 + file)) == WhitePawn)
+        {
+            m_homePawns |= 1 << homePawnIndex(Square(a2 + file));
+        }
+        if (position.pieceAt(Square(a7 + file)) == BlackPawn)
+        {
+            m_homePawns |= 1 << homePawnIndex(Square(a7 + file));
+        }
+    }
+}
+
+GameSignature::GameSignature() : m_material(0), m_homePawns(0), m_homePawnCount(Unknown)
+{
+}
+
+GameSignature::GameSignature(quint32 material, int homePawnCount, quint64 homePawns)
+    : m_material(material)
+    , m_homePawns(homePawns)
+    , m_homePawnCount(static_cast<quint8>(qBound(0, homePawnCount, 16)))
+{
+}
+
+GameSignature GameSignature::fromGame(const GameX& game)
+{
+    const GameCursor& cursor = game.cursor();
+    if (cursor.initialBoard() != BoardX::standardStartBoard)
+    {
+        return GameSignature();
+    }
+
+    BoardX board = cursor.initialBoard();
+    quint16 home = AllHomePawns;
+    quint64 homePawns = 0;
+    int homePawnCount = 0;
+    for (MoveId node = cursor.nextMove(ROOT_NODE); node != NO_MOVE; node = cursor.nextMove(node))
+    {
+        const Move& move = cursor.move(node);
+        if (move.isNullMove())
+        {
+            continue;
+        }
+        // A home pawn leaves when it moves or is captured, only one per move
+        int index = homePawnIndex(move.from());
+        if (index < 0 || !(home & (1 << index)))
+        {
+            index = homePawnIndex(move.to());
+        }
+        if (index >= 0 && (home & (1 << index)))
+        {
+            home &= ~(1 << index);
+            homePawns |= quint64(index) << (60 - 4 * homePawnCount);
+            ++homePawnCount;
+        }
+        board.doMove(move);
+    }
+    return GameSignature(materialSignature(board), homePawnCount, homePawns);
+}
+
+quint32 GameSignature::materialSignature(const BoardX& board)
+{
+    quint32 count[2][Pawn + 1] = {};
+    for (int s = a1; s < NumSquares; ++s)
+    {
+        Piece piece = board.pieceAt(Square(s));
+        if (piece != Empty)
+        {
+            ++count[pieceColor(piece)][pieceType(piece)];
+        }
+    }
+    quint32 material = 0;
+    for (int c = White; c <= Black; ++c)
+    {
+        for (int type = Queen; type <= Pawn; ++type)
+        {
+            quint32 n = qMin(count[c][type], MaterialMask[type]);
+            material |= n << (MaterialShift[type] + ColorShift[c]);
+        }
+    }
+    return material;
+}
+
+bool GameSignature::isValid() const
+{
+    return m_homePawnCount != Unknown;
+}
+
+bool GameSignature::canReach(const Target& target) const
+{
+    return !isValid() || (materialCanReach(target) && homePawnsCanReach(target));
+}
+
+bool GameSignature::materialCanReach(const Target& target) const
+{
+    for (int c = White; c <= Black; ++c)
+    {
+        int last[Pawn + 1];
+        for (int type = Queen; type <= Pawn; ++type)
+        {
+            last[type] = static_cast<int>((m_material >> (MaterialShift[type] + ColorShift[c])) & MaterialMask[type]);
+        }
+
+        // Pawns never come back, each promotion uses up one of them
+        int promotions = target.m_count[c][Pawn] - last[Pawn];
+        if (promotions < 0)
+        {
+            return false;
+        }
+        int targetTotal = 0;
+        int lastTotal = 0;
+        for (int type = Queen; type <= Pawn; ++type)
+        {
+            // Capped counts are never above the real ones, so the tests stay safe
+            if (type != Pawn && last[type] > target.m_count[c][type] + promotions)
+            {
+                return false;
+            }
+            targetTotal += target.m_count[c][type];
+            lastTotal += last[type];
+        }
+        if (lastTotal > targetTotal)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GameSignature::homePawnsCanReach(const Target& target) const
+{
+    // Same walk as SCID's hpSig_PossibleMatch()
+    quint16 home = AllHomePawns;
+    for (int i = 0; ; ++i)
+    {
+        if (home == target.m_homePawns)
+        {
+            return true;
+        }
+        // A pawn can not return to its home square
+        if ((home & target.m_homePawns) != target.m_homePawns || i == m_homePawnCount)
+        {
+            return false;
+        }
+        home &= ~(1 << ((m_homePawns >> (60 - 4 * i)) & 0x0F));
+    }
+}
+
+quint32 GameSignature::material() const
+{
+    return m_material;
+}
+
+int GameSignature::homePawnCount() const
+{
+    return isValid() ? m_homePawnCount : 0;
+}
+
+quint64 GameSignature::homePawns() const
+{
+    return m_homePawns;
+}
+
+QDataStream& operator<<(QDataStream& out, const GameSignature& signature)
+{
+    out << signature.m_material << signature.m_homePawnCount << signature.m_homePawns;
+    return out;
+}
+
+QDataStream& operator>>(QDataStream& in, GameSignature& signature)
+{
+    in >> signature.m_material >> signature.m_homePawnCount >> signature.m_homePawns;
+    return in;
+}
@@ -0,0 +1,78 @@
+#ifndef GAMESIGNATURE_H_INCLUDED
+#define GAMESIGNATURE_H_INCLUDED
+
+#include <QtGlobal>
+
+#include "board.h"
+
+class GameX;
+class QDataStream;
+
+/** @ingroup Database
+   The GameSignature class summarizes the main line of a game so that a
+   position search can rule the game out without decoding it. It uses the
+   representation of SCID (see matsig.h), so the signatures stored in a SCID
+   index can be taken over unchanged:
+
+   - the material signature of the final position: 4 bits per pawn count and
+     2 bits (capped at 3) per piece count and color;
+   - the ordered list of home pawns (pawns on the 2nd/7th rank in the start
+     position) leaving their square by moving or being captured.
+
+   Signatures are only known for games starting from the standard position.
+*/
+
+class GameSignature
+{
+public:
+    /** The searched position, prepared once for the tests of many games */
+    class Target
+    {
+    public:
+        explicit Target(const BoardX& position);
+
+    private:
+        friend class GameSignature;
+        /** Exact piece counts, indexed by color and piece type */
+        int m_count[2][Pawn + 1];
+        /** Home pawns still on their square, in SCID's bit order */
+        quint16 m_homePawns;
+    };
+
+    /** Creates an unknown signature, which never excludes a game */
+    GameSignature();
+    /** Creates a signature from SCID data. @p homePawns holds the list of
+        @p homePawnCount 4 bit values, the first one in the highest nibble */
+    GameSignature(quint32 material, int homePawnCount, quint64 homePawns);
+
+    /** @return the signature of the main line of @p game */
+    static GameSignature fromGame(const GameX& game);
+    /** @return the SCID material signature of @p board */
+    static quint32 materialSignature(const BoardX& board);
+
+    /** @return true if the signature is known */
+    bool isValid() const;
+    /** @return false if no position of the main line can be @p target */
+    bool canReach(const Target& target) const;
+
+    quint32 material() const;
+    int homePawnCount() const;
+    quint64 homePawns() const;
+
+    friend QDataStream& operator<<(QDataStream& out, const GameSignature& signature);
+    friend QDataStream& operator>>(QDataStream& in, GameSignature& signature);
+
+private:
+    static const quint8 Unknown = 0xFF;
+
+    /** @return false if the material of @p target can not lead to m_material */
+    bool materialCanReach(const Target& target) const;
+    /** @return false if no prefix of the home pawn list leaves the pawns of @p target */
+    bool homePawnsCanReach(const Target& target) const;
+
+    quint32 m_material;
+    quint64 m_homePawns;
+    quint8 m_homePawnCount;
+};
+
+#endif // GAMESIGNATURE_H_INCLUDED
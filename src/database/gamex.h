@@ -607,6 +607,8 @@ private:
     void removeTimeCommentsFromMap(AnnotationMap& map);
 
     friend class SaveRestoreMove;
+    friend class CompactGameStore;
+    friend class GameFingerprint;
 };
 
 class SaveRestoreMove
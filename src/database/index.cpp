@@ -10,6 +10,7 @@
  ***************************************************************************/
 
 #include <QtDebug>
+#include <QDate>
 #include <QFile>
 #include <QDataStream>
 #include <QHash>
@@ -19,6 +20,8 @@
 #include <QVector>
 
 #include "index.h"
+#include "indeximage.h"
+#include "parallelfor.h"
 #include "tags.h"
 
 using namespace chessx;
@@ -28,7 +31,39 @@ using namespace chessx;
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
-IndexX::IndexX() : m_mutex(QReadWriteLock::Recursive)
+/** Tag searches with more distinct values test them on all cores */
+static const int ParallelMatchValues = 4096;
+/** Distinct values tested by one worker at a time */
+static const int MatchBatchSize = 512;
+
+namespace {
+
+/** Append the numeric column @p other of an index with games starting at @p base */
+template <class T>
+void appendNumeric(QVector<T>& column, const QVector<T>& other, GameId base)
+{
+    if (!other.isEmpty())
+    {
+        column.resize(static_cast<int>(base));
+        column += other;
+    }
+}
+
+/** Find the stored string of @p valueIndex in @p values or else in @p image */
+bool lookupTagValue(const QHash<ValueIndex, QString>& values, const IndexImage* image, ValueIndex valueIndex, QString& value)
+{
+    auto it = values.constFind(valueIndex);
+    if (it != values.constEnd())
+    {
+        value = it.value();
+        return true;
+    }
+    return image && image->findValue(valueIndex, value);
+}
+
+} // anonymous namespace
+
+IndexX::IndexX() : m_count(0), m_mutex(QReadWriteLock::Recursive)
 {
     // Dummy Values in case a index is miscalculated
     init();
@@ -41,9 +76,8 @@ IndexX::~IndexX()
 GameId IndexX::add()
 {
     QWriteLocker m(&m_mutex);
-    GameId gameId = m_indexItems.count();
-    m_indexItems.insert(gameId, IndexItem());
-    return gameId;
+    publish();
+    return static_cast<GameId>(m_count++);
 }
 
 TagIndex IndexX::AddTagName(const QString& name)
@@ -55,38 +89,243 @@ TagIndex IndexX::AddTagName(const QString& name)
     TagIndex n = m_tagNameIndex.size();
     m_tagNameIndex[name] = n;
     m_tagNames[n] = name;
+    if (static_cast<int>(n) >= m_columns.count())
+    {
+        m_columns.resize(static_cast<int>(n) + 1);
+        m_columns[n] = TagColumn(isFrequentTag(name), isPostedTag(name));
+    }
+    if (static_cast<int>(n) >= m_numericTags.count())
+    {
+        m_numericTags.resize(static_cast<int>(n) + 1);
+        m_numericTags[n] = numericTag(name);
+    }
     return n;
 }
 
+bool IndexX::isFrequentTag(const QString& name)
+{
+    static const QSet<QString> frequentTags =
+    {
+        TagNameWhite, TagNameBlack, TagNameEvent, TagNameSite, TagNameRound, TagNameDate,
+        TagNameResult, TagNameWhiteElo, TagNameBlackElo, TagNameECO, TagNameLength
+    };
+    return frequentTags.contains(name);
+}
+
+bool IndexX::isPostedTag(const QString& name)
+{
+    static const QSet<QString> postedTags =
+    {
+        TagNameWhite, TagNameBlack, TagNameEvent, TagNameSite, TagNameECO
+    };
+    return postedTags.contains(name);
+}
+
+IndexX::NumericTag IndexX::numericTag(const QString& name)
+{
+    static const QHash<QString, NumericTag> numericTags =
+    {
+        { TagNameWhiteElo, NumericWhiteElo }, { TagNameBlackElo, NumericBlackElo },
+        { TagNameDate, NumericDate }, { TagNameResult, NumericResult }, { TagNameLength, NumericLength }
+    };
+    return numericTags.value(name, NotNumeric);
+}
+
+qint32 IndexX::decodeNumeric(NumericTag tag, const QString& value)
+{
+    switch (tag)
+    {
+    case NumericWhiteElo:
+    case NumericBlackElo:
+        return qBound(0, value.toInt(), 0x7FFF);
+    case NumericLength:
+        return value.toInt();
+    case NumericResult:
+        return ResultFromString(value);
+    case NumericDate:
+    {
+        // Fast path for valid dates of the PGN form yyyy.mm.dd. A field with
+        // a '?' is unknown as a whole, as in PartialDate::fromString().
+        if (value.length() == 10 && value.at(4) == '.' && value.at(7) == '.')
+        {
+            int field[3] = { 0, 0, 0 };
+            const int start[3] = { 0, 5, 8 };
+            const int end[3] = { 4, 7, 10 };
+            bool ok = true;
+            for (int f = 0; f < 3 && ok; ++f)
+            {
+                bool unknown = false;
+                for (int i = start[f]; i < end[f] && ok; ++i)
+                {
+                    QChar c = value.at(i);
+                    if (c.isDigit())
+                    {
+                        field[f] = field[f] * 10 + c.digitValue();
+                    }
+                    else if (c == '?')
+                    {
+                        unknown = true;
+                    }
+                    else
+                    {
+                        ok = false;
+                    }
+                }
+                if (unknown)
+                {
+                    field[f] = 0;
+                }
+            }
+            // Invalid dates take the slow path, so they are packed as PartialDate does
+            if (ok && field[1] <= 12 && field[2] <= 31
+                    && (!field[0] || QDate::isValid(field[0], field[1] ? field[1] : 1, field[2] ? field[2] : 1)))
+            {
+                return (field[0] << 9) | (field[1] << 5) | field[2];
+            }
+        }
+        return PartialDate(value).packed();
+    }
+    default:
+        return 0;
+    }
+}
+
+void IndexX::setNumeric(NumericTag tag, GameId gameId, qint32 value)
+{
+    QVector<qint32>* column32 = nullptr;
+    switch (tag)
+    {
+    case NumericWhiteElo:
+    case NumericBlackElo:
+    {
+        QVector<qint16>& elo = (tag == NumericWhiteElo) ? m_whiteElo : m_blackElo;
+        if (static_cast<int>(gameId) >= elo.count())
+        {
+            if (!value)
+            {
+                return;
+            }
+            elo.resize(static_cast<int>(gameId) + 1);
+        }
+        elo[gameId] = static_cast<qint16>(value);
+        return;
+    }
+    case NumericResult:
+        if (static_cast<int>(gameId) >= m_results.count())
+        {
+            if (!value)
+            {
+                return;
+            }
+            m_results.resize(static_cast<int>(gameId) + 1);
+        }
+        m_results[gameId] = static_cast<quint8>(value);
+        return;
+    case NumericDate:
+        column32 = &m_dates;
+        break;
+    case NumericLength:
+        column32 = &m_lengths;
+        break;
+    default:
+        return;
+    }
+    if (static_cast<int>(gameId) >= column32->count())
+    {
+        if (!value)
+        {
+            return;
+        }
+        column32->resize(static_cast<int>(gameId) + 1);
+    }
+    (*column32)[gameId] = value;
+}
+
+void IndexX::calculateNumericColumn(TagIndex tagIndex)
+{
+    NumericTag tag = NumericTag(m_numericTags.value(static_cast<int>(tagIndex), NotNumeric));
+    if (tag == NotNumeric || (int)tagIndex >= m_columns.count())
+    {
+        return;
+    }
+    // Many games share a value, decode each one only once
+    QHash<ValueIndex, qint32> decoded;
+    const TagColumn& column = m_columns.at(tagIndex);
+    for (GameId gameId = 0; gameId < static_cast<GameId>(m_count); ++gameId)
+    {
+        qint32 value = 0;
+        if (column.contains(gameId))
+        {
+            ValueIndex valueIndex = column.value(gameId);
+            auto it = decoded.constFind(valueIndex);
+            if (it == decoded.constEnd())
+            {
+                it = decoded.insert(valueIndex, decodeNumeric(tag, tagValueName(valueIndex)));
+            }
+            value = it.value();
+        }
+        setNumeric(tag, gameId, value);
+    }
+}
+
 ValueIndex IndexX::AddTagValue(QString name)
 {
     ValueIndex n = qHash(name);
-    if (m_tagValues.contains(n))
+    QString stored;
+    if (storedTagValue(n, stored))
     {
-        if (m_tagValues[n] == name)
+        if (stored == name)
         {
             return n;
         }
         name.append(QChar(0));
         QString prelim;
         int i = 0;
+        bool taken;
         do {
             prelim = name + QString::number(i++);
             n = qHash(prelim);
-            if (m_tagValues.contains(n))
+            taken = storedTagValue(n, stored);
+            if (taken && stored == prelim)
             {
-                if (m_tagValues[n] == prelim)
-                {
-                    return n;
-                }
+                return n;
             }
-        } while(m_tagValues.contains(n));
+        } while(taken);
         name = prelim;
     }
     m_tagValues[n] = name;
     return n;
 }
 
+bool IndexX::storedTagValue(ValueIndex valueIndex, QString& value) const
+{
+    return lookupTagValue(m_tagValues, m_image.data(), valueIndex, value);
+}
+
+QHash<ValueIndex, QString> IndexX::allTagValues() const
+{
+    if (!m_image)
+    {
+        return m_tagValues;
+    }
+    QHash<ValueIndex, QString> values;
+    m_image->readValues(values);
+    for (auto it = m_tagValues.cbegin(); it != m_tagValues.cend(); ++it)
+    {
+        values.insert(it.key(), it.value());
+    }
+    return values;
+}
+
+void IndexX::detachTagValues()
+{
+    if (m_image)
+    {
+        m_tagValues = allTagValues();
+        m_image.reset();
+    }
+}
+
 void IndexX::setTag(const QString& tagName, const QString& value, GameId gameId)
 {
 	QWriteLocker m(&m_mutex); // PERF 10s aus 30s (aus 115s Gesamtdatei) 
@@ -95,31 +334,42 @@ void IndexX::setTag(const QString& tagName, const QString& value, GameId gameId)
 
 void IndexX::setTag_nolock(const QString& tagName, const QString& value, GameId gameId)
 {
+	publish();
 	TagIndex tagIndex = AddTagName(tagName);
 	ValueIndex valueIndex = AddTagValue(value);
 
-	if (m_indexItems.count() <= (int)gameId)
+	if (m_count <= (int)gameId)
+	{
+		m_count = (int)gameId + 1;
+	}
+	m_columns[tagIndex].set(gameId, valueIndex);
+
+	NumericTag numeric = NumericTag(m_numericTags.at(tagIndex));
+	if (numeric != NotNumeric)
 	{
-		(void) add();
+		setNumeric(numeric, gameId, decodeNumeric(numeric, value));
 	}
-	m_indexItems[gameId].set(tagIndex, valueIndex);
 }
 
 void IndexX::removeTag(const QString& tagName, GameId gameId)
 {
     QWriteLocker m(&m_mutex);
+    publish();
     if(m_tagNameIndex.contains(tagName))
     {
         TagIndex tagIndex = m_tagNameIndex.value(tagName);
-        if((int)gameId < m_indexItems.count())
+        if((int)gameId < m_count && (int)tagIndex < m_columns.count())
         {
-            m_indexItems[gameId].remove(tagIndex);
+            m_columns[tagIndex].remove(gameId);
+            setNumeric(NumericTag(m_numericTags.value(static_cast<int>(tagIndex), NotNumeric)), gameId, 0);
         }
     }
 }
 
 void IndexX::setValidFlag(GameId gameId, bool value)
 {
+    QWriteLocker m(&m_mutex);
+    publish();
     if (!value)
     {
         m_validFlags.insert(gameId);
@@ -144,26 +394,28 @@ bool IndexX::replaceTagValue(const QStringList& tags, const QString& newValue, c
         }
     }
     ValueIndex valueIndex = getValueIndex(oldValue);
-    if(!ok || !m_tagValues.contains(valueIndex))
+    QString stored;
+    if(!ok || !storedTagValue(valueIndex, stored))
     {
         return false;
     }
     ValueIndex newIndex = getValueIndex(newValue);
+    publish();
+    detachTagValues();
 
     if (!m_tagValues.contains(newIndex))
     {
         (void) AddTagValue(newValue); // Adds newIndex-newValue pair, return must be newIndex
     }
 
-    QList<TagIndex> tl;
     foreach (QString t, tags)
     {
-        tl << getTagIndex(t);
-    }
-
-     for (auto i = m_indexItems.begin(); i != m_indexItems.end(); ++i)
-    {
-        i->replaceValue(tl, valueIndex, newIndex);
+        TagIndex tagIndex = getTagIndex(t);
+        if (tagIndex != TagNoIndex && (int)tagIndex < m_columns.count())
+        {
+            m_columns[tagIndex].replaceValue(valueIndex, newIndex);
+            calculateNumericColumn(tagIndex);
+        }
     }
 
     m_tagValues.remove(valueIndex);
@@ -176,24 +428,125 @@ bool IndexX::isValidFlag(GameId gameId) const
     return !m_validFlags.contains(gameId);
 }
 
-bool IndexX::write(QDataStream &out) const
+int IndexX::elo(GameId gameId, Color color) const
+{
+    QReadLocker m(&m_mutex);
+    const QVector<qint16>& elo = (color == Black) ? m_blackElo : m_whiteElo;
+    return elo.value(static_cast<int>(gameId));
+}
+
+PartialDate IndexX::date(GameId gameId) const
+{
+    QReadLocker m(&m_mutex);
+    return PartialDate::fromPacked(m_dates.value(static_cast<int>(gameId)));
+}
+
+Result IndexX::result(GameId gameId) const
+{
+    QReadLocker m(&m_mutex);
+    return Result(m_results.value(static_cast<int>(gameId)));
+}
+
+int IndexX::length(GameId gameId) const
 {
     QReadLocker m(&m_mutex);
+    return m_lengths.value(static_cast<int>(gameId));
+}
 
-    out << m_tagNames;
-    out << m_tagValues;
-	out << m_indexItems;
-    out << m_validFlags;
+void IndexX::setSignature(GameId gameId, const GameSignature& signature)
+{
+    QWriteLocker m(&m_mutex);
+    if (static_cast<int>(gameId) >= m_signatures.count())
+    {
+        if (!signature.isValid())
+        {
+            return;
+        }
+        m_signatures.resize(static_cast<int>(gameId) + 1);
+    }
+    m_signatures[gameId] = signature;
+}
 
-    bool extension = false;
-    out << extension;
+GameSignature IndexX::signature(GameId gameId) const
+{
+    QReadLocker m(&m_mutex);
+    return static_cast<int>(gameId) < m_signatures.count() ? m_signatures.at(gameId) : GameSignature();
+}
 
+void IndexX::setFingerprint(GameId gameId, const GameFingerprint& fingerprint)
+{
+    QWriteLocker m(&m_mutex);
+    if (static_cast<int>(gameId) >= m_fingerprints.count())
+    {
+        if (!fingerprint.isValid())
+        {
+            return;
+        }
+        m_fingerprints.resize(static_cast<int>(gameId) + 1);
+    }
+    m_fingerprints[gameId] = fingerprint;
+}
+
+GameFingerprint IndexX::fingerprint(GameId gameId) const
+{
+    QReadLocker m(&m_mutex);
+    return static_cast<int>(gameId) < m_fingerprints.count() ? m_fingerprints.at(gameId) : GameFingerprint();
+}
+
+bool IndexX::hasSignatures() const
+{
+    QReadLocker m(&m_mutex);
+    return !m_signatures.isEmpty();
+}
+
+void IndexX::writeSignatures(QDataStream& out) const
+{
+    QReadLocker m(&m_mutex);
+    out << m_signatures;
+}
+
+bool IndexX::readSignatures(QDataStream& in)
+{
+    QWriteLocker m(&m_mutex);
+    in >> m_signatures;
+    if (in.status() != QDataStream::Ok || m_signatures.count() > m_count)
+    {
+        m_signatures.clear();
+        return false;
+    }
     return true;
 }
 
+bool IndexX::write(QDataStream &out) const
+{
+    QReadLocker m(&m_mutex);
+
+    IndexImageWriter writer(m_count);
+    writer.setValues(allTagValues());
+    // Tag names are numbered from 0 without gaps, see AddTagName()
+    for (int tagIndex = 0; tagIndex < m_columns.count(); ++tagIndex)
+    {
+        writer.addColumn(m_tagNames.value(tagIndex), m_columns.at(tagIndex));
+    }
+    writer.setInvalidGames(m_validFlags);
+    writer.setNumeric(IndexImage::WhiteEloColumn, m_whiteElo);
+    writer.setNumeric(IndexImage::BlackEloColumn, m_blackElo);
+    writer.setNumeric(IndexImage::DateColumn, m_dates);
+    writer.setNumeric(IndexImage::ResultColumn, m_results);
+    writer.setNumeric(IndexImage::LengthColumn, m_lengths);
+
+    QByteArray image = writer.data();
+    out << static_cast<quint32>(image.size());
+    return out.writeRawData(image.constData(), image.size()) == image.size();
+}
+
 void IndexX::reserve(quint32 estimation)
 {
     m_tagValues.reserve(estimation+16);
+    for (auto it = m_columns.begin(); it != m_columns.end(); ++it)
+    {
+        it->reserve(static_cast<int>(estimation));
+    }
     qDebug() << "Index space " << m_tagValues.capacity();
 }
 
@@ -201,23 +554,204 @@ void IndexX::squeeze()
 {
     qDebug() << "Index space " << m_tagValues.capacity();
     m_tagValues.squeeze();
+    for (auto it = m_columns.begin(); it != m_columns.end(); ++it)
+    {
+        it->squeeze();
+    }
+    m_signatures.squeeze();
+    m_fingerprints.squeeze();
+    m_whiteElo.squeeze();
+    m_blackElo.squeeze();
+    m_dates.squeeze();
+    m_results.squeeze();
+    m_lengths.squeeze();
     qDebug() << "Index space " << m_tagValues.capacity();
 }
 
-bool IndexX::read(QDataStream &in, volatile bool *breakFlag, short version)
+void IndexX::appendIndex(const IndexX& other)
 {
-    Q_UNUSED(version);
+    QWriteLocker m(&m_mutex);
+    publish();
+    QReadLocker o(&other.m_mutex);
 
+    QVector<TagIndex> tagMap(other.m_columns.count(), TagNoIndex);
+    for (auto it = other.m_tagNames.cbegin(); it != other.m_tagNames.cend(); ++it)
+    {
+        if ((int)it.key() < tagMap.count())
+        {
+            tagMap[it.key()] = AddTagName(it.value());
+        }
+    }
+
+    const QHash<ValueIndex, QString> otherValues = other.allTagValues();
+    QHash<ValueIndex, ValueIndex> valueMap;
+    valueMap.reserve(otherValues.count());
+    for (auto it = otherValues.cbegin(); it != otherValues.cend(); ++it)
+    {
+        valueMap.insert(it.key(), AddTagValue(other.tagValueName(it.key())));
+    }
+
+    GameId base = static_cast<GameId>(m_count);
+    for (int tagIndex = 0; tagIndex < other.m_columns.count(); ++tagIndex)
+    {
+        if (tagMap.at(tagIndex) == TagNoIndex)
+        {
+            continue;
+        }
+        const TagColumn& column = other.m_columns.at(tagIndex);
+        TagColumn& target = m_columns[tagMap.at(tagIndex)];
+        for (GameId gameId = 0; gameId < static_cast<GameId>(other.m_count); ++gameId)
+        {
+            if (column.contains(gameId))
+            {
+                target.set(base + gameId, valueMap.value(column.value(gameId)));
+            }
+        }
+    }
+
+    if (!other.m_signatures.isEmpty())
+    {
+        m_signatures.resize(static_cast<int>(base));
+        m_signatures += other.m_signatures;
+    }
+    if (!other.m_fingerprints.isEmpty())
+    {
+        m_fingerprints.resize(static_cast<int>(base));
+        m_fingerprints += other.m_fingerprints;
+    }
+    appendNumeric(m_whiteElo, other.m_whiteElo, base);
+    appendNumeric(m_blackElo, other.m_blackElo, base);
+    appendNumeric(m_dates, other.m_dates, base);
+    appendNumeric(m_results, other.m_results, base);
+    appendNumeric(m_lengths, other.m_lengths, base);
+
+    foreach (GameId gameId, other.m_validFlags)
+    {
+        m_validFlags.insert(base + gameId);
+    }
+    foreach (GameId gameId, other.m_deletedGames)
+    {
+        m_deletedGames.insert(base + gameId);
+    }
+    m_count += other.m_count;
+}
+
+bool IndexX::read(QDataStream &in, volatile bool *breakFlag, short version)
+{
     QWriteLocker m(&m_mutex);
+    publish();
+
+    m_image.reset();
+    if (version >= VERSION_INDEX_1_7)
+    {
+        return readImage(in, breakFlag);
+    }
+    return readStream(in, breakFlag);
+}
 
+bool IndexX::readImage(QDataStream& in, volatile bool* breakFlag)
+{
+    quint32 size;
+    in >> size;
+    QSharedPointer<const IndexImage> image = IndexImage::load(in, size);
+    if (!image)
+    {
+        clear();
+        return false;
+    }
+
+    // Only the tag names are decoded, values and columns stay in the image
+    m_image = image;
+    m_tagValues.clear();
+    m_tagNames.clear();
+    m_columns.clear();
+    m_numericTags.clear();
+    for (int tagIndex = 0; tagIndex < image->tagCount(); ++tagIndex)
+    {
+        QString name = image->tagName(tagIndex);
+        m_tagNames.insert(static_cast<TagIndex>(tagIndex), name);
+        m_columns.append(TagColumn(image, tagIndex));
+        m_numericTags.append(numericTag(name));
+    }
+    m_count = image->count();
+    m_validFlags = image->invalidGames();
+    m_deletedGames.clear();
+    m_fingerprints.clear();
+    m_whiteElo = image->numeric<qint16>(IndexImage::WhiteEloColumn);
+    m_blackElo = image->numeric<qint16>(IndexImage::BlackEloColumn);
+    m_dates = image->numeric<qint32>(IndexImage::DateColumn);
+    m_results = image->numeric<quint8>(IndexImage::ResultColumn);
+    m_lengths = image->numeric<qint32>(IndexImage::LengthColumn);
+
+    m_tagNameIndex.clear();
+
+    calculateCache(breakFlag);
+
+    return !(*breakFlag);
+}
+
+bool IndexX::readStream(QDataStream& in, volatile bool* breakFlag)
+{
     in >> m_tagNames;
     in >> m_tagValues;
-	in >> m_indexItems;
+
+    m_columns.clear();
+    m_numericTags.clear();
+    for (auto it = m_tagNames.cbegin(); it != m_tagNames.cend(); ++it)
+    {
+        if ((int)it.key() >= m_columns.count())
+        {
+            m_columns.resize((int)it.key() + 1);
+            m_numericTags.resize((int)it.key() + 1);
+        }
+        m_columns[it.key()] = TagColumn(isFrequentTag(it.value()), isPostedTag(it.value()));
+        m_numericTags[it.key()] = numericTag(it.value());
+    }
+
+    quint32 count;
+    in >> count;
+    m_count = 0;
+    for (quint32 gameId = 0; gameId < count && in.status() == QDataStream::Ok; ++gameId)
+    {
+        if (breakFlag && *breakFlag && (gameId % 1024 == 0))
+        {
+            return false;
+        }
+        IndexItem item;
+        in >> item;
+        foreach (TagIndex tagIndex, item.getTagIndices())
+        {
+            if ((int)tagIndex >= m_columns.count())
+            {
+                m_columns.resize((int)tagIndex + 1);
+            }
+            m_columns[tagIndex].set(gameId, item.valueIndex(tagIndex));
+        }
+        ++m_count;
+    }
     in >> m_validFlags;
-    
+
 	bool extension;
     in >> extension;
 
+    m_fingerprints.clear();
+    m_whiteElo.clear();
+    m_blackElo.clear();
+    m_dates.clear();
+    m_results.clear();
+    m_lengths.clear();
+    if (extension)
+    {
+        in >> m_whiteElo >> m_blackElo >> m_dates >> m_results >> m_lengths;
+    }
+    if (!extension || in.status() != QDataStream::Ok)
+    {
+        for (int tagIndex = 0; tagIndex < m_numericTags.count(); ++tagIndex)
+        {
+            calculateNumericColumn(static_cast<TagIndex>(tagIndex));
+        }
+    }
+
     m_tagNameIndex.clear();
 
     calculateCache(breakFlag);
@@ -228,6 +762,7 @@ bool IndexX::read(QDataStream &in, volatile bool *breakFlag, short version)
 void IndexX::clearCache()
 {
     QWriteLocker m(&m_mutex);
+    publish();
     m_tagNameIndex.clear();
 }
 
@@ -260,72 +795,185 @@ void IndexX::init()
 void IndexX::clear()
 {
     QWriteLocker m(&m_mutex);
-    m_indexItems.clear();
+    publish();
+    m_columns.clear();
+    m_count = 0;
     m_tagNames.clear();
     m_tagNameIndex.clear();
     m_tagValues.clear();
+    m_image.reset();
     m_deletedGames.clear();
     m_validFlags.clear();
+    m_signatures.clear();
+    m_fingerprints.clear();
+    m_numericTags.clear();
+    m_whiteElo.clear();
+    m_blackElo.clear();
+    m_dates.clear();
+    m_results.clear();
+    m_lengths.clear();
     init(); // Just to make sure that the index can be used after clearing
 }
 
 int IndexX::count() const
 {
-    return m_indexItems.count();
+    return m_count;
 }
 
-QBitArray IndexX::listInSet(const QString& tagName, const QSet<QString>& set) const
+template <class Predicate>
+QBitArray IndexX::listMatching(const QString& tagName, Predicate matches) const
 {
-    QReadLocker m(&m_mutex);
-
     TagIndex tagIndex = m_tagNameIndex.value(tagName);
 
     QBitArray list(count(), false);
-    for(int i = 0; i < count(); ++i)
+    // Games without the tag have value 0
+    bool missing = matches(tagValueName(0));
+    if ((int)tagIndex >= m_columns.count())
     {
-        QString value = tagValue(tagIndex, i);
-        bool b = false;
-        foreach(QString s, set)
+        list.fill(missing);
+        return list;
+    }
+
+    // Test every distinct value once instead of the value of every game
+    const TagColumn& column = m_columns.at(tagIndex);
+    QSet<ValueIndex> distinct;
+    collectValues(tagIndex, distinct);
+    distinct.remove(0);
+    const QVector<ValueIndex> values = distinct.values().toVector();
+    QVector<char> matched(values.count(), 0);
+    char* out = matched.data();
+    auto test = [&](Predicate& predicate, int first, int last)
+    {
+        for (int k = first; k < last; ++k)
         {
-            if (value.contains(s, Qt::CaseInsensitive))
+            out[k] = predicate(tagValueName(values.at(k))) ? 1 : 0;
+        }
+    };
+    if (values.count() < ParallelMatchValues)
+    {
+        test(matches, 0, values.count());
+    }
+    else
+    {
+        // Each batch uses its own copy of the predicate, a QRegExp keeps its match state
+        ParallelFor::run(values.count(), MatchBatchSize, [&](int first, int last)
+        {
+            Predicate predicate(matches);
+            test(predicate, first, last);
+        });
+    }
+
+    if (column.hasPostings())
+    {
+        // Only the games of values with another outcome than a missing tag are set
+        if (missing)
+        {
+            list.fill(true);
+        }
+        for (int k = 0; k < values.count(); ++k)
+        {
+            if ((matched.at(k) != 0) != missing)
             {
-                b = true;
-                break;
+                foreach (GameId gameId, column.games(values.at(k)))
+                {
+                    list.setBit(gameId, !missing);
+                }
             }
         }
-        list.setBit(i, b);
+        return list;
+    }
+
+    QSet<ValueIndex> hits;
+    if (missing)
+    {
+        hits.insert(0);
+    }
+    for (int k = 0; k < values.count(); ++k)
+    {
+        if (matched.at(k))
+        {
+            hits.insert(values.at(k));
+        }
+    }
+    for (int i = 0; i < count(); ++i)
+    {
+        list.setBit(i, hits.contains(column.value(i)));
     }
     return list;
 }
 
+QBitArray IndexX::listInSet(const QString& tagName, const QSet<QString>& set) const
+{
+    QReadLocker m(&m_mutex);
+
+    return listMatching(tagName, [&set](const QString& value)
+    {
+        foreach(QString s, set)
+        {
+            if (value.contains(s, Qt::CaseInsensitive))
+            {
+                return true;
+            }
+        }
+        return false;
+    });
+}
+
 QBitArray IndexX::listInRange(const QString& tagName, const QString& minValue, const QString& maxValue) const
 {
     QReadLocker m(&m_mutex);
 
-    TagIndex tagIndex = m_tagNameIndex.value(tagName);
+    return listMatching(tagName, [&minValue, &maxValue](const QString& value)
+    {
+        return (minValue <= value) && (value <= maxValue);
+    });
+}
 
+template <class T>
+QBitArray IndexX::listInNumericRange(const QVector<T>& column, qint32 minValue, qint32 maxValue) const
+{
     QBitArray list(count(), false);
-    for(int i = 0; i < count(); ++i)
+    // Games beyond the end of the column have value 0
+    if (minValue <= 0 && 0 <= maxValue)
     {
-        QString value = tagValue(tagIndex, i);
+        list.fill(true);
+    }
+    const int n = qMin(column.count(), count());
+    for (int i = 0; i < n; ++i)
+    {
+        qint32 value = column.at(i);
         list.setBit(i, (minValue <= value) && (value <= maxValue));
     }
     return list;
 }
 
-QBitArray IndexX::listInRange(const QString &tagName, int minValue, int maxValue) const
+QBitArray IndexX::listInDateRange(const PartialDate& minDate, const PartialDate& maxDate) const
 {
     QReadLocker m(&m_mutex);
+    return listInNumericRange(m_dates, minDate.packed(), maxDate.packed());
+}
 
-    TagIndex tagIndex = m_tagNameIndex.value(tagName);
+QBitArray IndexX::listInRange(const QString &tagName, int minValue, int maxValue) const
+{
+    QReadLocker m(&m_mutex);
 
-    QBitArray list(count(), false);
-    for(int i = 0; i < count(); ++i)
+    switch (numericTag(tagName))
     {
-        int value = tagValue(tagIndex, i).toInt();
-        list.setBit(i, (minValue <= value) && (value <= maxValue));
+    case NumericWhiteElo:
+        return listInNumericRange(m_whiteElo, minValue, maxValue);
+    case NumericBlackElo:
+        return listInNumericRange(m_blackElo, minValue, maxValue);
+    case NumericLength:
+        return listInNumericRange(m_lengths, minValue, maxValue);
+    default:
+        break;
     }
-    return list;
+
+    return listMatching(tagName, [minValue, maxValue](const QString& gameValue)
+    {
+        int value = gameValue.toInt();
+        return (minValue <= value) && (value <= maxValue);
+    });
 }
 
 QBitArray IndexX::listPartialValue(const QString& tagName, QString value) const
@@ -334,30 +982,26 @@ QBitArray IndexX::listPartialValue(const QString& tagName, QString value) const
     value.replace("-","\\-"); // Avoid - to become range
     value.replace("(","\\("); // Avoid () to become regex
     value.replace(")","\\)");
-    TagIndex tagIndex = m_tagNameIndex.value(tagName);
     QRegExp re(value);
     re.setCaseSensitivity(Qt::CaseInsensitive);
-    QBitArray list(count(), false);
-    for(int i = 0; i < count(); ++i)
+    return listMatching(tagName, [re](const QString& gameValue)
     {
-        QString gameValue = tagValue(tagIndex, i);
-        list.setBit(i, gameValue.contains(re));
-    }
-    return list;
+        return gameValue.contains(re);
+    });
 }
 
 QString IndexX::tagValue_byIndex(TagIndex tagIndex, GameId gameId) const
 {
     QReadLocker m(&m_mutex);
 
-    ValueIndex valueIndex = m_indexItems[gameId].valueIndex(tagIndex);
+    ValueIndex valueIndex = valueIndexFromIndex(tagIndex, gameId);
 
     return tagValueName(valueIndex);
 }
 
 QString IndexX::tagValue(TagIndex tagIndex, GameId gameId) const
 {
-    ValueIndex valueIndex = m_indexItems[gameId].valueIndex(tagIndex);
+    ValueIndex valueIndex = valueIndexFromIndex(tagIndex, gameId);
 
     return tagValueName(valueIndex);
 }
@@ -369,7 +1013,8 @@ QString IndexX::tagName(TagIndex tagIndex) const
 
 QString IndexX::tagValueName(ValueIndex valueIndex) const
 {
-    QString r = m_tagValues.value(valueIndex);
+    QString r;
+    storedTagValue(valueIndex, r);
     return r.section(QChar(0),0,0);
 }
 
@@ -387,14 +1032,40 @@ ValueIndex IndexX::valueIndexFromTag(const QString& tagName, GameId gameId) cons
     return valueIndexFromIndex(tagIndex, gameId);
 }
 
+QVector<GameId> IndexX::gamesWithValue(const QString& tagName, ValueIndex valueIndex) const
+{
+    QReadLocker m(&m_mutex);
+    TagIndex tagIndex = getTagIndex(tagName);
+    if (tagIndex == TagNoIndex || (int)tagIndex >= m_columns.count())
+    {
+        return QVector<GameId>();
+    }
+
+    const TagColumn& column = m_columns.at(tagIndex);
+    if (column.hasPostings())
+    {
+        return column.games(valueIndex);
+    }
+
+    QVector<GameId> games;
+    for (int i = 0; i < m_count; ++i)
+    {
+        if (column.contains(i) && column.value(i) == valueIndex)
+        {
+            games.append(i);
+        }
+    }
+    return games;
+}
+
 bool IndexX::indexItemHasTag(TagIndex tagIndex, GameId gameId) const
 {
-    return m_indexItems[gameId].hasTagIndex(tagIndex);
+    return ((int)tagIndex < m_columns.count()) && m_columns.at(tagIndex).contains(gameId);
 }
 
 inline ValueIndex IndexX::valueIndexFromIndex(TagIndex tagIndex, GameId gameId) const
 {
-    return m_indexItems[gameId].valueIndex(tagIndex);
+    return (tagIndex < static_cast<TagIndex>(m_columns.count())) ? m_columns.at(tagIndex).value(gameId) : 0;
 }
 
 TagIndex IndexX::getTagIndex(const QString& value) const
@@ -410,26 +1081,26 @@ ValueIndex IndexX::getValueIndex(QString name) const
 {
     ValueIndex n = qHash(name);
 
-    if (m_tagValues.contains(n))
+    QString stored;
+    if (storedTagValue(n, stored))
     {
-        if (m_tagValues[n] == name)
+        if (stored == name)
         {
             return n;
         }
         name.append(QChar(0));
         QString prelim;
         int i = 0;
+        bool taken;
         do {
             prelim = name + QString::number(i++);
             n = qHash(prelim);
-            if (m_tagValues.contains(n))
+            taken = storedTagValue(n, stored);
+            if (taken && stored == prelim)
             {
-                if (m_tagValues[n] == prelim)
-                {
-                    return n;
-                }
+                return n;
             }
-        } while(m_tagValues.contains(n));
+        } while(taken);
     }
 
     return n;
@@ -443,9 +1114,15 @@ unsigned int IndexX::hashIndexItem(GameId gameId) const
 bool IndexX::isIndexItemEqual(GameId i, GameId j) const
 {
     QReadLocker m(&m_mutex);
-    const IndexItem& iItem = m_indexItems.value(i);
-    const IndexItem& jItem = m_indexItems.value(j);
-    return (iItem.isEqual(jItem));
+    for (auto it = m_columns.cbegin(); it != m_columns.cend(); ++it)
+    {
+        bool inI = it->contains(i);
+        if (inI != it->contains(j) || (inI && it->value(i) != it->value(j)))
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
 void IndexX::loadGameHeaders(GameId id, GameX& game) const
@@ -453,10 +1130,12 @@ void IndexX::loadGameHeaders(GameId id, GameX& game) const
     QReadLocker m(&m_mutex);
 
     game.clearTags();
-    foreach(TagIndex tagIndex, m_indexItems[id].getTagIndices())
+    for (int tagIndex = 0; tagIndex < m_columns.count(); ++tagIndex)
     {
-        // qDebug() << "lGH>" << &game << " " << id << " " << tagName(tagIndex) << " " << tagValue(tagIndex, id);
-        game.setTag(tagName(tagIndex), tagValue(tagIndex, id));
+        if (m_columns.at(tagIndex).contains(id))
+        {
+            game.setTag(tagName(tagIndex), tagValue(tagIndex, id));
+        }
     }
 }
 
@@ -478,21 +1157,13 @@ QStringList IndexX::playerNames() const
     TagIndex tagIndex = getTagIndex(TagNameWhite);
     if(tagIndex != TagNoIndex)
     {
-        QVector<IndexItem>::const_iterator i;
-		for (i = m_indexItems.constBegin(); i != m_indexItems.constEnd(); ++i)
-		{
-            playerNameIndex.insert(i->valueIndex(tagIndex));
-		}
+        collectValues(tagIndex, playerNameIndex);
     }
 
     tagIndex = getTagIndex(TagNameBlack);
     if(tagIndex != TagNoIndex)
     {
-        QVector<IndexItem>::const_iterator i;
-		for (i = m_indexItems.constBegin(); i != m_indexItems.constEnd(); ++i)
-		{
-            playerNameIndex.insert(i->valueIndex(tagIndex));
-		}
+        collectValues(tagIndex, playerNameIndex);
 	}
 
     foreach(ValueIndex valueIndex, playerNameIndex)
@@ -512,15 +1183,32 @@ QSet<ValueIndex> IndexX::tagValueSet(const QString& tagName) const
 
 	if (tagIndex != TagNoIndex)
 	{
-        QVector<IndexItem>::const_iterator i;
-		for (i = m_indexItems.constBegin(); i != m_indexItems.constEnd(); ++i)
-		{
-            tagNameIndex.insert(i->valueIndex(tagIndex));
-		}
+        collectValues(tagIndex, tagNameIndex);
 	}
 	return tagNameIndex;
 }
 
+void IndexX::collectValues(TagIndex tagIndex, QSet<ValueIndex>& values) const
+{
+    const TagColumn& column = m_columns.at(tagIndex);
+    if (column.hasPostings())
+    {
+        foreach (ValueIndex valueIndex, column.postedValues())
+        {
+            values.insert(valueIndex);
+        }
+        if (column.postingCount() < m_count)
+        {
+            values.insert(0);
+        }
+        return;
+    }
+    for (int i = 0; i < m_count; ++i)
+    {
+        values.insert(column.value(i));
+    }
+}
+
 QStringList IndexX::tagValues(const QString& tagName) const
 {
 	QStringList allTagNames;
@@ -534,11 +1222,14 @@ QStringList IndexX::tagValues(const QString& tagName) const
 
 bool IndexX::deleted(GameId gameId) const
 {
+    QReadLocker m(&m_mutex);
     return m_deletedGames.contains(gameId);
 }
 
 void IndexX::setDeleted(GameId gameId, bool df)
 {
+    QWriteLocker m(&m_mutex);
+    publish();
     if (df)
     {
         m_deletedGames.insert(gameId);
@@ -548,3 +1239,118 @@ void IndexX::setDeleted(GameId gameId, bool df)
         m_deletedGames.remove(gameId);
     }
 }
+
+void IndexX::publish()
+{
+    m_version.fetchAndAddRelease(1);
+}
+
+int IndexX::version() const
+{
+    return m_version.loadAcquire();
+}
+
+IndexX::Snapshot IndexX::snapshot() const
+{
+    QReadLocker m(&m_mutex);
+    Snapshot snapshot;
+    snapshot.m_index = this;
+    snapshot.m_version = m_version.loadAcquire();
+    snapshot.m_count = m_count;
+    snapshot.m_tagNameIndex = m_tagNameIndex;
+    snapshot.m_tagValues = m_tagValues;
+    snapshot.m_image = m_image;
+    snapshot.m_columns = m_columns;
+    snapshot.m_validFlags = m_validFlags;
+    snapshot.m_deletedGames = m_deletedGames;
+    snapshot.m_whiteElo = m_whiteElo;
+    snapshot.m_blackElo = m_blackElo;
+    snapshot.m_dates = m_dates;
+    snapshot.m_results = m_results;
+    snapshot.m_lengths = m_lengths;
+    return snapshot;
+}
+
+IndexX::Snapshot::Snapshot() : m_index(nullptr), m_version(0), m_count(0)
+{
+}
+
+bool IndexX::Snapshot::isCurrent(const IndexX* index) const
+{
+    return index && m_index == index && m_version == index->version();
+}
+
+int IndexX::Snapshot::version() const
+{
+    return m_version;
+}
+
+int IndexX::Snapshot::count() const
+{
+    return m_count;
+}
+
+QString IndexX::Snapshot::tagValue(const QString& tagName, GameId gameId) const
+{
+    return tagValue(m_tagNameIndex.value(tagName), gameId);
+}
+
+QString IndexX::Snapshot::tagValue(TagIndex tagIndex, GameId gameId) const
+{
+    ValueIndex valueIndex = ((int)tagIndex < m_columns.count()) ? m_columns.at(tagIndex).value(gameId) : 0;
+    return tagValueName(valueIndex);
+}
+
+ValueIndex IndexX::Snapshot::valueIndexFromTag(const QString& tagName, GameId gameId) const
+{
+    TagIndex tagIndex = m_tagNameIndex.value(tagName);
+    return (tagIndex < static_cast<TagIndex>(m_columns.count())) ? m_columns.at(tagIndex).value(gameId) : 0;
+}
+
+QString IndexX::Snapshot::tagValueName(ValueIndex valueIndex) const
+{
+    QString r;
+    lookupTagValue(m_tagValues, m_image.data(), valueIndex, r);
+    return r.section(QChar(0),0,0);
+}
+
+TagIndex IndexX::Snapshot::tagIndex(const QString& tagName) const
+{
+    return m_tagNameIndex.value(tagName, TagNoIndex);
+}
+
+ValueIndex IndexX::Snapshot::valueIndex(TagIndex tagIndex, GameId gameId) const
+{
+    return (tagIndex < static_cast<TagIndex>(m_columns.count())) ? m_columns.at(tagIndex).value(gameId) : 0;
+}
+
+bool IndexX::Snapshot::isValidFlag(GameId gameId) const
+{
+    return !m_validFlags.contains(gameId);
+}
+
+bool IndexX::Snapshot::deleted(GameId gameId) const
+{
+    return m_deletedGames.contains(gameId);
+}
+
+int IndexX::Snapshot::elo(GameId gameId, Color color) const
+{
+    const QVector<qint16>& elo = (color == Black) ? m_blackElo : m_whiteElo;
+    return elo.value(static_cast<int>(gameId));
+}
+
+PartialDate IndexX::Snapshot::date(GameId gameId) const
+{
+    return PartialDate::fromPacked(m_dates.value(static_cast<int>(gameId)));
+}
+
+Result IndexX::Snapshot::result(GameId gameId) const
+{
+    return Result(m_results.value(static_cast<int>(gameId)));
+}
+
+int IndexX::Snapshot::length(GameId gameId) const
+{
+    return m_lengths.value(static_cast<int>(gameId));
+}
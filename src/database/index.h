@@ -12,28 +12,48 @@
 #ifndef INDEX_H_INCLUDED
 #define INDEX_H_INCLUDED
 
+#include <QAtomicInt>
 #include <QList>
 #include <QPair>
 #include <QObject>
 #include <QSet>
 #include <QReadWriteLock>
+#include <QSharedPointer>
 #include <QVector>
 
 #include "indexitem.h"
+#include "gamefingerprint.h"
+#include "gamesignature.h"
 #include "gamex.h"
+#include "partialdate.h"
+#include "piece.h"
+#include "result.h"
+#include "tagcolumn.h"
 
 #define VERSION_INDEX_1_2 0x0001
 #define VERSION_INDEX_1_3 0x0002
 #define VERSION_INDEX_1_4 0x0101
 #define VERSION_INDEX_1_5 0x0201
-#define VERSION_INDEX_CURRENT VERSION_INDEX_1_5
+#define VERSION_INDEX_1_6 0x0202
+#define VERSION_INDEX_1_7 0x0203
+#define VERSION_INDEX_CURRENT VERSION_INDEX_1_7
 
 #define INDEX_FILE_MAGIC 0xce55
 
+class IndexImage;
+
 /** @ingroup Database
- * The Index class holds a list of IndexItem instances, typically one
- * for each game in the current database. This enables fast access to
- * game header information.
+ * The Index class holds the header information of all games in the
+ * current database. Tag values are stored column-wise, one TagColumn
+ * per tag name, which enables fast access to and scans over game header
+ * information.
+ *
+ * The Elo, Date, Result and Length tags are decoded into numeric columns
+ * as well, so that searches and statistics need not parse the strings.
+ *
+ * Since version 1.7 the index is stored as an IndexImage, which is mapped
+ * when the index is read. Tag values and columns are looked up in the image
+ * until they are changed, so opening a database does not rebuild them.
  *
  */
 
@@ -81,6 +101,10 @@ public:
     /** @ret the value index number of a tags name @p value for a given game */
     ValueIndex valueIndexFromTag(const QString& tagName, GameId gameId) const;
 
+    /** @ret the sorted list of games where @p tagName has the value @p valueIndex.
+        Player, event, site and ECO tags are looked up in postings, other tags are scanned. */
+    QVector<GameId> gamesWithValue(const QString& tagName, ValueIndex valueIndex) const;
+
     /** Get the list of tagValues for a given @p tagName */
     QStringList tagValues(const QString& tagName) const;
 	
@@ -103,6 +127,45 @@ public:
     /** Get the valid flag accordingly */
     bool isValidFlag(GameId gameId) const;
 
+    // Decoded numeric tags
+    //
+    /** @ret the Elo of the player of @p color in game @p gameId, 0 if unknown */
+    int elo(GameId gameId, Color color) const;
+
+    /** @ret the date of game @p gameId */
+    PartialDate date(GameId gameId) const;
+
+    /** @ret the result of game @p gameId */
+    Result result(GameId gameId) const;
+
+    /** @ret the value of the Length tag of game @p gameId, 0 if unknown */
+    int length(GameId gameId) const;
+
+    // Position search signatures
+    //
+    /** Store the main line signature of game @p gameId */
+    void setSignature(GameId gameId, const GameSignature& signature);
+
+    /** @ret the main line signature of game @p gameId, it is unknown if none was stored */
+    GameSignature signature(GameId gameId) const;
+
+    /** @ret true if the signature of at least one game is known */
+    bool hasSignatures() const;
+
+    /** Write the signatures of all games */
+    void writeSignatures(QDataStream& out) const;
+
+    /** Read the signatures written by writeSignatures() */
+    bool readSignatures(QDataStream& in);
+
+    // Duplicate search fingerprints
+    //
+    /** Store the fingerprint of game @p gameId */
+    void setFingerprint(GameId gameId, const GameFingerprint& fingerprint);
+
+    /** @ret the fingerprint of game @p gameId, it is unknown if none was stored */
+    GameFingerprint fingerprint(GameId gameId) const;
+
     // Searching tags //
     //
     /** Returns a bit array to indicate which games in index have a tag value in given range */
@@ -111,6 +174,9 @@ public:
     /** Returns a bit array to indicate which games in index have a tag value in given range */
     QBitArray listInRange(const QString& tag, int minValue, int maxValue) const;
 
+    /** Returns a bit array to indicate which games in index have a date in given range */
+    QBitArray listInDateRange(const PartialDate& minDate, const PartialDate& maxDate) const;
+
     /** Returns a bit array to indicate which games in index have a tag value which somewhat matches */
     QBitArray listPartialValue(const QString& tagName, QString value) const;
 
@@ -156,6 +222,73 @@ public:
     /** Reserve space for @p estimation games */
     void reserve(quint32 estimation);
 
+    /** Append all games of @p other, its tag and value indices are remapped into this index */
+    void appendIndex(const IndexX& other);
+
+    // Lock-free reading //
+    //
+    /** The Snapshot class is an immutable view of the game headers of an
+        index. Taking it locks the index once, reading from it does not lock
+        at all, so that loops over many games and several threads may use it.
+        The containers of the index are implicitly shared: a change of the
+        index detaches its own copy and leaves the snapshot as it was taken. */
+    class Snapshot
+    {
+    public:
+        /** Creates an empty snapshot, which belongs to no index */
+        Snapshot();
+
+        /** @ret true if the snapshot was taken from @p index and it did not change since */
+        bool isCurrent(const IndexX* index) const;
+        /** @ret the version of the index when the snapshot was taken */
+        int version() const;
+        /** @ret number of games at the time the snapshot was taken */
+        int count() const;
+
+        /** Get the tag @p tagName for given game index @p gameId */
+        QString tagValue(const QString& tagName, GameId gameId) const;
+        /** Query the value of a tag given the tags index for a specific game */
+        QString tagValue(TagIndex tagIndex, GameId gameId) const;
+        /** @ret the value index number of a tags name @p value for a given game */
+        ValueIndex valueIndexFromTag(const QString& tagName, GameId gameId) const;
+        /** Get the name of a @p valueIndex */
+        QString tagValueName(ValueIndex valueIndex) const;
+        /** @ret the tag index of @p tagName, TagNoIndex if no game has the tag */
+        TagIndex tagIndex(const QString& tagName) const;
+        /** @ret the value index of tag @p tagIndex for game @p gameId, 0 if the game has no such tag */
+        ValueIndex valueIndex(TagIndex tagIndex, GameId gameId) const;
+
+        bool isValidFlag(GameId gameId) const;
+        bool deleted(GameId gameId) const;
+        int elo(GameId gameId, Color color) const;
+        PartialDate date(GameId gameId) const;
+        Result result(GameId gameId) const;
+        int length(GameId gameId) const;
+
+    private:
+        friend class IndexX;
+        const IndexX* m_index;
+        int m_version;
+        int m_count;
+        QHash<QString, TagIndex> m_tagNameIndex;
+        QHash<ValueIndex, QString> m_tagValues;
+        QSharedPointer<const IndexImage> m_image;
+        QVector<TagColumn> m_columns;
+        QSet<GameId> m_validFlags;
+        QSet<GameId> m_deletedGames;
+        QVector<qint16> m_whiteElo;
+        QVector<qint16> m_blackElo;
+        QVector<qint32> m_dates;
+        QVector<quint8> m_results;
+        QVector<qint32> m_lengths;
+    };
+
+    /** @ret a snapshot of the current game headers */
+    Snapshot snapshot() const;
+
+    /** @ret the version of the index, it changes with every change of a game header */
+    int version() const;
+
 signals:
     void progress(int);
 
@@ -170,6 +303,21 @@ private:
     /** Add a tag value to the index */
     ValueIndex AddTagValue(QString);
 
+    /** Find the stored string of @p valueIndex, @ret false if the value is unknown */
+    bool storedTagValue(ValueIndex valueIndex, QString& value) const;
+
+    /** @ret all tag values, including the ones only found in the image */
+    QHash<ValueIndex, QString> allTagValues() const;
+
+    /** Copy the tag values of the image, so that they can be removed */
+    void detachTagValues();
+
+    /** Read an index written before version 1.7 */
+    bool readStream(QDataStream& in, volatile bool* breakFlag);
+
+    /** Read the IndexImage of an index since version 1.7 */
+    bool readImage(QDataStream& in, volatile bool* breakFlag);
+
     /** Query the value of a tag given the tags index for a specific game */
     QString tagValue(TagIndex tagIndex, GameId gameId) const;
 
@@ -185,6 +333,50 @@ private:
     /** @ret true if a game @p gameId has a given tag index */
     bool indexItemHasTag(TagIndex tagIndex, GameId gameId) const;
 
+    /** @ret true if the tag @p name is stored densely from the beginning */
+    static bool isFrequentTag(const QString& name);
+
+    /** @ret true if the column of tag @p name keeps the list of games per value */
+    static bool isPostedTag(const QString& name);
+
+    /** @ret the games whose value of @p tagName satisfies @p matches, which is
+        called once per distinct value, by several threads for many values */
+    template <class Predicate>
+    QBitArray listMatching(const QString& tagName, Predicate matches) const;
+
+    /** Add all values of @p tagIndex to @p values, games without the tag contribute value 0 */
+    void collectValues(TagIndex tagIndex, QSet<ValueIndex>& values) const;
+
+    /** Tags with a numeric column */
+    enum NumericTag
+    {
+        NotNumeric,
+        NumericWhiteElo,
+        NumericBlackElo,
+        NumericDate,
+        NumericResult,
+        NumericLength
+    };
+
+    /** @ret the numeric column kind of tag @p name */
+    static NumericTag numericTag(const QString& name);
+
+    /** @ret the numeric representation of tag value @p value */
+    static qint32 decodeNumeric(NumericTag tag, const QString& value);
+
+    /** Store the decoded @p value of @p tag for game @p gameId */
+    void setNumeric(NumericTag tag, GameId gameId, qint32 value);
+
+    /** Recalculate the numeric column of @p tagIndex from the tag values */
+    void calculateNumericColumn(TagIndex tagIndex);
+
+    /** Announce a change of the game headers to the holders of a snapshot */
+    void publish();
+
+    /** @ret the games whose value in @p column is in the given range */
+    template <class T>
+    QBitArray listInNumericRange(const QVector<T>& column, qint32 minValue, qint32 maxValue) const;
+
 private:
     /** Contains information which games are marked for deletion */
     QSet<GameId> m_deletedGames;
@@ -194,10 +386,30 @@ private:
     QHash<QString, TagIndex> m_tagNameIndex;
     /** Map an Index to a tagValue */
     QHash<ValueIndex, QString> m_tagValues;
+    /** Image of the index file, values missing in m_tagValues are looked up there */
+    QSharedPointer<const IndexImage> m_image;
     /** Contains information which games are marked as valid */
     QSet<GameId> m_validFlags;
-    /** Hold the list of index items (=holds all game header information) */
-    QVector<IndexItem> m_indexItems;
+    /** Tag values of all games, one column per TagIndex (=holds all game header information) */
+    QVector<TagColumn> m_columns;
+    /** Main line signatures, games beyond the end are unknown */
+    QVector<GameSignature> m_signatures;
+    /** Fingerprints of the games compared by a duplicate search, games beyond the end are unknown */
+    QVector<GameFingerprint> m_fingerprints;
+    /** NumericTag of each TagIndex */
+    QVector<quint8> m_numericTags;
+    /** Decoded tag values, indexed by GameId. Games beyond the end have value 0. */
+    QVector<qint16> m_whiteElo;
+    QVector<qint16> m_blackElo;
+    /** Dates as returned by PartialDate::packed() */
+    QVector<qint32> m_dates;
+    /** Values of the Result enum */
+    QVector<quint8> m_results;
+    QVector<qint32> m_lengths;
+    /** Number of games in the index */
+    int m_count;
+    /** Incremented by every change, the snapshots keep the value of their time */
+    QAtomicInt m_version;
 
     mutable QReadWriteLock m_mutex;
 };
@@ -0,0 +1,524 @@
+#include <QDataStream>
+#include <QFile>
+
+#include <algorithm>
+
+#include "indeximage.h"
+#include "tagcolumn.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+namespace {
+
+/** Flags of a tag table entry */
+const quint32 DenseColumn = 1;
+const quint32 PostedColumn = 2;
+
+/** @return number of 32 bit words of a bitmap of @p bits */
+inline quint32 bitmapWords(quint32 bits)
+{
+    return (bits + 31) >> 5;
+}
+
+/** @return true if @p words 32 bit words at @p offset lie within @p size bytes */
+inline bool fits(quint32 offset, quint64 words, quint32 size)
+{
+    return offset <= size && words * 4 <= size - offset;
+}
+
+} // anonymous namespace
+
+IndexImage::IndexImage() : m_file(nullptr), m_data(nullptr), m_size(0)
+{
+}
+
+IndexImage::~IndexImage()
+{
+    delete m_file; // also releases the mapping
+}
+
+QSharedPointer<const IndexImage> IndexImage::load(QDataStream& in, quint32 size)
+{
+    QSharedPointer<IndexImage> image(new IndexImage);
+    image->m_size = size;
+
+    QFileDevice* device = qobject_cast<QFileDevice*>(in.device());
+    if (device && !device->fileName().isEmpty() && size)
+    {
+        // A file of its own keeps the mapping, the stream may be closed any time
+        QFile* file = new QFile(device->fileName());
+        if (file->open(QIODevice::ReadOnly))
+        {
+            image->m_data = file->map(device->pos(), size);
+        }
+        if (image->m_data && in.skipRawData(static_cast<int>(size)) == static_cast<int>(size))
+        {
+            image->m_file = file;
+        }
+        else
+        {
+            image->m_data = nullptr;
+            delete file;
+        }
+    }
+    if (!image->m_data)
+    {
+        // Not mappable, keep a copy of the image in memory instead
+        image->m_copy.resize(static_cast<int>(size));
+        if (in.readRawData(image->m_copy.data(), static_cast<int>(size)) != static_cast<int>(size))
+        {
+            return QSharedPointer<const IndexImage>();
+        }
+        image->m_data = reinterpret_cast<const uchar*>(image->m_copy.constData());
+    }
+
+    if (!image->isValid())
+    {
+        return QSharedPointer<const IndexImage>();
+    }
+    return image;
+}
+
+bool IndexImage::isValid() const
+{
+    if (!fits(0, HeaderWords, m_size) || word(0) != INDEX_IMAGE_MAGIC)
+    {
+        return false;
+    }
+    const quint32 count = word(4);
+    const quint32 valueCount = word(12);
+    const quint32 strings = word(20);
+    const quint32 stringsSize = word(24);
+    if (!fits(word(16), 2 * quint64(valueCount) + 2, m_size) ||
+        !fits(strings, (quint64(stringsSize) + 3) / 4, m_size) ||
+        !fits(word(28), quint64(tagCount()) * TagWords, m_size) ||
+        !fits(word(32), bitmapWords(count), m_size))
+    {
+        return false;
+    }
+    if (word(word(16) + 8 * valueCount + 4) > stringsSize)
+    {
+        return false;
+    }
+
+    const quint32 numericSize[NumericCount] = { 2, 2, 4, 1, 4 };
+    for (int column = 0; column < NumericCount; ++column)
+    {
+        quint32 offset = word(4 * (9 + column));
+        if (!fits(offset, 1, m_size) ||
+            !fits(offset + 4, (quint64(word(offset)) * numericSize[column] + 3) / 4, m_size))
+        {
+            return false;
+        }
+    }
+
+    for (int tag = 0; tag < tagCount(); ++tag)
+    {
+        quint32 entry = tagEntry(tag);
+        quint32 entries = word(entry + 12);
+        if (quint64(word(entry)) + word(entry + 4) > stringsSize)
+        {
+            return false;
+        }
+        if (isDense(tag) ? !fits(word(entry + 16), quint64(bitmapWords(entries)) + entries, m_size)
+                         : !fits(word(entry + 16), 2 * quint64(entries), m_size))
+        {
+            return false;
+        }
+        if (isPosted(tag))
+        {
+            quint32 postedValues = word(entry + 20);
+            if (!fits(word(entry + 24), 2 * quint64(postedValues) + 2, m_size) ||
+                !fits(word(entry + 28), word(word(entry + 24) + 8 * postedValues + 4), m_size))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int IndexImage::count() const
+{
+    return static_cast<int>(word(4));
+}
+
+int IndexImage::tagCount() const
+{
+    return static_cast<int>(word(8));
+}
+
+QString IndexImage::tagName(int tag) const
+{
+    return string(word(tagEntry(tag)), word(tagEntry(tag) + 4));
+}
+
+bool IndexImage::isDense(int tag) const
+{
+    return word(tagEntry(tag) + 8) & DenseColumn;
+}
+
+bool IndexImage::isPosted(int tag) const
+{
+    return word(tagEntry(tag) + 8) & PostedColumn;
+}
+
+QString IndexImage::string(quint32 offset, quint32 length) const
+{
+    if (quint64(offset) + length > word(24))
+    {
+        return QString();
+    }
+    return QString::fromUtf8(reinterpret_cast<const char*>(m_data + word(20) + offset), static_cast<int>(length));
+}
+
+bool IndexImage::findValue(ValueIndex valueIndex, QString& value) const
+{
+    const quint32 table = word(16);
+    int first = findPair(table, word(12), valueIndex);
+    if (first < 0)
+    {
+        return false;
+    }
+    quint32 begin = word(table + 8 * static_cast<quint32>(first) + 4);
+    quint32 end = word(table + 8 * static_cast<quint32>(first) + 12);
+    value = string(begin, end > begin ? end - begin : 0);
+    return true;
+}
+
+void IndexImage::readValues(QHash<ValueIndex, QString>& values) const
+{
+    const quint32 table = word(16);
+    values.reserve(values.count() + static_cast<int>(word(12)));
+    for (quint32 i = 0; i < word(12); ++i)
+    {
+        quint32 begin = word(table + 8 * i + 4);
+        quint32 end = word(table + 8 * i + 12);
+        values.insert(word(table + 8 * i), string(begin, end > begin ? end - begin : 0));
+    }
+}
+
+ValueIndex IndexImage::value(int tag, GameId gameId) const
+{
+    const quint32 entry = tagEntry(tag);
+    const quint32 entries = word(entry + 12);
+    const quint32 data = word(entry + 16);
+    if (isDense(tag))
+    {
+        // Absent games are stored with value 0
+        return gameId < entries ? word(data + 4 * (bitmapWords(entries) + gameId)) : 0;
+    }
+    int pair = findPair(data, entries, gameId);
+    return pair < 0 ? 0 : word(data + 8 * static_cast<quint32>(pair) + 4);
+}
+
+bool IndexImage::contains(int tag, GameId gameId) const
+{
+    const quint32 entry = tagEntry(tag);
+    const quint32 entries = word(entry + 12);
+    const quint32 data = word(entry + 16);
+    if (isDense(tag))
+    {
+        return gameId < entries && (word(data + 4 * (gameId >> 5)) & (1u << (gameId & 31)));
+    }
+    return findPair(data, entries, gameId) >= 0;
+}
+
+QVector<GameId> IndexImage::gameIds(int tag) const
+{
+    const quint32 entry = tagEntry(tag);
+    const quint32 entries = word(entry + 12);
+    const quint32 data = word(entry + 16);
+    QVector<GameId> games;
+    if (isDense(tag))
+    {
+        for (quint32 w = 0; w < bitmapWords(entries); ++w)
+        {
+            quint32 bits = word(data + 4 * w);
+            for (quint32 bit = 0; bits; ++bit, bits >>= 1)
+            {
+                if (bits & 1)
+                {
+                    games.append((w << 5) + bit);
+                }
+            }
+        }
+        return games;
+    }
+    games.reserve(static_cast<int>(entries));
+    for (quint32 i = 0; i < entries; ++i)
+    {
+        games.append(word(data + 8 * i));
+    }
+    return games;
+}
+
+int IndexImage::findPair(quint32 table, quint32 count, quint32 key) const
+{
+    // Binary search on the first word of the pairs
+    quint32 first = 0;
+    quint32 last = count;
+    while (first < last)
+    {
+        quint32 middle = first + (last - first) / 2;
+        if (word(table + 8 * middle) < key)
+        {
+            first = middle + 1;
+        }
+        else
+        {
+            last = middle;
+        }
+    }
+    return (first < count && word(table + 8 * first) == key) ? static_cast<int>(first) : -1;
+}
+
+int IndexImage::findPosting(int tag, ValueIndex valueIndex) const
+{
+    const quint32 entry = tagEntry(tag);
+    return findPair(word(entry + 24), word(entry + 20), valueIndex);
+}
+
+QVector<GameId> IndexImage::games(int tag, ValueIndex valueIndex) const
+{
+    QVector<GameId> games;
+    int posting = findPosting(tag, valueIndex);
+    if (posting < 0)
+    {
+        return games;
+    }
+    const quint32 entry = tagEntry(tag);
+    const quint32 table = word(entry + 24) + 8 * static_cast<quint32>(posting);
+    const quint32 data = word(entry + 28);
+    const quint32 end = qMin(word(table + 12), static_cast<quint32>(postingCount(tag)));
+    for (quint32 i = word(table + 4); i < end; ++i)
+    {
+        games.append(word(data + 4 * i));
+    }
+    return games;
+}
+
+QList<ValueIndex> IndexImage::postedValues(int tag) const
+{
+    const quint32 entry = tagEntry(tag);
+    const quint32 table = word(entry + 24);
+    QList<ValueIndex> values;
+    values.reserve(static_cast<int>(word(entry + 20)));
+    for (quint32 i = 0; i < word(entry + 20); ++i)
+    {
+        values.append(word(table + 8 * i));
+    }
+    return values;
+}
+
+int IndexImage::postingCount(int tag) const
+{
+    const quint32 entry = tagEntry(tag);
+    return static_cast<int>(word(word(entry + 24) + 8 * word(entry + 20) + 4));
+}
+
+QSet<GameId> IndexImage::invalidGames() const
+{
+    QSet<GameId> games;
+    const quint32 bitmap = word(32);
+    for (quint32 w = 0; w < bitmapWords(word(4)); ++w)
+    {
+        quint32 bits = word(bitmap + 4 * w);
+        for (quint32 bit = 0; bits; ++bit, bits >>= 1)
+        {
+            if (bits & 1)
+            {
+                games.insert((w << 5) + bit);
+            }
+        }
+    }
+    return games;
+}
+
+IndexImageWriter::IndexImageWriter(int count) : m_count(count)
+{
+    m_invalid.resize(static_cast<int>(bitmapWords(static_cast<quint32>(count))));
+    for (int column = 0; column < IndexImage::NumericCount; ++column)
+    {
+        setNumeric(IndexImage::Numeric(column), QVector<quint32>());
+    }
+}
+
+void IndexImageWriter::setValues(const QHash<ValueIndex, QString>& values)
+{
+    QList<ValueIndex> keys = values.keys();
+    std::sort(keys.begin(), keys.end());
+    m_valueTable.clear();
+    m_valueTable.reserve(2 * keys.count() + 1);
+    quint32 length;
+    foreach (ValueIndex valueIndex, keys)
+    {
+        m_valueTable.append(valueIndex);
+        m_valueTable.append(appendString(values.value(valueIndex), length));
+    }
+    // The end of the last string follows as a pair of its own
+    m_valueTable.append(0);
+    m_valueTable.append(static_cast<quint32>(m_strings.size()));
+}
+
+void IndexImageWriter::addColumn(const QString& name, const TagColumn& column)
+{
+    quint32 nameLength;
+    quint32 nameOffset = appendString(name, nameLength);
+    quint32 flags = (column.isDense() ? DenseColumn : 0) | (column.hasPostings() ? PostedColumn : 0);
+    const quint32 headerSize = IndexImage::HeaderWords * 4;
+
+    QVector<GameId> games = column.gameIds();
+    quint32 entries = column.isDense() ? static_cast<quint32>(m_count) : static_cast<quint32>(games.count());
+    quint32 data = headerSize + static_cast<quint32>(m_columns.size());
+    if (column.isDense())
+    {
+        QVector<quint32> present(static_cast<int>(bitmapWords(entries)));
+        QVector<quint32> values(static_cast<int>(entries));
+        foreach (GameId gameId, games)
+        {
+            if (gameId < entries)
+            {
+                present[gameId >> 5] |= 1u << (gameId & 31);
+                values[gameId] = column.value(gameId);
+            }
+        }
+        foreach (quint32 word, present)
+        {
+            append(word);
+        }
+        foreach (quint32 value, values)
+        {
+            append(value);
+        }
+    }
+    else
+    {
+        foreach (GameId gameId, games)
+        {
+            append(gameId);
+            append(column.value(gameId));
+        }
+    }
+
+    quint32 postedValues = 0;
+    quint32 postings = 0;
+    quint32 postedGames = 0;
+    if (column.hasPostings())
+    {
+        QList<ValueIndex> values = column.postedValues();
+        std::sort(values.begin(), values.end());
+        postedValues = static_cast<quint32>(values.count());
+        postings = headerSize + static_cast<quint32>(m_columns.size());
+        quint32 first = 0;
+        foreach (ValueIndex valueIndex, values)
+        {
+            append(valueIndex);
+            append(first);
+            first += static_cast<quint32>(column.games(valueIndex).count());
+        }
+        append(0);
+        append(first);
+        postedGames = headerSize + static_cast<quint32>(m_columns.size());
+        foreach (ValueIndex valueIndex, values)
+        {
+            foreach (GameId gameId, column.games(valueIndex))
+            {
+                append(gameId);
+            }
+        }
+    }
+
+    m_tagTable << nameOffset << nameLength << flags << entries << data << postedValues << postings << postedGames;
+}
+
+void IndexImageWriter::setInvalidGames(const QSet<GameId>& games)
+{
+    m_invalid.fill(0);
+    foreach (GameId gameId, games)
+    {
+        if (static_cast<int>(gameId) < m_count)
+        {
+            m_invalid[gameId >> 5] |= 1u << (gameId & 31);
+        }
+    }
+}
+
+void IndexImageWriter::append(quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    m_columns.append(reinterpret_cast<const char*>(bytes), 4);
+}
+
+quint32 IndexImageWriter::appendString(const QString& value, quint32& length)
+{
+    quint32 offset = static_cast<quint32>(m_strings.size());
+    QByteArray utf8 = value.toUtf8();
+    length = static_cast<quint32>(utf8.size());
+    m_strings.append(utf8);
+    return offset;
+}
+
+QByteArray IndexImageWriter::data() const
+{
+    QVector<quint32> valueTable = m_valueTable;
+    if (valueTable.isEmpty())
+    {
+        valueTable << 0 << 0;
+    }
+
+    // Sections follow the header and the column data in this order
+    quint32 offset = IndexImage::HeaderWords * 4 + static_cast<quint32>(m_columns.size());
+    const quint32 valueTableOffset = offset;
+    offset += 4 * static_cast<quint32>(valueTable.count());
+    const quint32 tagTableOffset = offset;
+    offset += 4 * static_cast<quint32>(m_tagTable.count());
+    const quint32 invalidOffset = offset;
+    offset += 4 * static_cast<quint32>(m_invalid.count());
+    quint32 numericOffset[IndexImage::NumericCount];
+    for (int column = 0; column < IndexImage::NumericCount; ++column)
+    {
+        numericOffset[column] = offset;
+        offset += static_cast<quint32>(m_numeric[column].size());
+    }
+    const quint32 stringsOffset = offset;
+
+    QVector<quint32> header;
+    header << INDEX_IMAGE_MAGIC << static_cast<quint32>(m_count)
+           << static_cast<quint32>(m_tagTable.count()) / IndexImage::TagWords
+           << static_cast<quint32>(valueTable.count() / 2 - 1)
+           << valueTableOffset << stringsOffset << static_cast<quint32>(m_strings.size())
+           << tagTableOffset << invalidOffset;
+    for (int column = 0; column < IndexImage::NumericCount; ++column)
+    {
+        header << numericOffset[column];
+    }
+
+    QByteArray image;
+    image.reserve(static_cast<int>(offset) + m_strings.size());
+    auto appendWords = [&image](const QVector<quint32>& words)
+    {
+        foreach (quint32 word, words)
+        {
+            uchar bytes[4];
+            qToLittleEndian<quint32>(word, bytes);
+            image.append(reinterpret_cast<const char*>(bytes), 4);
+        }
+    };
+    appendWords(header);
+    image.append(m_columns);
+    appendWords(valueTable);
+    appendWords(m_tagTable);
+    appendWords(m_invalid);
+    for (int column = 0; column < IndexImage::NumericCount; ++column)
+    {
+        image.append(m_numeric[column]);
+    }
+    image.append(m_strings);
+    image.append(QByteArray((4 - m_strings.size() % 4) % 4, '\0'));
+    return image;
+}
@@ -0,0 +1,199 @@
+#ifndef INDEXIMAGE_H_INCLUDED
+#define INDEXIMAGE_H_INCLUDED
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector>
+#include <QtEndian>
+
+#include "gameid.h"
+#include "indexitem.h"
+
+class QDataStream;
+class QFile;
+class TagColumn;
+
+#define INDEX_IMAGE_MAGIC 0x49495843
+
+/** @ingroup Database
+   The IndexImage class is the flat form of an IndexX, as stored in the .cxi
+   file since index version 1.7. All sections are arrays of little endian
+   integers, so the image is mapped into memory when the index file is opened
+   and the game headers are read from it directly, without building hashes:
+
+   - the string table of the tag names and values, the values sorted by
+     ValueIndex;
+   - one column per tag: the presence bits and the ValueIndex of every game
+     for dense columns, sorted (GameId, ValueIndex) pairs for sparse columns,
+     and for posted columns the sorted list of games per value;
+   - the bitmap of the games with an invalid header;
+   - the decoded numeric tags.
+
+   An image is never changed. IndexX and TagColumn copy the part they change
+   into their own storage.
+*/
+
+class IndexImage
+{
+public:
+    /** Decoded numeric tags, in the order of the image */
+    enum Numeric
+    {
+        WhiteEloColumn,
+        BlackEloColumn,
+        DateColumn,
+        ResultColumn,
+        LengthColumn,
+        NumericCount
+    };
+
+    ~IndexImage();
+
+    /** Map the image of @p size bytes at the current position of the device
+        of @p in and skip it. The image is read into memory if the device is
+        not a file. @return a null pointer if the image is corrupt. */
+    static QSharedPointer<const IndexImage> load(QDataStream& in, quint32 size);
+
+    /** @return number of games */
+    int count() const;
+    /** @return number of tags, the columns are indexed by TagIndex */
+    int tagCount() const;
+    /** @return the name of tag @p tag */
+    QString tagName(int tag) const;
+    bool isDense(int tag) const;
+    bool isPosted(int tag) const;
+
+    /** Find the stored string of @p valueIndex, @return false if it is not in the image */
+    bool findValue(ValueIndex valueIndex, QString& value) const;
+    /** Add all values of the image to @p values */
+    void readValues(QHash<ValueIndex, QString>& values) const;
+
+    /** @return the value of game @p gameId in column @p tag, 0 if the game has no such tag */
+    ValueIndex value(int tag, GameId gameId) const;
+    /** @return true if game @p gameId has a value in column @p tag */
+    bool contains(int tag, GameId gameId) const;
+    /** @return the sorted list of games with a value in column @p tag */
+    QVector<GameId> gameIds(int tag) const;
+    /** @return the sorted list of games with value @p valueIndex of a posted column */
+    QVector<GameId> games(int tag, ValueIndex valueIndex) const;
+    /** @return all values of a posted column */
+    QList<ValueIndex> postedValues(int tag) const;
+    /** @return number of games with a value in a posted column */
+    int postingCount(int tag) const;
+
+    /** @return the games with an invalid header */
+    QSet<GameId> invalidGames() const;
+    /** @return the numeric column @p column */
+    template <class T>
+    QVector<T> numeric(Numeric column) const;
+
+private:
+    IndexImage();
+
+    /** Size of the header in 32 bit words */
+    static const quint32 HeaderWords = 9 + NumericCount;
+    /** Size of a tag table entry in 32 bit words */
+    static const quint32 TagWords = 8;
+
+    /** @return the 32 bit word at byte @p offset */
+    inline quint32 word(quint32 offset) const;
+    /** @return byte offset of the tag table entry of @p tag */
+    inline quint32 tagEntry(int tag) const;
+    /** @return the string at @p offset of the string table */
+    QString string(quint32 offset, quint32 length) const;
+    /** @return the index of the pair starting with @p key in the sorted table
+        of @p count pairs of 32 bit words at @p table, or -1 */
+    int findPair(quint32 table, quint32 count, quint32 key) const;
+    /** @return the index of the posting of @p valueIndex in column @p tag or -1 */
+    int findPosting(int tag, ValueIndex valueIndex) const;
+    /** Check that all sections lie within the image */
+    bool isValid() const;
+
+    /** Open file the image is mapped from */
+    QFile* m_file;
+    /** Copy of the image, if it could not be mapped */
+    QByteArray m_copy;
+    const uchar* m_data;
+    quint32 m_size;
+
+    friend class IndexImageWriter;
+};
+
+/** @ingroup Database
+   The IndexImageWriter class lays out an IndexImage. */
+
+class IndexImageWriter
+{
+public:
+    explicit IndexImageWriter(int count);
+
+    /** Store the tag values, indexed by ValueIndex */
+    void setValues(const QHash<ValueIndex, QString>& values);
+    /** Append the column of the next TagIndex */
+    void addColumn(const QString& name, const TagColumn& column);
+    /** Store the games with an invalid header */
+    void setInvalidGames(const QSet<GameId>& games);
+    /** Store a numeric column */
+    template <class T>
+    void setNumeric(IndexImage::Numeric column, const QVector<T>& values);
+
+    /** @return the complete image */
+    QByteArray data() const;
+
+private:
+    void append(quint32 value);
+    /** @return offset of @p value in the string table */
+    quint32 appendString(const QString& value, quint32& length);
+
+    int m_count;
+    /** Column data, written behind the header */
+    QByteArray m_columns;
+    QVector<quint32> m_tagTable;
+    QVector<quint32> m_valueTable;
+    QByteArray m_strings;
+    QVector<quint32> m_invalid;
+    QByteArray m_numeric[IndexImage::NumericCount];
+};
+
+inline quint32 IndexImage::word(quint32 offset) const
+{
+    return qFromLittleEndian<quint32>(m_data + offset);
+}
+
+inline quint32 IndexImage::tagEntry(int tag) const
+{
+    return word(28) + static_cast<quint32>(tag) * TagWords * 4;
+}
+
+template <class T>
+QVector<T> IndexImage::numeric(Numeric column) const
+{
+    quint32 offset = word(4 * (9 + column));
+    QVector<T> values(static_cast<int>(word(offset)));
+    const uchar* p = m_data + offset + 4;
+    for (int i = 0; i < values.count(); ++i)
+    {
+        values[i] = qFromLittleEndian<T>(p + i * sizeof(T));
+    }
+    return values;
+}
+
+template <class T>
+void IndexImageWriter::setNumeric(IndexImage::Numeric column, const QVector<T>& values)
+{
+    QByteArray& data = m_numeric[column];
+    data.resize(static_cast<int>(4 + ((values.count() * sizeof(T) + 3) & ~3u)));
+    data.fill(0);
+    uchar* p = reinterpret_cast<uchar*>(data.data());
+    qToLittleEndian<quint32>(static_cast<quint32>(values.count()), p);
+    for (int i = 0; i < values.count(); ++i)
+    {
+        qToLittleEndian<T>(values.at(i), p + 4 + i * sizeof(T));
+    }
+}
+
+#endif // INDEXIMAGE_H_INCLUDED
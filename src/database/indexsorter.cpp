@@ -0,0 +1,267 @@
+#include <QPair>
+#include <QSet>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <functional>
+
+#include "indexsorter.h"
+#include "parallelfor.h"
+#include "tags.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+/** Indexes with less games are sorted on the calling thread alone */
+static const int ParallelSortGames = 65536;
+
+namespace {
+
+/** Call @p f(chunk, first, last) for @p chunks ranges of [0, @p count), each on a thread of its own */
+void forChunks(int count, int chunks, const std::function<void(int, int, int)>& f)
+{
+    if (chunks <= 1)
+    {
+        f(0, 0, count);
+        return;
+    }
+    ParallelFor loop(chunks, 1, [&](int chunk, int)
+    {
+        f(chunk, static_cast<int>(qint64(count) * chunk / chunks), static_cast<int>(qint64(count) * (chunk + 1) / chunks));
+    }, chunks);
+    loop.wait();
+}
+
+/** Column the games are sorted by */
+enum SortKey
+{
+    ValueKey,
+    WhiteEloKey,
+    BlackEloKey,
+    DateKey,
+    LengthKey
+};
+
+SortKey sortKey(const QString& tagName)
+{
+    static const QHash<QString, SortKey> numericKeys =
+    {
+        { TagNameWhiteElo, WhiteEloKey }, { TagNameBlackElo, BlackEloKey },
+        { TagNameDate, DateKey }, { TagNameLength, LengthKey }
+    };
+    return numericKeys.value(tagName, ValueKey);
+}
+
+/** @return the key of game @p gameId before ranking, numeric keys are biased to compare unsigned */
+inline quint32 rawKey(const IndexX::Snapshot& snapshot, SortKey key, TagIndex tagIndex, GameId gameId)
+{
+    switch (key)
+    {
+    case WhiteEloKey:
+        return static_cast<quint32>(snapshot.elo(gameId, White)) ^ 0x80000000u;
+    case BlackEloKey:
+        return static_cast<quint32>(snapshot.elo(gameId, Black)) ^ 0x80000000u;
+    case DateKey:
+        return static_cast<quint32>(snapshot.date(gameId).packed()) ^ 0x80000000u;
+    case LengthKey:
+        return static_cast<quint32>(snapshot.length(gameId)) ^ 0x80000000u;
+    default:
+        return snapshot.valueIndex(tagIndex, gameId);
+    }
+}
+
+} // anonymous namespace
+
+QVector<GameId> IndexSorter::Permutation::ordered(Qt::SortOrder order) const
+{
+    if (order == Qt::AscendingOrder)
+    {
+        return games;
+    }
+    // Reverse the values, but not the games of one value
+    QVector<GameId> reversed;
+    reversed.reserve(games.count());
+    int end = games.count();
+    for (int i = end - 1; i >= 0; --i)
+    {
+        if (groupStarts.testBit(i))
+        {
+            for (int j = i; j < end; ++j)
+            {
+                reversed.append(games.at(j));
+            }
+            end = i;
+        }
+    }
+    return reversed;
+}
+
+IndexSorter::IndexSorter(QObject* parent) : QObject(parent), m_index(nullptr), m_cache(CachedTags)
+{
+}
+
+IndexSorter::~IndexSorter()
+{
+}
+
+void IndexSorter::setIndex(const IndexX* index)
+{
+    if (index == m_index)
+    {
+        return;
+    }
+    m_index = index;
+    m_cache.clear();
+    // Sorts of the former index keep running, but their results are dropped
+    foreach (QFutureWatcher<Permutation>* watcher, m_pending)
+    {
+        watcher->disconnect(this);
+        watcher->deleteLater();
+    }
+    m_pending.clear();
+}
+
+bool IndexSorter::permutation(const QString& tagName, Qt::SortOrder order, QVector<GameId>& games) const
+{
+    const Permutation* permutation = m_cache.object(tagName);
+    if (!m_index || !permutation || permutation->version != m_index->version())
+    {
+        return false;
+    }
+    games = permutation->ordered(order);
+    return true;
+}
+
+void IndexSorter::request(const QString& tagName)
+{
+    if (!m_index || m_pending.contains(tagName))
+    {
+        return;
+    }
+    QFutureWatcher<Permutation>* watcher = new QFutureWatcher<Permutation>(this);
+    connect(watcher, SIGNAL(finished()), SLOT(slotFinished()));
+    m_pending.insert(tagName, watcher);
+    watcher->setFuture(QtConcurrent::run(&IndexSorter::sort, m_index->snapshot(), tagName));
+}
+
+void IndexSorter::slotFinished()
+{
+    QFutureWatcher<Permutation>* watcher = static_cast<QFutureWatcher<Permutation>*>(sender());
+    QString tagName = m_pending.key(watcher);
+    m_pending.remove(tagName);
+    m_cache.insert(tagName, new Permutation(watcher->result()));
+    watcher->deleteLater();
+    emit sorted(tagName);
+}
+
+IndexSorter::Permutation IndexSorter::sort(const IndexX::Snapshot& snapshot, const QString& tagName)
+{
+    Permutation permutation;
+    permutation.version = snapshot.version();
+    const int count = snapshot.count();
+    const SortKey key = sortKey(tagName);
+    const TagIndex tagIndex = snapshot.tagIndex(tagName);
+    const int chunks = (count < ParallelSortGames) ? 1 : QThread::idealThreadCount();
+
+    // The key of a game goes to the high word, the game to the low word
+    QVector<quint64> keys(count);
+    quint64* out = keys.data();
+    QVector<QSet<quint32> > distinct(chunks);
+    QSet<quint32>* chunkValues = distinct.data();
+    forChunks(count, chunks, [&](int chunk, int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+        {
+            quint32 raw = rawKey(snapshot, key, tagIndex, static_cast<GameId>(i));
+            chunkValues[chunk].insert(raw);
+            out[i] = (quint64(raw) << 32) | static_cast<quint32>(i);
+        }
+    });
+
+    // Rank every distinct value once
+    QSet<quint32> values;
+    foreach (const QSet<quint32>& chunk, distinct)
+    {
+        values.unite(chunk);
+    }
+    QHash<quint32, quint32> ranks;
+    ranks.reserve(values.count());
+    if (key == ValueKey)
+    {
+        // Values shown with the same string share their rank
+        QVector<QPair<QString, quint32> > names;
+        names.reserve(values.count());
+        foreach (quint32 valueIndex, values)
+        {
+            QString name = snapshot.tagValueName(valueIndex);
+            if (name == "?")
+            {
+                name.clear();
+            }
+            names.append(qMakePair(name, valueIndex));
+        }
+        std::sort(names.begin(), names.end());
+        quint32 rank = 0;
+        for (int i = 0; i < names.count(); ++i)
+        {
+            if (i > 0 && names.at(i).first != names.at(i - 1).first)
+            {
+                ++rank;
+            }
+            ranks.insert(names.at(i).second, rank);
+        }
+    }
+    else
+    {
+        QVector<quint32> numbers = values.values().toVector();
+        std::sort(numbers.begin(), numbers.end());
+        for (int i = 0; i < numbers.count(); ++i)
+        {
+            ranks.insert(numbers.at(i), static_cast<quint32>(i));
+        }
+    }
+
+    // Sort the chunks by rank, then merge them pairwise
+    QVector<int> bounds;
+    for (int chunk = 0; chunk <= chunks; ++chunk)
+    {
+        bounds.append(static_cast<int>(qint64(count) * chunk / chunks));
+    }
+    forChunks(count, chunks, [&](int, int first, int last)
+    {
+        for (int i = first; i < last; ++i)
+        {
+            out[i] = (quint64(ranks.value(static_cast<quint32>(out[i] >> 32))) << 32) | (out[i] & 0xFFFFFFFFu);
+        }
+        std::sort(out + first, out + last);
+    });
+    while (bounds.count() > 2)
+    {
+        const int pairs = (bounds.count() - 1) / 2;
+        forChunks(pairs, pairs, [&](int pair, int, int)
+        {
+            std::inplace_merge(out + bounds.at(2 * pair), out + bounds.at(2 * pair + 1), out + bounds.at(2 * pair + 2));
+        });
+        QVector<int> merged;
+        for (int i = 0; i < bounds.count(); i += 2)
+        {
+            merged.append(bounds.at(i));
+        }
+        if (merged.last() != bounds.last())
+        {
+            merged.append(bounds.last());
+        }
+        bounds.swap(merged);
+    }
+
+    permutation.games.resize(count);
+    permutation.groupStarts.resize(count);
+    for (int i = 0; i < count; ++i)
+    {
+        permutation.games[i] = static_cast<GameId>(out[i]);
+        permutation.groupStarts.setBit(i, i == 0 || (out[i] >> 32) != (out[i - 1] >> 32));
+    }
+    return permutation;
+}
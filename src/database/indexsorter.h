@@ -0,0 +1,76 @@
+#ifndef INDEXSORTER_H_INCLUDED
+#define INDEXSORTER_H_INCLUDED
+
+#include <QBitArray>
+#include <QCache>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QObject>
+#include <QVector>
+
+#include "gameid.h"
+#include "index.h"
+
+/** @ingroup Database
+   The IndexSorter class sorts the games of an index by the value of a tag,
+   for the game list. Instead of comparing the tag strings of two games over
+   and over, the distinct values of the tag are ranked once: the Elo, Date
+   and Length tags by their numeric columns, all other tags by their strings.
+   The games are then sorted by rank on all cores, games with equal values
+   keep the order of the database.
+
+   Permutations are computed from a snapshot of the index in the background
+   and kept for a number of tags, until the index changes.
+*/
+
+class IndexSorter : public QObject
+{
+    Q_OBJECT
+public:
+    /** The games of an index in ascending order of a tag */
+    struct Permutation
+    {
+        Permutation() : version(0) {}
+        /** @return the games in @p order, equal values in the order of the database */
+        QVector<GameId> ordered(Qt::SortOrder order) const;
+
+        /** Version of the index that was sorted */
+        int version;
+        QVector<GameId> games;
+        /** Set at the first game of every value */
+        QBitArray groupStarts;
+    };
+
+    explicit IndexSorter(QObject* parent = nullptr);
+    ~IndexSorter();
+
+    /** Sort the games of @p index from now on */
+    void setIndex(const IndexX* index);
+
+    /** Get the games sorted by @p tagName in @p order.
+        @return false if the games were not sorted since the index changed */
+    bool permutation(const QString& tagName, Qt::SortOrder order, QVector<GameId>& games) const;
+
+    /** Sort the games by @p tagName in the background, sorted() is emitted when done */
+    void request(const QString& tagName);
+
+    /** @return the games of @p snapshot sorted ascending by @p tagName */
+    static Permutation sort(const IndexX::Snapshot& snapshot, const QString& tagName);
+
+signals:
+    void sorted(const QString& tagName);
+
+private slots:
+    void slotFinished();
+
+private:
+    /** Number of tags whose permutation is kept */
+    static const int CachedTags = 8;
+
+    const IndexX* m_index;
+    QCache<QString, Permutation> m_cache;
+    /** Sorts running in the background, by tag */
+    QHash<QString, QFutureWatcher<Permutation>*> m_pending;
+};
+
+#endif // INDEXSORTER_H_INCLUDED
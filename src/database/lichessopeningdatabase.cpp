@@ -58,7 +58,7 @@ unsigned int LichessOpeningDatabase::getMoveMapForBoard(const BoardX &board, QMa
             int n = w+d+b;
             total += n;
             QString u = (*it).toObject().value("uci").toString();
-            Move m = board.parseMove(u.toLatin1());
+            Move m = board.parseMove(u);
             MoveData md;
             md.results.update(WhiteWin, w);
             md.results.update(Draw, d);
@@ -9,9 +9,11 @@
  ***************************************************************************/
 
 #include <QtCore>
+#include <QFile>
 #include <QFileInfo>
 #include <QMutexLocker>
 #include "memorydatabase.h"
+#include "output.h"
 #include "settings.h"
 #include "tags.h"
 
@@ -30,14 +32,18 @@ MemoryDatabase::~MemoryDatabase()
 
 void MemoryDatabase::clear()
 {
-    for(int i = 0; i < m_games.count(); ++i)
-    {
-        delete m_games[i];
-    }
     m_games.clear();
     m_index.clear();
-    m_isModified = false;
+    m_isModified.store(0);
     m_transaction = false;
+    {
+        QMutexLocker file(&m_fileMutex);
+        m_fileSlots.clear();
+        m_changedGames.clear();
+        m_rewrite = true;
+        ++m_changes;
+    }
+    touch();
 
     PgnDatabase::clear();
 }
@@ -49,13 +55,42 @@ bool MemoryDatabase::isReadOnly() const
 
 bool MemoryDatabase::isModified() const
 {
-    return m_isModified;
+    return m_isModified.load() != 0;
 }
 
 void MemoryDatabase::setModified(bool b)
 {
-    m_isModified = b;
-    if (!m_transaction) emit dirtyChanged(m_isModified);
+    {
+        QMutexLocker file(&m_fileMutex);
+        // Changes made through the index are not known per game
+        m_rewrite = m_rewrite || b;
+        ++m_changes;
+    }
+    updateModified(b);
+}
+
+void MemoryDatabase::updateModified(bool b)
+{
+    if (b)
+    {
+        touch();
+    }
+    m_isModified.store(b ? 1 : 0);
+    if (!m_transaction) emit dirtyChanged(b);
+}
+
+void MemoryDatabase::markChanged(GameId gameId)
+{
+    {
+        QMutexLocker file(&m_fileMutex);
+        // A running save may be writing an older text of any game, including the appended ones
+        if (m_saving || static_cast<int>(gameId) < m_fileSlots.count())
+        {
+            m_changedGames.insert(gameId);
+        }
+        ++m_changes;
+    }
+    updateModified(true);
 }
 
 void MemoryDatabase::startTransaction(bool b)
@@ -63,7 +98,7 @@ void MemoryDatabase::startTransaction(bool b)
     m_transaction = b;
     if (!b)
     {
-        emit dirtyChanged(m_isModified);
+        emit dirtyChanged(isModified());
     }
 }
 
@@ -73,29 +108,33 @@ bool MemoryDatabase::appendGame(const GameX& game)
     // Add to index
     m_count = m_index.add();
     setTagsToIndex(game, m_count);
+    m_index.setSignature(m_count, GameSignature::fromGame(game));
 
     // Upate game array
-    GameX* newGame = new GameX;
-    *newGame = game;
-    newGame->clearTags();
-    newGame->unmountBoard();
-    m_games.append(newGame);
+    m_games.append(game);
+    if (!m_positionIndex.isEmpty())
+    {
+        // Index the game as it is numbered by the store
+        GameX stored;
+        m_games.load(m_count, stored);
+        m_positionIndex.updateGame(m_count, stored);
+    }
     ++m_count;
-    setModified(true);
+    markChanged(m_count - 1);
     return true;
 }
 
 bool MemoryDatabase::remove(GameId gameId)
 {
     m_index.setDeleted(gameId, true);
-    setModified(true);
+    markChanged(gameId);
     return true;
 }
 
 bool MemoryDatabase::undelete(GameId gameId)
 {
     m_index.setDeleted(gameId, false);
-    setModified(true);
+    markChanged(gameId);
     return true;
 }
 
@@ -108,12 +147,19 @@ bool MemoryDatabase::replace(GameId gameId, GameX& game)
     }
     // Update index
     setTagsToIndex(game, gameId);
+    m_index.setSignature(gameId, GameSignature::fromGame(game));
+    // The stored game may be numbered differently, it is fingerprinted when needed
+    m_index.setFingerprint(gameId, GameFingerprint());
 
     // Upate game array
-    *m_games[gameId] = game;
-    m_games[gameId]->clearTags();
-    m_games[gameId]->unmountBoard();
-    setModified(true);
+    m_games.replace(gameId, game);
+    if (!m_positionIndex.isEmpty())
+    {
+        GameX stored;
+        m_games.load(gameId, stored);
+        m_positionIndex.updateGame(gameId, stored);
+    }
+    markChanged(gameId);
     return true;
 }
 
@@ -124,14 +170,28 @@ void MemoryDatabase::loadGameMoves(GameId gameId, GameX& game)
     {
         return;
     }
-    game = *m_games[gameId];
+    m_games.load(gameId, game);
 }
 
 int MemoryDatabase::findPosition(GameId index, const BoardX &position)
 {
-    GameX g;
-    loadGameMoves(index, g);
-    return g.cursor().findPosition(position);
+    QReadLocker m(&m_mutex);
+    if(index >= m_count)
+    {
+        return NO_MOVE;
+    }
+    PositionReplay replay(position);
+    return m_games.findPosition(index, replay);
+}
+
+MoveId MemoryDatabase::replayToPosition(GameId gameId, PositionReplay& replay)
+{
+    QReadLocker m(&m_mutex);
+    if(gameId >= m_count)
+    {
+        return NO_MOVE;
+    }
+    return m_games.findPosition(gameId, replay);
 }
 
 
@@ -143,7 +203,7 @@ bool MemoryDatabase::loadGame(GameId gameId, GameX& game)
         return false;
     }
 
-    game = *m_games[gameId];
+    m_games.load(gameId, game);
     loadGameHeaders(gameId, game);
 
     return true;
@@ -152,22 +212,22 @@ bool MemoryDatabase::loadGame(GameId gameId, GameX& game)
 void MemoryDatabase::parseGame()
 {
     QWriteLocker m(&m_mutex);
-    GameX* game = new GameX;
+    GameX game;
 
     QString fen = m_index.tagValue(TagNameFEN, m_count - 1);
     QString variant = m_index.tagValue(TagNameVariant, m_count - 1).toLower();
     bool chess960 = (variant.startsWith("fischer", Qt::CaseInsensitive) || variant.endsWith("960"));
     if(fen != "?")
     {
-        game->dbSetStartingBoard(fen, chess960);
+        game.dbSetStartingBoard(fen, chess960);
     }
-    m_index.setValidFlag(m_count - 1, parseMoves(game));
+    m_index.setValidFlag(m_count - 1, parseMoves(&game));
+    m_index.setSignature(m_count - 1, GameSignature::fromGame(game));
 
-    QString valLength = QString::number((game->plyCount() + 1) / 2);
+    QString valLength = QString::number((game.plyCount() + 1) / 2);
     m_index.setTag(TagNameLength, valLength, m_count - 1);
-    game->setTag(TagNameLength, valLength);
 
-    QString eco = game->tag(TagNameECO).left(3);
+    QString eco = game.tag(TagNameECO).left(3);
     if(eco == "?")
     {
         eco.clear();
@@ -177,21 +237,233 @@ void MemoryDatabase::parseGame()
     {
         if(eco.isEmpty())
         {
-            eco = game->ecoClassify().left(3);
+            eco = game.ecoClassify().left(3);
             if(!eco.isEmpty())
             {
-                game->setTag(TagNameECO, eco);
                 m_index.setTag(TagNameECO, eco, m_count - 1);
             }
         }
     }
 
-    game->unmountBoard();
     m_games.append(game);
 }
 
 bool MemoryDatabase::parseFile()
 {
     bool ok = parseFileIntern();
+    m_games.squeeze();
+    unmapFile(); // All games are in memory, the file may be overwritten when saving
+    if (ok)
+    {
+        // A game's text reaches up to the start of the next game
+        QVector<FileSlot> slots(static_cast<int>(m_count));
+        qint64 fileEnd = QFileInfo(filename()).size();
+        for (int i = 0; i < slots.count(); ++i)
+        {
+            slots[i].begin = offset(i);
+            slots[i].end = (i + 1 < slots.count()) ? offset(i + 1) : fileEnd;
+            slots[i].padding = 0;
+        }
+        QMutexLocker file(&m_fileMutex);
+        setFileSaved(slots);
+        m_changedGames.clear();
+        m_rewrite = false;
+    }
     return ok;
 }
+
+void MemoryDatabase::setFileSaved(const QVector<FileSlot>& slots)
+{
+    QFileInfo fi(filename());
+    m_fileSize = fi.size();
+    m_fileModified = fi.lastModified();
+    m_fileSlots = slots;
+}
+
+QByteArray MemoryDatabase::gameText(Output& output, GameId gameId)
+{
+    GameX game;
+    if (!loadGame(gameId, game))
+    {
+        return QByteArray();
+    }
+    QString text = output.output(&game) + "\n\n";
+    return Output::fileLineEnds(isUtf8() ? text.toUtf8() : text.toLatin1());
+}
+
+bool MemoryDatabase::save(Output& output, bool compact, const QAtomicInt* cancel)
+{
+    QMutexLocker saving(&m_saveMutex);
+
+    // The games are rendered from a snapshot of the file state, so that they may be edited meanwhile
+    QVector<FileSlot> slots;
+    QSet<GameId> changed;
+    bool rewrite;
+    int count;
+    quint64 changes;
+    qint64 fileSize;
+    QDateTime fileModified;
+    {
+        QReadLocker games(&m_mutex);
+        QMutexLocker file(&m_fileMutex);
+        slots = m_fileSlots;
+        changed.swap(m_changedGames);
+        rewrite = m_rewrite;
+        m_rewrite = false;
+        m_saving = true;
+        count = static_cast<int>(m_count);
+        changes = m_changes;
+        fileSize = m_fileSize;
+        fileModified = m_fileModified;
+    }
+
+    QFileInfo fi(filename());
+    bool changedOutside = (fi.size() != fileSize) || (fi.lastModified() != fileModified);
+    bool ok = (compact || rewrite || changedOutside || !saveChanges(output, slots, changed, count, fileSize, cancel)) ?
+              saveAll(output, slots, cancel) : true;
+
+    // Merge the changes made meanwhile, they are saved next time
+    bool clean = false;
+    {
+        QMutexLocker file(&m_fileMutex);
+        m_saving = false;
+        if (ok)
+        {
+            setFileSaved(slots);
+            // The dirty flag stays set if games were changed meanwhile
+            clean = (m_changes == changes);
+            if (clean)
+            {
+                m_isModified.store(0);
+            }
+        }
+        else
+        {
+            m_changedGames.unite(changed);
+            m_rewrite = m_rewrite || rewrite;
+        }
+        // Games beyond the saved ones are appended anyway
+        QSet<GameId> inFile;
+        foreach (GameId gameId, m_changedGames)
+        {
+            if (static_cast<int>(gameId) < m_fileSlots.count())
+            {
+                inFile.insert(gameId);
+            }
+        }
+        m_changedGames.swap(inFile);
+    }
+    if (clean && !m_transaction)
+    {
+        emit dirtyChanged(isModified());
+    }
+    return ok;
+}
+
+bool MemoryDatabase::saveChanges(Output& output, QVector<FileSlot>& saved, const QSet<GameId>& changedGames, int count,
+                                 qint64 fileSize, const QAtomicInt* cancel)
+{
+    // Check that every changed game fits before touching the file
+    QVector<FileSlot> slots = saved;
+    QList<GameId> changed = changedGames.values();
+    QList<QByteArray> texts;
+    const QByteArray newline = Output::fileLineEnds("\n");
+    foreach (GameId gameId, changed)
+    {
+        FileSlot& slot = slots[gameId];
+        QByteArray text = gameText(output, gameId);
+        if (text.size() > slot.end - slot.begin)
+        {
+            return false;
+        }
+        // Empty lines separate games, pad with them
+        slot.padding = slot.end - slot.begin - text.size();
+        QByteArray padding = QByteArray(static_cast<int>(slot.padding % newline.size()), ' ');
+        while (padding.size() < slot.padding)
+        {
+            padding.append(newline);
+        }
+        texts.append(text + padding);
+    }
+    qint64 padding = 0;
+    foreach (const FileSlot& slot, slots)
+    {
+        padding += slot.padding;
+    }
+    if (padding * 100 > fileSize * MaxPaddingPercent)
+    {
+        return false;
+    }
+
+    // The texts carry the line ends of the platform already, the file is written as binary
+    QFile file(filename());
+    if (!file.open(QIODevice::ReadWrite))
+    {
+        return false;
+    }
+    for (int i = 0; i < changed.count(); ++i)
+    {
+        if (!file.seek(slots.at(changed.at(i)).begin) || file.write(texts.at(i)) != texts.at(i).size())
+        {
+            return false;
+        }
+    }
+
+    // The new games follow an empty line after the last game
+    qint64 pos = file.size();
+    QByteArray separator;
+    if (pos > 0)
+    {
+        file.seek(qMax(pos - 2 * newline.size(), qint64(0)));
+        QByteArray end = file.read(2 * newline.size());
+        separator = end.endsWith(newline + newline) ? QByteArray() : (end.endsWith(newline) ? newline : newline + newline);
+    }
+    file.seek(pos);
+    const qint64 fileEnd = pos;
+    if (file.write(separator) != separator.size())
+    {
+        return false;
+    }
+    pos += separator.size();
+
+    const int fileGames = saved.count();
+    for (int gameId = fileGames; gameId < count; ++gameId)
+    {
+        if (cancel && cancel->load())
+        {
+            // The games written in place are complete, drop the part of the new ones
+            file.resize(fileEnd);
+            return false;
+        }
+        QByteArray text = gameText(output, gameId);
+        if (file.write(text) != text.size())
+        {
+            return false;
+        }
+        FileSlot slot = { pos, pos + text.size(), 0 };
+        slots.append(slot);
+        pos += text.size();
+        emit progress((gameId - fileGames + 1) * 100 / (count - fileGames));
+    }
+    file.close();
+    saved = slots;
+    return true;
+}
+
+bool MemoryDatabase::saveAll(Output& output, QVector<FileSlot>& slots, const QAtomicInt* cancel)
+{
+    QVector<qint64> offsets;
+    if (!output.save(filename(), *this, cancel, &offsets))
+    {
+        return false;
+    }
+    // Deleted games are dropped, their slot is empty
+    slots.resize(offsets.count() - 1);
+    for (int gameId = 0; gameId < slots.count(); ++gameId)
+    {
+        slots[gameId].begin = offsets.at(gameId);
+        slots[gameId].end = offsets.at(gameId + 1);
+        slots[gameId].padding = 0;
+    }
+    return true;
+}
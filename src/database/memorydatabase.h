@@ -11,16 +11,29 @@
 #ifndef MEMORYDATABASE_H__
 #define MEMORYDATABASE_H__
 
+#include <QAtomicInt>
+#include <QDateTime>
 #include <QMutex>
+#include <QSet>
 #include <QVector>
+#include "compactgamestore.h"
 #include "pgndatabase.h"
 
+class Output;
+
 /** @ingroup Database
    The MemoryDatabase class provides database access to PGN files.
-   Games are stored in memory, and are editable.
+   Games are stored in memory in a compact encoding, and are editable.
    The class is derived from the PgnDatabase class, providing methods for the
    loading and saving of games, and for performing searches and queries.
 
+   The database remembers where the text of each game is in the file. Saving
+   appends new games at the end of the file and writes changed games over
+   their old text if it is long enough, so that the file is only rewritten
+   completely if necessary. A changed game that became shorter leaves blank
+   lines behind it; once these take more than a tenth of the file, the next
+   save rewrites the file completely to drop them.
+
 */
 
 /** @todo
@@ -39,7 +52,7 @@ public:
     virtual bool isReadOnly() const;
     /** @return whether the database was modified. */
     virtual bool isModified() const;
-    /** Set database dirty flag */
+    /** Set database dirty flag. Setting it from outside means the file must be rewritten completely. */
     void setModified(bool b);
     /** Set database dirty flag */
     void startTransaction(bool b);
@@ -58,18 +71,75 @@ public:
     void loadGameMoves(GameId gameId, GameX& game);
     virtual int findPosition(GameId index, const BoardX& position);
 
+    /** Saves the database to its file, rendering the games with @p output.
+        Only appended and changed games are written, unless @p compact is set
+        or the changes do not fit into the file. Saving stops when @p cancel is
+        set: a complete rewrite keeps the old file, appending new games cuts
+        the file back to its former end. The games may be changed by another
+        thread meanwhile; such changes are not saved, the database stays
+        modified and they are written by the next save.
+        Returns true if successful */
+    bool save(Output& output, bool compact = false, const QAtomicInt* cancel = nullptr);
+
 protected:
     virtual void parseGame();
     virtual bool hasIndexFile() const { return false; }
+    virtual MoveId replayToPosition(GameId gameId, PositionReplay& replay);
 
 private:
     bool parseFile();
 
+    /** Byte range of the text of a game in the file */
+    struct FileSlot
+    {
+        qint64 begin;
+        qint64 end;
+        /** Blank bytes written after a game that was saved in place */
+        qint64 padding;
+    };
+    /** Share of the file in percent that may be padding before the file is compacted */
+    static const int MaxPaddingPercent = 10;
+
+    /** Set the dirty flag without requiring a complete rewrite */
+    void updateModified(bool b);
+    /** Set the dirty flag after game @p gameId changed */
+    void markChanged(GameId gameId);
+    /** Remember the file state and the positions of all games after loading or saving, m_fileMutex is held */
+    void setFileSaved(const QVector<FileSlot>& slots);
+    /** @return the PGN text of game @p gameId as stored in the file, empty if it is deleted */
+    QByteArray gameText(Output& output, GameId gameId);
+    /** Write all games to the file, @p slots receives their positions */
+    bool saveAll(Output& output, QVector<FileSlot>& slots, const QAtomicInt* cancel);
+    /** Write the games in @p changedGames in place and append the games up to @p count to the file
+        at @p saved, which receives the new positions. The file had @p fileSize bytes when it was saved.
+        @return false if the changes do not fit or would leave too much padding */
+    bool saveChanges(Output& output, QVector<FileSlot>& saved, const QSet<GameId>& changedGames, int count,
+                     qint64 fileSize, const QAtomicInt* cancel);
+
 private:
-    QVector <GameX*> m_games;
-    bool m_isModified {false};
+    CompactGameStore m_games;
+    /** Dirty flag, cleared by saves running on another thread */
+    QAtomicInt m_isModified {0};
     bool m_transaction {false};
     mutable QReadWriteLock m_mutex;
+    /** Held for a whole save, so that only one save runs at a time */
+    QMutex m_saveMutex;
+    /** Guards the state of the file below, it is only held briefly */
+    QMutex m_fileMutex;
+
+    /** Positions of the saved games in the file, games beyond the end are not saved yet */
+    QVector<FileSlot> m_fileSlots;
+    /** Saved games which were replaced, deleted or undeleted since, and all games changed during a save */
+    QSet<GameId> m_changedGames;
+    /** The file must be written completely at the next save */
+    bool m_rewrite {true};
+    /** A save is rendering the games */
+    bool m_saving {false};
+    /** Number of changes, a save only clears the dirty flag if there were none meanwhile */
+    quint64 m_changes {0};
+    /** Size and time of the file after the last load or save, to notice changes by other programs */
+    qint64 m_fileSize {0};
+    QDateTime m_fileModified;
 };
 
 #endif	// MEMORYDATABASE_H__
@@ -90,6 +90,14 @@ public:
     {
         return m_count? static_cast<int>(m_sum / static_cast<decltype(m_sum)>(m_count)): 0;
     }
+    /** Sum over valid samples */
+    std::int64_t sum() const { return m_sum; }
+    /** Add @p count samples with the sum @p sum, as collected elsewhere */
+    void add(size_t count, std::int64_t sum)
+    {
+        m_count += count;
+        m_sum += sum;
+    }
 
     IntegralMetrics& operator+=(const IntegralMetrics& rhs)
     {
@@ -122,6 +130,15 @@ struct MoveData
     RatingMetrics rating;
     YearMetrics year;
     Move move;
+
+    /** Add the games of @p rhs, which are counted for the same move */
+    MoveData& operator+=(const MoveData& rhs)
+    {
+        results += rhs.results;
+        rating += rhs.rating;
+        year += rhs.year;
+        return *this;
+    }
 };
 
 bool operator<(const MoveData& m1, const MoveData& m2);
@@ -0,0 +1,181 @@
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QMutexLocker>
+
+#include "openingtreecache.h"
+#include "positionindex.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+uint qHash(const OpeningTreeCache::Key& key, uint seed)
+{
+    return qHash(key.position ^ (key.source * 0x9E3779B97F4A7C15ull) ^ quint64(key.bEnd), seed);
+}
+
+OpeningTreeCache::OpeningTreeCache() : m_generation(0), m_modified(false)
+{
+}
+
+bool OpeningTreeCache::accepts(const BoardX& board)
+{
+    int ply = 2 * (static_cast<int>(board.moveNumber()) - 1) + (board.toMove() == Black ? 1 : 0);
+    return ply <= MaxPly;
+}
+
+bool OpeningTreeCache::find(const BoardX& board, bool bEnd, quint64 source, unsigned int generation, QMap<Move, MoveData>& moves, unsigned int& games) const
+{
+    QMutexLocker m(&m_mutex);
+    if (generation != m_generation)
+    {
+        return false;
+    }
+    Key key = { board.getHashValue(), source, bEnd };
+    auto it = m_trees.constFind(key);
+    if (it == m_trees.constEnd())
+    {
+        return false;
+    }
+
+    moves.clear();
+    for (const CachedMove& cached: it->moves)
+    {
+        MoveData md;
+        if (cached.move == PositionIndex::NoMove)
+        {
+            md.localsan = md.san = QCoreApplication::translate("MoveData", "[end]");
+        }
+        else
+        {
+            md.move = PositionIndex::decodeMove(board, cached.move);
+            md.san = board.moveToSan(md.move);
+            md.localsan = board.moveToSan(md.move, true);
+        }
+        for (int r = ResultUnknown; r <= BlackWin; ++r)
+        {
+            md.results.update(Result(r), cached.results[r]);
+        }
+        md.rating.add(cached.ratingCount, cached.ratingSum);
+        md.year.add(cached.yearCount, cached.yearSum);
+        moves.insert(md.move, md);
+    }
+    games = it->games;
+    return true;
+}
+
+void OpeningTreeCache::insert(const BoardX& board, bool bEnd, quint64 source, unsigned int generation, const QMap<Move, MoveData>& moves, unsigned int games)
+{
+    QMutexLocker m(&m_mutex);
+    if (generation != m_generation)
+    {
+        m_trees.clear();
+        m_generation = generation;
+    }
+    if (m_trees.count() >= MaxTrees)
+    {
+        return;
+    }
+
+    Tree tree;
+    tree.games = games;
+    for (const MoveData& md: moves)
+    {
+        CachedMove cached;
+        cached.move = md.move.isLegal() ? PositionIndex::encodeMove(md.move) : PositionIndex::NoMove;
+        for (int r = ResultUnknown; r <= BlackWin; ++r)
+        {
+            cached.results[r] = static_cast<quint32>(md.results.count(Result(r)));
+        }
+        cached.ratingCount = static_cast<quint32>(md.rating.count());
+        cached.ratingSum = md.rating.sum();
+        cached.yearCount = static_cast<quint32>(md.year.count());
+        cached.yearSum = md.year.sum();
+        tree.moves.append(cached);
+    }
+    Key key = { board.getHashValue(), source, bEnd };
+    m_trees.insert(key, tree);
+    m_modified = true;
+}
+
+void OpeningTreeCache::clear(unsigned int generation)
+{
+    QMutexLocker m(&m_mutex);
+    m_trees.clear();
+    m_generation = generation;
+    m_modified = false;
+}
+
+unsigned int OpeningTreeCache::generation() const
+{
+    QMutexLocker m(&m_mutex);
+    return m_generation;
+}
+
+bool OpeningTreeCache::isModified() const
+{
+    QMutexLocker m(&m_mutex);
+    return m_modified;
+}
+
+bool OpeningTreeCache::write(QDataStream& out)
+{
+    QMutexLocker m(&m_mutex);
+    out << static_cast<quint32>(m_trees.count());
+    for (auto it = m_trees.cbegin(); it != m_trees.cend(); ++it)
+    {
+        out << it.key().position << it.key().source << it.key().bEnd;
+        out << it->games << static_cast<quint32>(it->moves.count());
+        for (const CachedMove& cached: it->moves)
+        {
+            out << cached.move;
+            for (quint32 count: cached.results)
+            {
+                out << count;
+            }
+            out << cached.ratingCount << cached.ratingSum << cached.yearCount << cached.yearSum;
+        }
+    }
+    m_modified = false;
+    return out.status() == QDataStream::Ok;
+}
+
+bool OpeningTreeCache::read(QDataStream& in, unsigned int generation)
+{
+    QMutexLocker m(&m_mutex);
+    m_trees.clear();
+    m_generation = generation;
+    m_modified = false;
+
+    quint32 n;
+    in >> n;
+    for (quint32 i = 0; i < n && in.status() == QDataStream::Ok; ++i)
+    {
+        Key key;
+        Tree tree;
+        quint32 moveCount;
+        in >> key.position >> key.source >> key.bEnd;
+        in >> tree.games >> moveCount;
+        for (quint32 j = 0; j < moveCount && in.status() == QDataStream::Ok; ++j)
+        {
+            CachedMove cached;
+            in >> cached.move;
+            for (quint32& count: cached.results)
+            {
+                in >> count;
+            }
+            in >> cached.ratingCount >> cached.ratingSum >> cached.yearCount >> cached.yearSum;
+            tree.moves.append(cached);
+        }
+        m_trees.insert(key, tree);
+    }
+    if (in.status() != QDataStream::Ok)
+    {
+        m_trees.clear();
+        return false;
+    }
+    return true;
+}
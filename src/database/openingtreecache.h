@@ -0,0 +1,96 @@
+#ifndef OPENINGTREECACHE_H_INCLUDED
+#define OPENINGTREECACHE_H_INCLUDED
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QVector>
+
+#include "board.h"
+#include "movedata.h"
+
+class QDataStream;
+
+#define VERSION_OPENING_TREE_CACHE_1_0 0x0100
+#define VERSION_OPENING_TREE_CACHE_CURRENT VERSION_OPENING_TREE_CACHE_1_0
+
+#define OPENING_TREE_CACHE_FILE_MAGIC 0xce57
+
+/** @ingroup Search
+   The OpeningTreeCache class keeps the opening trees of the first plies of a
+   database, so that popular positions are shown at once, also after a
+   restart. A tree is found by the position hash (BoardX::getHashValue()),
+   the end of game option and a signature of the games it was counted over,
+   0 for all games of the database.
+
+   The cache belongs to one state of the database: a change of
+   Database::generation() clears it. Moves are stored in the compact
+   encoding of PositionIndex, their notation is restored for the position.
+*/
+
+class OpeningTreeCache
+{
+public:
+    /** Trees of positions after more plies are not kept */
+    static const int MaxPly = 16;
+    /** Maximum number of trees */
+    static const int MaxTrees = 4096;
+
+    OpeningTreeCache();
+
+    /** @return true if the tree of @p board may be kept */
+    static bool accepts(const BoardX& board);
+
+    /** Look up the tree of @p board. @return true if it is known, then @p moves and @p games are set */
+    bool find(const BoardX& board, bool bEnd, quint64 source, unsigned int generation, QMap<Move, MoveData>& moves, unsigned int& games) const;
+    /** Keep the tree of @p board */
+    void insert(const BoardX& board, bool bEnd, quint64 source, unsigned int generation, const QMap<Move, MoveData>& moves, unsigned int games);
+    /** Remove all trees and adopt @p generation */
+    void clear(unsigned int generation = 0);
+
+    /** @return the database generation of the trees */
+    unsigned int generation() const;
+    /** @return true if trees were added since the last read() or write() */
+    bool isModified() const;
+
+    /** Write the trees to a stream */
+    bool write(QDataStream& out);
+    /** Read trees from a stream, valid for database generation @p generation */
+    bool read(QDataStream& in, unsigned int generation);
+
+private:
+    struct Key
+    {
+        quint64 position;
+        quint64 source;
+        bool bEnd;
+        bool operator==(const Key& rhs) const
+        {
+            return position == rhs.position && source == rhs.source && bEnd == rhs.bEnd;
+        }
+    };
+    friend uint qHash(const Key& key, uint seed);
+
+    struct CachedMove
+    {
+        quint16 move;
+        quint32 results[4];
+        quint32 ratingCount;
+        qint64 ratingSum;
+        quint32 yearCount;
+        qint64 yearSum;
+    };
+
+    struct Tree
+    {
+        quint32 games;
+        QVector<CachedMove> moves;
+    };
+
+    mutable QMutex m_mutex;
+    QHash<Key, Tree> m_trees;
+    unsigned int m_generation;
+    bool m_modified;
+};
+
+#endif // OPENINGTREECACHE_H_INCLUDED
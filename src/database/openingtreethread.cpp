@@ -4,12 +4,15 @@
 
 #include <QMutex>
 #include <QMutexLocker>
+#include <QWaitCondition>
 
 #include "ctgdatabase.h"
 #include "database.h"
 #include "lichessopeningdatabase.h"
 #include "openingtreethread.h"
+#include "parallelfor.h"
 #include "polyglotdatabase.h"
+#include "statisticsbook.h"
 
 using namespace chessx;
 
@@ -18,6 +21,18 @@ using namespace chessx;
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
+/** Number of positions whose trees are kept for stepping back and forth */
+static const int RecentPositions = 8;
+
+/** Consecutive games searched by one worker, with their own statistics */
+struct OpeningTreeBatch
+{
+    QList<GameId> games;
+    QList<MoveId> nodes;
+    QMap<Move, MoveData> moves;
+    bool done = false;
+};
+
 OpeningTreeThread::OpeningTreeThread()
 {
     m_games = nullptr;
@@ -50,75 +65,170 @@ void OpeningTreeThread::run()
         games = pgdb->getMoveMapForBoard(m_board, moves);
         ProgressUpdate(moves, games, 100, 100);
     }
+    else if (StatisticsBook* pgdb = qobject_cast<StatisticsBook*>(m_filter ? m_filter->database() : nullptr))
+    {
+        games = pgdb->getMoveMapForBoard(m_board, moves);
+        ProgressUpdate(moves, games, 100, 100);
+    }
     else if (m_filter)
     {
-        const auto batchSize = 100;
-
-        // setup buffers for batch processing
-        QList<GameId> rqBuffer;
-        QList<MoveId> rsBuffer;
-        rqBuffer.reserve(batchSize);
-        rsBuffer.reserve(batchSize);
-
-        // determine options
-        Database::PositionSearchOptions opts = Database::PositionSearch_Default;
-        if (m_bEnd)
-            opts = Database::PositionSearch_GameEnd;
-
-        // scan games
-        int total = m_filter->size();
-        int processed = 0;
-        while (processed < total)
+        // Only trees over the whole database are kept, a filter changes without notice
+        PositionResult result;
+        result.database = m_filter->database();
+        result.generation = result.database->generation();
+        result.size = static_cast<int>(m_filter->size());
+        result.board = m_board;
+        result.bEnd = m_bEnd;
+        result.games = 0;
+        int recent = m_sourceIsDatabase ? findRecent(result) : -1;
+        OpeningTreeCache* cache = result.database->openingTreeCache();
+        quint64 source = m_sourceIsDatabase ? 0 : m_filter->signature();
+        bool cacheable = OpeningTreeCache::accepts(m_board);
+        if (recent < 0 && cacheable && !m_updateFilter && cache->find(m_board, m_bEnd, source, result.generation, moves, games))
         {
-            // prepare requests
-            rqBuffer.clear();
-            rsBuffer.clear();
-            if (m_sourceIsDatabase)
+            // A popular position, the filter is not updated so the games are not needed
+            ProgressUpdate(moves, games, 100, 100);
+        }
+        else if (recent >= 0)
+        {
+            // The position was visited recently
+            m_recent.move(recent, 0);
+            const PositionResult& cached = m_recent.first();
+            moves = cached.moves;
+            games = cached.games;
+            ProgressUpdate(moves, games, 100, 100);
+            if (m_updateFilter)
             {
-                auto size = std::min(total - processed, batchSize);
-                for (auto i = 0; i < size; ++i)
+                for (int i = 0; i < cached.nodes.count(); ++i)
                 {
-                    auto gameId = processed + i;
-                    rqBuffer.append(gameId);
+                    emit requestGameFilterUpdate(i, cached.nodes.at(i) + 1);
                 }
-                processed += size;
             }
-            else
+        }
+        else
+        {
+            // A step from a recent position continues its games instead of replaying them
+            Move step;
+            int parent = (m_sourceIsDatabase && !m_bEnd) ? findParent(result, step) : -1;
+            QVector<MoveId> previousNodes = (parent >= 0) ? m_recent.at(parent).nodes : QVector<MoveId>();
+            if (m_sourceIsDatabase)
             {
-                for (; processed < total && rqBuffer.size() < batchSize; ++processed)
-                {
-                    auto gameId = processed;
-                    if (m_filter->contains(gameId))
-                        rqBuffer.append(gameId);
-                }
+                result.nodes.reserve(result.size);
             }
 
-            // perform search
-            m_filter->database()->findPosition(m_board, opts, rqBuffer, rsBuffer, moves);
+            const int batchSize = 100;
+            const int total = m_filter->size();
+            const int batches = (total + batchSize - 1) / batchSize;
+
+            // determine options
+            Database::PositionSearchOptions opts = Database::PositionSearch_Default;
+            if (m_bEnd)
+                opts = Database::PositionSearch_GameEnd;
 
-            // update progress
-            for (auto rs: rsBuffer)
+            // Workers search batches of consecutive games, each into its own statistics
+            QVector<OpeningTreeBatch> results(batches);
+            OpeningTreeBatch* out = results.data();
+            QMutex mutex;
+            QWaitCondition batchDone;
+            Database* db = m_filter->database();
+
+            ParallelFor search(batches, 1, [&](int b, int)
             {
-                if (rs != NO_MOVE)
-                    games += 1;
-            }
-            ProgressUpdate(moves, games, processed, total);
+                if (m_break)
+                {
+                    return;
+                }
+                OpeningTreeBatch& batch = out[b];
+                int last = std::min(total, (b + 1) * batchSize);
+                for (int gameId = b * batchSize; gameId < last; ++gameId)
+                {
+                    if (m_sourceIsDatabase || m_filter->contains(gameId))
+                        batch.games.append(gameId);
+                }
+                if (parent >= 0)
+                {
+                    QList<MoveId> previous;
+                    for (auto gameId: batch.games)
+                    {
+                        previous.append(previousNodes.at(gameId));
+                    }
+                    db->findNextPosition(m_board, step, batch.games, previous, batch.nodes, batch.moves);
+                }
+                else
+                {
+                    db->findPosition(m_board, opts, batch.games, batch.nodes, batch.moves);
+                }
+                QMutexLocker lock(&mutex);
+                batch.done = true;
+                batchDone.wakeAll();
+            });
 
-            // update filter if necessary
-            if (m_updateFilter)
+            // Merge the batches in their order, so that the filter is updated game by game
+            for (int b = 0; b < batches; ++b)
             {
-                for (auto i = 0; i < rqBuffer.size(); ++i)
                 {
-                    auto rq = rqBuffer.at(i);
-                    auto rs = rsBuffer.at(i);
-                    emit requestGameFilterUpdate(rq, rs + 1);
+                    QMutexLocker lock(&mutex);
+                    while (!out[b].done && !m_break)
+                    {
+                        batchDone.wait(&mutex, 100);
+                    }
+                }
+                if (!out[b].done)
+                {
+                    break;
+                }
+                OpeningTreeBatch batch;
+                std::swap(batch, out[b]);
+                for (auto it = batch.moves.cbegin(); it != batch.moves.cend(); ++it)
+                {
+                    auto found = moves.find(it.key());
+                    if (found == moves.end())
+                        moves.insert(it.key(), it.value());
+                    else
+                        found.value() += it.value();
+                }
+
+                // update progress
+                for (auto rs: batch.nodes)
+                {
+                    if (rs != NO_MOVE)
+                        games += 1;
+                    if (m_sourceIsDatabase)
+                        result.nodes.append(rs);
+                }
+                ProgressUpdate(moves, games, std::min(total, (b + 1) * batchSize), total);
+
+                // update filter if necessary
+                if (m_updateFilter)
+                {
+                    for (auto i = 0; i < batch.games.size(); ++i)
+                    {
+                        emit requestGameFilterUpdate(batch.games.at(i), batch.nodes.at(i) + 1);
+                    }
+                }
+
+                // interrupt if requested
+                if (m_break)
+                {
+                    break;
                 }
             }
+            search.stop();
+            search.wait();
 
-            // interrupt if requested
-            if (m_break)
+            if (cacheable && (m_sourceIsDatabase || !m_updateFilter) && !m_break)
             {
-                break;
+                cache->insert(m_board, m_bEnd, source, result.generation, moves, games);
+            }
+            if (m_sourceIsDatabase && !m_break)
+            {
+                result.moves = moves;
+                result.games = games;
+                m_recent.prepend(result);
+                while (m_recent.count() > RecentPositions)
+                {
+                    m_recent.removeLast();
+                }
             }
         }
     }
@@ -139,6 +249,51 @@ void OpeningTreeThread::run()
     }
 }
 
+bool OpeningTreeThread::sameSource(const PositionResult& a, const PositionResult& b)
+{
+    return a.database && a.database == b.database && a.generation == b.generation && a.size == b.size;
+}
+
+int OpeningTreeThread::findRecent(const PositionResult& key) const
+{
+    for (int i = 0; i < m_recent.count(); ++i)
+    {
+        const PositionResult& result = m_recent.at(i);
+        if (sameSource(result, key) && result.bEnd == key.bEnd && result.board == key.board)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int OpeningTreeThread::findParent(const PositionResult& key, Move& move) const
+{
+    for (int i = 0; i < m_recent.count(); ++i)
+    {
+        const PositionResult& result = m_recent.at(i);
+        if (!sameSource(result, key) || result.bEnd)
+        {
+            continue;
+        }
+        for (auto it = result.moves.cbegin(); it != result.moves.cend(); ++it)
+        {
+            if (!it.key().isLegal())
+            {
+                continue;
+            }
+            BoardX board = result.board;
+            board.doMove(it.key());
+            if (board == key.board)
+            {
+                move = it.key();
+                return i;
+            }
+        }
+    }
+    return -1;
+}
+
 void OpeningTreeThread::cancel()
 {
     m_break = true;
@@ -5,6 +5,7 @@
 #ifndef OPENINGTREETHREAD_H
 #define OPENINGTREETHREAD_H
 
+#include "database.h"
 #include "filter.h"
 #include "gamex.h"
 #include "movedata.h"
@@ -30,6 +31,27 @@ signals:
 protected:
     void ProgressUpdate(QMap<Move, MoveData>& moves, unsigned int games, int i, int n);
 private:
+    /** Tree of a position over all games of a database */
+    struct PositionResult
+    {
+        QPointer<Database> database;
+        unsigned int generation;
+        int size;
+        BoardX board;
+        bool bEnd;
+        QMap<Move, MoveData> moves;
+        unsigned int games;
+        /** Node reaching the position in each game, NO_MOVE if it is not reached */
+        QVector<MoveId> nodes;
+    };
+
+    /** @return true if @p a and @p b are taken from the same state of the same database */
+    static bool sameSource(const PositionResult& a, const PositionResult& b);
+    /** @return the index of the recent result for @p key, or -1 */
+    int findRecent(const PositionResult& key) const;
+    /** @return the index of a recent result one move before @p key, or -1. @p move receives the move */
+    int findParent(const PositionResult& key, Move& move) const;
+
     unsigned int* m_games;
 
     bool    m_break;
@@ -38,6 +60,9 @@ private:
     bool m_updateFilter;
     bool m_sourceIsDatabase;
     bool m_bEnd;
+
+    /** Recently calculated positions, the latest first */
+    QList<PositionResult> m_recent;
 };
 
 #endif // OPENINGTREETHREAD_H
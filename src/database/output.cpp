@@ -10,9 +10,13 @@
 
 #include <algorithm>
 #include <QMap>
+#include <QMutex>
+#include <QSaveFile>
+#include <QWaitCondition>
 
 #include "board.h"
 #include "output.h"
+#include "parallelfor.h"
 #include "settings.h"
 #include "tags.h"
 #include "partialdate.h"
@@ -30,6 +34,9 @@ const char* DEFAULT_PGN_TEMPLATE = "pgn-default.template";
 
 QMap<Output::OutputType, QString> Output::m_outputMap;
 
+/** Games per work item when saving a database */
+static const int SaveChunk = 256;
+
 Output::Output(OutputType output, BoardRenderingFunc renderer, const QString& pathToTemplateFile)
     : m_renderer(renderer)
     , m_outputType(output)
@@ -56,6 +63,22 @@ Output::Output(OutputType output, BoardRenderingFunc renderer, const QString& pa
     initialize();
 }
 
+Output::Output(const Output* prototype)
+    : m_options(prototype->m_options)
+    , m_templateFilename(prototype->m_templateFilename)
+    , m_renderer(prototype->m_renderer)
+    , m_header(prototype->m_header)
+    , m_footer(prototype->m_footer)
+    , m_outputType(prototype->m_outputType)
+    , m_dirtyBlack(false)
+    , m_currentVariationLevel(0)
+    , m_newlineChar(prototype->m_newlineChar)
+    , m_startTagMap(prototype->m_startTagMap)
+    , m_endTagMap(prototype->m_endTagMap)
+    , m_expandable(prototype->m_expandable)
+{
+}
+
 Output::~Output()
 {
 }
@@ -938,18 +961,152 @@ void Output::output(const QString& filename, FilterX& filter)
 
 void Output::output(const QString& filename, Database& database)
 {
-    QFile f(filename);
-    if(!f.open(QIODevice::WriteOnly | QIODevice::Text))
+    if(save(filename, database))
     {
-        return;
+        database.setModified(false);
     }
-    QTextStream out(&f);
-    if((m_outputType == Html) || (m_outputType == NotationWidget))
+}
+
+QByteArray Output::fileLineEnds(QByteArray text)
+{
+#ifdef Q_OS_WIN
+    text.replace("\n", "\r\n");
+#endif
+    return text;
+}
+
+bool Output::save(const QString& filename, Database& database, const QAtomicInt* cancel, QVector<qint64>* offsets)
+{
+    QSaveFile file(filename);
+    if(!file.open(QIODevice::WriteOnly))
     {
-        out.setCodec(QTextCodec::codecForName("utf8"));
+        return false;
     }
-    output(out, database);
-    f.close();
+    const bool latin1 = !database.isUtf8() && (m_outputType == Pgn);
+    // The line ends are converted here, the offsets count the bytes in the file
+    auto encode = [latin1](const QString& text)
+    {
+        return fileLineEnds(latin1 ? text.toLatin1() : text.toUtf8());
+    };
+
+    const int count = static_cast<int>(database.count());
+    const int chunks = (count + SaveChunk - 1) / SaveChunk;
+    const int window = 2 * QThread::idealThreadCount(); // Rendered chunks waiting for the writer
+    QVector<QByteArray> texts(chunks);
+    QVector<bool> ready(chunks, false);
+    QVector<int> sizes(count);
+    int* gameSizes = sizes.data();
+    QMutex mutex;
+    QWaitCondition chunkReady;
+    QWaitCondition chunkWritten;
+    int written = 0;
+    bool stop = false;
+
+    // Every range is one chunk, the chunks are taken in order
+    ParallelFor rendering(chunks, 1, [&](int chunk, int)
+    {
+        {
+            QMutexLocker lock(&mutex);
+            while (!stop && chunk >= written + window)
+            {
+                chunkWritten.wait(&mutex);
+            }
+            if (stop)
+            {
+                return;
+            }
+        }
+        Output renderer(this);
+        QByteArray text;
+        int last = qMin((chunk + 1) * SaveChunk, count);
+        for (int i = chunk * SaveChunk; i < last; ++i)
+        {
+            int size = text.size();
+            GameX game;
+            if (database.loadGame(i, game))
+            {
+                QString gameText = renderer.outputTags(&game);
+                QString moves = renderer.outputGame(&game, false);
+                renderer.postProcessOutput(moves);
+                text += encode(gameText + moves + "\n\n");
+            }
+            gameSizes[i] = text.size() - size;
+        }
+        QMutexLocker lock(&mutex);
+        texts[chunk] = text;
+        ready[chunk] = true;
+        chunkReady.wakeAll();
+    });
+
+    QString header = m_header;
+    postProcessOutput(header);
+    QByteArray headerText = encode(header);
+    bool ok = (file.write(headerText) == headerText.size());
+
+    // Write the chunks in their order as soon as they are rendered
+    int percentDone = 0;
+    for (int chunk = 0; ok && chunk < chunks; ++chunk)
+    {
+        QByteArray text;
+        {
+            QMutexLocker lock(&mutex);
+            while (!ready.at(chunk) && !(cancel && cancel->load()))
+            {
+                chunkReady.wait(&mutex, 100);
+            }
+            if (cancel && cancel->load())
+            {
+                ok = false;
+                break;
+            }
+            text.swap(texts[chunk]);
+            written = chunk + 1;
+            chunkWritten.wakeAll();
+        }
+        ok = (file.write(text) == text.size());
+        int percentDone2 = (chunk + 1) * 100 / chunks;
+        if(percentDone2 > percentDone)
+        {
+            emit progress((percentDone = percentDone2));
+        }
+    }
+    {
+        QMutexLocker lock(&mutex);
+        stop = true;
+        chunkWritten.wakeAll();
+    }
+    rendering.stop();
+    rendering.wait();
+
+    if (ok)
+    {
+        QString footer = m_footer;
+        postProcessOutput(footer);
+        QByteArray footerText = encode(footer);
+        ok = (file.write(footerText) == footerText.size());
+    }
+    if (!ok)
+    {
+        file.cancelWriting();
+        return false;
+    }
+    if (!file.commit())
+    {
+        return false;
+    }
+
+    if (offsets)
+    {
+        offsets->resize(count + 1);
+        qint64 pos = headerText.size();
+        for (int i = 0; i < count; ++i)
+        {
+            (*offsets)[i] = pos;
+            pos += sizes.at(i);
+        }
+        (*offsets)[count] = pos;
+    }
+    return true;
 }
 
 bool Output::append(const QString& filename, GameX& game)
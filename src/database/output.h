@@ -134,6 +134,14 @@ public:
      * @param database A pointer to a database object. All games in the database will be output, one
      *               after the other, using the output(GameX* game) method */
     void output(const QString& filename, Database& database);
+    /** Write all games of the given database to a file.
+     * Batches of games are loaded and rendered in parallel and written in their order.
+     * The file is only replaced after all games are written, so that a failed or
+     * cancelled save leaves the old file intact.
+     * @param cancel The save stops as soon as it is set
+     * @param offsets If given, receives the position of each game in the file, followed by the end of the last game
+     * @return true if the file was written */
+    bool save(const QString& filename, Database& database, const QAtomicInt* cancel = nullptr, QVector<qint64>* offsets = nullptr);
 
     /** Append output to a closed file */
     bool append(const QString& filename, GameX& game);
@@ -147,6 +155,8 @@ public:
     void setTemplateFile(QString filename = "");
     /** Static list of objects. */
     static QMap<OutputType, QString>& getFormats();
+    /** @return @p text with the line ends of a text file on this platform, as QIODevice::Text writes them */
+    static QByteArray fileLineEnds(QByteArray text);
 
 signals:
     /** Operation progress. */
@@ -154,6 +164,9 @@ signals:
 protected:
     QString outputTags(const GameX *game);
 private:
+    /** Creates a copy of @p prototype for rendering in another thread, without reading the template again */
+    explicit Output(const Output* prototype);
+
     /* User definable settings */
     OutputOptions m_options;
     /** The name of the current template file */
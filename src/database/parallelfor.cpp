@@ -0,0 +1,70 @@
+#include <QRunnable>
+
+#include "parallelfor.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+class ParallelFor::Task : public QRunnable
+{
+public:
+    explicit Task(ParallelFor* loop) : m_loop(loop) {}
+    void run() { m_loop->work(); }
+private:
+    ParallelFor* m_loop;
+};
+
+ParallelFor::ParallelFor(int count, int chunkSize, const std::function<void(int, int)>& f, int threads) :
+    m_f(f),
+    m_count(count),
+    m_chunkSize(qMax(chunkSize, 1)),
+    m_next(0),
+    m_done(0),
+    m_stop(0)
+{
+    const int ranges = (count + m_chunkSize - 1) / m_chunkSize;
+    threads = qMin(qMax(threads, 1), ranges);
+    m_pool.setMaxThreadCount(qMax(threads, 1));
+    for (int i = 0; i < threads; ++i)
+    {
+        m_pool.start(new Task(this));
+    }
+}
+
+ParallelFor::~ParallelFor()
+{
+    m_pool.waitForDone();
+}
+
+bool ParallelFor::wait(int msecs)
+{
+    return m_pool.waitForDone(msecs);
+}
+
+void ParallelFor::stop()
+{
+    m_stop = 1;
+}
+
+void ParallelFor::run(int count, int chunkSize, const std::function<void(int, int)>& f)
+{
+    ParallelFor loop(count, chunkSize, f);
+    loop.wait();
+}
+
+void ParallelFor::work()
+{
+    for (;;)
+    {
+        const int first = m_next.fetchAndAddOrdered(m_chunkSize);
+        if (first >= m_count || m_stop.load())
+        {
+            return;
+        }
+        const int last = qMin(first + m_chunkSize, m_count);
+        m_f(first, last);
+        m_done.fetchAndAddRelaxed(last - first);
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef PARALLELFOR_H_INCLUDED
+#define PARALLELFOR_H_INCLUDED
+
+#include <QAtomicInt>
+#include <QThread>
+#include <QThreadPool>
+
+#include <functional>
+
+/** @ingroup Database
+   The ParallelFor class runs a loop over [0, count) on the threads of a
+   private pool. The workers take ranges of consecutive items in ascending
+   order, so results stored by item may be merged in order as soon as their
+   ranges are done. The loop starts when the object is created; the caller
+   may do other work meanwhile, e.g. report the progress, and must wait()
+   before the data used by the loop goes away. The destructor waits as well.
+*/
+
+class ParallelFor
+{
+public:
+    /** Starts calling @p f(first, last) for ranges of @p chunkSize items of [0, @p count) on up to @p threads threads */
+    ParallelFor(int count, int chunkSize, const std::function<void(int, int)>& f, int threads = QThread::idealThreadCount());
+    ~ParallelFor();
+
+    /** Waits up to @p msecs for all ranges to be done, forever if negative. @return true if they are done */
+    bool wait(int msecs = -1);
+    /** Hands out no more ranges, the running ones are finished */
+    void stop();
+    /** @return the number of items of the ranges done so far */
+    int done() const { return m_done.load(); }
+
+    /** Call @p f(first, last) for ranges of @p chunkSize items of [0, @p count) on all cores and wait for them */
+    static void run(int count, int chunkSize, const std::function<void(int, int)>& f);
+
+private:
+    Q_DISABLE_COPY(ParallelFor)
+    class Task;
+    void work();
+
+    std::function<void(int, int)> m_f;
+    int m_count;
+    int m_chunkSize;
+    QAtomicInt m_next;
+    QAtomicInt m_done;
+    QAtomicInt m_stop;
+    QThreadPool m_pool;
+};
+
+#endif // PARALLELFOR_H_INCLUDED
@@ -108,6 +108,16 @@ bool PartialDate::isValid() const
     return m_bIsValid;
 }
 
+qint32 PartialDate::packed() const
+{
+    return (static_cast<qint32>(m_year) << 9) | (qMin<int>(m_month, 15) << 5) | qMin<int>(m_day, 31);
+}
+
+PartialDate PartialDate::fromPacked(qint32 packed)
+{
+    return PartialDate(packed >> 9, (packed >> 5) & 15, packed & 31);
+}
+
 QString PartialDate::asString() const
 {
     if(!m_year)
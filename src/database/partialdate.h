@@ -50,6 +50,10 @@ public:
     QString range(const PartialDate& d) const;
     /** Test if PartialDate is valid */
     bool isValid() const;
+    /** @return the date packed into an integer, packed dates compare like the dates themselves */
+    qint32 packed() const;
+    /** Creates a date from a value returned by packed() */
+    static PartialDate fromPacked(qint32 packed);
 
     PartialDate(const PartialDate& rhs)
     {
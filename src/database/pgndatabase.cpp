@@ -11,13 +11,17 @@
  ***************************************************************************/
 
 #include <QDir>
+#include <QSaveFile>
 #include <QStringList>
 #include <QtDebug>
 #include <QMutexLocker>
 
+#include <cstring>
+
 #include "board.h"
 #include "nag.h"
 
+#include "parallelfor.h"
 #include "pgndatabase.h"
 #include "settings.h"
 #include "tags.h"
@@ -29,6 +33,9 @@ using namespace chessx;
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
+/** Files smaller than this are indexed on a single thread */
+static const qint64 ParallelIndexMinSize = 16 * 1024 * 1024;
+
 PgnDatabase::PgnDatabase() : Database()
 {
     initialise();
@@ -167,14 +174,14 @@ bool PgnDatabase::readOffsetFile(const QString& filename, volatile bool *breakFl
 
     emit progress(20);
 
-    readIndexFile(in, breakFlag, version);
+    bool indexRead = readIndexFile(in, breakFlag, version);
     bUpdate = (version < VERSION_INDEX_CURRENT);
 
     emit progress(80);
 
     unsigned short finalMagic;
     in >> finalMagic;
-    if(*breakFlag || (finalMagic != 0x55ec))
+    if(!indexRead || *breakFlag || (finalMagic != 0x55ec))
     {
         m_index.clear();
         m_gameOffsets32.clear();
@@ -193,7 +200,8 @@ bool PgnDatabase::writeOffsetFile(const QString& filename) const
         return false;
     }
 
-    QFile file(offsetFilename(filename));
+    // The index read from the old file may still be mapped, replace the file instead of overwriting it
+    QSaveFile file(offsetFilename(filename));
     if(!file.open(QIODevice::WriteOnly))
     {
         return false;
@@ -226,7 +234,7 @@ bool PgnDatabase::writeOffsetFile(const QString& filename) const
     unsigned short finalMagic = 0x55ec;
     out << finalMagic;
 
-    return true;
+    return file.commit();
 }
 
 bool PgnDatabase::parseFile()
@@ -249,7 +257,7 @@ bool PgnDatabase::parseFile()
         return false;
     }
 
-    bool ok = parseFileIntern();
+    bool ok = parseFileParallel();
     if (ok)
     {
         writeOffsetFile(m_filename);
@@ -260,22 +268,22 @@ bool PgnDatabase::parseFile()
 bool PgnDatabase::parseFileIntern()
 {
     //indexing game positions in the file, game contents are ignored
-    qint64 size = m_file->size();
+    qint64 size = fileSize();
     int oldFp = -3;
 
     qint64 countDiff = size / 100;
     qint64 nextDiff = countDiff;
     percentDone = 0;
-    m_index.reserve(size/1000);
+    m_index.reserve((size - filePos())/1000);
 
-    while(!m_file->atEnd() || !m_currentLine.isEmpty())
+    while(!fileAtEnd() || !m_currentLine.isEmpty())
     {
         if(m_break)
         {
             return false;
         }
         IndexBaseType fp;
-        if (!m_file->atEnd())
+        if (!fileAtEnd())
         {
             fp = skipJunk();
             if(fp == oldFp)
@@ -287,7 +295,7 @@ bool PgnDatabase::parseFileIntern()
         }
         else
         {
-            fp = m_file->pos() - m_lineBuffer.size();
+            fp = filePos() - m_lineBuffer.size();
             if (fp == oldFp)
             {
                 break;
@@ -301,7 +309,7 @@ bool PgnDatabase::parseFileIntern()
             {
                 if (!addOffset(fp))
                 {
-                    m_file->seek(m_file->size());
+                    fileSeek(fileSize());
                 }
                 else
                 {
@@ -309,7 +317,7 @@ bool PgnDatabase::parseFileIntern()
                     parseGame();
                 }
 
-                if(!m_file->atEnd())
+                if(!fileAtEnd())
                 {
                     if(fp > nextDiff)
                     {
@@ -330,6 +338,156 @@ bool PgnDatabase::parseFileIntern()
     return true;
 }
 
+IndexBaseType PgnDatabase::findGameStart(IndexBaseType pos) const
+{
+    const char* end = m_map + m_mapSize;
+    const char* p = static_cast<const char*>(memchr(m_map + pos, '\n', static_cast<size_t>(m_mapSize - pos)));
+    if(!p)
+    {
+        return -1;
+    }
+    ++p;
+
+    // A game starts with an Event tag after an empty line which follows move text
+    bool afterTag = true;
+    bool afterEmptyLine = false;
+    while(p < end)
+    {
+        const char* newLine = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char* lineEnd = newLine ? newLine + 1 : end;
+        if(!afterTag && afterEmptyLine && (lineEnd - p > 7) && !memcmp(p, "[Event ", 7))
+        {
+            return p - m_map;
+        }
+        const char* c = p;
+        while(c < lineEnd && isspace(static_cast<unsigned char>(*c)))
+        {
+            ++c;
+        }
+        afterEmptyLine = (c == lineEnd);
+        if(!afterEmptyLine)
+        {
+            afterTag = (*c == '[');
+        }
+        p = lineEnd;
+    }
+    return -1;
+}
+
+void PgnDatabase::parseShard()
+{
+    parseFileIntern();
+}
+
+bool PgnDatabase::parseFileParallel()
+{
+    int threads = QThread::idealThreadCount();
+    if(!m_map || threads < 2 || m_mapSize < ParallelIndexMinSize)
+    {
+        return parseFileIntern();
+    }
+
+    // Split the file into byte ranges, each range starts with a game
+    int shards = threads * 4;
+    QVector<IndexBaseType> bounds;
+    bounds << 0;
+    for(int i = 1; i < shards; ++i)
+    {
+        IndexBaseType pos = m_mapSize * i / shards;
+        if(pos <= bounds.last())
+        {
+            continue;
+        }
+        IndexBaseType start = findGameStart(pos);
+        if(start < 0)
+        {
+            break;
+        }
+        bounds << start;
+    }
+    bounds << m_mapSize;
+    if(bounds.count() < 3)
+    {
+        return parseFileIntern();
+    }
+
+    // Every shard indexes its range into a private index, the mapping is shared
+    QVector<PgnDatabase*> workers;
+    for(int i = 0; i + 1 < bounds.count(); ++i)
+    {
+        PgnDatabase* worker = new PgnDatabase;
+        worker->m_map = m_map;
+        worker->m_mapPos = bounds.at(i);
+        worker->m_mapSize = bounds.at(i + 1);
+        worker->m_utf8 = m_utf8;
+        worker->bUse64bit = bUse64bit;
+        workers << worker;
+    }
+
+    ParallelFor loop(workers.count(), 1, [&workers](int shard, int)
+    {
+        workers.at(shard)->parseShard();
+    }, threads);
+    while(!loop.wait(100))
+    {
+        if(m_break)
+        {
+            foreach(PgnDatabase* worker, workers)
+            {
+                worker->m_break = true;
+            }
+        }
+        emit progress(loop.done() * 99 / workers.count());
+    }
+
+    // Merge the shards in game order
+    bool ok = !m_break;
+    if(ok)
+    {
+        IndexBaseType total = 0;
+        foreach(PgnDatabase* worker, workers)
+        {
+            total += worker->m_count;
+        }
+        m_allocated = total;
+        if(bUse64bit)
+        {
+            m_gameOffsets64.resize(static_cast<int>(total));
+        }
+        else
+        {
+            m_gameOffsets32.resize(static_cast<int>(total));
+        }
+        foreach(PgnDatabase* worker, workers)
+        {
+            for(GameId gameId = 0; gameId < worker->m_count; ++gameId)
+            {
+                if(bUse64bit)
+                {
+                    m_gameOffsets64[m_count] = worker->offset(gameId);
+                }
+                else
+                {
+                    m_gameOffsets32[m_count] = static_cast<quint32>(worker->offset(gameId));
+                }
+                ++m_count;
+            }
+            m_index.appendIndex(worker->m_index);
+        }
+        m_index.squeeze();
+    }
+
+    foreach(PgnDatabase* worker, workers)
+    {
+        worker->m_map = nullptr; // The mapping belongs to this database
+        worker->m_lineBuffer.clear();
+        delete worker;
+    }
+
+    emit progress(100);
+    return ok;
+}
+
 bool PgnDatabase::openFile(const QString& filename)
 {
     //open file
@@ -341,6 +499,7 @@ bool PgnDatabase::openFile(const QString& filename)
     }
     file->open(QIODevice::ReadOnly);
     m_file = file;
+    mapFile();
     return true;
 }
 
@@ -382,6 +541,8 @@ void PgnDatabase::close()
         QCoreApplication::processEvents();
         QThread::sleep(1);
     }
+    unmapFile();
+    m_lineBuffer.clear();
     if(m_file)
     {
         m_file->close();
@@ -415,9 +576,172 @@ void PgnDatabase::loadGameMoves(GameId gameId, GameX& game)
 
 int PgnDatabase::findPosition(GameId index, const BoardX &position)
 {
-    GameX g;
-    loadGameMoves(index, g);
-    return g.cursor().findPosition(position);
+    PositionReplay replay(position);
+    return replayToPosition(index, replay);
+}
+
+inline bool isPgnSpace(char c)
+{
+    return isspace(static_cast<unsigned char>(c));
+}
+
+/** Feed the main line of the PGN text [p, end) of a single game to @p replay.
+    @return false if the text needs the full parser, e.g. because of variations */
+static bool replayMoveText(const char* p, const char* end, PositionReplay& replay)
+{
+    // Skip the tags and the white space following them, as skipTags() does
+    while (p < end)
+    {
+        if (*p == '[')
+        {
+            const char* newLine = static_cast<const char*>(memchr(p, '\n', static_cast<size_t>(end - p)));
+            p = newLine ? newLine + 1 : end;
+        }
+        else if (isPgnSpace(*p))
+        {
+            ++p;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    MoveId moveId = ROOT_NODE;
+    char san[16];
+    while (p < end)
+    {
+        char c = *p;
+        if (isPgnSpace(c))
+        {
+            ++p;
+        }
+        else if (c == '{')
+        {
+            p = static_cast<const char*>(memchr(p, '}', static_cast<size_t>(end - p)));
+            if (!p)
+            {
+                return false;
+            }
+            ++p;
+        }
+        else if (c == '[' || c == '*')
+        {
+            return true; // End of the game
+        }
+        else if (c == '$' || c == '!' || c == '?' || c == '+' || c == '=' || c == '#')
+        {
+            // NAGs and evaluation symbols
+            while (p < end && !isPgnSpace(*p) && strchr("$!?+-=/#0123456789", *p))
+            {
+                ++p;
+            }
+        }
+        else if (isalnum(static_cast<unsigned char>(c)))
+        {
+            const char* q = p;
+            while (q < end && isdigit(static_cast<unsigned char>(*q)))
+            {
+                ++q;
+            }
+            if (q != p && q < end && *q == '.')
+            {
+                // Move number
+                while (q < end && *q == '.')
+                {
+                    ++q;
+                }
+                p = q;
+                continue;
+            }
+            if ((end - p >= 3) && (!strncmp(p, "1-0", 3) || !strncmp(p, "0-1", 3) || !strncmp(p, "1/2", 3)))
+            {
+                return true; // Result
+            }
+
+            q = p;
+            while (q < end && !isPgnSpace(*q) && !strchr("{}()!?+#$;.", *q))
+            {
+                ++q;
+            }
+            if (q - p >= static_cast<int>(sizeof(san)) || (q < end && *q == '.'))
+            {
+                return false;
+            }
+            memcpy(san, p, static_cast<size_t>(q - p));
+            san[q - p] = 0;
+            p = q;
+
+            Move move = replay.board().parseMove(san);
+            if (!move.isLegal() && !move.isNullMove())
+            {
+                return true; // The parser stops at illegal moves as well
+            }
+            if (!replay.play(move, ++moveId))
+            {
+                return true;
+            }
+        }
+        else
+        {
+            return false; // Variations, null moves written as "--", escapes etc.
+        }
+    }
+    return true;
+}
+
+MoveId PgnDatabase::replayToPosition(GameId gameId, PositionReplay& replay)
+{
+    const char* begin;
+    const char* end;
+    QString fen;
+    QString variant;
+    {
+        // The lock only covers finding the text, the mapping stays valid while the database is referenced
+        QMutexLocker m(&m_mutex);
+        if(!m_file || gameId >= m_count)
+        {
+            return NO_MOVE;
+        }
+
+        IndexBaseType from = offset(gameId);
+        IndexBaseType to = (static_cast<IndexBaseType>(gameId) + 1 < m_count) ? offset(gameId + 1) : fileSize();
+        if(m_map)
+        {
+            begin = m_map + from;
+            end = m_map + qMin(to, m_mapSize);
+        }
+        else
+        {
+            QByteArray& buffer = replay.buffer();
+            buffer.resize(static_cast<int>(qMax(to - from, IndexBaseType(0))));
+            qint64 n = m_file->seek(from) ? m_file->read(buffer.data(), buffer.size()) : 0;
+            begin = buffer.constData();
+            end = begin + qMax(n, qint64(0));
+        }
+
+        fen = m_index.tagValue(TagNameFEN, gameId);
+        if(fen != "?")
+        {
+            variant = m_index.tagValue(TagNameVariant, gameId).toLower();
+        }
+    }
+
+    bool started;
+    if(fen != "?")
+    {
+        BoardX board;
+        board.setChess960(variant.startsWith("fischer", Qt::CaseInsensitive) || variant.endsWith("960"));
+        board.fromFen(fen);
+        started = replay.start(board);
+    }
+    else
+    {
+        started = replay.start(BoardX::standardStartBoard);
+    }
+    bool replayed = !started || replayMoveText(begin, end, replay);
+    // Anything unusual is left to the full parser
+    return replayed ? replay.moveId() : Database::replayToPosition(gameId, replay);
 }
 
 bool PgnDatabase::loadGame(GameId gameId, GameX& game)
@@ -450,6 +774,9 @@ bool PgnDatabase::loadGame(GameId gameId, GameX& game)
 void PgnDatabase::initialise()
 {
     m_file = nullptr;
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_mapPos = 0;
     m_inComment = false;
     m_inPreComment = false;
     m_filename = QString();
@@ -459,31 +786,116 @@ void PgnDatabase::initialise()
 
 void PgnDatabase::readLine()
 {
-    if(m_file->atEnd())
+    if(fileAtEnd())
     {
         m_lineBuffer.clear();
         m_currentLine.clear();
         return;
     }
-    m_lineBuffer = m_file->readLine();
+    readRawLine();
     prepareNextLineForMoveParser();
 }
 
 void PgnDatabase::readTagLine()
 {
-    m_lineBuffer = m_file->readLine();
+    readRawLine();
     prepareNextLine();
 }
 
 void PgnDatabase::skipLine()
 {
-    m_lineBuffer = m_file->readLine();
+    readRawLine();
+}
+
+void PgnDatabase::readRawLine()
+{
+    if(!m_map)
+    {
+        m_lineBuffer = m_file->readLine();
+        return;
+    }
+    // Point the line buffer into the mapping, the bytes are neither copied nor converted
+    const char* begin = m_map + m_mapPos;
+    const char* newLine = static_cast<const char*>(memchr(begin, '\n', static_cast<size_t>(m_mapSize - m_mapPos)));
+    qint64 length = newLine ? (newLine - begin + 1) : (m_mapSize - m_mapPos);
+    m_lineBuffer.setRawData(begin, static_cast<uint>(length));
+    m_mapPos += length;
+}
+
+IndexBaseType PgnDatabase::fileSize() const
+{
+    return m_map ? m_mapSize : m_file->size();
+}
+
+bool PgnDatabase::fileAtEnd() const
+{
+    return m_map ? (m_mapPos >= m_mapSize) : m_file->atEnd();
+}
+
+IndexBaseType PgnDatabase::filePos() const
+{
+    return m_map ? m_mapPos : m_file->pos();
+}
+
+bool PgnDatabase::fileSeek(IndexBaseType pos)
+{
+    if(!m_map)
+    {
+        return m_file->seek(pos);
+    }
+    if(pos < 0 || pos > m_mapSize)
+    {
+        return false;
+    }
+    m_mapPos = pos;
+    return true;
+}
+
+bool PgnDatabase::mapFile()
+{
+    QFile* file = qobject_cast<QFile*>(m_file.data());
+    if(!file || m_map || !AppSettings->getValue("/General/mapPgnFiles").toBool())
+    {
+        return false;
+    }
+    qint64 size = file->size();
+    if(size <= 0 || size != static_cast<qint64>(static_cast<size_t>(size)))
+    {
+        return false;
+    }
+    uchar* map = file->map(0, size);
+    if(!map)
+    {
+        return false; // e.g. pipes or special files, keep reading through m_file
+    }
+    m_map = reinterpret_cast<const char*>(map);
+    m_mapSize = size;
+    m_mapPos = file->pos();
+    return true;
+}
+
+void PgnDatabase::unmapFile()
+{
+    if(!m_map)
+    {
+        return;
+    }
+    m_lineBuffer = QByteArray(m_lineBuffer.constData(), m_lineBuffer.size()); // Detach from the mapping
+    QFile* file = qobject_cast<QFile*>(m_file.data());
+    if(file)
+    {
+        file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(m_map)));
+        file->seek(m_mapPos);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_mapPos = 0;
 }
 
 void PgnDatabase::seekGame(GameId gameId)
 {
     IndexBaseType n = offset(gameId);
-    if(!m_file->seek(n))
+    if(!fileSeek(n))
     {
         qDebug() << "Seeking offset " << QString::number(n) << " failed!";
     }
@@ -559,20 +971,20 @@ void PgnDatabase::parseTagsIntoIndex()
             if (pos != -1)
             {
                 QString remainder = m_currentLine.mid(pos);
-                if (m_file->atEnd()) { m_currentLine = remainder; break; }
+                if (fileAtEnd()) { m_currentLine = remainder; break; }
                 readTagLine();
-                m_currentLine.prepend(remainder); // TODO - Problem hier ist, dass der m_lineBuffer leer ist bei m_file->atEnd() und dann der remainder nicht richtig geparst wird
+                m_currentLine.prepend(remainder); // TODO - Problem hier ist, dass der m_lineBuffer leer ist bei fileAtEnd() und dann der remainder nicht richtig geparst wird
             }
         }
         else
         {
-            if (m_file->atEnd()) break;
+            if (fileAtEnd()) break;
             readTagLine();
         }
     }
 
     // skip empty lines
-    while(m_currentLine.isEmpty() && !m_file->atEnd())
+    while(m_currentLine.isEmpty() && !fileAtEnd())
     {
         readLine();
     }
@@ -603,7 +1015,7 @@ bool PgnDatabase::parseMoves(GameX* game)
             }
         }
     }
-    while(!m_gameOver && (!m_file->atEnd() || m_currentLine != ""));
+    while(!m_gameOver && (!fileAtEnd() || m_currentLine != ""));
 
     if(m_gameOver)
     {
@@ -927,6 +1339,59 @@ void PgnDatabase::parseComment(GameX* game)
     }
 }
 
+/** @return the last move number of the main line in the move text [begin, end) or -1 */
+static int lastMoveNumber(const char* begin, const char* end)
+{
+    int result = -1;
+    int depth = 0;
+    bool inComment = false;
+    bool afterSpace = true;
+    for(const char* p = begin; p < end; ++p)
+    {
+        char c = *p;
+        if(inComment)
+        {
+            inComment = (c != '}');
+            continue;
+        }
+        switch(c)
+        {
+        case '{':
+            inComment = true;
+            break;
+        case '(':
+            ++depth;
+            break;
+        case ')':
+            if(depth) --depth;
+            break;
+        default:
+            if(!depth && afterSpace && c >= '0' && c <= '9')
+            {
+                int number = 0;
+                const char* q = p;
+                while(q < end && *q >= '0' && *q <= '9')
+                {
+                    number = number * 10 + (*q++ - '0');
+                }
+                while(q < end && isspace(static_cast<unsigned char>(*q)))
+                {
+                    ++q;
+                }
+                if(q < end && *q == '.')
+                {
+                    result = number;
+                }
+                p = q - 1;
+                c = *p;
+            }
+            break;
+        }
+        afterSpace = isspace(static_cast<unsigned char>(c));
+    }
+    return result;
+}
+
 inline bool onlyWhite(const QByteArray& b)
 {
     for(int i = 0; i < b.length(); ++i)
@@ -958,22 +1423,22 @@ void PgnDatabase::prepareNextLineForMoveParser()
 IndexBaseType PgnDatabase::skipJunk()
 {
     IndexBaseType fp = -2;
-    if(m_file->atEnd())
+    if(fileAtEnd())
     {
         fp = -1;
     }
 
     while((!m_lineBuffer.length()
             || (m_lineBuffer[0] != '[' && !QChar::isNumber(m_lineBuffer[0])))
-            && !m_file->atEnd())
+            && !fileAtEnd())
     {
-        fp = m_file->pos();
+        fp = filePos();
         skipLine();
     }
 
     if(fp == -2)
     {
-        fp = m_file->pos() - m_lineBuffer.size();
+        fp = filePos() - m_lineBuffer.size();
     }
 
     prepareNextLineForMoveParser();
@@ -983,13 +1448,13 @@ IndexBaseType PgnDatabase::skipJunk()
 
 void PgnDatabase::skipTags()
 {
-    while(m_lineBuffer.length() && (m_lineBuffer[0] == '[') && !m_file->atEnd())
+    while(m_lineBuffer.length() && (m_lineBuffer[0] == '[') && !fileAtEnd())
     {
         skipLine();
     }
 
     //swallow trailing whitespace
-    while(onlyWhite(m_lineBuffer) && !m_file->atEnd())
+    while(onlyWhite(m_lineBuffer) && !fileAtEnd())
     {
         skipLine();
     }
@@ -1006,7 +1471,7 @@ void PgnDatabase::skipMoves()
     }
     if(!tag.isEmpty())
     {
-        while(!onlyWhite(m_lineBuffer) && !m_file->atEnd())
+        while(!onlyWhite(m_lineBuffer) && !fileAtEnd())
         {
             skipLine();
         }
@@ -1016,27 +1481,38 @@ void PgnDatabase::skipMoves()
     }
     else
     {
-        // PERF Costs about 5s in 157s for the ref database (3.1%)
-        QRegExp gameNumber("\\s(\\d+)\\s*\\.");
-
-        QString gameText = " ";
-
-        while(!onlyWhite(m_lineBuffer) && !m_file->atEnd())
+        int moveNumber;
+        if(m_map)
         {
-            gameText += QString(m_lineBuffer) + " ";
-            skipLine();
+            // The move text is contiguous in the mapping, scan it in place
+            IndexBaseType start = filePos() - m_lineBuffer.size();
+            while(!onlyWhite(m_lineBuffer) && !fileAtEnd())
+            {
+                skipLine();
+            }
+            IndexBaseType end = (fileAtEnd() && !onlyWhite(m_lineBuffer)) ? filePos() : filePos() - m_lineBuffer.size();
+            moveNumber = lastMoveNumber(m_map + start, m_map + end);
+        }
+        else
+        {
+            QByteArray gameText;
+            while(!onlyWhite(m_lineBuffer) && !fileAtEnd())
+            {
+                gameText += m_lineBuffer;
+                gameText += ' ';
+                skipLine();
+            }
+            moveNumber = lastMoveNumber(gameText.constData(), gameText.constData() + gameText.size());
         }
 
-        gameText = gameText.remove(QRegExp("\\([^\\(\\)]*\\)"));
-
-        if (gameNumber.lastIndexIn(gameText)>=0)
+        if (moveNumber >= 0)
         {
-            m_index.setTag_nolock(TagNameLength, gameNumber.cap(1), m_count - 1);
+            m_index.setTag_nolock(TagNameLength, QString::number(moveNumber), m_count - 1);
         }
     }
 
     //swallow trailing whitespace
-    while(onlyWhite(m_lineBuffer) && !m_file->atEnd())
+    while(onlyWhite(m_lineBuffer) && !fileAtEnd())
     {
         skipLine();
     }
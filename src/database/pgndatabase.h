@@ -57,6 +57,8 @@ public:
     virtual quint64 count() const;
 
     virtual bool parseFile();
+    /** Index the games of the range a shard has been set up for by parseFileParallel() */
+    void parseShard();
     bool get64bit() const;
     void set64bit(bool value);
 
@@ -84,6 +86,10 @@ protected:
     void parseTagIntoIndex(const QString &tag, QString value);
 
     bool parseFileIntern();
+    /** Index the file using all cores if it is mapped and large enough */
+    bool parseFileParallel();
+    /** @return the start of the first game beginning after @p pos in the mapping or -1 */
+    IndexBaseType findGameStart(IndexBaseType pos) const;
     virtual void parseGame();
 
     bool readIndexFile(QDataStream& in, volatile  bool *breakFlag, short version);
@@ -96,6 +102,8 @@ protected:
     bool openFile(const QString& filename);
 
     bool hasIndexFile() const;
+    /** Replays the main line straight from the file data, without building a GameX if possible */
+    virtual MoveId replayToPosition(GameId gameId, PositionReplay& replay);
 
     /** Resets/initialises important member variables. Called by constructor and close methods */
     void initialise();
@@ -109,9 +117,25 @@ protected:
     void skipLine();
     /** Moves the file position to the start of the given game */
     void seekGame(GameId gameId);
+    /** Reads the next line into m_lineBuffer without any conversion */
+    void readRawLine();
+    /** @return the size of the file, or the end of the range when indexing a shard */
+    IndexBaseType fileSize() const;
+    /** @return true if all data of the file has been read */
+    bool fileAtEnd() const;
+    /** @return the current read position in the file */
+    IndexBaseType filePos() const;
+    /** Moves the read position to @p pos */
+    bool fileSeek(IndexBaseType pos);
+    /** Maps a QFile into memory, lines are then read directly from the mapping */
+    bool mapFile();
+    /** Releases the mapping, reading continues at the same position through m_file */
+    void unmapFile();
 
     void prepareNextLineForMoveParser();
     void prepareNextLine();
+    /** @return the position of game @p gameId in the file */
+    IndexBaseType offset(GameId gameId) const;
 
 protected:
 	IndexBaseType m_count; // Should actually be a GameId - but cannot be changed due to serialization issues
@@ -122,7 +146,6 @@ private:
 
     /** Adds the current file position as a new offset */
     bool addOffset(IndexBaseType offset);
-    IndexBaseType offset(GameId gameId) const;
 
     //file variables
     QString m_filename;
@@ -143,6 +166,11 @@ private:
     QVector<quint32> m_gameOffsets32;
     QVector<quint64> m_gameOffsets64;
     QByteArray m_lineBuffer;
+    /** Memory mapping of the whole file or nullptr if reading through m_file */
+    const char* m_map;
+    /** End of the readable part of the mapping */
+    qint64 m_mapSize;
+    qint64 m_mapPos;
     QStack<MoveId> m_variationStack;
     int percentDone;
 
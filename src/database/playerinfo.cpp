@@ -63,26 +63,6 @@ void PlayerInfo::setName(const QString& player)
     update();
 }
 
-int PlayerInfo::toResult(const QString& res) const
-{
-    if(res.startsWith("1/2"))
-    {
-        return Draw;
-    }
-    else if(res.startsWith('1'))
-    {
-        return WhiteWin;
-    }
-    else if(res.startsWith('0'))
-    {
-        return BlackWin;
-    }
-    else
-    {
-        return ResultUnknown;
-    }
-}
-
 void PlayerInfo::update()
 {
     QHash<QString, EcoFrequencyInfo> openings[2];
@@ -95,46 +75,47 @@ void PlayerInfo::update()
     // Clean previous statistics
     reset();
 
-    for(int i = 0; i < (int)m_database->count(); ++i)
+    // Only the games of the player are visited, a game against oneself counts for White
+    QVector<GameId> games[2];
+    games[White] = index->gamesWithValue(TagNameWhite, player);
+    games[Black] = index->gamesWithValue(TagNameBlack, player);
+    // Read the headers of the games without locking the index for each of them
+    const IndexX::Snapshot headers = index->snapshot();
+
+    for(int c = White; c <= Black; ++c)
     {
-        Color c;
-        if(index->valueIndexFromTag(TagNameWhite, i) == player)
-        {
-            c = White;
-        }
-        else if(index->valueIndexFromTag(TagNameBlack, i) == player)
-        {
-            c = Black;
-        }
-        else
+        foreach(GameId i, games[c])
         {
-            continue;
-        }
-        int res = toResult(index->tagValue(TagNameResult, i));
-        m_result[c][res]++;
-        m_count[c]++;
-        int elo = index->tagValue(c == White ? TagNameWhiteElo : TagNameBlackElo, i).toInt();
-        if(elo)
-        {
-            m_rating[0] = qMin(elo, m_rating[0]);
-            m_rating[1] = qMax(elo, m_rating[1]);
-        }
-        PartialDate date(index->tagValue(TagNameDate, i));
-        if(date.year() > 1000)
-        {
-            m_date[0] = qMin(date, m_date[0]);
-            m_date[1] = qMax(date, m_date[1]);
-        }
-        QString eco = index->tagValue(TagNameECO, i).left(3);
-        if(eco.length() == 3)
-        {
-            openings[c][eco].count++;
-            openings[c][eco].result[res]++;
-        }
-        QString ecoX = index->tagValue(TagNameECO, i).left(4);
-        if(ecoX.length() >= 3)
-        {
-            openingsX[c][ecoX]++;
+            if(c == Black && std::binary_search(games[White].cbegin(), games[White].cend(), i))
+            {
+                continue;
+            }
+            int res = headers.result(i);
+            m_result[c][res]++;
+            m_count[c]++;
+            int elo = headers.elo(i, Color(c));
+            if(elo)
+            {
+                m_rating[0] = qMin(elo, m_rating[0]);
+                m_rating[1] = qMax(elo, m_rating[1]);
+            }
+            PartialDate date = headers.date(i);
+            if(date.year() > 1000)
+            {
+                m_date[0] = qMin(date, m_date[0]);
+                m_date[1] = qMax(date, m_date[1]);
+            }
+            QString eco = headers.tagValue(TagNameECO, i).left(3);
+            if(eco.length() == 3)
+            {
+                openings[c][eco].count++;
+                openings[c][eco].result[res]++;
+            }
+            QString ecoX = headers.tagValue(TagNameECO, i).left(4);
+            if(ecoX.length() >= 3)
+            {
+                openingsX[c][ecoX]++;
+            }
         }
     }
 
@@ -3,8 +3,7 @@
 ****************************************************************************/
 
 #include <QtCore>
-#include <QFuture>
-#include <QtConcurrent/QtConcurrent>
+#include <QtEndian>
 
 #include "polyglotdatabase.h"
 #include "board.h"
@@ -22,13 +21,36 @@ using namespace  chessx;
 
 #define MAX_COUNT 16384
 
-struct key_compare : std::binary_function< const book_entry&, const book_entry&, bool >
+/** Size of an entry in a Polyglot book file */
+static const quint64 PolyglotEntrySize = 16;
+/** Every FenceStride-th key of the book is kept in the fence index */
+static const quint64 FenceStride = 256;
+
+static bool entryLess(const book_entry& a, const book_entry& b)
 {
-    bool operator()( const book_entry& a, const book_entry& b ) const
-    {
-        return a<b;
-    }
-};
+    return a.key < b.key || (a.key == b.key && a.move < b.move);
+}
+
+static bool sameMove(const book_entry& a, const book_entry& b)
+{
+    return a.key == b.key && a.move == b.move;
+}
+
+static void addEntry(book_entry& to, const book_entry& from)
+{
+    to.n += from.n;
+    to.sum += from.sum;
+}
+
+static QDataStream& operator<<(QDataStream& out, const book_entry& entry)
+{
+    return out << entry.key << entry.move << entry.n << entry.sum;
+}
+
+static QDataStream& operator>>(QDataStream& in, book_entry& entry)
+{
+    return in >> entry.key >> entry.move >> entry.n >> entry.sum;
+}
 
 // ---------------------------------------------------------
 // construction
@@ -37,7 +59,11 @@ struct key_compare : std::binary_function< const book_entry&, const book_entry&,
 PolyglotDatabase::PolyglotDatabase() :
     Database(),
     m_file(nullptr),
-    m_count(0)
+    m_count(0),
+    m_entries(nullptr),
+    m_searchPos(-1),
+    m_cache(BookCacheSize),
+    m_runs(entryLess, sameMove, addEntry)
 {
 }
 
@@ -62,27 +88,19 @@ bool PolyglotDatabase::open(const QString &filename, bool)
     {
         m_utf8 = false;
         QFileInfo fi(m_filename);
-        m_count = fi.size() / 16; // Polyglot entry size is 16
-        m_midKey = (quint64)-1;
-        m_midPos = 16*((m_count+1)/2);
+        m_count = fi.size() / PolyglotEntrySize;
         if (m_count)
         {
-            if (m_file->seek(m_midPos))
+            QFile* file = static_cast<QFile*>(m_file);
+            m_entries = file->map(0, m_count * PolyglotEntrySize);
+            if (!m_entries)
             {
-                entry_t entry;
-                entry_t nextEntry;
-                if(!entry_from_file(&entry))
-                {
-                    while (!entry_from_file(&nextEntry))
-                    {
-                        if (entry.key != nextEntry.key)
-                        {
-                            m_midKey = nextEntry.key;
-                            m_midPos = m_file->pos() - sizeof(entry_t);
-                        }
-                    }
-                }
+                // Not mappable, keep a copy of the book in memory instead
+                m_bookData = file->readAll();
+                m_count = m_bookData.size() / PolyglotEntrySize;
+                m_entries = reinterpret_cast<const uchar*>(m_bookData.constData());
             }
+            buildFence();
             reset();
         }
         return true;
@@ -142,9 +160,14 @@ bool PolyglotDatabase::openFile(const QString &filename, bool readOnly)
 void PolyglotDatabase::close()
 {
     //close the file, and delete objects
+    m_entries = nullptr;
+    m_bookData.clear();
+    m_fence.clear();
+    m_cache.clear();
+    m_searchPos = -1;
     if(m_file)
     {
-        m_file->close();
+        m_file->close(); // also releases the mapping
     }
     delete m_file;
     m_file = nullptr;
@@ -368,43 +391,61 @@ static const quint64 RandomTurn = U64(0xF8D626AAAF278509);
 // Book reading
 // ---------------------------------------------------------
 
-int PolyglotDatabase::int_from_file(int l, quint64& r)
+inline quint64 PolyglotDatabase::keyAt(quint64 index) const
 {
-    int i;
-    unsigned char c;
-    for(i=0;i<l;i++)
+    return qFromBigEndian<quint64>(m_entries + index * PolyglotEntrySize);
+}
+
+void PolyglotDatabase::entryAt(quint64 index, entry_t* entry) const
+{
+    const uchar* p = m_entries + index * PolyglotEntrySize;
+    entry->key = qFromBigEndian<quint64>(p);
+    entry->move = qFromBigEndian<quint16>(p + 8);
+    entry->weight = qFromBigEndian<quint16>(p + 10);
+    entry->learn = qFromBigEndian<quint32>(p + 12);
+}
+
+void PolyglotDatabase::buildFence()
+{
+    m_fence.clear();
+    m_fence.reserve(static_cast<int>(m_count / FenceStride) + 1);
+    for (quint64 i = 0; i < m_count; i += FenceStride)
     {
-        if(m_file->read((char*)&c,1)<=0)
-        {
-            return 1;
-        }
-        r=(r<<8)+c;
+        m_fence.append(keyAt(i));
     }
-    return 0;
 }
 
-int PolyglotDatabase::entry_from_file(entry_t *entry)
-{
-    int ret;
-    quint64 r=0;
-    ret=int_from_file(8,r);
-    if(ret) return 1;
-    entry->key=r;
-    ret=int_from_file(2,r);
-    if(ret) return 1;
-    entry->move=r;
-    ret=int_from_file(2,r);
-    if(ret) return 1;
-    entry->weight=r;
-    ret=int_from_file(4,r);
-    if(ret) return 1;
-    entry->learn=r;
-    return 0;
+quint64 PolyglotDatabase::lowerBound(quint64 key) const
+{
+    // The fence narrows the search down to one stride of entries
+    auto fence = std::upper_bound(m_fence.cbegin(), m_fence.cend(), key);
+    quint64 first = (fence == m_fence.cbegin()) ? 0 : (fence - m_fence.cbegin() - 1) * FenceStride;
+    quint64 last = qMin<quint64>((fence - m_fence.cbegin()) * FenceStride, m_count);
+
+    // A key may have entries on both sides of a fence post
+    while (first > 0 && keyAt(first - 1) >= key)
+    {
+        first -= FenceStride;
+    }
+
+    while (first < last)
+    {
+        quint64 mid = first + (last - first) / 2;
+        if (keyAt(mid) < key)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
 }
 
 void PolyglotDatabase::reset()
 {
-    m_file->seek(0);
+    m_searchPos = -1;
 }
 
 // ---------------------------------------------------------
@@ -485,23 +526,6 @@ QString PolyglotDatabase::move_to_string(quint16 move) const
     return move_s;
 }
 
-int PolyglotDatabase::find_key(quint64 key, entry_t *entry)
-{
-    if(!entry_from_file(entry))
-    {
-        if (key==entry->key)
-        {
-            return 0;
-        }
-        else if (key>entry->key)
-        {
-            return 1;
-        }
-    }
-
-    return -1;
-}
-
 // ---------------------------------------------------------
 // Book parser - public interface
 // ---------------------------------------------------------
@@ -510,16 +534,13 @@ bool PolyglotDatabase::findMove(quint64 key, MoveData& m, bool& done)
 {
     entry_t entry;
     done = false;
-    if (m_file->pos()==0)
+    if (m_searchPos < 0)
     {
-        if (key >= m_midKey)
-        {
-            m_file->seek(m_midPos);
-        }
+        m_searchPos = static_cast<qint64>(lowerBound(key));
     }
-    int result = find_key(key, &entry);
-    if (result == 0)
+    if (static_cast<quint64>(m_searchPos) < m_count && keyAt(m_searchPos) == key)
     {
+        entryAt(m_searchPos++, &entry);
         QString s = move_to_string(entry.move);
         m.san = s;
         m.localsan.clear(); // Don't care
@@ -529,11 +550,8 @@ bool PolyglotDatabase::findMove(quint64 key, MoveData& m, bool& done)
         m.results.update(ResultUnknown, count);
         return true;
     }
-    else if (result < 0)
-    {
-        done = true;
-    }
 
+    done = true;
     return false;
 }
 
@@ -542,7 +560,16 @@ unsigned int PolyglotDatabase::getMoveMapForBoard(const BoardX &board, QMap<Move
     unsigned int games = 0;
     moves.clear();
     QMutexLocker m(mutex());
+    if (!m_entries)
+    {
+        return 0;
+    }
     quint64 key = getHashFromBoard(board);
+    if (const BookCacheEntry* cached = m_cache.object(key))
+    {
+        moves = cached->moves;
+        return cached->games;
+    }
     reset();
     bool bDone = false;
     while(!bDone)
@@ -569,6 +596,11 @@ unsigned int PolyglotDatabase::getMoveMapForBoard(const BoardX &board, QMap<Move
             games += m.results.count();
         }
     }
+
+    BookCacheEntry* entry = new BookCacheEntry;
+    entry->moves = moves;
+    entry->games = games;
+    m_cache.insert(key, entry);
     return games;
 }
 
@@ -588,13 +620,35 @@ void PolyglotDatabase::write_integer(int size, quint64 n)
     }
 }
 
-void PolyglotDatabase::book_save()
+void PolyglotDatabase::book_save(QVector<book_entry>& group)
 {
-    for (Book::const_iterator i=m_book.cbegin(); i!=m_book.cend();++i)
+    // Overflow correction, all moves of the position are scaled alike
+    quint32 maxCount = 0;
+    for (const book_entry& e: group)
+    {
+        maxCount = qMax(maxCount, e.n);
+    }
+    while (maxCount >= MAX_COUNT)
+    {
+        for (book_entry& e: group)
+        {
+            e.n = (e.n + 1) / 2;
+            e.sum = (e.sum + 1) / 2;
+        }
+        maxCount = (maxCount + 1) / 2;
+    }
+
+    auto last = std::remove_if(group.begin(), group.end(), [this](const book_entry& e) { return !keep_entry(e); });
+    group.erase(last, group.end());
+
+    // highest score first, equal scores in move order to keep the book reproducible
+    std::stable_sort(group.begin(), group.end(), [](const book_entry& a, const book_entry& b) { return a.sum > b.sum; });
+
+    for (const book_entry& e: group)
     {
-        write_integer(8,(*i).key);
-        write_integer(2,(*i).move);
-        write_integer(2,entry_score((*i)));
+        write_integer(8,e.key);
+        write_integer(2,e.move);
+        write_integer(2,entry_score(e));
         write_integer(2,0);
         write_integer(2,0);
     }
@@ -626,16 +680,9 @@ void PolyglotDatabase::book_make(Database &db, volatile bool& breakFlag)
     QMutexLocker m(mutex());
     qDebug() << "Add Database";
     if (!breakFlag) add_database(db, breakFlag);
-    qDebug() << "Spool map";
-    if (!breakFlag) spool_map();
-    qDebug() << "Overflow correction";
-    if (!breakFlag) overflow_correction();
-    qDebug() << "Filter Book";
-    if (!breakFlag) book_filter();
-    qDebug() << "Sort Book";
-    if (!breakFlag) book_sort();
-    qDebug() << "Save Book";
-    if (!breakFlag) book_save();
+    qDebug() << "Merge" << m_runs.count() << "runs";
+    if (!breakFlag) merge_runs(breakFlag);
+    m_runs.clear();
     qDebug() << "Close";
     close();
 }
@@ -664,84 +711,22 @@ bool PolyglotDatabase::keep_entry(const book_entry&  entry)
     return true;
 }
 
-void PolyglotDatabase::halve_stats(quint64 key)
-{
-    for (Book::iterator i=m_book.begin(); i!=m_book.end();++i)
-    {
-        if ((*i).key == key)
-        {
-            (*i).n = ((*i).n + 1) / 2;
-            (*i).sum = ((*i).sum + 1) / 2;
-        }
-    }
-}
-
-void PolyglotDatabase::spool_map()
+void PolyglotDatabase::merge_runs(volatile bool& breakFlag)
 {
-    for (auto it = m_bookDictionary.cbegin(); it != m_bookDictionary.cend(); ++it)
+    // The moves of one position are saved together
+    QVector<book_entry> group;
+    m_runs.merge([&](const book_entry& entry)
     {
-        book_entry b(it.key(), it.value());
-        m_book.append(b);
-    }
-    m_bookDictionary.clear();
-}
-
-void PolyglotDatabase::overflow_correction()
-{
-    for (Book::iterator i=m_book.begin(); i!=m_book.end();++i)
-    {
-        while ((*i).n >= MAX_COUNT)
+        if (!group.isEmpty() && group.last().key != entry.key)
         {
-            halve_stats((*i).key);
+            book_save(group);
+            group.clear();
         }
-    }
-}
-
-book_entry* PolyglotDatabase::find_entry(const book_entry& entry)
-{
-    for (Book::iterator i=m_book.begin(); i!=m_book.end();++i)
-    {
-        if (((*i).key == entry.key) && ((*i).move == entry.move))
-        {
-            return &(*i);
-        }
-    }
-
-    return nullptr;
-}
-
-void PolyglotDatabase::update_entry(book_entry& entry, int result)
-{
-    QMutexLocker m(&mutex2);
-    book_key key;
-    key.key = entry.key;
-    key.move = entry.move;
-
-    book_value b = m_bookDictionary.value(key);
-
-    ++b.n;
-    b.sum += result + 1;
-
-    m_bookDictionary[key] = b;
-}
-
-void PolyglotDatabase::book_sort()
-{
-    std::sort(m_book.begin(),m_book.end(),key_compare());
-}
-
-void PolyglotDatabase::book_filter()
-{
-    for (Book::iterator i=m_book.begin(); i!=m_book.end(); )
+        group.append(entry);
+    }, breakFlag);
+    if (!group.isEmpty() && !breakFlag)
     {
-        if (keep_entry(*i))
-        {
-            ++i;
-        }
-        else
-        {
-            i = m_book.erase(i);
-        }
+        book_save(group);
     }
 }
 
@@ -819,7 +804,7 @@ bool PolyglotDatabase::get_move_entry(Move m, book_entry& entry) const
     return true;
 }
 
-void PolyglotDatabase::add_game(GameX& g, int result)
+void PolyglotDatabase::add_game(GameX& g, int result, QVector<book_entry>& run)
 {
     int ply = 0;
     if (BoardX::standardStartBoard == g.startingBoard())
@@ -842,8 +827,10 @@ void PolyglotDatabase::add_game(GameX& g, int result)
                 break;
             }
 
-            // add to Book
-            update_entry(entry, result);
+            // add to the run
+            entry.n = 1;
+            entry.sum = result + 1;
+            run.append(entry);
 
             // invert result for opposing color
             result = -result;
@@ -852,45 +839,20 @@ void PolyglotDatabase::add_game(GameX& g, int result)
     }
 }
 
-void PolyglotDatabase::add_database_chunk(Database* db, int start, int end, volatile bool* breakFlag)
+void PolyglotDatabase::add_database(Database& db, volatile bool& breakFlag)
 {
-    int progressCount = 1 + end / 100;
-    for(int i = start; i < end; ++i)
+    RefKeeper m(db.refCounter());
+    qDebug() << "Collect from database with" << QThread::idealThreadCount() << "threads";
+    m_runs.collect(db.count(), m_maxPly, [&](int i, QVector<book_entry>& run)
     {
-        if (!start)
-        {
-            if ((i)%progressCount==0) emit progress((i)/progressCount);
-        }
-
-        if (*breakFlag) return;
         GameX game;
-        if(db->loadGame(i, game))
+        if (db.loadGame(i, game))
         {
             int result = game.resultAsInt();
-            if ((m_filterResult==0) || (m_filterResult != result))
+            if ((m_filterResult == 0) || (m_filterResult != result))
             {
-                add_game(game, (m_overwriteResult == 0) ? result : m_overwriteResult);
+                add_game(game, (m_overwriteResult == 0) ? result : m_overwriteResult, run);
             }
         }
-    }
-}
-
-void PolyglotDatabase::add_database(Database& db, volatile bool& breakFlag)
-{
-    int maxThreads = QThread::idealThreadCount();
-    int n = db.count();
-    int chunk = n/maxThreads;
-
-    RefKeeper m(db.refCounter());
-    qDebug()<<"Collect from database with" << maxThreads << "threads";
-    QFutureSynchronizer<void> synchronizer;
-    int start = 0;
-    for (int i=0; i<maxThreads; ++i)
-    {
-        int end = std::min(start + chunk, n);
-        QFuture<void> future = QtConcurrent::run(this, &PolyglotDatabase::add_database_chunk, &db, start, end, &breakFlag);
-        synchronizer.addFuture(future);
-        start += chunk;
-    }
-    synchronizer.waitForFinished();
+    }, [this](int percent) { emit progress(percent); }, breakFlag);
 }
@@ -5,10 +5,12 @@
 #ifndef POLYGLOTDATABASE_H
 #define POLYGLOTDATABASE_H
 
+#include <QCache>
 #include <QMutex>
 
 #include "database.h"
 #include "movedata.h"
+#include "sortedruns.h"
 
 #undef EXTENDED_BOOK_FORMAT
 
@@ -95,8 +97,13 @@ typedef struct _book_entry
    }
 } book_entry;
 
-typedef QList<book_entry> Book;
-typedef QMap<book_key,book_value> BookMap;
+/** Decoded moves of a position, kept in the lookup cache */
+struct BookCacheEntry
+{
+    QMap<Move, MoveData> moves;
+    unsigned int games;
+};
+
 
 class PolyglotDatabase : public Database
 {
@@ -144,25 +151,26 @@ signals:
 public slots:
 
 protected:
-    int find_key(quint64 key, entry_t *entry);
-    int entry_from_file(entry_t *entry);
-    int int_from_file(int l, quint64 &r);
+    /** @return key of entry @p index of the mapped book */
+    quint64 keyAt(quint64 index) const;
+    /** Decode entry @p index of the mapped book */
+    void entryAt(quint64 index, entry_t *entry) const;
+    /** Collect every FenceStride-th key for the top level search */
+    void buildFence();
+    /** @return index of the first entry with a key not less than @p key */
+    quint64 lowerBound(quint64 key) const;
 
     QString move_to_string(quint16 move) const;
-    void book_save();
+    /** Write the merged moves of one position */
+    void book_save(QVector<book_entry>& group);
     void write_integer(int size, quint64 n);
     int entry_score(const book_entry& entry);
     bool keep_entry(const book_entry &entry);
-    void halve_stats(quint64 key);
-    void book_sort();
-    void spool_map();
-    void overflow_correction();
-    void update_entry(book_entry &entry, int result);
-    book_entry *find_entry(const book_entry &entry);
-    void book_filter();
+    /** Merge all spilled runs into the book file */
+    void merge_runs(volatile bool &breakFlag);
+    /** Collect the entries of all games of @p db in sorted runs */
     void add_database(Database &db, volatile bool &breakFlag);
-    void add_database_chunk(Database* db, int start, int end, volatile bool *breakFlag);
-    void add_game(GameX &g, int result);
+    void add_game(GameX &g, int result, QVector<book_entry>& run);
     bool get_move_entry(Move m, book_entry &entry) const;
     int get_promotion(Move m) const;
     int make_castling_move(Move m) const;
@@ -171,16 +179,24 @@ private:
     QString m_filename;
     QIODevice* m_file;
     quint64 m_count;
-    quint64 m_midKey;
-    quint64 m_midPos;
-    Book m_book;
-    BookMap m_bookDictionary;
+    /** Book entries, mapped from the file or read into m_bookData */
+    const uchar* m_entries;
+    QByteArray m_bookData;
+    /** Keys of every FenceStride-th entry */
+    QVector<quint64> m_fence;
+    /** Next entry returned by findMove() or -1 if a new key is searched */
+    qint64 m_searchPos;
+    /** Number of positions kept in the lookup cache */
+    static const int BookCacheSize = 1024;
+    /** Recently looked up positions */
+    QCache<quint64, BookCacheEntry> m_cache;
+    /** Sorted runs of book entries collected by the workers */
+    SortedRuns<book_entry> m_runs;
     bool m_uniform;
     int m_overwriteResult;
     int m_filterResult;
     quint32 m_minGame;
     int m_maxPly;
-    QMutex mutex2;
 };
 
 #endif // POLYGLOTDATABASE_H
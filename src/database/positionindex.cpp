@@ -0,0 +1,378 @@
+#include <QDataStream>
+#include <QReadLocker>
+#include <QWriteLocker>
+
+#include <algorithm>
+#include <vector>
+
+#include "positionindex.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+namespace {
+
+struct KeyedPosting
+{
+    quint64 key;
+    PositionIndex::Posting posting;
+};
+
+inline bool operator<(const KeyedPosting& a, const KeyedPosting& b)
+{
+    return a.key < b.key || (a.key == b.key && a.posting.gameId < b.posting.gameId);
+}
+
+inline quint32 packHorizon(const BoardX& board, bool complete)
+{
+    quint32 h = board.pieceCount(White)
+              | (board.pieceCount(Black) << 5)
+              | (board.pawnCount(White) << 10)
+              | (board.pawnCount(Black) << 14);
+    return complete ? (h | 0x80000000) : h;
+}
+
+} // anonymous namespace
+
+PositionIndex::PositionIndex() : m_maxPly(DefaultMaxPly), m_lock(QReadWriteLock::Recursive)
+{
+}
+
+void PositionIndex::clear()
+{
+    QWriteLocker m(&m_lock);
+    m_keys.clear();
+    m_offsets.clear();
+    m_postings.clear();
+    m_horizon.clear();
+    m_pending.clear();
+}
+
+bool PositionIndex::isEmpty() const
+{
+    QReadLocker m(&m_lock);
+    return m_horizon.isEmpty();
+}
+
+int PositionIndex::count() const
+{
+    QReadLocker m(&m_lock);
+    return m_horizon.count();
+}
+
+bool PositionIndex::covers(GameId gameId) const
+{
+    QReadLocker m(&m_lock);
+    return static_cast<int>(gameId) < m_horizon.count() && m_horizon.at(gameId) != HorizonUnknown;
+}
+
+int PositionIndex::maxPly() const
+{
+    return m_maxPly;
+}
+
+void PositionIndex::setMaxPly(int maxPly)
+{
+    clear();
+    m_maxPly = maxPly;
+}
+
+quint16 PositionIndex::encodeMove(const Move& move)
+{
+    quint16 promotion = move.isPromotion() ? pieceType(move.promotedPiece()) : 0;
+    return static_cast<quint16>(move.from() | (move.to() << 6) | (promotion << 12));
+}
+
+Move PositionIndex::decodeMove(const BoardX& position, quint16 encoded)
+{
+    if (encoded == NoMove)
+    {
+        return Move();
+    }
+    Square from = Square(encoded & 0x3F);
+    Square to = Square((encoded >> 6) & 0x3F);
+    if (from == to)
+    {
+        return position.nullMove();
+    }
+    Move move = position.prepareMove(from, to);
+    PieceType promotion = PieceType((encoded >> 12) & 0x7);
+    if (promotion != None)
+    {
+        move.setPromoted(promotion);
+    }
+    return move;
+}
+
+quint32 PositionIndex::collect(const GameX& game, QVector<Entry>& entries) const
+{
+    const GameCursor& cursor = game.cursor();
+    BoardX board(cursor.initialBoard());
+    MoveId current = ROOT_NODE;
+
+    for (int ply = 0; ; ++ply)
+    {
+        MoveId next = cursor.nextMove(current);
+        quint64 key = board.getHashValue();
+
+        // Only the first occurrence is posted, as GameCursor::findPosition() does
+        auto seen = std::find_if(entries.cbegin(), entries.cend(), [key](const Entry& e) { return e.key == key; });
+        if (seen == entries.cend())
+        {
+            Entry e;
+            e.key = key;
+            e.moveId = current;
+            e.nextMove = (next == NO_MOVE) ? NoMove : encodeMove(cursor.move(next));
+            entries.append(e);
+        }
+
+        if (next == NO_MOVE)
+        {
+            return packHorizon(board, true);
+        }
+        if (ply >= m_maxPly)
+        {
+            return packHorizon(board, false);
+        }
+        board.doMove(cursor.move(next));
+        current = next;
+    }
+}
+
+void PositionIndex::updateGame(GameId gameId, const GameX& game)
+{
+    QVector<Entry> entries;
+    entries.reserve(m_maxPly + 1);
+    quint32 horizon = collect(game, entries);
+
+    QWriteLocker m(&m_lock);
+    while (m_horizon.count() <= static_cast<int>(gameId))
+    {
+        m_horizon.append(HorizonUnknown);
+    }
+    m_horizon[gameId] = horizon;
+    m_pending.insert(gameId, entries);
+}
+
+void PositionIndex::squeeze()
+{
+    QWriteLocker m(&m_lock);
+    if (m_pending.isEmpty())
+    {
+        return;
+    }
+
+    std::vector<KeyedPosting> all;
+    all.reserve(m_postings.size() + m_pending.size() * (m_maxPly + 1));
+
+    for (int slot = 0; slot < m_keys.count(); ++slot)
+    {
+        for (quint32 i = m_offsets.at(slot); i < m_offsets.at(slot + 1); ++i)
+        {
+            const Posting& p = m_postings.at(i);
+            if (!m_pending.contains(p.gameId))
+            {
+                all.push_back({ m_keys.at(slot), p });
+            }
+        }
+    }
+
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it)
+    {
+        for (const Entry& e: it.value())
+        {
+            Posting p;
+            p.gameId = it.key();
+            p.moveId = e.moveId;
+            p.nextMove = e.nextMove;
+            all.push_back({ e.key, p });
+        }
+    }
+    m_pending.clear();
+
+    std::sort(all.begin(), all.end());
+
+    m_keys.clear();
+    m_offsets.clear();
+    m_postings.clear();
+    m_postings.reserve(static_cast<int>(all.size()));
+    for (const KeyedPosting& kp: all)
+    {
+        if (m_keys.isEmpty() || m_keys.last() != kp.key)
+        {
+            m_keys.append(kp.key);
+            m_offsets.append(static_cast<quint32>(m_postings.count()));
+        }
+        m_postings.append(kp.posting);
+    }
+    m_offsets.append(static_cast<quint32>(m_postings.count()));
+
+    m_keys.squeeze();
+    m_offsets.squeeze();
+    m_postings.squeeze();
+}
+
+int PositionIndex::findKey(quint64 key) const
+{
+    auto it = std::lower_bound(m_keys.cbegin(), m_keys.cend(), key);
+    if (it != m_keys.cend() && *it == key)
+    {
+        return static_cast<int>(it - m_keys.cbegin());
+    }
+    return -1;
+}
+
+bool PositionIndex::excludedByHorizon(const BoardX& position, quint32 horizon)
+{
+    if (horizon & HorizonComplete)
+    {
+        return true;
+    }
+    // Material can only decrease, see BitBoard::canBeReachedFrom()
+    return position.pieceCount(White) > (horizon & 0x1F)
+        || position.pieceCount(Black) > ((horizon >> 5) & 0x1F)
+        || position.pawnCount(White) > ((horizon >> 10) & 0xF)
+        || position.pawnCount(Black) > ((horizon >> 14) & 0xF);
+}
+
+PositionIndex::LookupResult PositionIndex::lookup(const BoardX& position, GameId gameId, MoveId& moveId, quint16& nextMove) const
+{
+    QReadLocker m(&m_lock);
+    if (static_cast<int>(gameId) >= m_horizon.count() || m_horizon.at(gameId) == HorizonUnknown)
+    {
+        return Unknown;
+    }
+
+    quint64 key = position.getHashValue();
+    auto pending = m_pending.constFind(gameId);
+    if (pending != m_pending.cend())
+    {
+        for (const Entry& e: pending.value())
+        {
+            if (e.key == key)
+            {
+                moveId = e.moveId;
+                nextMove = e.nextMove;
+                return Found;
+            }
+        }
+    }
+    else
+    {
+        int slot = findKey(key);
+        if (slot >= 0)
+        {
+            auto first = m_postings.cbegin() + m_offsets.at(slot);
+            auto last = m_postings.cbegin() + m_offsets.at(slot + 1);
+            auto p = std::lower_bound(first, last, gameId, [](const Posting& a, GameId g) { return a.gameId < g; });
+            if (p != last && p->gameId == gameId)
+            {
+                moveId = p->moveId;
+                nextMove = p->nextMove;
+                return Found;
+            }
+        }
+    }
+
+    return excludedByHorizon(position, m_horizon.at(gameId)) ? NotFound : Unknown;
+}
+
+QVector<PositionIndex::Posting> PositionIndex::postings(const BoardX& position) const
+{
+    QReadLocker m(&m_lock);
+    QVector<Posting> result;
+    quint64 key = position.getHashValue();
+    int slot = findKey(key);
+    if (slot >= 0)
+    {
+        for (quint32 i = m_offsets.at(slot); i < m_offsets.at(slot + 1); ++i)
+        {
+            const Posting& p = m_postings.at(i);
+            if (!m_pending.contains(p.gameId))
+            {
+                result.append(p);
+            }
+        }
+    }
+    if (!m_pending.isEmpty())
+    {
+        for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it)
+        {
+            for (const Entry& e: it.value())
+            {
+                if (e.key == key)
+                {
+                    Posting p;
+                    p.gameId = it.key();
+                    p.moveId = e.moveId;
+                    p.nextMove = e.nextMove;
+                    result.append(p);
+                    break;
+                }
+            }
+        }
+        std::sort(result.begin(), result.end(), [](const Posting& a, const Posting& b) { return a.gameId < b.gameId; });
+    }
+    return result;
+}
+
+bool PositionIndex::write(QDataStream& out) const
+{
+    QReadLocker m(&m_lock);
+    if (!m_pending.isEmpty())
+    {
+        return false; // squeeze() first
+    }
+    out << static_cast<qint32>(m_maxPly);
+    out << m_keys;
+    out << m_offsets;
+    out << m_horizon;
+    out << static_cast<quint32>(m_postings.count());
+    for (const Posting& p: m_postings)
+    {
+        out << p.gameId << p.moveId << p.nextMove;
+    }
+    return out.status() == QDataStream::Ok;
+}
+
+bool PositionIndex::read(QDataStream& in, volatile bool* breakFlag)
+{
+    QWriteLocker m(&m_lock);
+    m_pending.clear();
+
+    qint32 maxPly;
+    in >> maxPly;
+    m_maxPly = maxPly;
+    in >> m_keys;
+    in >> m_offsets;
+    in >> m_horizon;
+
+    quint32 n;
+    in >> n;
+    m_postings.resize(static_cast<int>(n));
+    for (quint32 i = 0; i < n; ++i)
+    {
+        if (breakFlag && *breakFlag && (i % 0x10000 == 0))
+        {
+            break;
+        }
+        Posting& p = m_postings[static_cast<int>(i)];
+        in >> p.gameId >> p.moveId >> p.nextMove;
+    }
+
+    bool ok = (in.status() == QDataStream::Ok) && !(breakFlag && *breakFlag)
+            && (m_offsets.isEmpty() ? (n == 0 && m_keys.isEmpty())
+                                    : (m_offsets.count() == m_keys.count() + 1 && m_offsets.last() == n));
+    if (!ok)
+    {
+        m_keys.clear();
+        m_offsets.clear();
+        m_postings.clear();
+        m_horizon.clear();
+    }
+    return ok;
+}
@@ -0,0 +1,130 @@
+#ifndef POSITIONINDEX_H_INCLUDED
+#define POSITIONINDEX_H_INCLUDED
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+#include "board.h"
+#include "gameid.h"
+#include "gamex.h"
+
+class QDataStream;
+
+#define VERSION_POSITION_INDEX_1_0 0x0100
+#define VERSION_POSITION_INDEX_1_1 0x0101
+#define VERSION_POSITION_INDEX_CURRENT VERSION_POSITION_INDEX_1_1
+
+#define POSITION_INDEX_FILE_MAGIC 0xce56
+
+/** @ingroup Database
+   The PositionIndex class maps position hashes (BoardX::getHashValue()) to
+   postings of (GameId, MoveId) sorted by game. Only the first maxPly() plies
+   of the main line of each game are indexed. For every game the material
+   left at that horizon is kept as well, so that a position which is neither
+   posted nor reachable from the horizon is known to be absent without
+   replaying the game.
+
+   The index is built once (or read from disk) into flat sorted arrays.
+   Later modifications of single games are kept in a small overlay until
+   squeeze() merges them back into the arrays.
+*/
+
+class PositionIndex
+{
+public:
+    /** Result of a lookup for a single game */
+    enum LookupResult
+    {
+        /** Index has no reliable information, the game must be replayed */
+        Unknown,
+        /** Position occurs in the game */
+        Found,
+        /** Position can not occur in the game */
+        NotFound
+    };
+
+    /** Encoded value of nextMove when the position is at the end of the main line */
+    static const quint16 NoMove = 0x8000;
+
+    /** Default number of indexed plies per game */
+    static const int DefaultMaxPly = 24;
+
+    struct Posting
+    {
+        GameId gameId;
+        MoveId moveId;
+        quint16 nextMove;
+    };
+
+    PositionIndex();
+
+    /** Remove all postings */
+    void clear();
+    /** @return true if no game is covered by the index */
+    bool isEmpty() const;
+    /** @return number of games covered by the index */
+    int count() const;
+    /** @return true if game @p gameId has been indexed */
+    bool covers(GameId gameId) const;
+
+    /** Number of plies indexed per game */
+    int maxPly() const;
+    /** Set number of plies indexed per game, clears the index */
+    void setMaxPly(int maxPly);
+
+    /** Index (or re-index) the main line of @p game as @p gameId */
+    void updateGame(GameId gameId, const GameX& game);
+    /** Merge all pending updates into the sorted tables */
+    void squeeze();
+
+    /** Look up @p position in game @p gameId. On success @p moveId and @p nextMove are set. */
+    LookupResult lookup(const BoardX& position, GameId gameId, MoveId& moveId, quint16& nextMove) const;
+
+    /** @return all postings of @p position, sorted by GameId */
+    QVector<Posting> postings(const BoardX& position) const;
+
+    /** Write the index to a stream, pending updates must have been merged by squeeze() */
+    bool write(QDataStream& out) const;
+    /** Read the index from a stream */
+    bool read(QDataStream& in, volatile bool* breakFlag);
+
+    /** Compact 16 bit representation of a move */
+    static quint16 encodeMove(const Move& move);
+    /** Recreate a move encoded by encodeMove() in @p position */
+    static Move decodeMove(const BoardX& position, quint16 encoded);
+
+private:
+    struct Entry
+    {
+        quint64 key;
+        MoveId moveId;
+        quint16 nextMove;
+    };
+
+    static const quint32 HorizonUnknown = 0xFFFFFFFF;
+    static const quint32 HorizonComplete = 0x80000000;
+
+    /** Collect postings of @p game, @return packed horizon material */
+    quint32 collect(const GameX& game, QVector<Entry>& entries) const;
+    /** @return true if @p position can not occur after horizon @p horizon */
+    static bool excludedByHorizon(const BoardX& position, quint32 horizon);
+    /** @return slot of @p key in m_keys or -1 */
+    int findKey(quint64 key) const;
+
+    int m_maxPly;
+    /** Sorted distinct position hashes */
+    QVector<quint64> m_keys;
+    /** Start of the postings of m_keys[i] in m_postings, one extra terminating element */
+    QVector<quint32> m_offsets;
+    /** Postings grouped by key, sorted by GameId inside each group */
+    QVector<Posting> m_postings;
+    /** Packed material at the horizon per game */
+    QVector<quint32> m_horizon;
+    /** Games indexed after the last squeeze(), they override m_postings */
+    QHash<GameId, QVector<Entry> > m_pending;
+
+    mutable QReadWriteLock m_lock;
+};
+
+#endif // POSITIONINDEX_H_INCLUDED
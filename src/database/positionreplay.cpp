@@ -0,0 +1,71 @@
+#include "positionreplay.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+PositionReplay::PositionReplay(const BoardX& position)
+    : m_position(position)
+    , m_state(Decided)
+    , m_moveId(NO_MOVE)
+    , m_atEnd(true)
+{
+}
+
+const BoardX& PositionReplay::position() const
+{
+    return m_position;
+}
+
+inline bool PositionReplay::matches() const
+{
+    // Same test as GameCursor::findPosition(), the hash is checked first
+    return m_board == m_position && m_board.positionIsSame(m_position);
+}
+
+bool PositionReplay::start(const BoardX& board)
+{
+    m_board = board;
+    m_moveId = NO_MOVE;
+    m_nextMove = Move();
+    m_atEnd = true;
+
+    if (matches())
+    {
+        m_moveId = ROOT_NODE;
+        m_state = Found;
+    }
+    else
+    {
+        m_state = m_position.canBeReachedFrom(m_board) ? Searching : Decided;
+    }
+    return m_state != Decided;
+}
+
+bool PositionReplay::play(const Move& move, MoveId moveId)
+{
+    switch (m_state)
+    {
+    case Searching:
+        m_board.doMove(move);
+        if (matches())
+        {
+            m_moveId = moveId;
+            m_state = Found;
+        }
+        else if (!m_position.canBeReachedFrom(m_board))
+        {
+            m_state = Decided;
+        }
+        break;
+    case Found:
+        m_nextMove = move;
+        m_atEnd = false;
+        m_state = Decided;
+        break;
+    case Decided:
+        break;
+    }
+    return m_state != Decided;
+}
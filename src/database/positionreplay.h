@@ -0,0 +1,65 @@
+#ifndef POSITIONREPLAY_H_INCLUDED
+#define POSITIONREPLAY_H_INCLUDED
+
+#include <QByteArray>
+
+#include "board.h"
+#include "gamex.h"
+
+/** @ingroup Database
+   The PositionReplay class searches one position in the main lines of many
+   games. Moves are fed one by one with play(), and the replay stops as soon
+   as the position has been found together with the move played there, or
+   when the material left makes it unreachable (see BitBoard::canBeReachedFrom()).
+
+   A single object is meant to be reused for a whole batch of games by one
+   thread, so that neither the board nor the raw data buffer is allocated
+   per game.
+*/
+
+class PositionReplay
+{
+public:
+    explicit PositionReplay(const BoardX& position);
+
+    /** @return the position searched for */
+    const BoardX& position() const;
+
+    /** Start the replay of a game at @p board. @return false if the search is already decided */
+    bool start(const BoardX& board);
+    /** Play the next main line move @p move which leads to node @p moveId.
+        @return false once the search is decided and no more moves are needed */
+    bool play(const Move& move, MoveId moveId);
+
+    /** @return the current position, useful to decode the next move */
+    const BoardX& board() const { return m_board; }
+    /** @return the node reaching the position or NO_MOVE */
+    MoveId moveId() const { return m_moveId; }
+    /** @return the move played in the found position, illegal if the game ends there */
+    const Move& nextMove() const { return m_nextMove; }
+    /** @return true if the game ends in the found position */
+    bool atEnd() const { return m_atEnd; }
+
+    /** Scratch buffer for the raw data of the current game */
+    QByteArray& buffer() { return m_buffer; }
+
+private:
+    enum State
+    {
+        Searching,
+        Found,
+        Decided
+    };
+
+    inline bool matches() const;
+
+    BoardX m_position;
+    BoardX m_board;
+    State m_state;
+    MoveId m_moveId;
+    Move m_nextMove;
+    bool m_atEnd;
+    QByteArray m_buffer;
+};
+
+#endif // POSITIONREPLAY_H_INCLUDED
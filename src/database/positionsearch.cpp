@@ -14,11 +14,11 @@
 
 /* PositionSearch Class
  * ******************************/
-PositionSearch::PositionSearch()
+PositionSearch::PositionSearch() : m_target(m_position)
 {
 }
 
-PositionSearch::PositionSearch(Database* db, const BoardX& position):Search(db)
+PositionSearch::PositionSearch(Database* db, const BoardX& position):Search(db), m_target(position)
 {
     setPosition(position);
 }
@@ -26,10 +26,26 @@ PositionSearch::PositionSearch(Database* db, const BoardX& position):Search(db)
 void PositionSearch::setPosition(const BoardX& position)
 {
     m_position = position;
+    m_target = GameSignature::Target(position);
 }
 
 int PositionSearch::matches(GameId index) const
 {
+    MoveId moveId = NO_MOVE;
+    quint16 nextMove;
+    switch (m_database->positionIndex()->lookup(m_position, index, moveId, nextMove))
+    {
+    case PositionIndex::Found:
+        return 1 + moveId;
+    case PositionIndex::NotFound:
+        return 0;
+    default:
+        break;
+    }
+    if (!m_database->index()->signature(index).canReach(m_target))
+    {
+        return 0;
+    }
     return (1+m_database->findPosition(index, m_position)); // so NO_MOVE results in 0
 }
 
@@ -7,6 +7,7 @@
 
 #include "search.h"
 #include "board.h"
+#include "gamesignature.h"
 
 /** @ingroup Search
 The PositionSearch class is a search that checks for given position.
@@ -29,6 +30,7 @@ public:
     virtual int matches(GameId index) const;
 private:
     BoardX m_position;
+    GameSignature::Target m_target;
 };
 
 #endif // POSITIONSEARCH_H
@@ -221,6 +221,18 @@ bool ScidStorage::readTags(IndexX& dst, gamenumT g) const
         dst.setTag_nolock(TagNameECO, strBuf, g);
     }
 
+    // signatures for position searches, SCID computes them for the standard start only
+    if (!ie->GetStartFlag())
+    {
+        auto hpData = ie->GetHomePawnData();
+        quint64 homePawns = 0;
+        for (uint i = 1; i < HPSIG_SIZE; ++i)
+        {
+            homePawns = (homePawns << 8) | hpData[i];
+        }
+        dst.setSignature(g, GameSignature(ie->GetFinalMatSig(), hpData[0], homePawns));
+    }
+
     // read the rest from game data
     auto bbuf = ByteBuffer(data, gameLength);
     bbuf.decodeTags([&dst, g](const auto& tag, const auto& val) {
@@ -42,6 +42,9 @@ public:
     virtual ~Search();
     virtual void Prepare(volatile bool&) {};
     virtual int matches(GameId index) const = 0;
+    /** @return the results of all games at once, if the search computes them up front.
+        A game matches if its bit is set. Valid after Prepare(). */
+    virtual const QBitArray* matchList() const { return nullptr; }
 
     void AddSearch(Search* search, FilterOperator op);
 
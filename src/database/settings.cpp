@@ -420,6 +420,8 @@ QMap<QString, QVariant> Settings::initDefaultValues() const
     map.insert("/General/EditLimit", 10);
     map.insert("/General/automaticECO", true);
     map.insert("/General/useIndexFile", true);
+    map.insert("/General/usePositionIndex", false);
+    map.insert("/General/mapPgnFiles", true);
     map.insert("/General/ListFontSize", DEFAULT_LISTFONTSIZE);
     map.insert("/General/onlineTablebases", true);
     map.insert("/General/tablebaseSource", 0);
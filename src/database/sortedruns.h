@@ -0,0 +1,222 @@
+#ifndef SORTEDRUNS_H_INCLUDED
+#define SORTEDRUNS_H_INCLUDED
+
+#include <QDataStream>
+#include <QDir>
+#include <QFutureSynchronizer>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent/QtConcurrent>
+#include <QtDebug>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <vector>
+
+/** @ingroup Database
+   The SortedRuns class sorts and aggregates more records than fit into
+   memory, as the book writers collect them over all games of a database.
+   collect() runs the games on all cores. Each worker gathers the records
+   of its games in a run of its share of RunMemoryBudget; a full run is
+   sorted, equal records are added up and it is written to a temporary file.
+   merge() reads the runs back in a k-way merge over a heap and hands the
+   records over in order, added up over all runs.
+
+   @p Record is written to the runs by its QDataStream operators. The order,
+   the equality and the sum of two records are given to the constructor.
+*/
+
+template <class Record>
+class SortedRuns
+{
+public:
+    typedef bool (*Less)(const Record& a, const Record& b);
+    typedef bool (*Same)(const Record& a, const Record& b);
+    typedef void (*Add)(Record& to, const Record& from);
+
+    /** Memory used by all workers for collecting records before they are spilled to disk */
+    static const quint64 RunMemoryBudget = 256 * 1024 * 1024;
+
+    SortedRuns(Less less, Same same, Add add) : m_less(less), m_same(same), m_add(add) {}
+    ~SortedRuns() { clear(); }
+
+    /** @return the number of spilled runs */
+    int count() const { return m_runs.count(); }
+    /** Remove all runs */
+    void clear()
+    {
+        qDeleteAll(m_runs);
+        m_runs.clear();
+    }
+
+    /** Collect the records of the games [0, @p games) on all cores. @p addGame(gameId, run) appends
+        at most @p perGame records of one game to run. @p progress receives the percentage done of the first worker */
+    void collect(int games, int perGame, const std::function<void(int, QVector<Record>&)>& addGame,
+                 const std::function<void(int)>& progress, volatile bool& breakFlag)
+    {
+        int maxThreads = QThread::idealThreadCount();
+        int chunk = (games + maxThreads - 1) / maxThreads;
+        // Each worker gets its share of the memory budget, full runs are spilled to disk
+        int runSize = qMax(1024, static_cast<int>(RunMemoryBudget / sizeof(Record)) / maxThreads);
+
+        auto worker = [&](int start, int end)
+        {
+            QVector<Record> run;
+            run.reserve(runSize);
+            int progressCount = 1 + (end - start) / 100;
+            for (int i = start; i < end; ++i)
+            {
+                if (!start && i % progressCount == 0)
+                {
+                    progress(i / progressCount);
+                }
+                if (breakFlag)
+                {
+                    return;
+                }
+                addGame(i, run);
+                if (run.count() + perGame >= runSize)
+                {
+                    spill(run);
+                }
+            }
+            spill(run);
+        };
+
+        QFutureSynchronizer<void> synchronizer;
+        for (int start = 0; start < games; start += chunk)
+        {
+            synchronizer.addFuture(QtConcurrent::run(worker, start, std::min(start + chunk, games)));
+        }
+        synchronizer.waitForFinished();
+    }
+
+    /** Sort and aggregate @p run and write it to a temporary file */
+    void spill(QVector<Record>& run)
+    {
+        if (run.isEmpty())
+        {
+            return;
+        }
+
+        std::sort(run.begin(), run.end(), m_less);
+
+        QTemporaryFile* file = new QTemporaryFile(QDir::tempPath() + "/chessx_book_XXXXXX.run");
+        if (!file->open())
+        {
+            qWarning() << "Cannot create temporary file for book run";
+            delete file;
+            run.clear();
+            return;
+        }
+
+        QDataStream out(file);
+        for (auto i = run.cbegin(); i != run.cend(); )
+        {
+            Record record = *i;
+            for (++i; i != run.cend() && m_same(*i, record); ++i)
+            {
+                m_add(record, *i);
+            }
+            out << record;
+        }
+        file->flush();
+        file->seek(0);
+        run.clear();
+
+        QMutexLocker m(&m_mutex);
+        m_runs.append(file);
+    }
+
+    /** K-way merge of all runs, @p f receives each record in order, added up over all runs */
+    void merge(const std::function<void(const Record&)>& f, volatile bool& breakFlag)
+    {
+        QVector<Reader*> readers;
+        for (QTemporaryFile* file: m_runs)
+        {
+            readers.append(new Reader(file));
+        }
+
+        // Min-heap of readers ordered by their current record
+        auto greater = [&](int a, int b)
+        {
+            return m_less(readers.at(b)->current(), readers.at(a)->current());
+        };
+        std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+        for (int i = 0; i < readers.count(); ++i)
+        {
+            if (!readers.at(i)->atEnd())
+            {
+                heap.push(i);
+            }
+        }
+
+        bool pending = false;
+        Record record;
+        while (!heap.empty() && !breakFlag)
+        {
+            int i = heap.top();
+            heap.pop();
+            Record next = readers.at(i)->current();
+            readers.at(i)->next();
+            if (!readers.at(i)->atEnd())
+            {
+                heap.push(i);
+            }
+
+            if (pending && m_same(record, next))
+            {
+                m_add(record, next);
+                continue;
+            }
+            if (pending)
+            {
+                f(record);
+            }
+            record = next;
+            pending = true;
+        }
+        if (pending && !breakFlag)
+        {
+            f(record);
+        }
+
+        qDeleteAll(readers);
+    }
+
+private:
+    Q_DISABLE_COPY(SortedRuns)
+
+    /** Reads a sorted run back during the merge */
+    class Reader
+    {
+    public:
+        explicit Reader(QIODevice* device) : m_in(device) { next(); }
+        bool atEnd() const { return m_atEnd; }
+        const Record& current() const { return m_current; }
+        void next()
+        {
+            m_atEnd = m_in.atEnd();
+            if (!m_atEnd)
+            {
+                m_in >> m_current;
+                m_atEnd = (m_in.status() != QDataStream::Ok);
+            }
+        }
+    private:
+        QDataStream m_in;
+        Record m_current;
+        bool m_atEnd;
+    };
+
+    Less m_less;
+    Same m_same;
+    Add m_add;
+    QList<QTemporaryFile*> m_runs;
+    QMutex m_mutex;
+};
+
+#endif // SORTEDRUNS_H_INCLUDED
@@ -0,0 +1,418 @@
+#include <QtCore>
+#include <QtEndian>
+
+#include "statisticsbook.h"
+#include "positionindex.h"
+
+using namespace chessx;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+// ---------------------------------------------------------
+// statics and constants
+// ---------------------------------------------------------
+
+/** Magic, version, maximum ply and record count */
+static const quint64 HeaderSize = 16;
+/** Size of a record in the book file */
+static const quint64 RecordSize = 56;
+
+static bool recordLess(const StatisticsBook::Record& a, const StatisticsBook::Record& b)
+{
+    return a.key < b.key || (a.key == b.key && a.move < b.move);
+}
+
+static bool sameMove(const StatisticsBook::Record& a, const StatisticsBook::Record& b)
+{
+    return a.key == b.key && a.move == b.move;
+}
+
+static void addRecord(StatisticsBook::Record& to, const StatisticsBook::Record& from)
+{
+    for (int r = 0; r < 4; ++r)
+    {
+        to.results[r] += from.results[r];
+    }
+    to.ratingCount += from.ratingCount;
+    to.ratingSum += from.ratingSum;
+    to.yearCount += from.yearCount;
+    to.yearSum += from.yearSum;
+}
+
+static quint32 gameCount(const StatisticsBook::Record& record)
+{
+    return record.results[0] + record.results[1] + record.results[2] + record.results[3];
+}
+
+static QDataStream& operator<<(QDataStream& out, const StatisticsBook::Record& record)
+{
+    out << record.key << record.move;
+    for (int r = 0; r < 4; ++r)
+    {
+        out << record.results[r];
+    }
+    out << record.ratingCount << record.ratingSum << record.yearCount << record.yearSum;
+    return out;
+}
+
+static QDataStream& operator>>(QDataStream& in, StatisticsBook::Record& record)
+{
+    in >> record.key >> record.move;
+    for (int r = 0; r < 4; ++r)
+    {
+        in >> record.results[r];
+    }
+    in >> record.ratingCount >> record.ratingSum >> record.yearCount >> record.yearSum;
+    return in;
+}
+
+// ---------------------------------------------------------
+// construction
+// ---------------------------------------------------------
+
+StatisticsBook::StatisticsBook() :
+    Database(),
+    m_file(nullptr),
+    m_count(0),
+    m_records(nullptr),
+    m_cache(BookCacheSize),
+    m_runs(recordLess, sameMove, addRecord),
+    m_minGame(0),
+    m_maxPly(0)
+{
+}
+
+StatisticsBook::~StatisticsBook()
+{
+    close();
+}
+
+// ---------------------------------------------------------
+// Database Interface implementation
+// ---------------------------------------------------------
+
+bool StatisticsBook::open(const QString& filename, bool)
+{
+    if (m_file)
+    {
+        return false;
+    }
+    m_break = false;
+    m_utf8 = false;
+    m_filename = filename;
+    QFile* file = new QFile(filename);
+    if (!file->open(QIODevice::ReadOnly))
+    {
+        delete file;
+        return false;
+    }
+    m_file = file;
+
+    QByteArray header = file->read(HeaderSize);
+    const uchar* p = reinterpret_cast<const uchar*>(header.constData());
+    if (static_cast<quint64>(header.size()) != HeaderSize ||
+        qFromLittleEndian<quint32>(p) != STATISTICS_BOOK_FILE_MAGIC ||
+        qFromLittleEndian<quint16>(p + 4) > VERSION_STATISTICS_BOOK_CURRENT)
+    {
+        close();
+        return false;
+    }
+
+    // A book cut short keeps its complete records
+    m_count = qMin(qFromLittleEndian<quint64>(p + 8), static_cast<quint64>(file->size() - HeaderSize) / RecordSize);
+    if (m_count)
+    {
+        m_records = file->map(HeaderSize, m_count * RecordSize);
+        if (!m_records)
+        {
+            // Not mappable, keep a copy of the book in memory instead
+            m_bookData = file->read(m_count * RecordSize);
+            m_count = m_bookData.size() / RecordSize;
+            m_records = reinterpret_cast<const uchar*>(m_bookData.constData());
+        }
+    }
+    return true;
+}
+
+bool StatisticsBook::parseFile()
+{
+    return false;
+}
+
+QString StatisticsBook::filename() const
+{
+    return m_filename;
+}
+
+quint64 StatisticsBook::count() const
+{
+    return 0;
+}
+
+quint64 StatisticsBook::positionCount() const
+{
+    return m_count;
+}
+
+void StatisticsBook::loadGameMoves(GameId, GameX&)
+{
+}
+
+int StatisticsBook::findPosition(GameId, const BoardX&)
+{
+    return NO_MOVE;
+}
+
+void StatisticsBook::close()
+{
+    m_records = nullptr;
+    m_count = 0;
+    m_bookData.clear();
+    m_cache.clear();
+    if (m_file)
+    {
+        m_file->close(); // also releases the mapping
+    }
+    delete m_file;
+    m_file = nullptr;
+}
+
+// ---------------------------------------------------------
+// Book reading
+// ---------------------------------------------------------
+
+inline quint64 StatisticsBook::keyAt(quint64 index) const
+{
+    return qFromLittleEndian<quint64>(m_records + index * RecordSize);
+}
+
+void StatisticsBook::recordAt(quint64 index, Record& record) const
+{
+    const uchar* p = m_records + index * RecordSize;
+    record.key = qFromLittleEndian<quint64>(p);
+    record.move = qFromLittleEndian<quint16>(p + 8);
+    for (int r = 0; r < 4; ++r)
+    {
+        record.results[r] = qFromLittleEndian<quint32>(p + 12 + 4 * r);
+    }
+    record.ratingCount = qFromLittleEndian<quint32>(p + 28);
+    record.yearCount = qFromLittleEndian<quint32>(p + 32);
+    record.ratingSum = qFromLittleEndian<qint64>(p + 40);
+    record.yearSum = qFromLittleEndian<qint64>(p + 48);
+}
+
+quint64 StatisticsBook::lowerBound(quint64 key) const
+{
+    quint64 first = 0;
+    quint64 last = m_count;
+    while (first < last)
+    {
+        quint64 mid = first + (last - first) / 2;
+        if (keyAt(mid) < key)
+        {
+            first = mid + 1;
+        }
+        else
+        {
+            last = mid;
+        }
+    }
+    return first;
+}
+
+unsigned int StatisticsBook::getMoveMapForBoard(const BoardX& board, QMap<Move, MoveData>& moves)
+{
+    moves.clear();
+    QMutexLocker m(mutex());
+    if (!m_records)
+    {
+        return 0;
+    }
+    quint64 key = board.getHashValue();
+    if (const QMap<Move, MoveData>* cached = m_cache.object(key))
+    {
+        moves = *cached;
+    }
+    else
+    {
+        for (quint64 i = lowerBound(key); i < m_count && keyAt(i) == key; ++i)
+        {
+            Record record;
+            recordAt(i, record);
+            MoveData md;
+            if (record.move == PositionIndex::NoMove)
+            {
+                md.localsan = md.san = QCoreApplication::translate("MoveData", "[end]");
+            }
+            else
+            {
+                md.move = PositionIndex::decodeMove(board, record.move);
+                if (!md.move.isLegal())
+                {
+                    // Another position with the same hash
+                    continue;
+                }
+                md.san = board.moveToSan(md.move);
+                md.localsan = board.moveToSan(md.move, true);
+            }
+            for (int r = ResultUnknown; r <= BlackWin; ++r)
+            {
+                md.results.update(Result(r), record.results[r]);
+            }
+            md.rating.add(record.ratingCount, record.ratingSum);
+            md.year.add(record.yearCount, record.yearSum);
+            moves.insert(md.move, md);
+        }
+        m_cache.insert(key, new QMap<Move, MoveData>(moves));
+    }
+
+    unsigned int games = 0;
+    for (const MoveData& md: moves)
+    {
+        games += md.results.count();
+    }
+    return games;
+}
+
+// ---------------------------------------------------------
+// Book building - public interface
+// ---------------------------------------------------------
+
+bool StatisticsBook::openForWriting(const QString& filename, int maxPly, int minGame)
+{
+    if (m_file)
+    {
+        return false;
+    }
+    m_maxPly = maxPly;
+    m_minGame = qMax(1, minGame);
+    m_break = false;
+    m_utf8 = false;
+    m_filename = filename;
+    QFile* file = new QFile(filename);
+    if (!file->open(QIODevice::WriteOnly))
+    {
+        delete file;
+        return false;
+    }
+    m_file = file;
+    return true;
+}
+
+void StatisticsBook::book_make(Database& db, volatile bool& breakFlag)
+{
+    QMutexLocker m(mutex());
+    write_header(0);
+    if (!breakFlag) add_database(db, breakFlag);
+    if (!breakFlag) merge_runs(breakFlag);
+    m_runs.clear();
+    if (breakFlag)
+    {
+        m_file->remove();
+    }
+    close();
+}
+
+// ---------------------------------------------------------
+// Book building
+// ---------------------------------------------------------
+
+void StatisticsBook::write_header(quint64 count)
+{
+    uchar header[HeaderSize];
+    qToLittleEndian<quint32>(STATISTICS_BOOK_FILE_MAGIC, header);
+    qToLittleEndian<quint16>(VERSION_STATISTICS_BOOK_CURRENT, header + 4);
+    qToLittleEndian<quint16>(static_cast<quint16>(m_maxPly), header + 6);
+    qToLittleEndian<quint64>(count, header + 8);
+    m_file->seek(0);
+    m_file->write(reinterpret_cast<const char*>(header), HeaderSize);
+}
+
+void StatisticsBook::write_record(const Record& record)
+{
+    uchar p[RecordSize];
+    memset(p, 0, RecordSize);
+    qToLittleEndian<quint64>(record.key, p);
+    qToLittleEndian<quint16>(record.move, p + 8);
+    for (int r = 0; r < 4; ++r)
+    {
+        qToLittleEndian<quint32>(record.results[r], p + 12 + 4 * r);
+    }
+    qToLittleEndian<quint32>(record.ratingCount, p + 28);
+    qToLittleEndian<quint32>(record.yearCount, p + 32);
+    qToLittleEndian<qint64>(record.ratingSum, p + 40);
+    qToLittleEndian<qint64>(record.yearSum, p + 48);
+    m_file->write(reinterpret_cast<const char*>(p), RecordSize);
+}
+
+void StatisticsBook::merge_runs(volatile bool& breakFlag)
+{
+    quint64 count = 0;
+    m_runs.merge([&](const Record& record)
+    {
+        if (gameCount(record) >= m_minGame)
+        {
+            write_record(record);
+            ++count;
+        }
+    }, breakFlag);
+    write_header(count);
+}
+
+void StatisticsBook::add_game(Database& db, GameId gameId, const GameX& game, QVector<Record>& run) const
+{
+    const IndexX* index = db.index();
+    Result result = index->result(gameId);
+    int elo[2] = { index->elo(gameId, White), index->elo(gameId, Black) };
+    MoveData::YearMetrics year;
+    year.update(index->date(gameId).year());
+
+    const GameCursor& cursor = game.cursor();
+    BoardX board(cursor.initialBoard());
+    QVector<quint64> seen;
+    MoveId node = ROOT_NODE;
+    for (int ply = 0; ; ++ply)
+    {
+        MoveId next = cursor.nextMove(node);
+        quint64 key = board.getHashValue();
+
+        // A game is counted at the first time it reaches a position
+        if (!seen.contains(key))
+        {
+            seen.append(key);
+            Record record;
+            memset(&record, 0, sizeof(record));
+            record.key = key;
+            record.move = (next == NO_MOVE) ? PositionIndex::NoMove : PositionIndex::encodeMove(cursor.move(next));
+            record.results[result] = 1;
+            MoveData::RatingMetrics rating;
+            rating.update(elo[board.toMove()]);
+            record.ratingCount = static_cast<quint32>(rating.count());
+            record.ratingSum = rating.sum();
+            record.yearCount = static_cast<quint32>(year.count());
+            record.yearSum = year.sum();
+            run.append(record);
+        }
+
+        if (next == NO_MOVE || ply >= m_maxPly || cursor.move(next).isNullMove())
+        {
+            break;
+        }
+        board.doMove(cursor.move(next));
+        node = next;
+    }
+}
+
+void StatisticsBook::add_database(Database& db, volatile bool& breakFlag)
+{
+    RefKeeper m(db.refCounter());
+    m_runs.collect(db.count(), m_maxPly + 1, [&](int i, QVector<Record>& run)
+    {
+        GameX game;
+        db.loadGameMoves(i, game);
+        add_game(db, i, game, run);
+    }, [this](int percent) { emit progress(percent); }, breakFlag);
+}
@@ -0,0 +1,119 @@
+#ifndef STATISTICSBOOK_H_INCLUDED
+#define STATISTICSBOOK_H_INCLUDED
+
+#include <QCache>
+#include <QMutex>
+
+#include "database.h"
+#include "movedata.h"
+#include "sortedruns.h"
+
+class QFile;
+
+#define VERSION_STATISTICS_BOOK_1_0 0x0100
+#define VERSION_STATISTICS_BOOK_CURRENT VERSION_STATISTICS_BOOK_1_0
+
+#define STATISTICS_BOOK_FILE_MAGIC 0x42584843
+
+/** @ingroup Database
+   The StatisticsBook class is the native ChessX book (.cxb). Unlike a
+   Polyglot or CTG book it keeps the complete MoveData of each move, as the
+   opening tree counts it over the games of a database: the results, the
+   average rating of the moving side and the average year.
+
+   The book holds one record per position hash (BoardX::getHashValue()) and
+   move, sorted by hash and move, behind a small header. All values are
+   stored little endian in fixed size records, so the book is mapped into
+   memory and a position is found by a binary search.
+
+   A book is built with book_make() for the positions of the main lines up
+   to a maximum ply. Like Database::findPosition(), a game is only counted
+   for the first time it reaches a position, games ending there are counted
+   for the "[end]" move.
+*/
+
+class StatisticsBook : public Database
+{
+    Q_OBJECT
+public:
+    /** Aggregated statistics of one move in one position */
+    struct Record
+    {
+        quint64 key;
+        quint16 move;
+        quint32 results[4];
+        quint32 ratingCount;
+        qint64 ratingSum;
+        quint32 yearCount;
+        qint64 yearSum;
+    };
+
+    StatisticsBook();
+    ~StatisticsBook();
+
+    /** Opens the given book */
+    virtual bool open(const QString& filename, bool);
+    /** Open a new book and set the parameters for the writer thread */
+    bool openForWriting(const QString& filename, int maxPly, int minGame);
+    /** Parse the database */
+    virtual bool parseFile();
+    /** File-based database name */
+    virtual QString filename() const;
+
+    /** Get the number of stored games*/
+    virtual quint64 count() const;
+    /** Get the number of stored records */
+    quint64 positionCount() const;
+
+    /** Loads only moves into a game from the given position */
+    virtual void loadGameMoves(GameId index, GameX& game);
+    /** Loads game moves and try to find a position */
+    virtual int findPosition(GameId, const BoardX &position);
+
+    virtual bool hasIndexFile() const { return true; }
+    /** Closes the book */
+    void close();
+
+    /** Build the book from all games of @p db */
+    void book_make(Database& db, volatile bool& breakFlag);
+
+    /** Get a map of MoveData from a given board position */
+    virtual unsigned int getMoveMapForBoard(const BoardX& board, QMap<Move, MoveData>& moves);
+
+signals:
+    void progress(int);
+
+protected:
+    /** @return key of record @p index of the mapped book */
+    quint64 keyAt(quint64 index) const;
+    /** Decode record @p index of the mapped book */
+    void recordAt(quint64 index, Record& record) const;
+    /** @return index of the first record with a key not less than @p key */
+    quint64 lowerBound(quint64 key) const;
+
+    /** Merge all spilled runs into the book file */
+    void merge_runs(volatile bool& breakFlag);
+    /** Collect the records of all games of @p db in sorted runs */
+    void add_database(Database& db, volatile bool& breakFlag);
+    void add_game(Database& db, GameId gameId, const GameX& game, QVector<Record>& run) const;
+    void write_header(quint64 count);
+    void write_record(const Record& record);
+
+private:
+    QString m_filename;
+    QFile* m_file;
+    quint64 m_count;
+    /** Records, mapped from the file or read into m_bookData */
+    const uchar* m_records;
+    QByteArray m_bookData;
+    /** Number of positions kept in the lookup cache */
+    static const int BookCacheSize = 1024;
+    /** Recently looked up positions */
+    QCache<quint64, QMap<Move, MoveData> > m_cache;
+    /** Sorted runs of records collected by the workers */
+    SortedRuns<Record> m_runs;
+    quint32 m_minGame;
+    int m_maxPly;
+};
+
+#endif // STATISTICSBOOK_H_INCLUDED
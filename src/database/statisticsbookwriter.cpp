@@ -0,0 +1,59 @@
+#include "statisticsbookwriter.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+StatisticsBookWriter::StatisticsBookWriter(QObject *parent) :
+    QThread(parent),
+    m_source(nullptr),
+    m_break(false)
+{
+}
+
+StatisticsBookWriter::~StatisticsBookWriter()
+{
+    delete m_destination;
+}
+
+void StatisticsBookWriter::run()
+{
+    m_destination->book_make(*m_source, m_break);
+    if (!m_break)
+    {
+        emit bookBuildFinished(m_out, this);
+    }
+    else
+    {
+        emit bookBuildError(m_out, this);
+    }
+    deleteLater();
+}
+
+// ---------------------------------------------------------
+// Mainthread Interface
+// ---------------------------------------------------------
+
+void StatisticsBookWriter::writeBookForDatabase(Database *src, const QString &out, int maxPly, int minGame)
+{
+    m_break = false;
+    m_out = out;
+    m_source = src;
+    m_destination = new StatisticsBook();
+    if (m_destination->openForWriting(out, maxPly, minGame))
+    {
+        connect(m_destination, SIGNAL(progress(int)), this, SIGNAL(progress(int)));
+        start();
+    }
+    else
+    {
+        emit bookBuildError(out, this);
+        deleteLater();
+    }
+}
+
+void StatisticsBookWriter::cancel()
+{
+    m_break = true;
+}
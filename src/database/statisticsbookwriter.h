@@ -0,0 +1,43 @@
+#ifndef STATISTICSBOOKWRITER_H_INCLUDED
+#define STATISTICSBOOKWRITER_H_INCLUDED
+
+#include <QPointer>
+#include <QThread>
+
+#include "database.h"
+#include "statisticsbook.h"
+
+/** @ingroup Database
+   The StatisticsBookWriter class builds a StatisticsBook from a database in
+   the background, like PolyglotWriter does for Polyglot books.
+*/
+
+class StatisticsBookWriter : public QThread
+{
+    Q_OBJECT
+public:
+    explicit StatisticsBookWriter(QObject *parent = nullptr);
+    ~StatisticsBookWriter();
+    /** Start building the book @p out from the games of @p src up to @p maxPly */
+    void writeBookForDatabase(Database* src, const QString &out, int maxPly, int minGame);
+
+signals:
+    void bookBuildFinished(QString, StatisticsBookWriter*);
+    void bookBuildError(QString, StatisticsBookWriter*);
+    void progress(int);
+
+public slots:
+    void cancel();
+
+    // QThread interface
+protected:
+    virtual void run();
+
+    QPointer<Database> m_source;
+    QPointer<StatisticsBook> m_destination;
+    QString m_out;
+
+    bool m_break;
+};
+
+#endif // STATISTICSBOOKWRITER_H_INCLUDED
@@ -24,7 +24,7 @@ bool StreamDatabase::loadNextGame(GameX& game)
     //indexing game positions in the file, game contents are ignored
     int oldFp = -3;
 
-    while(!m_file->atEnd())
+    while(!fileAtEnd())
     {
         IndexBaseType fp = skipJunk();
         if(fp == oldFp)
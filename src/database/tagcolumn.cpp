@@ -0,0 +1,297 @@
+#include <algorithm>
+
+#include "indeximage.h"
+#include "tagcolumn.h"
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+#define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
+#define new DEBUG_NEW
+#endif // _MSC_VER
+
+TagColumn::TagColumn(bool dense, bool posted) : m_dense(dense), m_posted(posted), m_end(0), m_postingCount(0), m_imageTag(0)
+{
+}
+
+TagColumn::TagColumn(QSharedPointer<const IndexImage> image, int tag)
+    : m_dense(image->isDense(tag))
+    , m_posted(image->isPosted(tag))
+    , m_end(0)
+    , m_postingCount(0)
+    , m_image(image)
+    , m_imageTag(tag)
+{
+}
+
+bool TagColumn::isDense() const
+{
+    return m_dense;
+}
+
+void TagColumn::makeDense()
+{
+    detach();
+    if (m_dense)
+    {
+        return;
+    }
+    m_dense = true;
+    m_values.resize(static_cast<int>(m_end));
+    m_present.resize(static_cast<int>((m_end + 31) >> 5));
+    for (auto it = m_sparse.cbegin(); it != m_sparse.cend(); ++it)
+    {
+        m_values[it.key()] = it.value();
+        m_present[it.key() >> 5] |= 1u << (it.key() & 31);
+    }
+    m_sparse.clear();
+    m_sparse.squeeze();
+}
+
+void TagColumn::set(GameId gameId, ValueIndex valueIndex)
+{
+    detach();
+    if (m_posted)
+    {
+        if (contains(gameId))
+        {
+            ValueIndex oldValueIndex = value(gameId);
+            if (oldValueIndex == valueIndex)
+            {
+                return;
+            }
+            unpost(gameId, oldValueIndex);
+        }
+        post(gameId, valueIndex);
+    }
+
+    if (gameId >= m_end)
+    {
+        m_end = gameId + 1;
+    }
+
+    if (!m_dense)
+    {
+        m_sparse.insert(gameId, valueIndex);
+        int n = m_sparse.count();
+        if (n >= MinDenseCount && static_cast<GameId>(n) * SparseRatio > m_end)
+        {
+            makeDense();
+        }
+        return;
+    }
+
+    if (gameId >= static_cast<GameId>(m_values.count()))
+    {
+        m_values.resize(static_cast<int>(gameId) + 1);
+        m_present.resize(static_cast<int>(gameId >> 5) + 1);
+    }
+    m_values[gameId] = valueIndex;
+    m_present[gameId >> 5] |= 1u << (gameId & 31);
+}
+
+void TagColumn::remove(GameId gameId)
+{
+    detach();
+    if (m_posted && contains(gameId))
+    {
+        unpost(gameId, value(gameId));
+    }
+
+    if (!m_dense)
+    {
+        m_sparse.remove(gameId);
+    }
+    else if (gameId < static_cast<GameId>(m_values.count()))
+    {
+        m_values[gameId] = 0;
+        m_present[gameId >> 5] &= ~(1u << (gameId & 31));
+    }
+}
+
+void TagColumn::replaceValue(ValueIndex valueIndex, ValueIndex newValueIndex)
+{
+    if (valueIndex == newValueIndex)
+    {
+        return;
+    }
+    detach();
+
+    if (m_posted)
+    {
+        // A game has one value only, so the two lists are disjoint
+        QVector<GameId> moved = m_postings.take(valueIndex);
+        if (!moved.isEmpty())
+        {
+            QVector<GameId>& games = m_postings[newValueIndex];
+            QVector<GameId> merged(games.count() + moved.count());
+            std::merge(games.constBegin(), games.constEnd(), moved.constBegin(), moved.constEnd(), merged.begin());
+            games.swap(merged);
+        }
+    }
+
+    if (!m_dense)
+    {
+        for (auto it = m_sparse.begin(); it != m_sparse.end(); ++it)
+        {
+            if (it.value() == valueIndex)
+            {
+                it.value() = newValueIndex;
+            }
+        }
+        return;
+    }
+
+    for (int i = 0, n = m_values.count(); i < n; ++i)
+    {
+        if (m_values.at(i) == valueIndex && contains(static_cast<GameId>(i)))
+        {
+            m_values[i] = newValueIndex;
+        }
+    }
+}
+
+bool TagColumn::hasPostings() const
+{
+    return m_posted;
+}
+
+QVector<GameId> TagColumn::games(ValueIndex valueIndex) const
+{
+    if (m_image)
+    {
+        return m_image->games(m_imageTag, valueIndex);
+    }
+    return m_postings.value(valueIndex);
+}
+
+QList<ValueIndex> TagColumn::postedValues() const
+{
+    if (m_image)
+    {
+        return m_image->postedValues(m_imageTag);
+    }
+    return m_postings.keys();
+}
+
+int TagColumn::postingCount() const
+{
+    if (m_image)
+    {
+        return m_image->postingCount(m_imageTag);
+    }
+    return m_postingCount;
+}
+
+void TagColumn::post(GameId gameId, ValueIndex valueIndex)
+{
+    QVector<GameId>& games = m_postings[valueIndex];
+    if (games.isEmpty() || games.last() < gameId)
+    {
+        games.append(gameId); // Games are usually added in order
+    }
+    else
+    {
+        games.insert(std::lower_bound(games.begin(), games.end(), gameId), gameId);
+    }
+    ++m_postingCount;
+}
+
+void TagColumn::unpost(GameId gameId, ValueIndex valueIndex)
+{
+    auto it = m_postings.find(valueIndex);
+    if (it == m_postings.end())
+    {
+        return;
+    }
+    auto pos = std::lower_bound(it->begin(), it->end(), gameId);
+    if (pos != it->end() && *pos == gameId)
+    {
+        it->erase(pos);
+        --m_postingCount;
+        if (it->isEmpty())
+        {
+            m_postings.erase(it);
+        }
+    }
+}
+
+void TagColumn::reserve(int games)
+{
+    if (m_dense && !m_image)
+    {
+        m_values.reserve(games);
+        m_present.reserve((games + 31) >> 5);
+    }
+}
+
+void TagColumn::squeeze()
+{
+    m_values.squeeze();
+    m_present.squeeze();
+    m_sparse.squeeze();
+    for (auto it = m_postings.begin(); it != m_postings.end(); ++it)
+    {
+        it->squeeze();
+    }
+}
+
+void TagColumn::clear()
+{
+    m_image.reset();
+    m_values.clear();
+    m_present.clear();
+    m_sparse.clear();
+    m_postings.clear();
+    m_postingCount = 0;
+    m_end = 0;
+}
+
+QVector<GameId> TagColumn::gameIds() const
+{
+    if (m_image)
+    {
+        return m_image->gameIds(m_imageTag);
+    }
+    QVector<GameId> games;
+    if (!m_dense)
+    {
+        games.reserve(m_sparse.count());
+        for (auto it = m_sparse.cbegin(); it != m_sparse.cend(); ++it)
+        {
+            games.append(it.key());
+        }
+        std::sort(games.begin(), games.end());
+        return games;
+    }
+    for (int i = 0, n = m_values.count(); i < n; ++i)
+    {
+        if (contains(static_cast<GameId>(i)))
+        {
+            games.append(static_cast<GameId>(i));
+        }
+    }
+    return games;
+}
+
+void TagColumn::detach()
+{
+    if (!m_image)
+    {
+        return;
+    }
+    QSharedPointer<const IndexImage> image;
+    image.swap(m_image);
+    foreach (GameId gameId, image->gameIds(m_imageTag))
+    {
+        set(gameId, image->value(m_imageTag, gameId));
+    }
+}
+
+ValueIndex TagColumn::imageValue(GameId gameId) const
+{
+    return m_image->value(m_imageTag, gameId);
+}
+
+bool TagColumn::imageContains(GameId gameId) const
+{
+    return m_image->contains(m_imageTag, gameId);
+}
@@ -0,0 +1,129 @@
+#ifndef TAGCOLUMN_H_INCLUDED
+#define TAGCOLUMN_H_INCLUDED
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "gameid.h"
+#include "indexitem.h"
+
+class IndexImage;
+
+/** @ingroup Database
+   The TagColumn class holds the values of one tag for all games of an index.
+   Frequently used tags are stored densely as one ValueIndex per game plus a
+   presence bit. Rare tags are kept in a sparse table, which is turned into
+   a dense column automatically once enough games carry the tag.
+
+   Columns of tags identifying an entity (players, events...) can keep
+   inverted postings as well: the sorted list of games for every value, so
+   that the games of one player are found without scanning the column.
+
+   A column read from an index file uses the mapped IndexImage directly and
+   copies its values into its own storage on the first change.
+*/
+
+class TagColumn
+{
+public:
+    explicit TagColumn(bool dense = false, bool posted = false);
+    /** Creates the column of tag @p tag of @p image */
+    TagColumn(QSharedPointer<const IndexImage> image, int tag);
+
+    /** @return true if the column stores one value per game */
+    bool isDense() const;
+    /** Convert a sparse column into a dense one */
+    void makeDense();
+
+    /** Store @p valueIndex for game @p gameId */
+    void set(GameId gameId, ValueIndex valueIndex);
+    /** Remove the value of game @p gameId */
+    void remove(GameId gameId);
+    /** @return the value of game @p gameId or 0 if the game has no such tag */
+    inline ValueIndex value(GameId gameId) const;
+    /** @return true if game @p gameId has a value */
+    inline bool contains(GameId gameId) const;
+    /** @return the sorted list of games with a value */
+    QVector<GameId> gameIds() const;
+
+    /** Search and replace all values @p valueIndex by @p newValueIndex */
+    void replaceValue(ValueIndex valueIndex, ValueIndex newValueIndex);
+
+    /** @return true if the column keeps a list of games per value */
+    bool hasPostings() const;
+    /** @return the sorted list of games with value @p valueIndex, requires postings */
+    QVector<GameId> games(ValueIndex valueIndex) const;
+    /** @return all values stored in the column, requires postings */
+    QList<ValueIndex> postedValues() const;
+    /** @return number of games with a value, requires postings */
+    int postingCount() const;
+
+    /** Reserve space for @p games games */
+    void reserve(int games);
+    /** Free unused memory */
+    void squeeze();
+    /** Remove all values */
+    void clear();
+
+private:
+    /** Dense columns are used when more than 1/SparseRatio of the games have a value */
+    static const int SparseRatio = 8;
+    /** Sparse columns with less values are never made dense */
+    static const int MinDenseCount = 256;
+
+    /** Add @p gameId to the postings of @p valueIndex */
+    void post(GameId gameId, ValueIndex valueIndex);
+    /** Remove @p gameId from the postings of @p valueIndex */
+    void unpost(GameId gameId, ValueIndex valueIndex);
+    /** Copy the values of the image into the own storage */
+    void detach();
+    ValueIndex imageValue(GameId gameId) const;
+    bool imageContains(GameId gameId) const;
+
+    bool m_dense;
+    bool m_posted;
+    /** Dense storage, indexed by GameId */
+    QVector<ValueIndex> m_values;
+    /** Presence bits of the dense storage */
+    QVector<quint32> m_present;
+    /** Sparse storage */
+    QHash<GameId, ValueIndex> m_sparse;
+    /** Highest GameId + 1 ever stored */
+    GameId m_end;
+    /** Sorted games per value, only if m_posted */
+    QHash<ValueIndex, QVector<GameId> > m_postings;
+    int m_postingCount;
+    /** Image the values are read from, until the column is changed */
+    QSharedPointer<const IndexImage> m_image;
+    int m_imageTag;
+};
+
+inline ValueIndex TagColumn::value(GameId gameId) const
+{
+    if (m_image)
+    {
+        return imageValue(gameId);
+    }
+    if (m_dense)
+    {
+        return (gameId < static_cast<GameId>(m_values.count())) ? m_values.at(gameId) : 0;
+    }
+    return m_sparse.value(gameId, 0);
+}
+
+inline bool TagColumn::contains(GameId gameId) const
+{
+    if (m_image)
+    {
+        return imageContains(gameId);
+    }
+    if (m_dense)
+    {
+        return ((gameId >> 5) < static_cast<GameId>(m_present.count()))
+                && (m_present.at(gameId >> 5) & (1u << (gameId & 31)));
+    }
+    return m_sparse.contains(gameId);
+}
+
+#endif // TAGCOLUMN_H_INCLUDED
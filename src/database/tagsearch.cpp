@@ -44,3 +44,8 @@ int TagSearch::matches(GameId index) const
 {
     return m_matches.at(index);
 }
+
+const QBitArray* TagSearch::matchList() const
+{
+    return &m_matches;
+}
@@ -24,6 +24,7 @@ public:
     TagSearch(Database *database, const QString &tag, int minValue, int maxValue);
     /** Return true if the game at index matches the search */
     virtual int matches(GameId index) const;
+    virtual const QBitArray* matchList() const;
 
 private:
     QBitArray m_matches;
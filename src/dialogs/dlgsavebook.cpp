@@ -84,16 +84,18 @@ void DlgSaveBook::reject()
 
 void DlgSaveBook::slotSelectTargetPath()
 {
+    QString chessxBook = tr("ChessX Book (*.cxb)");
+    QString selectedFilter;
     QString file = QFileDialog::getSaveFileName(this, tr("New book"),
                    AppSettings->value("/General/DefaultDataPath").toString(),
-                   tr("Polyglot Book (*.bin)"));
+                   tr("Polyglot Book (*.bin)") + ";;" + chessxBook, &selectedFilter);
     if(file.isEmpty())
     {
         return;
     }
-    if(!file.endsWith(".bin", Qt::CaseInsensitive))
+    if(!file.endsWith(".bin", Qt::CaseInsensitive) && !file.endsWith(".cxb", Qt::CaseInsensitive))
     {
-        file += ".bin";
+        file += (selectedFilter == chessxBook) ? ".cxb" : ".bin";
     }
     ui->outputPath->setText(file);
 }
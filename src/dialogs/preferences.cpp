@@ -481,6 +481,7 @@ void PreferencesDialog::restoreSettings()
     ui.versionCheck->setChecked(AppSettings->getValue("onlineVersionCheck").toBool());
     ui.automaticECO->setChecked(AppSettings->getValue("automaticECO").toBool());
     ui.useIndexFile->setChecked(AppSettings->getValue("useIndexFile").toBool());
+    ui.usePositionIndex->setChecked(AppSettings->getValue("usePositionIndex").toBool());
     ui.cbAutoCommitDB->setChecked(AppSettings->getValue("autoCommitDB").toBool());
     QString lang = AppSettings->getValue("language").toString();
     AppSettings->endGroup();
@@ -679,6 +680,7 @@ void PreferencesDialog::saveSettings()
     AppSettings->setValue("onlineVersionCheck", QVariant(ui.versionCheck->isChecked()));
     AppSettings->setValue("automaticECO", QVariant(ui.automaticECO->isChecked()));
     AppSettings->setValue("useIndexFile", QVariant(ui.useIndexFile->isChecked()));
+    AppSettings->setValue("usePositionIndex", QVariant(ui.usePositionIndex->isChecked()));
     AppSettings->setValue("autoCommitDB", QVariant(ui.cbAutoCommitDB->isChecked()));
     AppSettings->setValue("language", QVariant(ui.cbLanguage->currentText()));
     AppSettings->endGroup();
@@ -68,6 +68,10 @@ public:
         {
             return "Arena Book";
         }
+        if (m_name.endsWith(".cxb", Qt::CaseInsensitive))
+        {
+            return "ChessX Book";
+        }
         return m_utf8 ? "UTF8" : "ANSI";
     }
 };
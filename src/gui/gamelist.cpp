@@ -59,7 +59,6 @@ GameList::GameList(FilterX* filter, QWidget* parent) : TableView(parent)
     sortModel = new GameListSortModel(nullptr);
     sortModel->setFilter(filter);
     sortModel->setSourceModel(m_model);
-    sortModel->setDynamicSortFilter(true);
     setModel(sortModel);
 
     connect(this, SIGNAL(clicked(const QModelIndex&)), SLOT(itemSelected(const QModelIndex&)));
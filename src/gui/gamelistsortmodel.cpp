@@ -2,24 +2,431 @@
 *   Copyright (C) 2019 by Jens Nissen jens-chessx@gmx.net                   *
 ****************************************************************************/
 
+#include "database.h"
 #include "filter.h"
+#include "filtermodel.h"
 #include "gamelistsortmodel.h"
+#include "indexsorter.h"
+
+#include <algorithm>
 
 #if defined(_MSC_VER) && defined(_DEBUG)
 #define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
 #define new DEBUG_NEW
 #endif // _MSC_VER
 
-bool GameListSortModel::filterAcceptsRow(int source_row, const QModelIndex & /*source_parent*/) const
+/** Rows decoded ahead of and behind the rows shown */
+static const int PrefetchRows = 512;
+/** A filter change of more ranges resets the model instead of moving the rows for every range */
+static const int MaxChangedRanges = 32;
+
+GameListSortModel::GameListSortModel(QObject *parent) :
+    QAbstractProxyModel(parent),
+    m_filter(nullptr),
+    m_sortColumn(0),
+    m_sortOrder(Qt::AscendingOrder),
+    m_resetting(false),
+    m_prefetchFirst(0),
+    m_prefetchEnd(0)
 {
-    if (m_filter && m_filter->gamePosition(source_row))
-    {
-        return true;
-    }
-    return false;
+    m_sorter = new IndexSorter(this);
+    connect(m_sorter, SIGNAL(sorted(QString)), SLOT(slotSorted(QString)));
 }
 
 void GameListSortModel::setFilter(FilterX* filter)
 {
     m_filter = filter;
+    m_sorter->setIndex((filter && filter->database()) ? filter->database()->index() : nullptr);
+}
+
+void GameListSortModel::setSourceModel(QAbstractItemModel* model)
+{
+    beginResetModel();
+    if (sourceModel())
+    {
+        disconnect(sourceModel(), nullptr, this, nullptr);
+    }
+    QAbstractProxyModel::setSourceModel(model);
+    if (model)
+    {
+        connect(model, SIGNAL(modelAboutToBeReset()), SLOT(slotSourceAboutToBeReset()));
+        connect(model, SIGNAL(modelReset()), SLOT(slotSourceReset()));
+        connect(model, SIGNAL(dataChanged(QModelIndex,QModelIndex)), SLOT(slotSourceDataChanged(QModelIndex,QModelIndex)));
+        connect(model, SIGNAL(headerDataChanged(Qt::Orientation,int,int)), SIGNAL(headerDataChanged(Qt::Orientation,int,int)));
+        if (qobject_cast<FilterModel*>(model))
+        {
+            connect(model, SIGNAL(filterChanged()), SLOT(slotFilterChanged()));
+        }
+    }
+    buildRows();
+    endResetModel();
+}
+
+QModelIndex GameListSortModel::mapToSource(const QModelIndex& proxyIndex) const
+{
+    if (!proxyIndex.isValid() || !sourceModel() || proxyIndex.row() >= m_rows.count())
+    {
+        return QModelIndex();
+    }
+    return sourceModel()->index(m_rows.at(proxyIndex.row()), proxyIndex.column());
+}
+
+QModelIndex GameListSortModel::mapFromSource(const QModelIndex& sourceIndex) const
+{
+    int row = sourceIndex.isValid() ? m_sourceRows.value(sourceIndex.row(), -1) : -1;
+    if (row < 0)
+    {
+        return QModelIndex();
+    }
+    return createIndex(row, sourceIndex.column());
+}
+
+QModelIndex GameListSortModel::index(int row, int column, const QModelIndex& parent) const
+{
+    if (parent.isValid() || row < 0 || row >= m_rows.count() || column < 0 || column >= columnCount())
+    {
+        return QModelIndex();
+    }
+    return createIndex(row, column);
+}
+
+QModelIndex GameListSortModel::parent(const QModelIndex&) const
+{
+    return QModelIndex();
+}
+
+int GameListSortModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_rows.count();
+}
+
+int GameListSortModel::columnCount(const QModelIndex& parent) const
+{
+    return (parent.isValid() || !sourceModel()) ? 0 : sourceModel()->columnCount();
+}
+
+bool GameListSortModel::hasChildren(const QModelIndex& parent) const
+{
+    return !parent.isValid();
+}
+
+QVariant GameListSortModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (!sourceModel())
+    {
+        return QVariant();
+    }
+    if (orientation == Qt::Vertical)
+    {
+        if (section < 0 || section >= m_rows.count())
+        {
+            return QVariant();
+        }
+        section = m_rows.at(section);
+    }
+    return sourceModel()->headerData(section, orientation, role);
+}
+
+QVariant GameListSortModel::data(const QModelIndex& proxyIndex, int role) const
+{
+    if (proxyIndex.isValid() && role == Qt::DisplayRole)
+    {
+        prefetchAround(proxyIndex.row());
+    }
+    return QAbstractProxyModel::data(proxyIndex, role);
+}
+
+void GameListSortModel::prefetchAround(int row) const
+{
+    // Ask again when the rows shown come near the end of the rows asked for
+    bool covered = row >= m_prefetchFirst && row < m_prefetchEnd
+                   && (m_prefetchFirst == 0 || row - PrefetchRows / 2 >= m_prefetchFirst)
+                   && (m_prefetchEnd == m_rows.count() || row + PrefetchRows / 2 < m_prefetchEnd);
+    if (covered)
+    {
+        return;
+    }
+    FilterModel* model = qobject_cast<FilterModel*>(sourceModel());
+    if (!model)
+    {
+        return;
+    }
+    m_prefetchFirst = qMax(0, row - PrefetchRows);
+    m_prefetchEnd = qMin(m_rows.count(), row + PrefetchRows);
+    // Rows below first, scrolling down is the common case
+    QVector<GameId> games;
+    games.reserve(m_prefetchEnd - m_prefetchFirst);
+    for (int i = row; i < m_prefetchEnd; ++i)
+    {
+        games.append(static_cast<GameId>(m_rows.at(i)));
+    }
+    for (int i = row - 1; i >= m_prefetchFirst; --i)
+    {
+        games.append(static_cast<GameId>(m_rows.at(i)));
+    }
+    model->prefetch(games);
+}
+
+void GameListSortModel::sort(int column, Qt::SortOrder order)
+{
+    m_sortColumn = column;
+    m_sortOrder = order;
+    applySort();
+}
+
+QString GameListSortModel::columnTag(int column) const
+{
+    FilterModel* model = qobject_cast<FilterModel*>(sourceModel());
+    if (!model || column <= 0)
+    {
+        return QString();
+    }
+    QStringList tags = model->GetColumnTags();
+    return (column < tags.count()) ? tags.at(column) : QString();
+}
+
+void GameListSortModel::applySort()
+{
+    QString tag = columnTag(m_sortColumn);
+    if (tag.isEmpty())
+    {
+        // The game number needs no permutation
+        m_order.clear();
+        if (m_sortOrder == Qt::DescendingOrder && m_filter)
+        {
+            int count = static_cast<int>(m_filter->size());
+            m_order.resize(count);
+            for (int i = 0; i < count; ++i)
+            {
+                m_order[i] = static_cast<GameId>(count - 1 - i);
+            }
+        }
+        applyOrder();
+    }
+    else if (m_sorter->permutation(tag, m_sortOrder, m_order))
+    {
+        applyOrder();
+    }
+    else
+    {
+        m_sorter->request(tag);
+    }
+}
+
+bool GameListSortModel::accepted(int sourceRow) const
+{
+    return m_filter && m_filter->gamePosition(static_cast<GameId>(sourceRow));
+}
+
+void GameListSortModel::buildRows()
+{
+    const int count = sourceModel() ? sourceModel()->rowCount() : 0;
+    m_rows.clear();
+    m_sourceRows.fill(-1, count);
+    m_prefetchFirst = m_prefetchEnd = 0;
+    if (!m_filter)
+    {
+        return;
+    }
+    m_rows.reserve(m_filter->count());
+    // Games added after the permutation was computed come last
+    const int total = qMax(m_order.count(), count);
+    for (int i = 0; i < total; ++i)
+    {
+        int sourceRow = sourceRowAt(i);
+        if (sourceRow < count && accepted(sourceRow))
+        {
+            m_sourceRows[sourceRow] = m_rows.count();
+            m_rows.append(sourceRow);
+        }
+    }
+}
+
+void GameListSortModel::updateSourceRows()
+{
+    m_sourceRows.fill(-1);
+    for (int row = 0; row < m_rows.count(); ++row)
+    {
+        m_sourceRows[m_rows.at(row)] = row;
+    }
+    m_prefetchFirst = m_prefetchEnd = 0;
+}
+
+void GameListSortModel::applyOrder()
+{
+    if (m_resetting)
+    {
+        return;
+    }
+    emit layoutAboutToBeChanged();
+    QModelIndexList oldIndexes = persistentIndexList();
+    QModelIndexList sourceIndexes;
+    foreach (const QModelIndex& index, oldIndexes)
+    {
+        sourceIndexes.append(mapToSource(index));
+    }
+    buildRows();
+    QModelIndexList newIndexes;
+    foreach (const QModelIndex& index, sourceIndexes)
+    {
+        newIndexes.append(mapFromSource(index));
+    }
+    changePersistentIndexList(oldIndexes, newIndexes);
+    emit layoutChanged();
+}
+
+void GameListSortModel::slotSourceAboutToBeReset()
+{
+    m_resetting = true;
+    beginResetModel();
+}
+
+void GameListSortModel::slotSourceReset()
+{
+    buildRows();
+    m_resetting = false;
+    endResetModel();
+    if (!columnTag(m_sortColumn).isEmpty())
+    {
+        // The games may have changed, get a current permutation
+        applySort();
+    }
+}
+
+void GameListSortModel::slotSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+    // The source model decodes the changed games again
+    m_prefetchFirst = m_prefetchEnd = 0;
+    for (int sourceRow = topLeft.row(); sourceRow <= bottomRight.row(); ++sourceRow)
+    {
+        int row = m_sourceRows.value(sourceRow, -1);
+        bool inFilter = accepted(sourceRow);
+        if (row >= 0 && !inFilter)
+        {
+            beginRemoveRows(QModelIndex(), row, row);
+            m_rows.remove(row);
+            m_sourceRows[sourceRow] = -1;
+            for (int i = row; i < m_rows.count(); ++i)
+            {
+                m_sourceRows[m_rows.at(i)] = i;
+            }
+            endRemoveRows();
+        }
+        else if (row < 0 && inFilter)
+        {
+            // Games joining the list are inserted at their place in the order
+            slotFilterChanged();
+            return;
+        }
+        else if (row >= 0)
+        {
+            // An edited game keeps its place until the list is sorted again
+            emit dataChanged(index(row, topLeft.column()), index(row, bottomRight.column()));
+        }
+    }
+}
+
+void GameListSortModel::slotFilterChanged()
+{
+    if (m_resetting)
+    {
+        return;
+    }
+    const int count = m_sourceRows.count();
+    const int total = qMax(m_order.count(), count);
+
+    // Count the ranges of rows which leave and join the list
+    int ranges = 0;
+    bool leaving = false;
+    bool joining = false;
+    for (int i = 0; i < total; ++i)
+    {
+        int sourceRow = sourceRowAt(i);
+        if (sourceRow >= count)
+        {
+            continue;
+        }
+        bool was = m_sourceRows.at(sourceRow) >= 0;
+        bool is = accepted(sourceRow);
+        if (was)
+        {
+            ranges += (!is && !leaving) ? 1 : 0;
+            leaving = !is;
+        }
+        if (is)
+        {
+            ranges += (!was && !joining) ? 1 : 0;
+            joining = !was;
+        }
+    }
+    if (ranges == 0)
+    {
+        return;
+    }
+    if (ranges > MaxChangedRanges)
+    {
+        beginResetModel();
+        buildRows();
+        endResetModel();
+        return;
+    }
+
+    // Remove from the last row on, the rows before keep their numbers
+    int last = -1;
+    for (int row = m_rows.count() - 1; row >= -1; --row)
+    {
+        bool leaves = (row >= 0) && !accepted(m_rows.at(row));
+        if (leaves && last < 0)
+        {
+            last = row;
+        }
+        else if (!leaves && last >= 0)
+        {
+            beginRemoveRows(QModelIndex(), row + 1, last);
+            m_rows.remove(row + 1, last - row);
+            updateSourceRows();
+            endRemoveRows();
+            last = -1;
+        }
+    }
+
+    // Insert the joining games in front of the next remaining row
+    QVector<int> joined;
+    int row = 0;
+    for (int i = 0; i <= total; ++i)
+    {
+        int sourceRow = (i < total) ? sourceRowAt(i) : count;
+        if (i < total && sourceRow >= count)
+        {
+            continue;
+        }
+        bool stays = (i < total) && m_sourceRows.at(sourceRow) >= 0;
+        if (i < total && !stays && accepted(sourceRow))
+        {
+            joined.append(sourceRow);
+            continue;
+        }
+        if ((stays || i == total) && !joined.isEmpty())
+        {
+            beginInsertRows(QModelIndex(), row, row + joined.count() - 1);
+            m_rows.insert(row, joined.count(), 0);
+            std::copy(joined.constBegin(), joined.constEnd(), m_rows.begin() + row);
+            updateSourceRows();
+            endInsertRows();
+            row += joined.count();
+            joined.clear();
+        }
+        if (stays)
+        {
+            ++row;
+        }
+    }
+}
+
+void GameListSortModel::slotSorted(const QString& tagName)
+{
+    if (tagName == columnTag(m_sortColumn))
+    {
+        applySort();
+    }
 }
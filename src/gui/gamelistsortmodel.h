@@ -5,23 +5,86 @@
 #ifndef GAMELISTSORTMODEL_H
 #define GAMELISTSORTMODEL_H
 
-#include <QSortFilterProxyModel>
+#include <QAbstractProxyModel>
+#include <QVector>
+
+#include "gameid.h"
 
 class FilterX;
+class IndexSorter;
+
+/** The GameListSortModel shows the games of the filter in the order of a
+    permutation of the index, as computed by an IndexSorter. Sorting by a
+    column thus never compares two rows; a column which was not sorted since
+    the index changed is sorted in the background and the rows are reordered
+    when the permutation is ready. A change of the games in the filter
+    inserts and removes the rows which changed. Every range of rows moved
+    updates all rows, so a change of more than 32 ranges, e.g. inverting a
+    scattered filter, resets the model instead: the view then loses its
+    selection and scroll position. */
 
-class GameListSortModel : public QSortFilterProxyModel
+class GameListSortModel : public QAbstractProxyModel
 {
+    Q_OBJECT
 public:
-    explicit GameListSortModel(QObject *parent = nullptr) :
-        QSortFilterProxyModel(parent),
-        m_filter(nullptr)
-    {}
+    explicit GameListSortModel(QObject *parent = nullptr);
     void setFilter(FilterX* filter);
-protected:
-    bool filterAcceptsRow(int source_row, const QModelIndex &source_parent) const;
+
+    virtual void setSourceModel(QAbstractItemModel* sourceModel);
+    virtual QModelIndex mapToSource(const QModelIndex& proxyIndex) const;
+    virtual QModelIndex mapFromSource(const QModelIndex& sourceIndex) const;
+    virtual QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const;
+    virtual QModelIndex parent(const QModelIndex& child) const;
+    virtual int rowCount(const QModelIndex& parent = QModelIndex()) const;
+    virtual int columnCount(const QModelIndex& parent = QModelIndex()) const;
+    virtual bool hasChildren(const QModelIndex& parent = QModelIndex()) const;
+    virtual QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
+    virtual QVariant data(const QModelIndex& proxyIndex, int role = Qt::DisplayRole) const;
+    virtual void sort(int column, Qt::SortOrder order = Qt::AscendingOrder);
+
+protected slots:
+    void slotSourceAboutToBeReset();
+    void slotSourceReset();
+    void slotSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+    void slotFilterChanged();
+    void slotSorted(const QString& tagName);
 
 private:
+    /** @return the tag shown in @p column, empty for the game number */
+    QString columnTag(int column) const;
+    /** Sort by the current column, if its permutation is ready */
+    void applySort();
+    /** @return the source row at position @p i of the order, all source rows included */
+    inline int sourceRowAt(int i) const
+    {
+        return (i < m_order.count()) ? static_cast<int>(m_order.at(i)) : i;
+    }
+    /** @return true if the game of @p sourceRow is in the filter */
+    bool accepted(int sourceRow) const;
+    /** Build the rows of the games in the filter in the order of m_order */
+    void buildRows();
+    /** Map the source rows to the rows after a change of m_rows */
+    void updateSourceRows();
+    /** Ask the source model to decode the rows around @p row */
+    void prefetchAround(int row) const;
+    /** Reorder the rows, keeping the persistent indexes */
+    void applyOrder();
+
     FilterX* m_filter;
+    IndexSorter* m_sorter;
+    int m_sortColumn;
+    Qt::SortOrder m_sortOrder;
+    /** Set while the source model is reset, the rows are rebuilt at its end */
+    bool m_resetting;
+    /** Games in display order, empty for the order of the database */
+    QVector<GameId> m_order;
+    /** Source row of every row */
+    QVector<int> m_rows;
+    /** Row of every source row, -1 if the game is not in the filter */
+    QVector<int> m_sourceRows;
+    /** Rows the source model was asked to decode */
+    mutable int m_prefetchFirst;
+    mutable int m_prefetchEnd;
 };
 
 #endif // GAMELISTSORTMODEL_H
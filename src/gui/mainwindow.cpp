@@ -84,6 +84,7 @@
 #endif
 #include <QTimer>
 #include <QToolBar>
+#include <QToolButton>
 
 #if defined(_MSC_VER) && defined(_DEBUG)
 #define DEBUG_NEW new( _NORMAL_BLOCK, __FILE__, __LINE__ )
@@ -476,6 +477,11 @@ MainWindow::MainWindow() : QMainWindow(),
     statusBar()->setFixedHeight(statusBar()->height());
     statusBar()->setSizeGripEnabled(true);
     m_progressBar = new QProgressBar();
+    m_cancelWriters = new QToolButton();
+    m_cancelWriters->setText(tr("Cancel"));
+    m_cancelWriters->setToolTip(tr("Stop saving or exporting the database"));
+    m_cancelWriters->hide();
+    connect(m_cancelWriters, SIGNAL(clicked()), SLOT(slotCancelDatabaseWriters()));
 
     /* Very late as this will update other widgets */
     connect(this, SIGNAL(databaseModified()), SLOT(slotDatabaseModified()));
@@ -581,6 +587,7 @@ MainWindow::~MainWindow()
     }
     delete m_registry;
     delete m_progressBar;
+    delete m_cancelWriters;
     delete m_gameList;
 
     delete autoGroup;
@@ -1937,14 +1944,23 @@ bool MainWindow::confirmQuit()
             {
                 if (dbi->database()->isModified())
                 {
-                    output.output(dbi->database()->filename(), *(dbi->database()));
+                    MemoryDatabase* memoryDb = qobject_cast<MemoryDatabase*>(dbi->database());
+                    if (memoryDb)
+                    {
+                        memoryDb->save(output);
+                    }
+                    else
+                    {
+                        output.output(dbi->database()->filename(), *(dbi->database()));
+                    }
                 }
             }
         }
     }
 
     SwitchToClipboard();
-    cancelPolyglotWriters();
+    cancelBookWriters();
+    cancelDatabaseWriters();
     m_openingTreeWidget->cancel(); // Make sure we are not grabbing into something that is closed now
 
     for (int i = dbs.size() - 1; i; --i)
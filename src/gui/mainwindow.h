@@ -53,6 +53,7 @@ class QLabel;
 class QNetworkAccessManager;
 class QNetworkReply;
 class QProgressBar;
+class QToolButton;
 class QSlider;
 class QSplitter;
 class TextEdit;
@@ -62,6 +63,8 @@ class SaveDialog;
 class ToolMainWindow;
 class TranslatingSlider;
 class PolyglotWriter;
+class StatisticsBookWriter;
+class DatabaseWriter;
 
 /**
 @defgroup GUI GUI - User interface components
@@ -393,6 +396,14 @@ public slots:
     void slotBookDone(QString path, PolyglotWriter* writer);
     /** Show a path in finder */
     void slotBookBuildError(QString path, PolyglotWriter *writer);
+    /** A native book was finished with success */
+    void slotStatisticsBookDone(QString path, StatisticsBookWriter* writer);
+    /** Building a native book failed or was cancelled */
+    void slotStatisticsBookBuildError(QString path, StatisticsBookWriter* writer);
+    /** A database was written with success */
+    void slotDatabaseWritten(QString path, DatabaseWriter* writer);
+    /** Writing a database failed or was cancelled */
+    void slotDatabaseWriteError(QString path, DatabaseWriter* writer);
     /** Merge the clipboard into the current game */
     void slotEditMergePGN();
     /** Create a QImage from the current Board position */
@@ -489,7 +500,11 @@ protected slots:
     void slotShowBlackAttacks();
     void slotShowUnderprotectedWhite();
     void slotShowUnderprotectedBlack();
-    void cancelPolyglotWriters();
+    void cancelBookWriters();
+    /** Cancel the exports of @p database, or of all databases, and wait for them and for its saves */
+    void cancelDatabaseWriters(Database* database = nullptr);
+    /** Stop all exports and saves running in the background */
+    void slotCancelDatabaseWriters();
     void slotReadAhead();
 #ifdef USE_SPEECH
     void speechStateChanged(QTextToSpeech::State state);
@@ -616,8 +631,12 @@ private:
     void saveGame(DatabaseInfo *dbInfo);
     /** Load next game without query */
     bool loadNextGame();
-    /** Save Database without query or progress bar */
+    /** Save Database without query, a MemoryDatabase is saved in the background */
     void saveDatabase(DatabaseInfo *dbInfo);
+    /** Create a writer for the background, which shows @p msg and the progress until it is done */
+    DatabaseWriter* startDatabaseWriter(const QString& msg);
+    /** Forget @p writer after it finished */
+    void removeDatabaseWriter(DatabaseWriter* writer);
     /** Save current Database with query */
     bool QuerySaveDatabase();
     /** Save Database with query */
@@ -673,6 +692,8 @@ private:
     GameNotationWidget* m_gameView;
     OpeningTreeWidget* m_openingTreeWidget;
     QPointer<QProgressBar> m_progressBar;
+    /** Shown next to the progress bar while databases are written in the background */
+    QPointer<QToolButton> m_cancelWriters;
     QPointer<TranslatingSlider> m_sliderSpeed;
     QLabel* m_sliderText;
     QPointer<QComboBox> m_comboEngine;
@@ -744,6 +765,8 @@ private:
     EngineParameter m_matchParameter;
     bool m_bEvalRequested;
     QList<PolyglotWriter*> m_polyglotWriters;
+    QList<StatisticsBookWriter*> m_statisticsBookWriters;
+    QList<DatabaseWriter*> m_databaseWriters;
     QMap<QUrl, QString> m_mapDatabaseToDroppedUrl;
     bool m_lastMessageWasHint;
 #ifdef USE_SPEECH
@@ -48,6 +48,7 @@
 #include "pgndatabase.h"
 #include "playerlistwidget.h"
 #include "polyglotwriter.h"
+#include "databasewriter.h"
 #include "positionsearch.h"
 #include "preferences.h"
 #include "promotiondialog.h"
@@ -55,6 +56,7 @@
 #include "renametagdialog.h"
 #include "shellhelper.h"
 #include "settings.h"
+#include "statisticsbookwriter.h"
 #include "streamdatabase.h"
 #include "tablebase.h"
 #include "tagdialog.h"
@@ -121,7 +123,8 @@ void MainWindow::slotFileOpen()
 #endif
            << tr("Polyglot books (*.bin)")
            << tr("Arena books (*.abk)")
-           << tr("Chessbase books (*.ctg)");
+           << tr("Chessbase books (*.ctg)")
+           << tr("ChessX books (*.cxb)");
     QStringList files = QFileDialog::getOpenFileNames(this, tr("Open database"),
                         AppSettings->value("/General/DefaultDataPath").toString(),
                         filters.join(";;"));
@@ -159,9 +162,19 @@ void MainWindow::slotFileOpenRecent()
 
 void MainWindow::saveDatabase(DatabaseInfo* dbInfo)
 {
-    if(!dbInfo->database()->isReadOnly() && dbInfo->database()->isModified())
+    Database* db = dbInfo->database();
+    if(!db->isReadOnly() && db->isModified())
     {
-        Database* db = dbInfo->database();
+        MemoryDatabase* memoryDb = qobject_cast<MemoryDatabase*>(db);
+        if (memoryDb)
+        {
+            // Only the changed and new games are written when possible, in the background.
+            // A save that is still running keeps the database modified for the changes made after
+            // it started, this one waits for it on the writer thread.
+            DatabaseWriter* writer = startDatabaseWriter(tr("Saving %1...").arg(db->name()));
+            writer->saveDatabase(memoryDb, new Output(Output::Pgn, &BoardView::renderImageForBoard));
+            return;
+        }
         QMutexLocker m(db->mutex());
         startOperation(tr("Saving %1...").arg(db->name()));
         Output output(Output::Pgn, &BoardView::renderImageForBoard);
@@ -230,6 +243,7 @@ bool MainWindow::closeDatabaseInfo(DatabaseInfo* aboutToClose, bool dontAsk)
             closeBoardViewForDbIndex(aboutToClose);
 
             m_openingTreeWidget->cancel();
+            cancelDatabaseWriters(aboutToClose->database());
             m_databaseList->setFileClose(aboutToClose->displayName(), aboutToClose->currentIndex());
 
             m_registry->remove(aboutToClose);
@@ -305,9 +319,90 @@ void MainWindow::slotFileExportAll()
     QString filename = exportFileName(format);
     if(!filename.isEmpty())
     {
-        Output output(static_cast<Output::OutputType>(format), &BoardView::renderImageForBoard);
-        output.output(filename, *database());
+        // The games are written in the background, the old file stays until all are written
+        DatabaseWriter* writer = startDatabaseWriter(tr("Exporting %1...").arg(database()->name()));
+        writer->writeDatabase(database(), filename, new Output(static_cast<Output::OutputType>(format), &BoardView::renderImageForBoard));
+    }
+}
+
+DatabaseWriter* MainWindow::startDatabaseWriter(const QString& msg)
+{
+    DatabaseWriter* writer = new DatabaseWriter(this);
+    connect(writer, SIGNAL(writeFinished(QString, DatabaseWriter*)), SLOT(slotDatabaseWritten(QString, DatabaseWriter*)), Qt::QueuedConnection);
+    connect(writer, SIGNAL(writeError(QString, DatabaseWriter*)), SLOT(slotDatabaseWriteError(QString, DatabaseWriter*)), Qt::QueuedConnection);
+    connect(writer, SIGNAL(progress(int)), SLOT(slotOperationProgress(int)), Qt::QueuedConnection);
+    startOperation(msg);
+    if (m_databaseWriters.isEmpty())
+    {
+        statusBar()->insertPermanentWidget(1, m_cancelWriters);
+        m_cancelWriters->show();
+    }
+    m_databaseWriters.append(writer);
+    return writer;
+}
+
+void MainWindow::removeDatabaseWriter(DatabaseWriter* writer)
+{
+    m_databaseWriters.removeOne(writer);
+    if (m_databaseWriters.isEmpty())
+    {
+        statusBar()->removeWidget(m_cancelWriters);
+    }
+}
+
+void MainWindow::cancelDatabaseWriters(Database* database)
+{
+    foreach (DatabaseWriter* writer, m_databaseWriters)
+    {
+        if (!database || writer->database() == database)
+        {
+            // A save is completed, it holds the changes of the user
+            if (!writer->isSaving())
+            {
+                writer->cancel();
+            }
+            writer->wait();
+        }
+    }
+}
+
+void MainWindow::slotCancelDatabaseWriters()
+{
+    foreach (DatabaseWriter* writer, m_databaseWriters)
+    {
+        writer->cancel();
+    }
+}
+
+void MainWindow::slotDatabaseWritten(QString path, DatabaseWriter* writer)
+{
+    if (writer->isSaving())
+    {
+        finishOperation(tr("%1 saved").arg(QFileInfo(path).fileName()));
     }
+    else
+    {
+        finishOperation(tr("%1 exported").arg(QFileInfo(path).fileName()));
+    }
+    removeDatabaseWriter(writer);
+}
+
+void MainWindow::slotDatabaseWriteError(QString path, DatabaseWriter* writer)
+{
+    if (writer->isCancelled())
+    {
+        cancelOperation(writer->isSaving() ? tr("Saving %1 cancelled").arg(QFileInfo(path).fileName())
+                                           : tr("Exporting %1 cancelled").arg(QFileInfo(path).fileName()));
+    }
+    else if (writer->isSaving())
+    {
+        finishOperation(tr("Cannot save %1").arg(QFileInfo(path).fileName()));
+    }
+    else
+    {
+        finishOperation(tr("Cannot export %1").arg(QFileInfo(path).fileName()));
+    }
+    removeDatabaseWriter(writer);
 }
 
 void MainWindow::slotFileQuit()
@@ -4003,6 +4098,17 @@ void MainWindow::slotMakeBook(QString pathIn)
                 int maxPly, minGame, result, filterResult;
                 bool uniform;
                 dlg.getBookParameters(out, maxPly, minGame, uniform, result, filterResult);
+                if (DatabaseInfo::IsStatisticsBook(out))
+                {
+                    StatisticsBookWriter* bookWriter = new StatisticsBookWriter(this);
+                    connect(bookWriter, SIGNAL(bookBuildError(QString, StatisticsBookWriter*)), SLOT(slotStatisticsBookBuildError(QString, StatisticsBookWriter*)));
+                    connect(bookWriter, SIGNAL(bookBuildFinished(QString, StatisticsBookWriter*)), SLOT(slotStatisticsBookDone(QString, StatisticsBookWriter*)), Qt::QueuedConnection);
+                    connect(bookWriter, SIGNAL(progress(int)), SLOT(slotOperationProgress(int)), Qt::QueuedConnection);
+                    startOperation(tr("Build book"));
+                    m_statisticsBookWriters.append(bookWriter);
+                    bookWriter->writeBookForDatabase(dbi->database(), out, maxPly, minGame);
+                    return;
+                }
                 PolyglotWriter* polyglotWriter = new PolyglotWriter(this);
                 connect(polyglotWriter, SIGNAL(bookBuildError(QString, PolyglotWriter*)), SLOT(slotBookBuildError(QString, PolyglotWriter*)));
                 connect(polyglotWriter, SIGNAL(bookBuildFinished(QString, PolyglotWriter*)), SLOT(slotBookDone(QString, PolyglotWriter*)), Qt::QueuedConnection);
@@ -4016,12 +4122,16 @@ void MainWindow::slotMakeBook(QString pathIn)
     }
 }
 
-void MainWindow::cancelPolyglotWriters()
+void MainWindow::cancelBookWriters()
 {
     foreach (PolyglotWriter* writer, m_polyglotWriters)
     {
         writer->cancel();
     }
+    foreach (StatisticsBookWriter* writer, m_statisticsBookWriters)
+    {
+        writer->cancel();
+    }
 }
 
 void MainWindow::slotBookDone(QString path, PolyglotWriter* writer)
@@ -4034,6 +4144,16 @@ void MainWindow::slotBookDone(QString path, PolyglotWriter* writer)
     }
 }
 
+void MainWindow::slotStatisticsBookDone(QString path, StatisticsBookWriter* writer)
+{
+    finishOperation(tr("Book built"));
+    slotShowInFinder(path);
+    if (!m_statisticsBookWriters.removeOne(writer))
+    {
+        qDebug() << "Missing writer";
+    }
+}
+
 void MainWindow::slotShowInFinder(QString path)
 {
     ShellHelper::showInFinder(path);
@@ -4049,6 +4169,16 @@ void MainWindow::slotBookBuildError(QString /*path*/, PolyglotWriter* writer)
     }
 }
 
+void MainWindow::slotStatisticsBookBuildError(QString /*path*/, StatisticsBookWriter* writer)
+{
+    MessageDialog::warning(tr("Could not build book"), tr("Book Error"));
+    finishOperation(tr("Book build finished with Error"));
+    if (!m_statisticsBookWriters.removeOne(writer))
+    {
+        qDebug() << "Missing writer";
+    }
+}
+
 void MainWindow::slotToggleGameMode()
 {
     if (m_match->isChecked() != gameMode())
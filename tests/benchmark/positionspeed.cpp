@@ -0,0 +1,78 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+
+#include "pgndatabase.h"
+#include "settings.h"
+
+/** Search one position in all games, as the old batched search did */
+static int searchWithGames(PgnDatabase& db, const BoardX& position)
+{
+    int found = 0;
+    for (GameId gameId = 0; gameId < db.count(); ++gameId)
+    {
+        GameX g;
+        db.loadGameMoves(gameId, g);
+        if (g.cursor().findPosition(position) != NO_MOVE)
+        {
+            ++found;
+        }
+    }
+    return found;
+}
+
+/** Search one position in all games through the replay kernel */
+static int searchWithReplay(PgnDatabase& db, const BoardX& position)
+{
+    QList<GameId> games;
+    for (GameId gameId = 0; gameId < db.count(); ++gameId)
+    {
+        games.append(gameId);
+    }
+    QList<MoveId> output;
+    QMap<Move, MoveData> stats;
+    // PgnDatabase::findPosition(GameId, const BoardX&) hides the batched search
+    Database& database = db;
+    database.findPosition(position, Database::PositionSearch_Default, games, output, stats);
+    return games.count() - output.count(NO_MOVE);
+}
+
+int main(int argc, char* argv[])
+{
+    QCoreApplication app(argc, argv);
+    if(argc < 2)
+    {
+        qDebug("Usage: positionspeed <file>.pgn [san moves of the position].\n");
+        return -1;
+    }
+    AppSettings = new Settings;
+
+    PgnDatabase db;
+    if(!db.open(argv[1], true) || !db.parseFile())
+    {
+        qDebug("Can not open %s.\n", argv[1]);
+        return -1;
+    }
+
+    BoardX position;
+    position.setStandardPosition();
+    for(int i = 2; i < argc; ++i)
+    {
+        position.doMove(position.parseMove(argv[i]));
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int found = searchWithGames(db, position);
+    qint64 before = qMax(timer.elapsed(), qint64(1));
+
+    timer.restart();
+    int foundReplay = searchWithReplay(db, position);
+    qint64 after = qMax(timer.elapsed(), qint64(1));
+
+    qDebug("%d games, position found in %d / %d games.", static_cast<int>(db.count()), found, foundReplay);
+    qDebug("GameX replay:   %lld ms, %lld games/s", before, static_cast<qint64>(db.count()) * 1000 / before);
+    qDebug("Replay kernel:  %lld ms, %lld games/s", after, static_cast<qint64>(db.count()) * 1000 / after);
+
+    delete AppSettings;
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "doctest.h"
+
+#include "compactgamestore.h"
+#include "gamex.h"
+#include "positionreplay.h"
+
+TEST_CASE("testing CompactGameStore class")
+{
+    // 1.e4 (1.d4) 1...e5, the variation is added last
+    GameX game;
+    MoveId e4 = game.addMove("e4");
+    game.addMove("e5");
+    game.moveToId(ROOT_NODE);
+    game.addVariation("d4");
+    game.setAnnotation("main", e4);
+    game.addNag(GoodMove, e4);
+
+    CompactGameStore store;
+    store.append(game);
+    REQUIRE_EQ(store.count(), 1);
+
+    BoardX afterE5;
+    afterE5.setStandardPosition();
+    afterE5.doMove(afterE5.parseMove("e4"));
+    afterE5.doMove(afterE5.parseMove("e5"));
+
+    SUBCASE("load restores moves and annotations in PGN numbering")
+    {
+        GameX loaded;
+        store.load(0, loaded);
+        CHECK_EQ(loaded.plyCount(), 2);
+        CHECK_EQ(loaded.variationCount(ROOT_NODE), 1);
+        CHECK_EQ(loaded.cursor().variations(ROOT_NODE).first(), 2);
+        CHECK_EQ(loaded.move(2).toAlgebraic(), QString("d2d4"));
+        CHECK_EQ(loaded.annotation(1), QString("main"));
+        CHECK(loaded.nags(1).contains(GoodMove));
+        CHECK_EQ(loaded.cursor().findPosition(afterE5), 3);
+    }
+
+    SUBCASE("findPosition replays the encoded main line")
+    {
+        PositionReplay replay(afterE5);
+        CHECK_EQ(store.findPosition(0, replay), 3);
+        CHECK(replay.atEnd());
+
+        BoardX start;
+        start.setStandardPosition();
+        PositionReplay startReplay(start);
+        CHECK_EQ(store.findPosition(0, startReplay), ROOT_NODE);
+        CHECK_FALSE(startReplay.atEnd());
+        CHECK_EQ(startReplay.nextMove().toAlgebraic(), QString("e2e4"));
+
+        BoardX afterD4;
+        afterD4.setStandardPosition();
+        afterD4.doMove(afterD4.parseMove("d4"));
+        PositionReplay variationReplay(afterD4);
+        CHECK_EQ(store.findPosition(0, variationReplay), NO_MOVE);
+    }
+
+    SUBCASE("replace and squeeze keep the other games")
+    {
+        GameX other;
+        other.addMove("c4");
+        store.append(game);
+        store.replace(0, other);
+        store.squeeze();
+
+        GameX loaded;
+        store.load(0, loaded);
+        CHECK_EQ(loaded.plyCount(), 1);
+        CHECK(loaded.annotation(1).isEmpty());
+        PositionReplay replay(afterE5);
+        CHECK_EQ(store.findPosition(1, replay), 3);
+    }
+}
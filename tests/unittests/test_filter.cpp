@@ -0,0 +1,69 @@
+#include "doctest.h"
+
+#include "filter.h"
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "tags.h"
+#include "tagsearch.h"
+
+TEST_CASE("testing FilterX class")
+{
+    // 200 games, Anand plays White in the even ones
+    MemoryDatabase db;
+    for (int i = 0; i < 200; ++i)
+    {
+        GameX game;
+        game.setTag(TagNameWhite, (i % 2) ? "Carlsen, Magnus" : "Anand, Viswanathan");
+        game.setTag(TagNameRound, QString::number(i));
+        db.appendGame(game);
+    }
+
+    FilterX filter(&db);
+    REQUIRE_EQ(filter.size(), 200u);
+    CHECK_EQ(filter.count(), 200);
+
+    TagSearch anand(&db, TagNameWhite, "Anand");
+    filter.runSingleSearch(&anand, FilterOperator::NullOperator);
+    CHECK_EQ(filter.count(), 100);
+    CHECK(filter.contains(0));
+    CHECK_FALSE(filter.contains(1));
+    CHECK_EQ(filter.gamePosition(2), 1);
+
+    SUBCASE("joins keep the plies of the remaining games")
+    {
+        filter.set(4, 5);
+        TagSearch firstRounds(&db, TagNameRound, 0, 9);
+        filter.runSingleSearch(&firstRounds, FilterOperator::And);
+        CHECK_EQ(filter.count(), 5);
+        CHECK_EQ(filter.gamePosition(4), 5);
+
+        TagSearch lastRounds(&db, TagNameRound, 190, 199);
+        filter.runSingleSearch(&lastRounds, FilterOperator::Or);
+        CHECK_EQ(filter.count(), 15);
+        CHECK_EQ(filter.gamePosition(191), 1);
+        CHECK_EQ(filter.gamePosition(4), 5);
+
+        filter.runSingleSearch(&anand, FilterOperator::Remove);
+        CHECK_EQ(filter.count(), 5);
+        CHECK_FALSE(filter.contains(4));
+        CHECK_EQ(filter.gamePosition(4), 0);
+    }
+
+    SUBCASE("invert and resize maintain the count")
+    {
+        filter.invert();
+        CHECK_EQ(filter.count(), 100);
+        CHECK(filter.contains(199));
+        CHECK_FALSE(filter.contains(198));
+
+        filter.resize(230, true);
+        CHECK_EQ(filter.count(), 130);
+        CHECK(filter.contains(229));
+        filter.resize(70);
+        CHECK_EQ(filter.count(), 35);
+        CHECK_FALSE(filter.contains(70));
+
+        filter.setAll(0);
+        CHECK_EQ(filter.count(), 0);
+    }
+}
@@ -0,0 +1,94 @@
+#include "doctest.h"
+
+#include "duplicatesearch.h"
+#include "gamefingerprint.h"
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "tags.h"
+
+static GameX openGame(const QString& first, const QString& second)
+{
+    GameX game;
+    game.setTag(TagNameWhite, "Anand, Viswanathan");
+    game.setTag(TagNameBlack, "Carlsen, Magnus");
+    game.addMove(first);
+    game.addMove(second);
+    return game;
+}
+
+TEST_CASE("testing GameFingerprint class")
+{
+    GameX game = openGame("e4", "e5");
+    GameFingerprint fingerprint = GameFingerprint::fromGame(game);
+    REQUIRE(fingerprint.isValid());
+    CHECK_FALSE(GameFingerprint().isValid());
+
+    SUBCASE("equal games have equal fingerprints")
+    {
+        GameX copy = openGame("e4", "e5");
+        REQUIRE(copy.isEqual(game));
+        CHECK_EQ(GameFingerprint::fromGame(copy).hash(), fingerprint.hash());
+        CHECK(GameFingerprint::fromGame(copy).mayEqual(fingerprint));
+    }
+
+    SUBCASE("moves, variations and annotations change the fingerprint")
+    {
+        CHECK_FALSE(GameFingerprint::fromGame(openGame("d4", "d5")).mayEqual(fingerprint));
+
+        GameX annotated = openGame("e4", "e5");
+        annotated.setAnnotation("Solid");
+        GameFingerprint better = GameFingerprint::fromGame(annotated);
+        CHECK_FALSE(better.mayEqual(fingerprint));
+        CHECK(better.isBetterOrEqual(fingerprint));
+        CHECK_FALSE(fingerprint.isBetterOrEqual(better));
+
+        GameX variation = openGame("e4", "e5");
+        variation.moveToId(1);
+        variation.addVariation("c5");
+        CHECK_FALSE(GameFingerprint::fromGame(variation).mayEqual(fingerprint));
+    }
+}
+
+TEST_CASE("testing DuplicateSearch with fingerprints")
+{
+    // Games with equal tags: a copy of the first one, other moves, an annotated copy
+    MemoryDatabase db;
+    db.appendGame(openGame("e4", "e5"));
+    db.appendGame(openGame("e4", "e5"));
+    db.appendGame(openGame("d4", "d5"));
+    GameX annotated = openGame("e4", "e5");
+    annotated.setAnnotation("Solid");
+    db.appendGame(annotated);
+
+    bool breakFlag = false;
+
+    SUBCASE("same tags and moves")
+    {
+        DuplicateSearch search(&db, DuplicateSearch::DS_Both);
+        search.Prepare(breakFlag);
+        CHECK_FALSE(search.matches(0));
+        CHECK(search.matches(1));
+        CHECK_FALSE(search.matches(2));
+        CHECK_FALSE(search.matches(3));
+        // The compared games were fingerprinted
+        CHECK(db.index()->fingerprint(2).isValid());
+    }
+
+    SUBCASE("same tags")
+    {
+        DuplicateSearch search(&db, DuplicateSearch::DS_Tags);
+        search.Prepare(breakFlag);
+        CHECK_EQ(search.matchList()->count(true), 3);
+        CHECK_FALSE(search.matches(0));
+    }
+
+    SUBCASE("same tags, keeping the best game")
+    {
+        DuplicateSearch search(&db, DuplicateSearch::DS_Tags_BestGame);
+        search.Prepare(breakFlag);
+        CHECK(search.matches(0));
+        CHECK(search.matches(1));
+        CHECK(search.matches(2));
+        CHECK_FALSE(search.matches(3));
+    }
+}
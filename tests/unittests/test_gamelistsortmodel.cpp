@@ -0,0 +1,180 @@
+#include "doctest.h"
+
+#include <QAbstractItemModelTester>
+#include <QGuiApplication>
+#include <QSignalSpy>
+
+#include <functional>
+
+#include "filter.h"
+#include "filtermodel.h"
+#include "gamelistsortmodel.h"
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "settings.h"
+#include "tags.h"
+#include "tagsearch.h"
+
+namespace {
+
+/** The models need an event loop for the sorts and searches, and a palette for their data */
+void ensureApplication()
+{
+    if (!QCoreApplication::instance())
+    {
+        static int argc = 1;
+        static char name[] = "doctestrunner";
+        static char* argv[] = { name, nullptr };
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+        new QGuiApplication(argc, argv);
+    }
+}
+
+/** @return the name of the White player of game @p gameId, all names differ and are not in game order */
+QString whiteName(int gameId)
+{
+    return QString("Player %1").arg((gameId * 37) % 100, 3, 10, QChar('0'));
+}
+
+/** Check that the rows of @p proxy are the games in @p filter, with @p before true for every pair of neighbours */
+void checkRows(const GameListSortModel& proxy, const FilterX& filter, const std::function<bool(int, int)>& before)
+{
+    REQUIRE_EQ(proxy.rowCount(), filter.count());
+    QSet<int> seen;
+    int previous = -1;
+    for (int row = 0; row < proxy.rowCount(); ++row)
+    {
+        INFO(row);
+        const QModelIndex index = proxy.index(row, 1);
+        const QModelIndex source = proxy.mapToSource(index);
+        REQUIRE(source.isValid());
+        CHECK_EQ(source.column(), 1);
+        CHECK(filter.contains(static_cast<GameId>(source.row())));
+        CHECK_FALSE(seen.contains(source.row()));
+        CHECK_EQ(proxy.mapFromSource(source), index);
+        if (previous >= 0)
+        {
+            CHECK(before(previous, source.row()));
+        }
+        seen.insert(source.row());
+        previous = source.row();
+    }
+}
+
+} // namespace
+
+TEST_CASE("testing GameListSortModel over a FilterModel")
+{
+    ensureApplication();
+    AppSettings = new Settings;
+
+    const int count = 100;
+    MemoryDatabase db;
+    for (int i = 0; i < count; ++i)
+    {
+        GameX game;
+        game.setTag(TagNameWhite, whiteName(i));
+        REQUIRE(db.appendGame(game));
+    }
+    FilterX filter(&db);
+
+    {
+        FilterModel model(&filter);
+        GameListSortModel proxy;
+        proxy.setFilter(&filter);
+        proxy.setSourceModel(&model);
+        QAbstractItemModelTester sourceTester(&model, QAbstractItemModelTester::FailureReportingMode::Fatal);
+        QAbstractItemModelTester tester(&proxy, QAbstractItemModelTester::FailureReportingMode::Fatal);
+        QSignalSpy resets(&proxy, SIGNAL(modelReset()));
+
+        auto byGame = [](int a, int b) { return a < b; };
+        auto byWhite = [](int a, int b) { return whiteName(a) < whiteName(b); };
+        auto byWhiteDescending = [](int a, int b) { return whiteName(a) > whiteName(b); };
+        checkRows(proxy, filter, byGame);
+
+        // A single game leaves the list, the persistent indexes behind it move up
+        QPersistentModelIndex leaving(proxy.index(10, 1));
+        QPersistentModelIndex behind(proxy.index(20, 1));
+        QSignalSpy removed(&proxy, SIGNAL(rowsRemoved(QModelIndex,int,int)));
+        model.set(10, 0);
+        REQUIRE_EQ(removed.count(), 1);
+        CHECK_EQ(removed.at(0).at(1).toInt(), 10);
+        CHECK_EQ(removed.at(0).at(2).toInt(), 10);
+        CHECK_FALSE(leaving.isValid());
+        CHECK_EQ(behind.row(), 19);
+        CHECK_EQ(proxy.mapToSource(behind).row(), 20);
+        CHECK_FALSE(proxy.mapFromSource(model.index(10, 1)).isValid());
+        checkRows(proxy, filter, byGame);
+
+        // A game staying in the list only changes its row
+        QSignalSpy changed(&proxy, SIGNAL(dataChanged(QModelIndex,QModelIndex,QVector<int>)));
+        model.set(20, 2);
+        REQUIRE_EQ(changed.count(), 1);
+        CHECK_EQ(changed.at(0).at(0).value<QModelIndex>().row(), 19);
+        CHECK_EQ(removed.count(), 1);
+
+        // Single games leave and join the list
+        model.set(11, 0);
+        checkRows(proxy, filter, byGame);
+        model.set(10, 1);
+        checkRows(proxy, filter, byGame);
+        CHECK_EQ(filter.count(), count - 1);
+
+        // Inverting moves few ranges, the model is not reset
+        model.invert();
+        CHECK_EQ(filter.count(), 1);
+        checkRows(proxy, filter, byGame);
+        model.setAll(1);
+        checkRows(proxy, filter, byGame);
+        CHECK_EQ(resets.count(), 0);
+
+        // A search result of the same size as the filter
+        QSignalSpy searched(&model, SIGNAL(searchFinished()));
+        model.executeSearch(new TagSearch(&db, TagNameWhite, "Player 05"));
+        REQUIRE(searched.wait(5000));
+        CHECK_EQ(filter.count(), 10);
+        checkRows(proxy, filter, byGame);
+        model.setAll(1);
+        checkRows(proxy, filter, byGame);
+        CHECK_EQ(resets.count(), 0);
+
+        // Every other game changing are more ranges than are moved, the model is reset
+        for (int i = 1; i < count; i += 2)
+        {
+            model.set(i, 0);
+        }
+        checkRows(proxy, filter, byGame);
+        model.invert();
+        CHECK_EQ(resets.count(), 1);
+        checkRows(proxy, filter, byGame);
+        model.setAll(1);
+
+        // The permutation of a column is computed in the background, persistent indexes follow their games
+        QPersistentModelIndex game1(proxy.mapFromSource(model.index(1, 1)));
+        REQUIRE_EQ(game1.row(), 1);
+        QSignalSpy layouts(&proxy, SIGNAL(layoutChanged()));
+        proxy.sort(1, Qt::AscendingOrder);
+        REQUIRE(layouts.wait(5000));
+        checkRows(proxy, filter, byWhite);
+        CHECK_EQ(game1.row(), 37);
+        CHECK_EQ(proxy.mapToSource(game1).row(), 1);
+        proxy.sort(1, Qt::DescendingOrder);
+        checkRows(proxy, filter, byWhiteDescending);
+        CHECK_EQ(game1.row(), 62);
+        CHECK_EQ(proxy.mapToSource(game1).row(), 1);
+
+        // Games joining a sorted list are inserted at their place in the order
+        model.set(5, 0);
+        model.set(50, 0);
+        model.invert();
+        checkRows(proxy, filter, byWhiteDescending);
+        model.setAll(1);
+        checkRows(proxy, filter, byWhiteDescending);
+
+        proxy.sort(0, Qt::AscendingOrder);
+        checkRows(proxy, filter, byGame);
+    }
+
+    delete AppSettings;
+    AppSettings = nullptr;
+}
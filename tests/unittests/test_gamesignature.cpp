@@ -0,0 +1,70 @@
+#include "doctest.h"
+
+#include "gamesignature.h"
+#include "gamex.h"
+
+static BoardX boardAfter(const QStringList& moves)
+{
+    BoardX board;
+    board.setStandardPosition();
+    for (const QString& san: moves)
+    {
+        board.doMove(board.parseMove(san));
+    }
+    return board;
+}
+
+TEST_CASE("testing GameSignature class")
+{
+    // 1.e4 e5 2.Nf3 Nc6 3.Bb5 a6 4.Bxc6 dxc6
+    GameX game;
+    for (const QString& san: QStringList{"e4", "e5", "Nf3", "Nc6", "Bb5", "a6", "Bxc6", "dxc6"})
+    {
+        game.addMove(san);
+    }
+    GameSignature signature = GameSignature::fromGame(game);
+
+    SUBCASE("uses the SCID representation")
+    {
+        BoardX start;
+        start.setStandardPosition();
+        CHECK_EQ(GameSignature::materialSignature(start), 0x6A86A8u);
+
+        REQUIRE(signature.isValid());
+        CHECK_EQ(signature.homePawnCount(), 4);
+        // e2 (11), e7 (3), a7 (7) and d7 (4) left their squares in this order
+        CHECK_EQ(signature.homePawns() >> 48, 0xB374u);
+    }
+
+    SUBCASE("positions of the main line can be reached")
+    {
+        CHECK(signature.canReach(GameSignature::Target(boardAfter({}))));
+        CHECK(signature.canReach(GameSignature::Target(boardAfter({"e4", "e5", "Nf3"}))));
+        CHECK(signature.canReach(GameSignature::Target(boardAfter({"e4", "e5", "Nf3", "Nc6", "Bb5", "a6", "Bxc6", "dxc6"}))));
+        // Transposition with the same pawn moves
+        CHECK(signature.canReach(GameSignature::Target(boardAfter({"Nf3", "Nc6", "e4", "e5"}))));
+    }
+
+    SUBCASE("other home pawn orders are excluded")
+    {
+        CHECK_FALSE(signature.canReach(GameSignature::Target(boardAfter({"d4"}))));
+        CHECK_FALSE(signature.canReach(GameSignature::Target(boardAfter({"e4", "d5"}))));
+    }
+
+    SUBCASE("missing material is excluded")
+    {
+        BoardX noKnight;
+        noKnight.fromFen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKB1R w KQkq - 0 1");
+        CHECK_FALSE(signature.canReach(GameSignature::Target(noKnight)));
+    }
+
+    SUBCASE("games with a setup position are never excluded")
+    {
+        GameX setup;
+        setup.dbSetStartingBoard("4k3/8/8/8/8/8/4P3/4K3 w - - 0 1");
+        setup.addMove("e4");
+        GameSignature unknown = GameSignature::fromGame(setup);
+        CHECK_FALSE(unknown.isValid());
+        CHECK(unknown.canReach(GameSignature::Target(boardAfter({"d4"}))));
+    }
+}
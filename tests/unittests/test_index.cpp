@@ -2,6 +2,10 @@
 #include "doctest.h"
 #include "resourcepath.h"
 
+#include <QTemporaryFile>
+
+#include <algorithm>
+
 #include "tags.h"
 #include "index.h"
 #include "pgndatabase.h"
@@ -64,6 +68,109 @@ TEST_CASE("testing Index class")
 
 }
 
+TEST_CASE("testing Index column storage")
+{
+    IndexX index;
+
+    for (GameId i = 0; i < 1000; ++i)
+    {
+        index.setTag(TagNameWhite, QString("Player %1").arg(i % 10), i);
+        if (i % 100 == 0)
+        {
+            index.setTag("Annotator", "Rare", i);
+        }
+        if (i % 2 == 0)
+        {
+            index.setTag(TagNamePlyCount, QString::number(i), i);
+        }
+    }
+
+    CHECK_EQ(index.count(), 1000);
+    CHECK_EQ(index.tagValue(TagNameWhite, 123), QString("Player 3"));
+    CHECK_EQ(index.tagValue("Annotator", 300), QString("Rare"));
+    CHECK_EQ(index.tagValue("Annotator", 301), QString());
+    CHECK_EQ(index.tagValue(TagNamePlyCount, 998), QString("998"));
+    CHECK_EQ(index.tagValue(TagNamePlyCount, 999), QString());
+    CHECK_EQ(index.playerNames().count(), 10);
+    CHECK(index.isIndexItemEqual(1, 11));
+    CHECK_FALSE(index.isIndexItemEqual(1, 2));
+    CHECK_FALSE(index.isIndexItemEqual(0, 10));
+
+    index.removeTag("Annotator", 300);
+    CHECK_EQ(index.tagValue("Annotator", 300), QString());
+
+    GameX game;
+    index.loadGameHeaders(200, game);
+    CHECK_EQ(game.tag("Annotator"), QString("Rare"));
+    CHECK_EQ(game.tag(TagNamePlyCount), QString("200"));
+
+    QByteArray data;
+    {
+        QDataStream out(&data, QIODevice::WriteOnly);
+        CHECK(index.write(out));
+    }
+    IndexX copy;
+    bool breakFlag = false;
+    QDataStream in(data);
+    CHECK(copy.read(in, &breakFlag, VERSION_INDEX_CURRENT));
+    CHECK_EQ(copy.count(), 1000);
+    CHECK_EQ(copy.tagValue(TagNameWhite, 999), QString("Player 9"));
+    CHECK_EQ(copy.tagValue("Annotator", 100), QString("Rare"));
+    CHECK_EQ(copy.tagValue("Annotator", 300), QString());
+    CHECK_EQ(copy.tagValue(TagNamePlyCount, 500), QString("500"));
+}
+
+TEST_CASE("testing Index read from a mapped index file")
+{
+    IndexX index;
+    for (GameId i = 0; i < 1000; ++i)
+    {
+        index.setTag(TagNameWhite, QString("Player %1").arg(i % 10), i);
+        index.setTag(TagNameWhiteElo, QString::number(2000 + i), i);
+        if (i % 100 == 0)
+        {
+            index.setTag("Annotator", "Rare", i);
+        }
+    }
+    index.setValidFlag(7, false);
+
+    QTemporaryFile file;
+    REQUIRE(file.open());
+    {
+        QDataStream out(&file);
+        out << static_cast<quint16>(INDEX_FILE_MAGIC);
+        REQUIRE(index.write(out));
+    }
+    REQUIRE(file.seek(0));
+
+    IndexX copy;
+    bool breakFlag = false;
+    QDataStream in(&file);
+    quint16 magic;
+    in >> magic;
+    REQUIRE(copy.read(in, &breakFlag, VERSION_INDEX_CURRENT));
+    CHECK(in.atEnd());
+    CHECK_EQ(copy.count(), 1000);
+    CHECK_EQ(copy.tagValue(TagNameWhite, 123), QString("Player 3"));
+    CHECK_EQ(copy.tagValue("Annotator", 300), QString("Rare"));
+    CHECK_EQ(copy.tagValue("Annotator", 301), QString());
+    CHECK_EQ(copy.elo(999, White), 2999);
+    CHECK_FALSE(copy.isValidFlag(7));
+    CHECK(copy.isValidFlag(8));
+    CHECK_EQ(copy.playerNames().count(), 10);
+    CHECK_EQ(copy.gamesWithValue(TagNameWhite, copy.getValueIndex("Player 3")).count(), 100);
+
+    // Changed columns leave the image
+    copy.setTag(TagNameWhite, "Euwe, Max", 3);
+    CHECK_EQ(copy.tagValue(TagNameWhite, 3), QString("Euwe, Max"));
+    CHECK_EQ(copy.tagValue(TagNameWhite, 13), QString("Player 3"));
+    CHECK_EQ(copy.gamesWithValue(TagNameWhite, copy.getValueIndex("Player 3")).count(), 99);
+    CHECK(copy.replaceTagValue(QStringList() << TagNameWhite, "Player X", "Player 4"));
+    CHECK_EQ(copy.tagValue(TagNameWhite, 4), QString("Player X"));
+    CHECK_FALSE(copy.replaceTagValue(QStringList() << TagNameWhite, "Player Y", "Player 4"));
+    CHECK_EQ(copy.tagValue("Annotator", 500), QString("Rare"));
+}
+
 TEST_CASE("testing Index read from PGN database")
 {
     // required by PgnDatabase::open() to check if indexing is enabled
@@ -97,3 +204,183 @@ TEST_CASE("testing Index read from PGN database")
 
     AppSettings = nullptr;
 }
+
+TEST_CASE("testing Index append of a shard")
+{
+    IndexX index;
+    index.setTag(TagNameWhite, "Alekhine, Alexander A", 0);
+    index.setTag(TagNameResult, "1-0", 0);
+
+    IndexX shard;
+    shard.setTag(TagNameBlack, "Capablanca, Jose Raul", 0);
+    shard.setTag(TagNameWhite, "Euwe, Max", 1);
+    shard.setTag("Annotator", "Rare", 1);
+    shard.setValidFlag(1, false);
+
+    index.appendIndex(shard);
+
+    CHECK_EQ(index.count(), 3);
+    CHECK_EQ(index.tagValue(TagNameWhite, 0), QString("Alekhine, Alexander A"));
+    CHECK_EQ(index.tagValue(TagNameBlack, 1), QString("Capablanca, Jose Raul"));
+    CHECK_EQ(index.tagValue(TagNameWhite, 1), QString());
+    CHECK_EQ(index.tagValue(TagNameWhite, 2), QString("Euwe, Max"));
+    CHECK_EQ(index.tagValue("Annotator", 2), QString("Rare"));
+    CHECK(index.isValidFlag(1));
+    CHECK_FALSE(index.isValidFlag(2));
+}
+
+TEST_CASE("testing Index snapshots")
+{
+    IndexX index;
+    index.setTag(TagNameWhite, "Alekhine, Alexander A", 0);
+    index.setTag(TagNameResult, "1-0", 0);
+    index.setTag(TagNameWhiteElo, "2700", 0);
+
+    IndexX::Snapshot snapshot = index.snapshot();
+    CHECK(snapshot.isCurrent(&index));
+    CHECK_FALSE(IndexX::Snapshot().isCurrent(&index));
+    CHECK_EQ(snapshot.count(), 1);
+    CHECK_EQ(snapshot.tagValue(TagNameWhite, 0), QString("Alekhine, Alexander A"));
+    CHECK_EQ(snapshot.result(0), WhiteWin);
+    CHECK_EQ(snapshot.elo(0, White), 2700);
+
+    // Changes of the index leave the snapshot as it was taken
+    index.setTag(TagNameWhite, "Euwe, Max", 0);
+    index.setTag(TagNameResult, "0-1", 1);
+    CHECK_FALSE(snapshot.isCurrent(&index));
+    CHECK_EQ(snapshot.count(), 1);
+    CHECK_EQ(snapshot.tagValue(TagNameWhite, 0), QString("Alekhine, Alexander A"));
+    CHECK_EQ(index.snapshot().tagValue(TagNameWhite, 0), QString("Euwe, Max"));
+    CHECK_EQ(index.snapshot().result(1), BlackWin);
+}
+
+TEST_CASE("testing Index tag postings")
+{
+    IndexX index;
+    for (GameId i = 0; i < 100; ++i)
+    {
+        index.setTag(TagNameWhite, QString("Player %1").arg(i % 10), i);
+        index.setTag(TagNameBlack, QString("Player %1").arg((i + 1) % 10), i);
+        index.setTag(TagNameRound, QString::number(i % 10), i);
+    }
+    ValueIndex player3 = index.getValueIndex("Player 3");
+
+    QVector<GameId> games = index.gamesWithValue(TagNameWhite, player3);
+    REQUIRE_EQ(games.count(), 10);
+    CHECK_EQ(games.first(), 3);
+    CHECK_EQ(games.last(), 93);
+    CHECK_EQ(index.gamesWithValue(TagNameBlack, player3).first(), 2);
+    // Tags without postings are scanned
+    CHECK_EQ(index.gamesWithValue(TagNameRound, index.getValueIndex("3")), games);
+
+    // Postings follow changes of the values
+    index.setTag(TagNameWhite, "Player 3", 0);
+    index.removeTag(TagNameWhite, 93);
+    games = index.gamesWithValue(TagNameWhite, player3);
+    CHECK_EQ(games.count(), 10);
+    CHECK_EQ(games.first(), 0);
+    CHECK_EQ(games.last(), 83);
+    CHECK_EQ(index.gamesWithValue(TagNameWhite, index.getValueIndex("Player 0")).count(), 9);
+
+    CHECK(index.replaceTagValue(QStringList() << TagNameWhite << TagNameBlack, "Player 3", "Player 4"));
+    games = index.gamesWithValue(TagNameWhite, player3);
+    CHECK_EQ(games.count(), 20);
+    CHECK(std::is_sorted(games.cbegin(), games.cend()));
+    CHECK(index.gamesWithValue(TagNameWhite, index.getValueIndex("Player 4")).isEmpty());
+
+    // Game 93 has no White tag, its empty value is found as well
+    QBitArray list = index.listPartialValue(TagNameWhite, "Player");
+    CHECK_EQ(list.count(true), 99);
+    CHECK_FALSE(list.at(93));
+    CHECK_EQ(index.listInSet(TagNameBlack, QSet<QString>() << "Player 3").count(true), 20);
+    CHECK_EQ(index.playerNames().count(), 10);
+}
+
+TEST_CASE("testing Index searches over many tag values")
+{
+    // More distinct values than tested on the calling thread alone
+    IndexX index;
+    for (GameId i = 0; i < 5000; ++i)
+    {
+        index.setTag(TagNameWhite, QString("Name %1").arg(i), i);
+        index.setTag(TagNameWhiteTeam, QString("Name %1").arg(i), i);
+        index.setTag(TagNameRound, QString::number(i % 10), i);
+    }
+
+    // 12, 120-129 and 1200-1299
+    QBitArray posted = index.listPartialValue(TagNameWhite, "Name 12");
+    CHECK_EQ(posted.count(true), 111);
+    CHECK(posted.at(1234));
+    CHECK_EQ(index.listPartialValue(TagNameWhiteTeam, "Name 12"), posted);
+    CHECK_EQ(index.listInSet(TagNameWhiteTeam, QSet<QString>() << "Name 4999" << "Name 7").count(true), 2);
+    CHECK_EQ(index.listInRange(TagNameRound, QString("3"), QString("4")).count(true), 1000);
+}
+
+TEST_CASE("testing Index numeric tags")
+{
+    IndexX index;
+    for (GameId i = 0; i < 100; ++i)
+    {
+        index.setTag(TagNameWhiteElo, QString::number(2000 + i * 10), i);
+        index.setTag(TagNameDate, QString("%1.05.??").arg(1950 + i), i);
+        index.setTag(TagNameResult, (i % 2) ? "1-0" : "1/2-1/2", i);
+        index.setTag(TagNameLength, QString::number(i), i);
+    }
+    index.setTag(TagNameBlackElo, "2700", 50);
+    index.setTag(TagNameDate, "5.6.2001", 51);
+
+    CHECK_EQ(index.elo(10, White), 2100);
+    CHECK_EQ(index.elo(10, Black), 0);
+    CHECK_EQ(index.elo(50, Black), 2700);
+    CHECK_EQ(index.date(10), PartialDate(1960, 5));
+    CHECK_EQ(index.date(51), PartialDate(2001, 6, 5));
+    CHECK_EQ(index.result(3), WhiteWin);
+    CHECK_EQ(index.result(4), Draw);
+    CHECK_EQ(index.result(200), ResultUnknown);
+    CHECK_EQ(index.length(42), 42);
+
+    CHECK_EQ(index.listInRange(TagNameWhiteElo, 2500, 2600).count(true), 11);
+    CHECK_EQ(index.listInRange(TagNameBlackElo, 0, 2600).count(true), 99);
+    CHECK_EQ(index.listInDateRange(PartialDate(2000), PartialDate(2000, 12, 31)).count(true), 1);
+    CHECK_EQ(index.listInDateRange(PartialDate(2000), PartialDate(2010)).count(true), 10);
+
+    // Changes of the tag values are decoded again
+    index.removeTag(TagNameBlackElo, 50);
+    CHECK_EQ(index.elo(50, Black), 0);
+    CHECK(index.replaceTagValue(QStringList() << TagNameResult, "0-1", "1-0"));
+    CHECK_EQ(index.result(3), BlackWin);
+
+    QByteArray data;
+    {
+        QDataStream out(&data, QIODevice::WriteOnly);
+        CHECK(index.write(out));
+    }
+    IndexX copy;
+    bool breakFlag = false;
+    QDataStream in(data);
+    CHECK(copy.read(in, &breakFlag, VERSION_INDEX_CURRENT));
+    CHECK_EQ(copy.elo(99, White), 2990);
+    CHECK_EQ(copy.date(51), PartialDate(2001, 6, 5));
+    CHECK_EQ(copy.result(3), BlackWin);
+    CHECK_EQ(copy.length(99), 99);
+}
+
+TEST_CASE("testing Index dates decoded as by PartialDate")
+{
+    const QStringList dates = QStringList()
+        << "2001.06.05" << "1999.12.31" << "2020.02.29" << "2019.02.29" << "2020.02.30"
+        << "2020.13.01" << "2020.12.32" << "2020.00.00" << "2020.??.15" << "19??.??.??"
+        << "2020.1?.05" << "2020.06.?1" << "????.??.??" << "abcd.ef.gh" << "5.6.2001";
+    IndexX index;
+    for (int i = 0; i < dates.count(); ++i)
+    {
+        index.setTag(TagNameDate, dates.at(i), static_cast<GameId>(i));
+    }
+    for (int i = 0; i < dates.count(); ++i)
+    {
+        const std::string date = dates.at(i).toStdString();
+        INFO(date);
+        CHECK_EQ(index.date(static_cast<GameId>(i)).packed(), PartialDate(dates.at(i)).packed());
+    }
+    CHECK_EQ(index.date(9), PartialDate());
+}
@@ -0,0 +1,51 @@
+#include "doctest.h"
+
+#include "index.h"
+#include "indexsorter.h"
+#include "tags.h"
+
+TEST_CASE("testing IndexSorter permutations")
+{
+    IndexX index;
+    index.setTag(TagNameWhite, "Tal, Mikhail", 0);
+    index.setTag(TagNameWhiteElo, "2100", 0);
+    index.setTag(TagNameWhite, "Euwe, Max", 1);
+    index.setTag(TagNameWhiteElo, "900", 1);
+    index.setTag(TagNameWhite, "Tal, Mikhail", 2);
+    index.setTag(TagNameWhiteElo, "2100", 2);
+    index.setTag(TagNameWhite, "Alekhine, Alexander A", 3);
+    index.setTag(TagNameWhiteElo, "2700", 3);
+
+    IndexSorter::Permutation byWhite = IndexSorter::sort(index.snapshot(), TagNameWhite);
+    CHECK_EQ(byWhite.version, index.version());
+    CHECK_EQ(byWhite.games, QVector<GameId>({ 3, 1, 0, 2 }));
+    // Equal values keep the order of the database in both directions
+    CHECK_EQ(byWhite.ordered(Qt::DescendingOrder), QVector<GameId>({ 0, 2, 1, 3 }));
+
+    // Elo is sorted by number, not by string
+    IndexSorter::Permutation byElo = IndexSorter::sort(index.snapshot(), TagNameWhiteElo);
+    CHECK_EQ(byElo.games, QVector<GameId>({ 1, 0, 2, 3 }));
+    CHECK_EQ(byElo.ordered(Qt::DescendingOrder), QVector<GameId>({ 3, 0, 2, 1 }));
+}
+
+TEST_CASE("testing IndexSorter on a large index")
+{
+    IndexX index;
+    const GameId count = 100000;
+    for (GameId i = 0; i < count; ++i)
+    {
+        index.setTag(TagNameEvent, QString("Event %1").arg((i * 7919) % 1000, 4, 10, QChar('0')), i);
+    }
+
+    IndexSorter::Permutation byEvent = IndexSorter::sort(index.snapshot(), TagNameEvent);
+    REQUIRE_EQ(byEvent.games.count(), static_cast<int>(count));
+    bool sorted = true;
+    for (int i = 1; i < byEvent.games.count() && sorted; ++i)
+    {
+        QString previous = index.tagValue(TagNameEvent, byEvent.games.at(i - 1));
+        QString current = index.tagValue(TagNameEvent, byEvent.games.at(i));
+        sorted = ((previous < current) || (previous == current && byEvent.games.at(i - 1) < byEvent.games.at(i)))
+                 && byEvent.groupStarts.testBit(i) == (previous != current);
+    }
+    CHECK(sorted);
+}
@@ -0,0 +1,166 @@
+#include "doctest.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "output.h"
+#include "settings.h"
+#include "tags.h"
+
+namespace {
+
+const char* SavePgn =
+    "[Event \"A rather long event name, which is shortened later on in the test, so that the padding it leaves takes more than a tenth of the file\"]\n"
+    "[White \"Alekhine, Alexander A\"]\n"
+    "[Black \"Capablanca, Jose Raul\"]\n"
+    "[Result \"1-0\"]\n"
+    "\n"
+    "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 1-0\n"
+    "\n"
+    "[Event \"Second\"]\n"
+    "[White \"Euwe, Max\"]\n"
+    "[Black \"Tal, Mikhail\"]\n"
+    "[Result \"0-1\"]\n"
+    "\n"
+    "1. d4 d5 2. c4 0-1\n"
+    "\n"
+    "[Event \"Third\"]\n"
+    "[White \"Lasker, Emanuel\"]\n"
+    "[Black \"Steinitz, Wilhelm\"]\n"
+    "[Result \"1/2-1/2\"]\n"
+    "\n"
+    "1. c4 1/2-1/2\n"
+    "\n";
+
+struct SavedGame
+{
+    QString event;
+    QString white;
+    int plies;
+};
+
+/** Parse @p filename again and compare every game with @p games */
+void checkFile(const QString& filename, const QList<SavedGame>& games)
+{
+    MemoryDatabase db;
+    REQUIRE(db.open(filename, false));
+    REQUIRE(static_cast<Database&>(db).parseFile());
+    REQUIRE_EQ(static_cast<int>(db.count()), games.count());
+    for (int i = 0; i < games.count(); ++i)
+    {
+        GameX game;
+        REQUIRE(db.loadGame(static_cast<GameId>(i), game));
+        CHECK_EQ(game.tag(TagNameEvent), games.at(i).event);
+        CHECK_EQ(game.tag(TagNameWhite), games.at(i).white);
+        CHECK_EQ(game.plyCount(), games.at(i).plies);
+    }
+}
+
+} // namespace
+
+TEST_CASE("testing MemoryDatabase saves changes in place")
+{
+    AppSettings = new Settings;
+
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const QString filename = dir.filePath("save.pgn");
+    {
+        QFile file(filename);
+        REQUIRE(file.open(QIODevice::WriteOnly));
+        file.write(SavePgn);
+    }
+
+    QList<SavedGame> games;
+    games << SavedGame { "A rather long event name, which is shortened later on in the test, so that the padding it leaves takes more than a tenth of the file", "Alekhine, Alexander A", 6 }
+          << SavedGame { "Second", "Euwe, Max", 3 }
+          << SavedGame { "Third", "Lasker, Emanuel", 1 };
+
+    MemoryDatabase db;
+    REQUIRE(db.open(filename, false));
+    REQUIRE(static_cast<Database&>(db).parseFile());
+    Output output(Output::Pgn, nullptr);
+
+    // Write the file once in the format of the output, the later saves render the same way
+    REQUIRE(db.save(output, true));
+    checkFile(filename, games);
+    const qint64 size = QFileInfo(filename).size();
+
+    auto change = [&](int gameId, const QString& tag, const QString& value)
+    {
+        GameX game;
+        REQUIRE(db.loadGame(static_cast<GameId>(gameId), game));
+        game.setTag(tag, value);
+        REQUIRE(db.replace(static_cast<GameId>(gameId), game));
+    };
+
+    SUBCASE("a game of the same length is written over its text")
+    {
+        change(1, TagNameWhite, "Euwe, Mxx");
+        games[1].white = "Euwe, Mxx";
+        REQUIRE(db.save(output));
+        CHECK_EQ(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+    }
+
+    SUBCASE("a shorter game is padded with empty lines")
+    {
+        change(1, TagNameEvent, "2nd");
+        games[1].event = "2nd";
+        REQUIRE(db.save(output));
+        CHECK_EQ(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+
+        // A second change of the same slot reuses it again
+        change(1, TagNameEvent, "Second");
+        games[1].event = "Second";
+        REQUIRE(db.save(output));
+        CHECK_EQ(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+    }
+
+    SUBCASE("a longer game rewrites the file")
+    {
+        change(2, TagNameEvent, "The third game of the file, with a longer event");
+        games[2].event = "The third game of the file, with a longer event";
+        REQUIRE(db.save(output));
+        CHECK_GT(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+
+        // The slots of the rewritten file are used by the next save
+        change(0, TagNameWhite, "Alekhine, Alexander B");
+        games[0].white = "Alekhine, Alexander B";
+        qint64 rewritten = QFileInfo(filename).size();
+        REQUIRE(db.save(output));
+        CHECK_EQ(QFileInfo(filename).size(), rewritten);
+        checkFile(filename, games);
+    }
+
+    SUBCASE("new games are appended")
+    {
+        GameX game;
+        game.addMove("e4");
+        game.setTag(TagNameEvent, "Fourth");
+        game.setTag(TagNameWhite, "Morphy, Paul");
+        REQUIRE(db.appendGame(game));
+        games << SavedGame { "Fourth", "Morphy, Paul", 1 };
+        REQUIRE(db.save(output));
+        CHECK_GT(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+    }
+
+    SUBCASE("too much padding compacts the file")
+    {
+        change(0, TagNameEvent, "First");
+        games[0].event = "First";
+        REQUIRE(db.save(output));
+        CHECK_LT(QFileInfo(filename).size(), size);
+        checkFile(filename, games);
+    }
+
+    delete AppSettings;
+    AppSettings = nullptr;
+}
@@ -0,0 +1,78 @@
+#include "doctest.h"
+
+#include <QBuffer>
+#include <QDataStream>
+
+#include "openingtreecache.h"
+
+TEST_CASE("testing OpeningTreeCache class")
+{
+    BoardX start;
+    start.setStandardPosition();
+
+    QMap<Move, MoveData> moves;
+    Move e4 = start.parseMove("e4");
+    MoveData& md = moves[e4];
+    md.move = e4;
+    md.san = "e4";
+    md.results.update(WhiteWin, 3);
+    md.results.update(Draw);
+    md.rating.update(2500, 2);
+    md.year.update(2001);
+
+    OpeningTreeCache cache;
+    cache.insert(start, false, 0, 1, moves, 4);
+
+    SUBCASE("find restores the tree")
+    {
+        QMap<Move, MoveData> found;
+        unsigned int games = 0;
+        REQUIRE(cache.find(start, false, 0, 1, found, games));
+        CHECK_EQ(games, 4u);
+        REQUIRE_EQ(found.count(), 1);
+        const MoveData& restored = found.first();
+        CHECK_EQ(restored.san, QString("e4"));
+        CHECK_EQ(restored.results, md.results);
+        CHECK_EQ(restored.rating, md.rating);
+        CHECK_EQ(restored.year, md.year);
+    }
+
+    SUBCASE("trees of other sources or generations are unknown")
+    {
+        QMap<Move, MoveData> found;
+        unsigned int games = 0;
+        CHECK_FALSE(cache.find(start, true, 0, 1, found, games));
+        CHECK_FALSE(cache.find(start, false, 42, 1, found, games));
+        CHECK_FALSE(cache.find(start, false, 0, 2, found, games));
+        cache.insert(start, true, 0, 2, moves, 4);
+        CHECK_FALSE(cache.find(start, false, 0, 2, found, games));
+    }
+
+    SUBCASE("only the first plies are kept")
+    {
+        BoardX late;
+        late.fromFen("4k3/8/8/8/8/8/4P3/4K3 w - - 0 40");
+        CHECK(OpeningTreeCache::accepts(start));
+        CHECK_FALSE(OpeningTreeCache::accepts(late));
+    }
+
+    SUBCASE("write and read keep the trees")
+    {
+        CHECK(cache.isModified());
+        QBuffer buffer;
+        buffer.open(QIODevice::ReadWrite);
+        QDataStream out(&buffer);
+        REQUIRE(cache.write(out));
+        CHECK_FALSE(cache.isModified());
+
+        buffer.seek(0);
+        QDataStream in(&buffer);
+        OpeningTreeCache copy;
+        REQUIRE(copy.read(in, 7));
+        QMap<Move, MoveData> found;
+        unsigned int games = 0;
+        REQUIRE(copy.find(start, false, 0, 7, found, games));
+        CHECK_EQ(games, 4u);
+        CHECK_EQ(found.first().results, md.results);
+    }
+}
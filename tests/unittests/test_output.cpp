@@ -0,0 +1,74 @@
+#include "doctest.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "output.h"
+#include "settings.h"
+#include "tags.h"
+
+TEST_CASE("testing Output saves games at the offsets it reports")
+{
+    AppSettings = new Settings;
+
+    // More games than one chunk of the save renders, with names of varying length
+    const int count = 600;
+    const int deleted = 300;
+    MemoryDatabase db;
+    QStringList names;
+    for (int i = 0; i < count; ++i)
+    {
+        QString name = (i % 7) ? QString("Player %1").arg(i) : QString::fromUtf8("M\xC3\xBCller, %1").arg(i);
+        names << name;
+        GameX game;
+        game.addMove("e4");
+        if (i % 2)
+        {
+            game.addMove("e5");
+        }
+        game.setTag(TagNameEvent, QString("Event %1").arg(i));
+        game.setTag(TagNameWhite, name);
+        REQUIRE(db.appendGame(game));
+    }
+    REQUIRE(db.remove(deleted));
+
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const QString filename = dir.filePath("offsets.pgn");
+    Output output(Output::Pgn, nullptr);
+    QVector<qint64> offsets;
+    REQUIRE(output.save(filename, db, nullptr, &offsets));
+
+    QFile file(filename);
+    REQUIRE(file.open(QIODevice::ReadOnly));
+    const QByteArray bytes = file.readAll();
+    REQUIRE_EQ(offsets.count(), count + 1);
+    CHECK_GE(offsets.first(), 0);
+    CHECK_LE(offsets.last(), bytes.size());
+    CHECK_FALSE(bytes.left(static_cast<int>(offsets.first())).contains("[Event "));
+    CHECK_FALSE(bytes.mid(static_cast<int>(offsets.last())).contains("[Event "));
+
+    for (int i = 0; i < count; ++i)
+    {
+        INFO(i);
+        const int begin = static_cast<int>(offsets.at(i));
+        const int end = static_cast<int>(offsets.at(i + 1));
+        REQUIRE_LE(begin, end);
+        if (i == deleted)
+        {
+            CHECK_EQ(begin, end);
+            continue;
+        }
+        // Every range holds exactly the text of its game
+        const QByteArray text = bytes.mid(begin, end - begin);
+        const QString white = "[White \"" + names.at(i) + "\"]";
+        CHECK(text.startsWith(QString("[Event \"Event %1\"]").arg(i).toLatin1()));
+        CHECK(text.contains(db.isUtf8() ? white.toUtf8() : white.toLatin1()));
+        CHECK_EQ(text.count("[Event "), 1);
+    }
+
+    delete AppSettings;
+    AppSettings = nullptr;
+}
@@ -0,0 +1,62 @@
+#include "doctest.h"
+
+#include "gamex.h"
+#include "positionindex.h"
+
+TEST_CASE("testing PositionIndex class")
+{
+    GameX game;
+    game.addMove("e4");
+    game.addMove("e5");
+    game.addMove("Nf3");
+    game.addMove("Nc6");
+
+    PositionIndex index;
+    index.setMaxPly(2);
+    index.updateGame(0, game);
+
+    MoveId moveId = NO_MOVE;
+    quint16 nextMove = 0;
+
+    SUBCASE("position inside the horizon is found")
+    {
+        BoardX board;
+        board.setStandardPosition();
+        board.doMove(board.parseMove("e4"));
+        CHECK_EQ(index.lookup(board, 0, moveId, nextMove), PositionIndex::Found);
+        CHECK_EQ(moveId, 1);
+        Move next = PositionIndex::decodeMove(board, nextMove);
+        CHECK(next.isLegal());
+        CHECK_EQ(next.toAlgebraic(), QString("e7e5"));
+    }
+
+    SUBCASE("position beyond the horizon is unknown")
+    {
+        BoardX board;
+        board.setStandardPosition();
+        board.doMove(board.parseMove("e4"));
+        board.doMove(board.parseMove("e5"));
+        board.doMove(board.parseMove("Nf3"));
+        CHECK_EQ(index.lookup(board, 0, moveId, nextMove), PositionIndex::Unknown);
+    }
+
+    SUBCASE("unreachable position is not found")
+    {
+        BoardX board("4k3/8/8/8/8/8/8/4K3 w - - 0 1");
+        CHECK_EQ(index.lookup(board, 0, moveId, nextMove), PositionIndex::Unknown);
+        index.setMaxPly(PositionIndex::DefaultMaxPly);
+        index.updateGame(0, game);
+        CHECK_EQ(index.lookup(board, 0, moveId, nextMove), PositionIndex::NotFound);
+    }
+
+    SUBCASE("squeeze keeps the postings")
+    {
+        index.updateGame(1, game);
+        index.squeeze();
+        BoardX board;
+        board.setStandardPosition();
+        CHECK_EQ(index.postings(board).count(), 2);
+        CHECK_EQ(index.lookup(board, 1, moveId, nextMove), PositionIndex::Found);
+        CHECK_EQ(moveId, 0);
+    }
+}
@@ -0,0 +1,51 @@
+#include "doctest.h"
+
+#include "board.h"
+#include "positionreplay.h"
+
+TEST_CASE("testing PositionReplay class")
+{
+    BoardX start;
+    start.setStandardPosition();
+
+    BoardX afterE4(start);
+    afterE4.doMove(afterE4.parseMove("e4"));
+
+    SUBCASE("found position reports the next move")
+    {
+        PositionReplay replay(afterE4);
+        BoardX board(start);
+        REQUIRE(replay.start(start));
+        Move e4 = board.parseMove("e4");
+        CHECK(replay.play(e4, 1));
+        CHECK_EQ(replay.moveId(), 1);
+        board.doMove(e4);
+        CHECK_FALSE(replay.play(board.parseMove("e5"), 2));
+        CHECK_EQ(replay.moveId(), 1);
+        CHECK_FALSE(replay.atEnd());
+        CHECK_EQ(replay.nextMove().toAlgebraic(), QString("e7e5"));
+    }
+
+    SUBCASE("found position at the end of the game")
+    {
+        PositionReplay replay(start);
+        CHECK(replay.start(start));
+        CHECK_EQ(replay.moveId(), ROOT_NODE);
+        CHECK(replay.atEnd());
+    }
+
+    SUBCASE("unreachable position stops the replay")
+    {
+        PositionReplay replay(start);
+        BoardX board(start);
+        board.doMove(board.parseMove("e4"));
+        board.doMove(board.parseMove("d5"));
+        board.doMove(board.parseMove("exd5"));
+        CHECK_FALSE(replay.start(board)); // a pawn has left the board
+        CHECK_EQ(replay.moveId(), NO_MOVE);
+
+        CHECK(replay.start(afterE4));
+        CHECK(replay.play(afterE4.parseMove("d5"), 1));
+        CHECK_EQ(replay.moveId(), NO_MOVE);
+    }
+}
@@ -0,0 +1,135 @@
+#include "doctest.h"
+
+#include <QFile>
+#include <QTemporaryDir>
+
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "settings.h"
+
+namespace {
+
+const char* SearchPgn =
+    "[Event \"Main line\"]\n[Result \"*\"]\n\n1. e4 e5 2. Nf3 Nc6 3. Bb5 *\n\n"
+    "[Event \"Transposition\"]\n[Result \"*\"]\n\n1. Nf3 Nc6 2. e4 e5 3. Bc4 *\n\n"
+    "[Event \"Other opening\"]\n[Result \"*\"]\n\n1. e4 c5 2. Nf3 *\n\n"
+    "[Event \"Ends in the position\"]\n[Result \"*\"]\n\n1. e4 e5 2. Nf3 Nc6 *\n\n";
+
+/** @return the board after @p moves from the start */
+BoardX boardAfter(const QStringList& moves)
+{
+    GameX game;
+    foreach (const QString& move, moves)
+    {
+        game.addMove(move);
+    }
+    return game.board();
+}
+
+/** @return the number of games per move in @p stats */
+QMap<QString, int> gamesPerMove(const QMap<Move, MoveData>& stats)
+{
+    QMap<QString, int> games;
+    foreach (const MoveData& data, stats)
+    {
+        games[data.san] += static_cast<int>(data.results.count());
+    }
+    return games;
+}
+
+} // namespace
+
+TEST_CASE("testing position search with and without the position index")
+{
+    AppSettings = new Settings;
+
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    const QString filename = dir.filePath("search.pgn");
+    {
+        QFile file(filename);
+        REQUIRE(file.open(QIODevice::WriteOnly));
+        file.write(SearchPgn);
+    }
+    MemoryDatabase db;
+    REQUIRE(db.open(filename, false));
+    REQUIRE(static_cast<Database&>(db).parseFile());
+    REQUIRE_EQ(static_cast<int>(db.count()), 4);
+    Database& database = db; // MemoryDatabase hides the batched search
+    const QList<GameId> games = { 0, 1, 2, 3 };
+
+    const BoardX parent = boardAfter(QStringList() << "e4" << "e5" << "Nf3");
+    const BoardX position = boardAfter(QStringList() << "e4" << "e5" << "Nf3" << "Nc6");
+
+    auto search = [&](const BoardX& board, Database::PositionSearchOptions options, QList<MoveId>& nodes, QMap<QString, int>& moves)
+    {
+        QMap<Move, MoveData> stats;
+        nodes.clear();
+        database.findPosition(board, options, games, nodes, stats);
+        REQUIRE_EQ(nodes.count(), games.count());
+        moves = gamesPerMove(stats);
+    };
+    auto step = [&](const QList<MoveId>& previous, QList<MoveId>& nodes, QMap<QString, int>& moves)
+    {
+        QMap<Move, MoveData> stats;
+        nodes.clear();
+        database.findNextPosition(position, parent.parseMove("Nc6"), games, previous, nodes, stats);
+        REQUIRE_EQ(nodes.count(), games.count());
+        moves = gamesPerMove(stats);
+    };
+
+    QList<MoveId> parentNodes;
+    QMap<QString, int> parentMoves;
+    search(parent, Database::PositionSearch_Default, parentNodes, parentMoves);
+    CHECK_NE(parentNodes.at(0), NO_MOVE);
+    CHECK_EQ(parentNodes.at(1), NO_MOVE);
+    CHECK_EQ(parentNodes.at(2), NO_MOVE);
+    CHECK_NE(parentNodes.at(3), NO_MOVE);
+
+    // The transposed game reaches the position without passing the parent
+    QList<MoveId> nodes;
+    QMap<QString, int> moves;
+    search(position, Database::PositionSearch_Default, nodes, moves);
+    CHECK_NE(nodes.at(0), NO_MOVE);
+    CHECK_NE(nodes.at(1), NO_MOVE);
+    CHECK_EQ(nodes.at(2), NO_MOVE);
+    CHECK_NE(nodes.at(3), NO_MOVE);
+    CHECK_EQ(moves.value("Bb5"), 1);
+    CHECK_EQ(moves.value("Bc4"), 1);
+    CHECK_EQ(moves.count(), 3); // the end of the last game is counted too
+
+    // A step from the parent continues the games passing it and still finds the transposition
+    QList<MoveId> stepNodes;
+    QMap<QString, int> stepMoves;
+    step(parentNodes, stepNodes, stepMoves);
+    CHECK_EQ(stepNodes, nodes);
+    CHECK_EQ(stepMoves, moves);
+
+    QList<MoveId> endNodes;
+    QMap<QString, int> endMoves;
+    search(position, Database::PositionSearch_GameEnd, endNodes, endMoves);
+    CHECK_EQ(endNodes.at(0), NO_MOVE);
+    CHECK_EQ(endNodes.at(1), NO_MOVE);
+    CHECK_EQ(endNodes.at(2), NO_MOVE);
+    CHECK_EQ(endNodes.at(3), nodes.at(3));
+
+    // The position index finds the same games at the same nodes
+    REQUIRE(database.buildPositionIndex(nullptr));
+    QList<MoveId> indexedNodes;
+    QMap<QString, int> indexedMoves;
+    search(parent, Database::PositionSearch_Default, indexedNodes, indexedMoves);
+    CHECK_EQ(indexedNodes, parentNodes);
+    CHECK_EQ(indexedMoves, parentMoves);
+    search(position, Database::PositionSearch_Default, indexedNodes, indexedMoves);
+    CHECK_EQ(indexedNodes, nodes);
+    CHECK_EQ(indexedMoves, moves);
+    step(parentNodes, stepNodes, stepMoves);
+    CHECK_EQ(stepNodes, nodes);
+    CHECK_EQ(stepMoves, moves);
+    search(position, Database::PositionSearch_GameEnd, indexedNodes, indexedMoves);
+    CHECK_EQ(indexedNodes, endNodes);
+    CHECK_EQ(indexedMoves, endMoves);
+
+    delete AppSettings;
+    AppSettings = nullptr;
+}
@@ -0,0 +1,76 @@
+#include "doctest.h"
+
+#include <QTemporaryDir>
+
+#include "gamex.h"
+#include "memorydatabase.h"
+#include "statisticsbook.h"
+#include "tags.h"
+
+static GameX bookGame(const QStringList& moves, const QString& result, const QString& whiteElo)
+{
+    GameX game;
+    game.setTag(TagNameResult, result);
+    game.setTag(TagNameWhiteElo, whiteElo);
+    game.setTag(TagNameDate, "2001.01.01");
+    for (const QString& san: moves)
+    {
+        game.addMove(san);
+    }
+    return game;
+}
+
+TEST_CASE("testing StatisticsBook class")
+{
+    MemoryDatabase db;
+    db.appendGame(bookGame({"e4", "e5", "Nf3"}, "1-0", "2500"));
+    db.appendGame(bookGame({"e4", "c5"}, "1/2-1/2", "2300"));
+    db.appendGame(bookGame({"d4"}, "0-1", "2400"));
+
+    QTemporaryDir dir;
+    REQUIRE(dir.isValid());
+    QString path = dir.filePath("test.cxb");
+
+    StatisticsBook writer;
+    REQUIRE(writer.openForWriting(path, 2, 1));
+    volatile bool breakFlag = false;
+    writer.book_make(db, breakFlag);
+
+    StatisticsBook book;
+    REQUIRE(book.open(path, false));
+
+    BoardX start;
+    start.setStandardPosition();
+
+    SUBCASE("the start position keeps results, rating and year")
+    {
+        QMap<Move, MoveData> moves;
+        CHECK_EQ(book.getMoveMapForBoard(start, moves), 3u);
+        REQUIRE_EQ(moves.count(), 2);
+        const MoveData& e4 = moves.value(start.parseMove("e4"));
+        CHECK_EQ(e4.san, QString("e4"));
+        CHECK_EQ(e4.results, ResultsCounter({WhiteWin, Draw}));
+        CHECK_EQ(e4.rating.average(), 2400);
+        CHECK_EQ(e4.year.average(), 2001);
+    }
+
+    SUBCASE("game ends and the ply limit are kept")
+    {
+        BoardX afterD4 = start;
+        afterD4.doMove(afterD4.parseMove("d4"));
+        QMap<Move, MoveData> moves;
+        CHECK_EQ(book.getMoveMapForBoard(afterD4, moves), 1u);
+        REQUIRE_EQ(moves.count(), 1);
+        CHECK_FALSE(moves.firstKey().isLegal());
+
+        BoardX afterE5 = start;
+        afterE5.doMove(afterE5.parseMove("e4"));
+        afterE5.doMove(afterE5.parseMove("e5"));
+        CHECK_EQ(book.getMoveMapForBoard(afterE5, moves), 1u);
+        REQUIRE_EQ(moves.count(), 1);
+        CHECK_EQ(moves.first().san, QString("Nf3"));
+
+        afterE5.doMove(afterE5.parseMove("Nf3"));
+        CHECK_EQ(book.getMoveMapForBoard(afterE5, moves), 0u);
+    }
+}